@@ -0,0 +1,175 @@
+cmake_minimum_required(VERSION 3.18 FATAL_ERROR)
+include_guard(GLOBAL)
+
+if(NOT CMAKE_CURRENT_LIST_FILE STREQUAL CMAKE_SCRIPT_MODE_FILE)
+    # Running as a module; define the target_dif_tables function.
+    #
+    # target_dif_tables(<target> <output> <hash> <dif> [<hash> <dif>]...)
+    #
+    # Generates the header <output> holding a wcdx::patch::patch_table for each IDA .dif
+    # file, keyed by the hash of the executable it applies to, and adds it to <target>.  The
+    # tables are collected in the array dif_tables::patches.
+    function(target_dif_tables target output)
+        list(LENGTH ARGN count)
+        math(EXPR odd "${count} % 2")
+        if(count EQUAL 0 OR odd)
+            message(FATAL_ERROR "target_dif_tables expects pairs of hashes and .dif files")
+        endif()
+
+        set(tables)
+        set(difs)
+        while(ARGN)
+            list(POP_FRONT ARGN hash dif)
+            get_filename_component(dif ${dif} ABSOLUTE)
+            list(APPEND tables "${hash}=${dif}")
+            list(APPEND difs ${dif})
+        endwhile()
+        # Semicolons would split the list across command-line arguments.
+        string(JOIN "|" tables ${tables})
+
+        get_filename_component(output ${output} ABSOLUTE BASE_DIR ${CMAKE_CURRENT_BINARY_DIR})
+        get_filename_component(output_dir ${output} DIRECTORY)
+        add_custom_command(OUTPUT ${output}
+            COMMAND ${CMAKE_COMMAND} --log-level=NOTICE -D OUTPUT=${output} -D TABLES=${tables}
+                -P ${CMAKE_CURRENT_FUNCTION_LIST_FILE}
+            DEPENDS ${difs} ${CMAKE_CURRENT_FUNCTION_LIST_FILE}
+            COMMENT "Generating ${output}..."
+            VERBATIM
+        )
+        target_sources(${target} PRIVATE ${output})
+        target_include_directories(${target} PRIVATE ${output_dir})
+    endfunction()
+
+    # The rest of this file runs in script mode.
+    return()
+endif()
+
+foreach(var OUTPUT TABLES)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "Missing ${var}")
+    endif()
+endforeach()
+
+string(REPLACE "|" ";" TABLES "${TABLES}")
+
+set(content)
+set(patches)
+foreach(table ${TABLES})
+    if(NOT table MATCHES [[^(0x[0-9A-Fa-f]+)=(.+)$]])
+        message(FATAL_ERROR "Bad table: ${table}")
+    endif()
+    set(hash ${CMAKE_MATCH_1})
+    set(dif ${CMAKE_MATCH_2})
+
+    get_filename_component(name ${dif} NAME_WE)
+    string(MAKE_C_IDENTIFIER ${name} name)
+
+    file(STRINGS ${dif} lines ENCODING UTF-8)
+    list(POP_FRONT lines tag)
+    if(NOT tag MATCHES "This difference file has been created by IDA$")
+        message(FATAL_ERROR "${dif} is not an IDA difference file")
+    endif()
+
+    # Each change is a line of the form "<offset>: <original> <replacement>".  Changes to
+    # consecutive offsets are coalesced into one range, whose expected bytes are followed in
+    # the data by its replacement bytes.  IDA writes FFFFFFFF as the original value of bytes
+    # beyond the end of the file; those are skipped, as there's nothing there to patch.
+    set(ranges)
+    set(data)
+    set(data_size 0)
+    set(range_start -1)
+    set(range_end -1)
+    set(expected)
+    set(replacement)
+    foreach(line ${lines} "")
+        set(flush FALSE)
+        if(line STREQUAL "")
+            set(flush TRUE)
+        elseif(line MATCHES ":")
+            if(NOT line MATCHES [[^([0-9A-Fa-f]+): +([0-9A-Fa-f]+) +([0-9A-Fa-f]+) *$]])
+                message(FATAL_ERROR "${dif}: malformed line: ${line}")
+            endif()
+            if(CMAKE_MATCH_2 STREQUAL "FFFFFFFF")
+                continue()
+            endif()
+
+            math(EXPR offset "0x${CMAKE_MATCH_1}")
+            math(EXPR original "0x${CMAKE_MATCH_2}")
+            math(EXPR value "0x${CMAKE_MATCH_3}")
+            if(original GREATER 255 OR value GREATER 255)
+                message(FATAL_ERROR "${dif}: value out of range: ${line}")
+            endif()
+            math(EXPR original "${original}" OUTPUT_FORMAT HEXADECIMAL)
+            math(EXPR value "${value}" OUTPUT_FORMAT HEXADECIMAL)
+            if(NOT range_end EQUAL -1 AND offset LESS range_end)
+                message(FATAL_ERROR "${dif}: offsets out of order: ${line}")
+            endif()
+            if(NOT offset EQUAL range_end)
+                set(flush TRUE)
+            endif()
+        else()
+            continue()
+        endif()
+
+        if(flush AND NOT range_start EQUAL -1)
+            math(EXPR range_size "${range_end} - ${range_start}")
+            math(EXPR hex_start "${range_start}" OUTPUT_FORMAT HEXADECIMAL)
+            string(APPEND ranges "        { ${hex_start}, ${range_size}, ${data_size} },\n")
+            string(STRIP "${expected}${replacement}" bytes)
+            string(APPEND data "        ${bytes}\n")
+            math(EXPR data_size "${data_size} + 2 * ${range_size}")
+            set(expected)
+            set(replacement)
+            set(range_start -1)
+        endif()
+
+        if(NOT line STREQUAL "")
+            if(range_start EQUAL -1)
+                set(range_start ${offset})
+            endif()
+            math(EXPR range_end "${offset} + 1")
+            string(APPEND expected "${original}, ")
+            string(APPEND replacement "${value}, ")
+        endif()
+    endforeach()
+
+    if(data_size EQUAL 0)
+        message(FATAL_ERROR "${dif} has no changes")
+    endif()
+
+    string(APPEND content
+        "    // ${name}.dif\n"
+        "    inline constexpr unsigned char ${name}_data[] =\n"
+        "    {\n"
+        "${data}"
+        "    };\n"
+        "\n"
+        "    inline constexpr wcdx::patch::patch_range ${name}_ranges[] =\n"
+        "    {\n"
+        "${ranges}"
+        "    };\n"
+        "\n"
+    )
+    string(APPEND patches "        { ${hash}, ${name}_ranges, std::size(${name}_ranges), ${name}_data },\n")
+endforeach()
+
+file(CONFIGURE OUTPUT ${OUTPUT} @ONLY CONTENT [[
+// Generated by DifTables.cmake; do not edit.
+#ifndef DIF_TABLES_INCLUDED
+#define DIF_TABLES_INCLUDED
+#pragma once
+
+#include <patch/patch.h>
+
+#include <iterator>
+
+
+namespace dif_tables
+{
+@content@    inline constexpr wcdx::patch::patch_table patches[] =
+    {
+@patches@    };
+}
+
+#endif
+]])
@@ -26,6 +26,11 @@ endfunction()
 if(NOT CMAKE_CURRENT_LIST_FILE STREQUAL CMAKE_SCRIPT_MODE_FILE)
     # Running as a module; define the target_version_info function.
     function(target_version_info target output description)
+        # Version resources are a Windows feature.
+        if(NOT WIN32)
+            return()
+        endif()
+
         get_target_property(VERSION ${target} VERSION)
         if(NOT VERSION AND NOT PROJECT_VERSION)
             message(FATAL_ERROR "No version set for project ${PROJECT_NAME} or target ${target}")
@@ -1,5 +1,9 @@
+#include <archive/archive.h>
+#include <image/font.h>
 #include <image/image.h>
+#include <image/png.h>
 #include <image/resources.h>
+#include <parallel/parallel.h>
 
 #include <stdext/array_view.h>
 #include <stdext/file.h>
@@ -7,16 +11,17 @@
 #include <stdext/multi.h>
 #include <stdext/utility.h>
 
-#include <array>
 #include <filesystem>
 #include <iostream>
 #include <memory>
-#include <numeric>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
 
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
@@ -27,20 +32,14 @@ struct IUnknown;
 
 namespace
 {
-    struct glyph_info
-    {
-        uint16_t file_position;
-        uint8_t width;
-        uint8_t height;
-        std::unique_ptr<std::byte[]> pixels;
-    };
-
     enum : uint32_t
     {
         mode_none               = 0x0,
         mode_extract_glyph      = 0x1,
         mode_extract_all_glyphs = 0x2,
-        mode_extract_font_strip = 0x4
+        mode_extract_font_strip = 0x4,
+        mode_extract_atlas      = 0x8,
+        mode_batch              = 0x10
     };
 
     struct program_options
@@ -50,6 +49,8 @@ namespace
         const wchar_t* output_path = nullptr;
         const wchar_t* prefix = nullptr;
         unsigned glyph_index = unsigned(-1);
+        unsigned jobs = 0;
+        bool jobs_set = false;
     };
 
     class usage_error : public std::runtime_error
@@ -61,11 +62,12 @@ namespace
     void show_usage(const wchar_t* invocation);
     void diagnose_options(const program_options& options);
 
-    using glyph_array = std::array<glyph_info, 0x100>;
-    glyph_array read_font(stdext::multi_ref<stdext::input_stream, stdext::seekable> input);
-    void extract_glyph(const glyph_info& glyph, stdext::array_view<std::byte> palette_view, const wchar_t* output_path);
-    void extract_all_glyphs(const glyph_array& glyphs, stdext::array_view<std::byte> palette_view, const wchar_t* output_path, const wchar_t* prefix);
-    void extract_font_strip(const glyph_array& glyphs, stdext::array_view<std::byte> palette_view, const wchar_t* output_path);
+    wcdx::image::font read_font(const wchar_t* path);
+    void extract_glyph(const wcdx::image::font& font, unsigned index, stdext::array_view<std::byte> palette_view, const wchar_t* output_path);
+    void extract_all_glyphs(const wcdx::image::font& font, stdext::array_view<std::byte> palette_view, const wchar_t* output_path, const wchar_t* prefix);
+    void extract_font_strip(const wcdx::image::font& font, stdext::array_view<std::byte> palette_view, const wchar_t* output_path);
+    void extract_atlas(const wcdx::image::font& font, wcdx::image::png_encoder& encoder, const std::filesystem::path& output_path);
+    void extract_all_atlases(const wchar_t* archive_path, stdext::array_view<std::byte> palette_view, unsigned jobs, const wchar_t* output_path, const wchar_t* prefix);
 }
 
 int wmain(int argc, wchar_t* argv[])
@@ -88,20 +90,30 @@ int wmain(int argc, wchar_t* argv[])
         auto palette_size = ::SizeofResource(nullptr, palette_resource);
         stdext::array_view<std::byte> palette_view(static_cast<std::byte*>(palette_data), palette_size);
 
-        stdext::file_input_stream file(options.input_path);
-        auto glyphs = read_font(file);
+        if (options.mode == mode_batch)
+        {
+            extract_all_atlases(options.input_path, palette_view, options.jobs, options.output_path, options.prefix);
+            return EXIT_SUCCESS;
+        }
 
+        auto font = read_font(options.input_path);
         switch (options.mode)
         {
         case mode_extract_glyph:
-            extract_glyph(glyphs[options.glyph_index], palette_view, options.output_path);
+            extract_glyph(font, options.glyph_index, palette_view, options.output_path);
             break;
         case mode_extract_all_glyphs:
-            extract_all_glyphs(glyphs, palette_view, options.output_path, options.prefix);
+            extract_all_glyphs(font, palette_view, options.output_path, options.prefix);
             break;
         case mode_extract_font_strip:
-            extract_font_strip(glyphs, palette_view, options.output_path);
+            extract_font_strip(font, palette_view, options.output_path);
             break;
+        case mode_extract_atlas:
+            {
+                wcdx::image::png_encoder encoder(palette_view);
+                extract_atlas(font, encoder, options.output_path);
+                break;
+            }
         default:
             stdext::unreachable();
         }
@@ -188,6 +200,37 @@ namespace
                     options.mode |= mode_extract_font_strip;
                     diagnose_options(options);
                 }
+                else if (wcscmp(argv[n], L"-extract-atlas") == 0)
+                {
+                    if ((options.mode & mode_extract_atlas) != 0)
+                        throw usage_error("The -extract-atlas option can only be used once");
+
+                    options.mode |= mode_extract_atlas;
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-batch") == 0)
+                {
+                    if ((options.mode & mode_batch) != 0)
+                        throw usage_error("The -batch option can only be used once");
+
+                    options.mode |= mode_batch;
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-jobs") == 0)
+                {
+                    if (++n == argc)
+                        throw usage_error("No value for -jobs");
+                    if (options.jobs_set)
+                        throw usage_error("The -jobs option can only be used once");
+
+                    wchar_t* endp;
+                    auto jobs = wcstol(argv[n], &endp, 10);
+                    if (*endp != L'\0' || jobs < 0)
+                        throw usage_error("Bad value for -jobs");
+
+                    options.jobs = unsigned(jobs);
+                    options.jobs_set = true;
+                }
                 else
                     throw usage_error("Unrecognized option: " + stdext::to_mbstring(argv[n]));
             }
@@ -204,7 +247,9 @@ namespace
         if (options.output_path == nullptr)
             throw usage_error("Missing output path");
         if (options.mode == 0)
-            throw usage_error("Missing -extract-glyph, -extract-all-glyphs, or -extract-font-strip");
+            throw usage_error("Missing -extract-glyph, -extract-all-glyphs, -extract-font-strip, -extract-atlas, or -batch");
+        if (options.jobs_set && options.mode != mode_batch)
+            throw usage_error("The -jobs option can only be used with -batch");
         if (options.prefix == nullptr)
             options.prefix = L"";
 
@@ -217,13 +262,16 @@ namespace
             L"    " << invocation << " -o <output_path> -extract-glyph <glyph_index> <input_path>\n"
             L"    " << invocation << " -o <output_path> -extract-all-glyphs [-prefix <name_prefix>] <input_path>\n"
             L"    " << invocation << " -o <output_path> -extract-font-strip <input_path>\n"
+            L"    " << invocation << " -o <output_path> -extract-atlas <input_path>\n"
+            L"    " << invocation << " -o <output_path> -batch [-jobs <count>] [-prefix <name_prefix>] <input_path>\n"
             L"\n"
             L"input_path is an extracted font resource for Wing Commander II.  You can get it\n"
-            L"by running wcres against fonts.fnt.\n"
+            L"by running wcres against fonts.fnt.  For -batch, input_path is fonts.fnt itself.\n"
             L"\n"
             L"output_path points to a location where data will be written out.  For\n"
-            L"-extract-glyph and -extract-font-strip, this should name a file ending in .png.\n"
-            L"For -extract-all-glyphs, this should name a directory.\n"
+            L"-extract-glyph, -extract-font-strip, and -extract-atlas, this should name a file\n"
+            L"ending in .png.  For -extract-all-glyphs and -batch, this should name a\n"
+            L"directory.\n"
             L"\n"
             L"The -extract-glyph option extracts a single glyph from the font resource, saving\n"
             L"it as a PNG-encoded image file.  Note that zero-sized glyphs cannot be\n"
@@ -236,12 +284,22 @@ namespace
             L"The -extract-font-strip option extracts all glyphs from the font resource,\n"
             L"concatenating them into a single image.\n"
             L"\n"
+            L"The -extract-atlas option packs all glyphs from the font resource into a single\n"
+            L"image whose width and height are powers of two, suitable for use as a texture.\n"
+            L"The position and size of each glyph within the image is written to a metrics\n"
+            L"file alongside it, named like the image but ending in .metrics.\n"
+            L"\n"
+            L"The -batch option does the same as -extract-atlas for every font in fonts.fnt,\n"
+            L"working on several fonts at once.  Files are named according to the index of\n"
+            L"the font, with an optional prefix.  -jobs sets the number of threads, which by\n"
+            L"default is the number of processors.\n"
+            L"\n"
             L"glyph_index is the numeric value of a character in the font.  It can be any\n"
             L"value from 0 to 255, and typically corresponds with the ASCII encoding of the\n"
             L"character.\n"
             L"\n"
             L"name_prefix is a string that will be prepended to the names of the files that\n"
-            L"will be written to the output directory for -extract-all-glyphs.\n";
+            L"will be written to the output directory for -extract-all-glyphs and -batch.\n";
     }
 
     void diagnose_options(const program_options& options)
@@ -252,6 +310,8 @@ namespace
                 throw usage_error("The -extract-glyph option cannot be used with -extract-all-glyphs");
             if ((options.mode & mode_extract_font_strip) != 0)
                 throw usage_error("The -extract-glyph option cannot be used with -extract-file-strip");
+            if ((options.mode & mode_extract_atlas) != 0)
+                throw usage_error("The -extract-glyph option cannot be used with -extract-atlas");
             if (options.prefix != nullptr)
                 throw usage_error("The -prefix option cannot be used with -extract-glyph");
             if (options.glyph_index == unsigned(-1))
@@ -261,104 +321,123 @@ namespace
         {
             if ((options.mode & mode_extract_font_strip) != 0)
                 throw usage_error("The -extract-all-glyphs option cannot be used with -extract-font-strip");
+            if ((options.mode & mode_extract_atlas) != 0)
+                throw usage_error("The -extract-all-glyphs option cannot be used with -extract-atlas");
         }
         if ((options.mode & mode_extract_font_strip) != 0)
         {
+            if ((options.mode & mode_extract_atlas) != 0)
+                throw usage_error("The -extract-font-strip option cannot be used with -extract-atlas");
             if (options.prefix)
                 throw usage_error("The -prefix option cannot be used with -extract-font-strip");
         }
-    }
-
-    std::array<glyph_info, 0x100> read_font(stdext::multi_ref<stdext::input_stream, stdext::seekable> input)
-    {
-        auto& stream = input.as<stdext::input_stream>();
-        auto& seeker = input.as<stdext::seekable>();
-
-        auto font_height = stream.read<uint16_t>();
-        stream.skip<uint16_t>();    // color index, duplicative of pixel data
-
-        std::array<glyph_info, 0x100> glyphs;
-
-        for (auto& glyph : glyphs)
+        if ((options.mode & mode_extract_atlas) != 0)
         {
-            glyph.width = stream.read<uint8_t>();
-            glyph.height = uint8_t(font_height);
+            if (options.prefix)
+                throw usage_error("The -prefix option cannot be used with -extract-atlas");
         }
-
-        for (auto& glyph : glyphs)
-            glyph.file_position = stream.read<uint8_t>();
-
-        for (auto& glyph : glyphs)
-            glyph.file_position |= uint16_t(stream.read<uint8_t>()) << 8;
-
-        for (auto& glyph : glyphs)
+        if ((options.mode & mode_batch) != 0)
         {
-            assert(seeker.position() == glyph.file_position);
-            size_t pixel_count = glyph.width * glyph.height;
-            if (pixel_count == 0)
-                continue;
-
-            glyph.pixels = std::make_unique<std::byte[]>(pixel_count);
-            stream.read_all(glyph.pixels.get(), pixel_count);
+            if ((options.mode & ~mode_batch) != 0)
+                throw usage_error("The -batch option cannot be used with any other mode");
         }
+    }
 
-        assert(seeker.position() == seeker.end_position());
-        stdext::discard(seeker);
-
-        return glyphs;
+    wcdx::image::font read_font(const wchar_t* path)
+    {
+        wcdx::archive::mapped_file file(path);
+        return wcdx::image::font({ file.data(), file.size() });
     }
 
-    void extract_glyph(const glyph_info& glyph, stdext::array_view<std::byte> palette_view, const wchar_t* output_path)
+    void extract_glyph(const wcdx::image::font& font, unsigned index, stdext::array_view<std::byte> palette_view, const wchar_t* output_path)
     {
-        stdext::memory_input_stream pixels_stream(glyph.pixels.get(), glyph.width * glyph.height);
+        if (index >= wcdx::image::font::glyph_count)
+            throw std::runtime_error("Invalid glyph index");
+
+        auto width = font.width(index);
+        auto height = font.height();
+        if (width == 0 || height == 0)
+            throw std::runtime_error("Cannot extract a zero-sized glyph");
+
+        stdext::memory_input_stream pixels_stream(font.pixels(index), size_t(width) * height);
         stdext::file_output_stream out(output_path);
-        wcdx::image::write_image({ glyph.width, glyph.height }, palette_view, pixels_stream, out);
+        wcdx::image::write_image({ width, height }, palette_view, pixels_stream, out);
     }
 
-    void extract_all_glyphs(const glyph_array& glyphs, stdext::array_view<std::byte> palette_view, const wchar_t* output_path, const wchar_t* prefix)
+    void extract_all_glyphs(const wcdx::image::font& font, stdext::array_view<std::byte> palette_view, const wchar_t* output_path, const wchar_t* prefix)
     {
-        size_t index = 0;
-        for (auto& glyph : glyphs)
+        wcdx::image::png_encoder encoder(palette_view);
+        auto height = font.height();
+        for (unsigned index = 0; index < wcdx::image::font::glyph_count; ++index)
         {
-            if (glyph.width == 0 || glyph.height == 0)
-            {
-                ++index;
+            auto width = font.width(index);
+            if (width == 0 || height == 0)
                 continue;
-            }
 
-            stdext::memory_input_stream pixels_stream(glyph.pixels.get(), glyph.width * glyph.height);
-            stdext::file_output_stream out(stdext::format_string("$0\\$1$2.png", output_path, prefix, index++).c_str(), stdext::utf8_path_encoding());
-            wcdx::image::write_image({ glyph.width, glyph.height }, palette_view, pixels_stream, out);
+            auto path = std::filesystem::path(output_path) /= prefix + std::to_wstring(index) + L".png";
+            stdext::file_output_stream out(path.c_str());
+            encoder.encode({ width, height }, { font.pixels(index), size_t(width) * height }, out);
         }
     }
 
-    void extract_font_strip(const glyph_array& glyphs, stdext::array_view<std::byte> palette_view, const wchar_t* output_path)
+    void extract_font_strip(const wcdx::image::font& font, stdext::array_view<std::byte> palette_view, const wchar_t* output_path)
     {
-        unsigned width = std::accumulate(glyphs.begin(), glyphs.end(), unsigned(0), [](unsigned acc, const glyph_info& glyph)
-        {
-            return acc + glyph.width;
-        });
-        unsigned height = glyphs[0].height;
+        unsigned width = 0;
+        for (unsigned index = 0; index < wcdx::image::font::glyph_count; ++index)
+            width += font.width(index);
+        unsigned height = font.height();
 
         auto pixels = std::make_unique<std::byte[]>(width * height);
         auto p = pixels.get();
-        for (auto& glyph : glyphs)
+        for (unsigned index = 0; index < wcdx::image::font::glyph_count; ++index)
         {
-            assert(p + glyph.width <= pixels.get() + width);
-            auto src = glyph.pixels.get();
+            auto glyph_width = font.width(index);
+            assert(p + glyph_width <= pixels.get() + width);
+            auto src = font.pixels(index);
             auto dst = p;
-            for (unsigned y = 0; y < glyph.height; ++y)
+            for (unsigned y = 0; y < height; ++y)
             {
-                memcpy(dst, src, glyph.width);
+                memcpy(dst, src, glyph_width);
                 dst += width;
-                src += glyph.width;
+                src += glyph_width;
             }
 
-            p += glyph.width;
+            p += glyph_width;
         }
 
         stdext::memory_input_stream pixels_stream(pixels.get(), width * height);
         stdext::file_output_stream out(output_path);
         wcdx::image::write_image({ width, height }, palette_view, pixels_stream, out);
     }
+
+    void extract_atlas(const wcdx::image::font& font, wcdx::image::png_encoder& encoder, const std::filesystem::path& output_path)
+    {
+        auto atlas = wcdx::image::pack_atlas(font);
+        {
+            stdext::file_output_stream out(output_path.c_str());
+            encoder.encode({ atlas.width, atlas.height }, { atlas.pixels.data(), atlas.pixels.size() }, out);
+        }
+
+        auto metrics = wcdx::image::atlas_metrics(atlas);
+        stdext::file_output_stream out(std::filesystem::path(output_path).replace_extension(L".metrics").c_str());
+        out.write_all(metrics.data(), metrics.size());
+    }
+
+    void extract_all_atlases(const wchar_t* archive_path, stdext::array_view<std::byte> palette_view, unsigned jobs, const wchar_t* output_path, const wchar_t* prefix)
+    {
+        // Fonts are small and independent, so each one is loaded, packed and written on
+        // whichever thread picks it up.  Encoders are per thread and created on first use.
+        wcdx::archive::archive fonts(archive_path, 0);
+        std::vector<std::unique_ptr<wcdx::image::png_encoder>> encoders(wcdx::parallel::job_count(fonts.size(), jobs));
+
+        wcdx::parallel::for_each_index(fonts.size(), jobs, [&](size_t n, unsigned thread)
+        {
+            auto& encoder = encoders[thread];
+            if (encoder == nullptr)
+                encoder = std::make_unique<wcdx::image::png_encoder>(palette_view);
+
+            wcdx::image::font font(fonts.view(n));
+            extract_atlas(font, *encoder, std::filesystem::path(output_path) /= prefix + std::to_wstring(n) + L".png");
+        });
+    }
 }
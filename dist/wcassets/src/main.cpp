@@ -0,0 +1,200 @@
+#include <assets/pipeline.h>
+#include <image/resources.h>
+
+#include <stdext/array_view.h>
+#include <stdext/string.h>
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <cassert>
+#include <cstdlib>
+#include <cwchar>
+
+#define NOMINMAX
+struct IUnknown;
+#include <Windows.h>
+
+
+namespace
+{
+    enum class game_id
+    {
+        wc1,
+        wc2
+    };
+
+    struct game_directory
+    {
+        game_id game;
+        const wchar_t* path;
+    };
+
+    struct program_options
+    {
+        std::vector<game_directory> games;
+        const wchar_t* output_path = nullptr;
+        unsigned jobs = 0;
+    };
+
+    class usage_error : public std::runtime_error
+    {
+        using runtime_error::runtime_error;
+    };
+
+    void parse_args(int argc, const wchar_t* const argv[], program_options& options);
+    void show_usage(const wchar_t* invocation);
+
+    void extract_assets(const program_options& options);
+    stdext::array_view<const std::byte> load_palette(game_id game);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    std::wstring invocation = argc > 0 ? std::filesystem::path(argv[0]).filename() : "wcassets";
+
+    try
+    {
+        if (argc < 2)
+        {
+            show_usage(invocation.c_str());
+            return EXIT_SUCCESS;
+        }
+
+        program_options options;
+        parse_args(argc - 1, argv + 1, options);
+        extract_assets(options);
+        return EXIT_SUCCESS;
+    }
+    catch (const usage_error& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        show_usage(invocation.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+    }
+    catch (...)
+    {
+        std::cerr << "Unknown error" << '\n';
+    }
+
+    return EXIT_FAILURE;
+}
+
+namespace
+{
+    void parse_args(int argc, const wchar_t* const argv[], program_options& options)
+    {
+        for (int n = 0; n < argc; ++n)
+        {
+            if (wcscmp(argv[n], L"-wc1") == 0 || wcscmp(argv[n], L"-wc2") == 0)
+            {
+                auto game = argv[n][3] == L'1' ? game_id::wc1 : game_id::wc2;
+                for (auto& entry : options.games)
+                {
+                    if (entry.game == game)
+                        throw usage_error(stdext::to_mbstring(argv[n]) + " specified more than once");
+                }
+
+                if (++n == argc)
+                    throw usage_error("No directory for " + stdext::to_mbstring(argv[n - 1]));
+
+                options.games.push_back({ game, argv[n] });
+            }
+            else if (wcscmp(argv[n], L"-jobs") == 0)
+            {
+                if (++n == argc)
+                    throw usage_error("No value for -jobs");
+
+                wchar_t* p;
+                auto jobs = wcstol(argv[n], &p, 10);
+                if (*p != L'\0' || jobs < 0)
+                    throw usage_error("Bad value for -jobs");
+
+                options.jobs = unsigned(jobs);
+            }
+            else if (wcscmp(argv[n], L"-o") == 0)
+            {
+                if (++n == argc)
+                    throw usage_error("No output directory specified for -o");
+
+                options.output_path = argv[n];
+            }
+            else
+                throw usage_error("Unrecognized argument " + stdext::to_mbstring(argv[n]));
+        }
+
+        if (options.games.empty())
+            throw usage_error("At least one of -wc1 and -wc2 must be specified");
+        if (options.output_path == nullptr)
+            throw usage_error("No output directory specified");
+    }
+
+    void show_usage(const wchar_t* invocation)
+    {
+        std::wcout << L"Usage:\n"
+            L"    " << invocation << L" -o <output_path> [-jobs <count>] [-wc1 <game_path>] [-wc2 <game_path>]\n"
+            L"\n"
+            L"Extracts every image set, font, and music stream found under each game_path\n"
+            L"into output_path, which need not exist.  Archives are searched for content at\n"
+            L"any depth; resources that aren't recognized are copied as they are.\n"
+            L"game_path is usually the directory the game is installed in.\n"
+            L"\n"
+            L"Images and fonts use the palette of the game they were found in.  Identical\n"
+            L"content is extracted only once, even when it appears in several files or in\n"
+            L"both games.\n"
+            L"\n"
+            L"output_path receives a file named manifest.csv listing each input file and\n"
+            L"resource, the hash of its content, and the directory under output_path\\objects\n"
+            L"where its output was written.  Running the same command again skips files that\n"
+            L"haven't changed since, so only new or modified content is extracted.\n"
+            L"\n"
+            L"Files are processed on several threads at once; -jobs sets the number of\n"
+            L"threads, which by default matches the number of processors.\n"
+            L"\n"
+            L"Example:\n"
+            L"    " << invocation << L" -o assets -wc1 C:\\GOG\\WC1 -wc2 C:\\GOG\\WC2\n";
+    }
+
+    void extract_assets(const program_options& options)
+    {
+        std::vector<wcdx::assets::pipeline_source> sources;
+        for (auto& entry : options.games)
+            sources.push_back({ entry.game == game_id::wc1 ? "wc1" : "wc2", entry.path, load_palette(entry.game) });
+
+        auto stats = wcdx::assets::run_pipeline(sources, options.output_path, options.jobs);
+        for (auto& error : stats.errors)
+            std::cerr << "Error: " << error << '\n';
+
+        std::cout << stats.files << " files (" << stats.unchanged_files << " unchanged), "
+            << stats.resources << " resources, "
+            << stats.objects_written << " objects written, "
+            << stats.objects_shared << " shared\n";
+
+        if (!stats.errors.empty())
+            throw std::runtime_error(std::to_string(stats.errors.size()) + " files could not be processed");
+    }
+
+    stdext::array_view<const std::byte> load_palette(game_id game)
+    {
+        WORD resid = game == game_id::wc1 ? RESOURCE_ID_WC1PAL : RESOURCE_ID_WC2PAL;
+        size_t palette_offset = game == game_id::wc1 ? 0x30 : 0;
+
+        auto res = ::FindResource(nullptr, MAKEINTRESOURCE(resid), RT_RCDATA);
+        if (res == nullptr)
+            throw std::system_error(::GetLastError(), std::system_category());
+        auto resp = ::LoadResource(nullptr, res);
+        auto palette_data = static_cast<const std::byte*>(::LockResource(resp));
+        auto palette_size = ::SizeofResource(nullptr, res);
+        assert(palette_size >= palette_offset + 3 * 256);
+
+        // GAME.PAL is an ILBM file; only its color map is needed.
+        return { palette_data + palette_offset, 3 * 256 };
+    }
+}
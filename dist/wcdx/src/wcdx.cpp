@@ -1,12 +1,12 @@
 #include "wcdx.h"
 
-#include <image/image.h>
-#include <image/resources.h>
+#include <frame/convert.h>
+#include <frame/recorder.h>
+#include <frame/snow.h>
 
 #include <stdext/array_view.h>
 #include <stdext/scope_guard.h>
 #include <stdext/file.h>
-#include <stdext/format.h>
 #include <stdext/multi.h>
 #include <stdext/utility.h>
 
@@ -14,7 +14,12 @@
 #include <iterator>
 #include <limits>
 #include <random>
+#include <string>
 #include <system_error>
+#include <utility>
+
+#include <cstdint>
+#include <cstring>
 
 #include <io.h>
 #include <fcntl.h>
@@ -39,8 +44,25 @@ namespace
     HRESULT GetLocalAppDataPath(LPCWSTR subdir, LPWSTR path);
 
     bool CreateDirectoryRecursive(LPWSTR pathName);
+    bool GetSetting(LPCWSTR valueName, DWORD& value);
+    bool IsFileCacheEnabled();
+    DWORD GetRecordingLimit();
+
+    // Data files that aren't mapped go straight to the C runtime, as they always have.
+    class CrtDescriptorIo : public wcdx::fileio::descriptor_io
+    {
+    public:
+        long seek(int filedesc, long offset, int method) override { return _lseek(filedesc, offset, method); }
+        long read(int filedesc, void* data, unsigned int size) override { return _read(filedesc, data, size); }
+        long length(int filedesc) override { return _filelength(filedesc); }
+    };
+
+    // Any open flag that lets the descriptor change the file.
+    const int WriteFlags = _O_WRONLY | _O_RDWR | _O_APPEND | _O_CREAT | _O_TRUNC;
 
-    std::independent_bits_engine<std::mt19937, 1, unsigned int> RandomBit(std::random_device{}());
+    CrtDescriptorIo CrtIo;
+
+    wcdx::frame::snow_generator Snow(std::random_device{}());
 }
 
 WCDXAPI IWcdx* WcdxCreate(LPCWSTR windowTitle, WNDPROC windowProc, BOOL _fullScreen)
@@ -57,10 +79,8 @@ WCDXAPI IWcdx* WcdxCreate(LPCWSTR windowTitle, WNDPROC windowProc, BOOL _fullScr
 
 Wcdx::Wcdx(LPCWSTR title, WNDPROC windowProc, bool _fullScreen)
     : _refCount(1), _monitor(nullptr), _clientWindowProc(windowProc), _frameStyle(WS_OVERLAPPEDWINDOW), _frameExStyle(WS_EX_OVERLAPPEDWINDOW)
-    , _fullScreen(false), _dirty(false), _sizeChanged(false)
-#if DEBUG_SCREENSHOTS
-    , _screenshotFrameCounter(0), _screenshotIndex(0), _screenshotFileIndex(0)
-#endif
+    , _paletteChanged(true), _fullScreen(false), _dirty(ContentWidth, ContentHeight), _sizeChanged(false)
+    , _fileCache(CrtIo, IsFileCacheEnabled())
 {
     // Create the window.
     auto hwnd = ::CreateWindowEx(_frameExStyle,
@@ -94,14 +114,7 @@ Wcdx::Wcdx(LPCWSTR title, WNDPROC windowProc, bool _fullScreen)
 
     SetFullScreen(IsDebuggerPresent() ? false : _fullScreen);
 
-#if DEBUG_SCREENSHOTS
-    auto res = ::FindResource(DllInstance, MAKEINTRESOURCE(RESOURCE_ID_WC1PAL), RT_RCDATA);
-    if (res == nullptr)
-        throw std::system_error(::GetLastError(), std::system_category());
-    auto resp = ::LoadResource(DllInstance, res);
-    _screenshotPalette = static_cast<const std::byte*>(::LockResource(resp)) + 0x30;
-    _screenshotPaletteSize = 0x300;
-#endif
+    StartRecording();
 }
 
 Wcdx::~Wcdx() = default;
@@ -155,15 +168,24 @@ HRESULT STDMETHODCALLTYPE Wcdx::SetVisible(BOOL visible)
 
 HRESULT STDMETHODCALLTYPE Wcdx::SetPalette(const WcdxColor entries[256])
 {
-    std::copy_n(entries, 256, _palette);
-    _dirty = true;
+    // Every visible pixel depends on the palette, so a change means converting the whole frame.
+    if (std::memcmp(entries, _palette, sizeof(_palette)) != 0)
+    {
+        std::copy_n(entries, 256, _palette);
+        _paletteChanged = true;
+        _dirty.mark_all();
+    }
     return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Wcdx::UpdatePalette(UINT index, const WcdxColor* entry)
 {
-    _palette[index] = *entry;
-    _dirty = true;
+    if (std::memcmp(entry, &_palette[index], sizeof(*entry)) != 0)
+    {
+        _palette[index] = *entry;
+        _paletteChanged = true;
+        _dirty.mark_all();
+    }
     return S_OK;
 }
 
@@ -177,6 +199,8 @@ HRESULT STDMETHODCALLTYPE Wcdx::UpdateFrame(INT x, INT y, UINT width, UINT heigh
         std::min(rect.right, LONG(ContentWidth)),
         std::min(rect.bottom, LONG(ContentHeight))
     };
+    if (clipped.left >= clipped.right || clipped.top >= clipped.bottom)
+        return S_OK;
 
     auto src = reinterpret_cast<const std::byte*>(bits);
     auto dest = _framebuffer + clipped.left + (ContentWidth * clipped.top);
@@ -187,7 +211,7 @@ HRESULT STDMETHODCALLTYPE Wcdx::UpdateFrame(INT x, INT y, UINT width, UINT heigh
         src += pitch;
         dest += ContentWidth;
     }
-    _dirty = true;
+    _dirty.mark(clipped.left, clipped.top, clipped.right - clipped.left, clipped.bottom - clipped.top);
     return S_OK;
 }
 
@@ -211,49 +235,29 @@ HRESULT STDMETHODCALLTYPE Wcdx::Present()
     {
         at_scope_exit([&]{ _device->EndScene(); });
 
-        if (_dirty)
+        if (_dirty.any())
         {
+            // Only the pixels written since the last frame need converting.  A partial lock has
+            // to keep the rest of the surface, so it can only be discarded when every row is
+            // being replaced.
+            static_assert(sizeof(WcdxColor) == sizeof(uint32_t), "Palette entries must match D3DFMT_X8R8G8B8");
+            auto& dirtyBounds = _dirty.bounds();
             D3DLOCKED_RECT locked;
-            RECT bounds = { 0, 0, ContentWidth, ContentHeight };
-            if (FAILED(hr = _surface->LockRect(&locked, &bounds, D3DLOCK_DISCARD)))
+            RECT bounds = { LONG(dirtyBounds.left), LONG(dirtyBounds.top), LONG(dirtyBounds.right), LONG(dirtyBounds.bottom) };
+            if (FAILED(hr = _surface->LockRect(&locked, &bounds, _dirty.all() ? D3DLOCK_DISCARD : 0)))
                 return hr;
             {
                 at_scope_exit([&]{ _surface->UnlockRect(); });
 
-                const std::byte* src = _framebuffer;
-                auto dest = static_cast<WcdxColor*>(locked.pBits);
-                for (int row = 0; row < ContentHeight; ++row)
-                {
-                    std::transform(src, src + ContentWidth, dest, [&](std::byte index)
-                    {
-                        return _palette[uint8_t(index)];
-                    });
-
-                    src += ContentWidth;
-                    dest += locked.Pitch / sizeof(*dest);
-                }
+                wcdx::frame::convert_dirty_rows(_dirty, _framebuffer, reinterpret_cast<const uint32_t*>(_palette), locked.pBits, locked.Pitch);
             }
-        }
-
-#if DEBUG_SCREENSHOTS
-        std::copy_n(_framebuffer, std::size(_framebuffer), _screenshotBuffers[_screenshotIndex]);
-        if (++_screenshotIndex == std::size(_screenshotBuffers))
-            _screenshotIndex = 0;
 
-        if (_screenshotFrameCounter != 0 && --_screenshotFrameCounter == 0)
-        {
-            for (size_t n = 0; n != std::size(_screenshotBuffers); ++n)
-            {
-                auto index = (_screenshotIndex + n) % std::size(_screenshotBuffers);
-                auto& buffer = _screenshotBuffers[index];
-                stdext::array_view<const std::byte> paletteView(_screenshotPalette, _screenshotPaletteSize);
-                stdext::memory_input_stream bufferStream(buffer, sizeof(buffer));
-                stdext::file_output_stream file(stdext::format_string("screenshot${0:03}.png", _screenshotFileIndex).c_str(), stdext::utf8_path_encoding());
-                wcdx::image::write_image({ ContentWidth, ContentHeight }, paletteView, bufferStream, file);
-                ++_screenshotFileIndex;
-            }
+            // Only changed frames are recorded.  If the writer can't keep up, the frame is
+            // dropped; the next one recorded still holds every change.
+            if (_recorder != nullptr)
+                _recorder->record(_framebuffer, reinterpret_cast<const uint32_t*>(_palette), _paletteChanged);
+            _paletteChanged = false;
         }
-#endif
 
         RECT activeRect = GetContentRect(clientRect);
         if (_sizeChanged)
@@ -280,14 +284,14 @@ HRESULT STDMETHODCALLTYPE Wcdx::Present()
             }
         }
 
-        if (_dirty || _sizeChanged)
+        if (_dirty.any() || _sizeChanged)
         {
             IDirect3DSurface9Ptr backBuffer;
             if (FAILED(hr = _device->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &backBuffer)))
                 return hr;
             if (FAILED(hr = _device->StretchRect(_surface, nullptr, backBuffer, &activeRect, D3DTEXF_POINT)))
                 return hr;
-            _dirty = false;
+            _dirty.clear();
             _sizeChanged = false;
         }
     }
@@ -390,6 +394,10 @@ HRESULT STDMETHODCALLTYPE Wcdx::SavedGameOpen(const wchar_t* subdir, const wchar
             if (FAILED(hr = StringCchCopy(pathEnd, remaining, filename)))
                 return hr;
 
+            // Windows won't truncate a file with a mapped view, so any mapping goes first.
+            if ((oflag & WriteFlags) != 0)
+                _fileCache.release(path);
+
             auto error = _wsopen_s(filedesc, path, oflag, _SH_DENYNO, pmode);
             if (*filedesc != -1)
                 return S_OK;
@@ -401,7 +409,9 @@ HRESULT STDMETHODCALLTYPE Wcdx::SavedGameOpen(const wchar_t* subdir, const wchar
 
     if ((oflag & _O_CREAT) == 0)
     {
-        // If the savegame file exists, try to move or copy it into a better location.
+        // If the savegame file exists, try to move or copy it into a better location.  A
+        // mapping would keep the file from moving, and would name the old path if it did.
+        _fileCache.release(filename);
         for (auto func : pathFuncs)
         {
             auto hr = func(subdir, path);
@@ -428,6 +438,9 @@ HRESULT STDMETHODCALLTYPE Wcdx::SavedGameOpen(const wchar_t* subdir, const wchar
         }
     }
 
+    if ((oflag & WriteFlags) != 0)
+        _fileCache.release(filename);
+
     _wsopen_s(filedesc, filename, oflag, _SH_DENYNO, pmode);
     if (*filedesc != -1)
         return S_OK;
@@ -441,11 +454,24 @@ HRESULT STDMETHODCALLTYPE Wcdx::OpenFile(const char* filename, int oflag, int pm
     if (filename == nullptr || filedesc == nullptr)
         return E_POINTER;
 
-    return _sopen_s(filedesc, filename, oflag, _SH_DENYNO, pmode) == 0 ? S_OK : E_FAIL;
+    // Windows won't truncate a file with a mapped view, so a file opened for writing loses
+    // its mapping before it's opened.
+    if ((oflag & WriteFlags) != 0)
+        _fileCache.release(filename);
+
+    if (_sopen_s(filedesc, filename, oflag, _SH_DENYNO, pmode) != 0)
+        return E_FAIL;
+
+    // Read-only data files are served from a mapping.  Text mode translates line endings as
+    // it reads, which a mapping can't do, so only binary files qualify.
+    if ((oflag & WriteFlags) == 0 && (oflag & _O_BINARY) != 0)
+        _fileCache.attach(*filedesc, filename);
+    return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Wcdx::CloseFile(int filedesc)
 {
+    _fileCache.detach(filedesc);
     return _close(filedesc) == 0 ? S_OK : E_FAIL;
 }
 
@@ -465,10 +491,7 @@ HRESULT STDMETHODCALLTYPE Wcdx::ReadFile(int filedesc, long offset, unsigned int
     if (size > 0 && data == nullptr)
         return E_POINTER;
 
-    if (offset != -1 && _lseek(filedesc, offset, SEEK_SET) == -1)
-        return E_FAIL;
-
-    return _read(filedesc, data, size) != -1 ? S_OK : E_FAIL;
+    return _fileCache.read(filedesc, offset, size, data) ? S_OK : E_FAIL;
 }
 
 HRESULT STDMETHODCALLTYPE Wcdx::SeekFile(int filedesc, long offset, int method, long* position)
@@ -476,8 +499,7 @@ HRESULT STDMETHODCALLTYPE Wcdx::SeekFile(int filedesc, long offset, int method,
     if (position == nullptr)
         return E_POINTER;
 
-    *position = _lseek(filedesc, offset, method);
-    return *position != -1 ? S_OK : E_FAIL;
+    return _fileCache.seek(filedesc, offset, method, *position) ? S_OK : E_FAIL;
 }
 
 HRESULT STDMETHODCALLTYPE Wcdx::FileLength(int filedesc, long *length)
@@ -485,7 +507,7 @@ HRESULT STDMETHODCALLTYPE Wcdx::FileLength(int filedesc, long *length)
     if (length == nullptr)
         return E_POINTER;
 
-    *length = _filelength(filedesc);
+    _fileCache.length(filedesc, *length);
     return S_OK;
 }
 
@@ -529,6 +551,9 @@ HRESULT STDMETHODCALLTYPE Wcdx::ConvertRectFromScreen(RECT* rect)
 
 HRESULT STDMETHODCALLTYPE Wcdx::QueryValue(const wchar_t* keyname, const wchar_t* valuename, void* data, DWORD* size)
 {
+    if (keyname != nullptr && wcscmp(keyname, WCDX_FILE_CACHE_KEY) == 0)
+        return QueryFileCacheValue(valuename, data, size);
+
     HKEY roots[] = { HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE };
 
     for (auto root : roots)
@@ -561,14 +586,7 @@ HRESULT STDMETHODCALLTYPE Wcdx::SetValue(const wchar_t* keyname, const wchar_t*
 
 HRESULT STDMETHODCALLTYPE Wcdx::FillSnow(byte color_index, INT x, INT y, UINT width, UINT height, UINT pitch, byte* pixels)
 {
-    for (UINT h = 0; h != height; ++h)
-    {
-        auto p = pixels + (y * pitch) + x;
-        for (UINT w = 0; w != width; ++w)
-            *p++ = byte(RandomBit() * color_index);
-        ++y;
-    }
-
+    Snow.fill(std::byte(color_index), x, y, width, height, pitch, reinterpret_cast<std::byte*>(pixels));
     return S_OK;
 }
 
@@ -906,10 +924,86 @@ HRESULT Wcdx::ResetDevice()
 
 HRESULT Wcdx::CreateIntermediateSurface()
 {
-    _dirty = true;
+    _dirty.mark_all();
     return _device->CreateOffscreenPlainSurface(ContentWidth, ContentHeight, D3DFMT_X8R8G8B8, D3DPOOL_DEFAULT, &_surface, nullptr);
 }
 
+void Wcdx::StartRecording()
+{
+    // Every session is recorded so that bugs can be replayed with wcreplay.  Each session
+    // replaces the last one's recording.  Failing to record is never fatal.
+    //
+    // The recording is kept to a bounded size by splitting it into segments of half the
+    // limit.  session.wcfr holds the current segment; when it fills up, it becomes
+    // session.previous.wcfr, replacing the segment before it, so the most recent play is
+    // always on disk.  Each file is a recording of its own.
+    auto limit = GetRecordingLimit();
+    if (limit == 0)
+        return;
+
+    wchar_t path[_MAX_PATH];
+    if (FAILED(GetLocalAppDataPath(L"wcdx", path)) || !CreateDirectoryRecursive(path))
+        return;
+
+    try
+    {
+        std::wstring current = std::wstring(path) + L"\\session.wcfr";
+        std::wstring previous = std::wstring(path) + L"\\session.previous.wcfr";
+        ::DeleteFile(previous.c_str());
+
+        // Called on the recorder's writer thread, which is the only one to touch
+        // _recordingFile until the recorder is destroyed.
+        auto openSegment = [this, current, previous]() -> stdext::output_stream&
+        {
+            if (_recordingFile != nullptr)
+            {
+                _recordingFile = nullptr;
+                ::MoveFileEx(current.c_str(), previous.c_str(), MOVEFILE_REPLACE_EXISTING);
+            }
+            _recordingFile = std::make_unique<stdext::file_output_stream>(current.c_str());
+            return *_recordingFile;
+        };
+
+        auto segmentSize = uint64_t(limit) * 1024 * 1024 / 2;
+        _recorder = std::make_unique<wcdx::frame::frame_recorder>(ContentWidth, ContentHeight, openSegment, segmentSize);
+    }
+    catch (const std::exception&)
+    {
+        _recorder = nullptr;
+        _recordingFile = nullptr;
+    }
+}
+
+HRESULT Wcdx::QueryFileCacheValue(const wchar_t* valuename, void* data, DWORD* size)
+{
+    if (valuename == nullptr || size == nullptr)
+        return E_POINTER;
+
+    auto stats = _fileCache.stats();
+    const std::pair<const wchar_t*, uint64_t> values[] =
+    {
+        { L"Hits", stats.hits },
+        { L"Misses", stats.misses },
+        { L"BytesServed", stats.bytes_served },
+        { L"MappedFiles", stats.mapped_files }
+    };
+
+    auto i = std::find_if(std::begin(values), std::end(values), [&](const auto& value) { return wcscmp(value.first, valuename) == 0; });
+    if (i == std::end(values))
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+    // Same conventions as RegQueryValueEx: a null buffer just asks for the size.
+    auto available = *size;
+    *size = sizeof(uint64_t);
+    if (data == nullptr)
+        return S_OK;
+    if (available < sizeof(uint64_t))
+        return HRESULT_FROM_WIN32(ERROR_MORE_DATA);
+
+    std::memcpy(data, &i->second, sizeof(uint64_t));
+    return S_OK;
+}
+
 void Wcdx::SetFullScreen(bool enabled)
 {
     if (enabled == _fullScreen)
@@ -1072,4 +1166,39 @@ namespace
         *i = L'\\';
         return result && ::CreateDirectory(pathName, nullptr);
     }
+
+    bool GetSetting(LPCWSTR valueName, DWORD& value)
+    {
+        // Settings are DWORD values under Software\wcdx; the current user's take precedence.
+        HKEY roots[] = { HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE };
+        for (auto root : roots)
+        {
+            HKEY key;
+            if (::RegOpenKeyEx(root, L"Software\\wcdx", 0, KEY_QUERY_VALUE, &key) != ERROR_SUCCESS)
+                continue;
+            at_scope_exit([&]{ ::RegCloseKey(key); });
+
+            DWORD size = sizeof(value);
+            DWORD type;
+            if (::RegQueryValueEx(key, valueName, nullptr, &type, reinterpret_cast<BYTE*>(&value), &size) == ERROR_SUCCESS && type == REG_DWORD)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool IsFileCacheEnabled()
+    {
+        // The file cache can be turned off by setting FileCache to 0.
+        DWORD value;
+        return !GetSetting(L"FileCache", value) || value != 0;
+    }
+
+    DWORD GetRecordingLimit()
+    {
+        // Recording sets the most disk space, in megabytes, that the session recording may
+        // take; 0 turns recording off.
+        DWORD value;
+        return GetSetting(L"Recording", value) ? value : 64;
+    }
 }
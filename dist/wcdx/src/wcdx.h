@@ -8,13 +8,26 @@
 
 #include <iwcdx.h>
 
+#include <fileio/read_cache.h>
+#include <frame/dirty_rows.h>
+
+#include <memory>
+
 #include <cstddef>
 
 #include <comdef.h>
 #include <d3d9.h>
 
 
-#define DEBUG_SCREENSHOTS 0
+namespace stdext
+{
+    class file_output_stream;
+}
+
+namespace wcdx::frame
+{
+    class frame_recorder;
+}
 
 class Wcdx : public IWcdx
 {
@@ -83,6 +96,8 @@ private:
     HRESULT RecreateDevice(UINT adapter);
     HRESULT ResetDevice();
     HRESULT CreateIntermediateSurface();
+    void StartRecording();
+    HRESULT QueryFileCacheValue(const wchar_t* valuename, void* data, DWORD* size);
     void SetFullScreen(bool enabled);
     RECT GetContentRect(RECT clientRect);
     void ConfineCursor();
@@ -103,20 +118,17 @@ private:
     D3DPRESENT_PARAMETERS _presentParams;
 
     WcdxColor _palette[256];
+    bool _paletteChanged;
     std::byte _framebuffer[ContentWidth * ContentHeight];
 
     bool _fullScreen;
-    bool _dirty;
+    wcdx::frame::dirty_rows _dirty;
     bool _sizeChanged;
 
-#if DEBUG_SCREENSHOTS
-    int _screenshotFrameCounter;
-    std::byte _screenshotBuffers[10][ContentWidth * ContentHeight];
-    size_t _screenshotIndex;
-    const std::byte* _screenshotPalette;
-    size_t _screenshotPaletteSize;
-    size_t _screenshotFileIndex;
-#endif
+    std::unique_ptr<stdext::file_output_stream> _recordingFile;
+    std::unique_ptr<wcdx::frame::frame_recorder> _recorder;
+
+    wcdx::fileio::read_cache _fileCache;
 };
 
 #endif
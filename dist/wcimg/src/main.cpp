@@ -1,5 +1,10 @@
+#include <archive/archive.h>
 #include <image/image.h>
+#include <image/palette.h>
+#include <image/png.h>
 #include <image/resources.h>
+#include <image/sprite.h>
+#include <parallel/parallel.h>
 
 #include <stdext/array_view.h>
 #include <stdext/file.h>
@@ -13,6 +18,7 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <vector>
 
 #include <cassert>
 #include <cstdlib>
@@ -34,7 +40,6 @@ namespace
 {
     _COM_SMARTPTR_TYPEDEF(IWICImagingFactory, __uuidof(IWICImagingFactory));
     _COM_SMARTPTR_TYPEDEF(IWICBitmap, __uuidof(IWICBitmap));
-    _COM_SMARTPTR_TYPEDEF(IWICPalette, __uuidof(IWICPalette));
     _COM_SMARTPTR_TYPEDEF(IWICBitmapLock, __uuidof(IWICBitmapLock));
     _COM_SMARTPTR_TYPEDEF(IWICStream, __uuidof(IWICStream));
     _COM_SMARTPTR_TYPEDEF(IWICBitmapEncoder, __uuidof(IWICBitmapEncoder));
@@ -62,11 +67,6 @@ namespace
         int16_t x, y;
     };
 
-    struct rect
-    {
-        point p1, p2;
-    };
-
     struct program_options
     {
         program_mode invocation_mode = program_mode::unspecified;
@@ -76,6 +76,8 @@ namespace
         const wchar_t* output_path = nullptr;
         const wchar_t* output_prefix = nullptr;
         int index = -1;
+        unsigned jobs = 0;
+        bool dither = false;
     };
 
     class usage_error : public std::runtime_error
@@ -86,12 +88,12 @@ namespace
     void parse_args(int argc, const wchar_t* const argv[], program_options& options);
     void show_usage(const wchar_t* invocation);
 
-    void extract_images(stdext::multi_ref<stdext::input_stream, stdext::seekable> input, game_id game, const wchar_t* output_path, const wchar_t* prefix);
-    void extract_image(stdext::multi_ref<stdext::input_stream, stdext::seekable> input, game_id game, int index, const wchar_t* output_path);
-    void extract_image(stdext::input_stream& input, game_id game, const wchar_t* output_path);
-    void pack_images(const std::vector<const wchar_t*>& input_paths, game_id game, const std::vector<point>& reference_points, const wchar_t* output_path);
-    void pack_image(const IWICImagingFactoryPtr& imaging_factory, const IWICPalettePtr& palette, const IWICBitmapFrameDecodePtr& input, point reference_point, stdext::output_stream& output);
-    rect read_image_dimensions(stdext::input_stream& input);
+    void extract_images(const wcdx::archive::archive& images, game_id game, unsigned jobs, const wchar_t* output_path, const wchar_t* prefix);
+    void extract_image(const wcdx::archive::archive& images, game_id game, int index, const wchar_t* output_path);
+    void extract_image(stdext::array_view<const std::byte> image, wcdx::image::png_encoder& encoder, std::vector<std::byte>& pixels, const wchar_t* output_path);
+    stdext::array_view<const std::byte> load_palette(game_id game);
+    void pack_images(const std::vector<const wchar_t*>& input_paths, game_id game, const std::vector<point>& reference_points, bool dither, const wchar_t* output_path);
+    void pack_image(const IWICImagingFactoryPtr& imaging_factory, const wcdx::image::color_quantizer& quantizer, bool dither, const IWICBitmapFrameDecodePtr& input, point reference_point, wcdx::image::sprite_encoder& encoder, stdext::output_stream& output);
 }
 
 int wmain(int argc, wchar_t* argv[])
@@ -112,20 +114,20 @@ int wmain(int argc, wchar_t* argv[])
         {
         case program_mode::extract:
             {
-                stdext::file_input_stream file(options.input_paths.front());
-                extract_image(file, options.game, options.index, options.output_path);
+                wcdx::archive::archive images(options.input_paths.front(), 0);
+                extract_image(images, options.game, options.index, options.output_path);
                 break;
             }
 
         case program_mode::extract_all:
             {
-                stdext::file_input_stream file(options.input_paths.front());
-                extract_images(file, options.game, options.output_path, options.output_prefix);
+                wcdx::archive::archive images(options.input_paths.front(), 0);
+                extract_images(images, options.game, options.jobs, options.output_path, options.output_prefix);
                 break;
             }
 
         case program_mode::pack:
-            pack_images(options.input_paths, options.game, options.reference_points, options.output_path);
+            pack_images(options.input_paths, options.game, options.reference_points, options.dither, options.output_path);
             break;
 
         default:
@@ -222,6 +224,24 @@ namespace
 
                     options.reference_points.back() = { x, y };
                 }
+                else if (wcscmp(argv[n], L"-dither") == 0)
+                {
+                    if (options.invocation_mode != program_mode::pack)
+                        throw usage_error("-pack must precede -dither");
+                    options.dither = true;
+                }
+                else if (wcscmp(argv[n], L"-jobs") == 0)
+                {
+                    if (++n == argc)
+                        throw usage_error("No value for -jobs");
+
+                    wchar_t* p;
+                    auto jobs = wcstol(argv[n], &p, 10);
+                    if (*p != L'\0' || jobs < 0)
+                        throw usage_error("Bad value for -jobs");
+
+                    options.jobs = unsigned(jobs);
+                }
                 else if (wcscmp(argv[n], L"-o") == 0)
                 {
                     if (++n == argc)
@@ -300,8 +320,8 @@ namespace
     {
         std::wcout << L"Usage:\n"
             L"    " << invocation << L" -o <output_path> [-wc1 | -wc2] -extract <image_index> <input_path>\n"
-            L"    " << invocation << L" -o <output_path> [-wc1 | -wc2] -extract-all -prefix <name_prefix> <input_path>\n"
-            L"    " << invocation << L" -o <output_path> [-wc1 | -wc2] -pack <input_path> [-ref <x> <y>] ...\n"
+            L"    " << invocation << L" -o <output_path> [-wc1 | -wc2] -extract-all [-jobs <count>] -prefix <name_prefix> <input_path>\n"
+            L"    " << invocation << L" -o <output_path> [-wc1 | -wc2] -pack [-dither] <input_path> [-ref <x> <y>] ...\n"
             L"    " << invocation << L" @<filename>\n"
             L"\n"
             L"image_index gives the zero-based index of the image to be extracted.\n"
@@ -310,7 +330,9 @@ namespace
             L"of a file name.  A new file is created for each image in the input file.  File\n"
             L"names begin with 0.png, with each succeeding file name incrementing the number\n"
             L"by one.  If the -prefix option is given, then the specified sequence of\n"
-            L"characters is prepended to each file name.\n"
+            L"characters is prepended to each file name.  Images are decoded and written on\n"
+            L"several threads at once; -jobs sets the number of threads, which by default\n"
+            L"matches the number of processors.\n"
             L"\n"
             L"Example:\n"
             L"    " << invocation << L" -o images -extract-all -prefix foo imageset\n"
@@ -323,7 +345,10 @@ namespace
             L"The -pack option accepts any number of input files.  Each must be an image file.\n"
             L"The images are converted and packed into an image set of the format expected for\n"
             L"Wing Commander image resources.  Colors are converted to the appropriate palette\n"
-            L"based on the appearance of the -wc1 or -wc2 option.\n"
+            L"based on the appearance of the -wc1 or -wc2 option.  Each pixel becomes the\n"
+            L"nearest color in the palette, or transparent if it is almost fully see-through.\n"
+            L"With -dither, the difference between each pixel and its palette color is\n"
+            L"spread to the pixels around it, which smooths gradients.\n"
             L"\n"
             L"When the -pack option is specified, each image may be followed by a -ref\n"
             L"argument giving the coordinates of the image's reference point.  The reference\n"
@@ -338,7 +363,7 @@ namespace
             L"spaces.\n";
     }
 
-    void extract_images(stdext::multi_ref<stdext::input_stream, stdext::seekable> input, game_id game, const wchar_t* output_path, const wchar_t* prefix)
+    void extract_images(const wcdx::archive::archive& images, game_id game, unsigned jobs, const wchar_t* output_path, const wchar_t* prefix)
     {
         auto cwd = std::filesystem::current_path();
         if (output_path == nullptr)
@@ -346,61 +371,54 @@ namespace
         if (prefix == nullptr)
             prefix = L"";
 
-        auto& stream = input.as<stdext::input_stream>();
-        auto& seeker = input.as<stdext::seekable>();
-
-        auto begin_pos = seeker.position();
-        auto file_size = stream.read<uint32_t>();
-        auto first_offset = stream.read<uint32_t>();
-        if (first_offset % 4 != 0)
-            throw std::runtime_error("Input file is not an image archive");
+        // The palette is shared by every thread; encoders and pixel buffers are per thread and
+        // created on first use, so each is reused for all the images its thread handles.
+        auto palette = load_palette(game);
+        auto thread_count = wcdx::parallel::job_count(images.size(), jobs);
+        std::vector<std::unique_ptr<wcdx::image::png_encoder>> encoders(thread_count);
+        std::vector<std::vector<std::byte>> pixel_buffers(thread_count);
 
-        auto image_count = (first_offset - 4) / 4;
-        for (unsigned n = 0; n < image_count; ++n)
+        wcdx::parallel::for_each_index(images.size(), jobs, [&](size_t n, unsigned thread)
         {
-            seeker.set_position(begin_pos + 4 + 4 * n);
-            auto image_offset = stream.read<uint32_t>();
-            if (image_offset >= file_size)
-                throw std::runtime_error("Bad image offset");
+            auto& encoder = encoders[thread];
+            if (encoder == nullptr)
+                encoder = std::make_unique<wcdx::image::png_encoder>(palette);
 
-            seeker.set_position(begin_pos + image_offset);
-            extract_image(stream, game, (std::filesystem::path(output_path) /= prefix + std::to_wstring(n) + L".png").c_str());
-        }
+            auto path = std::filesystem::path(output_path) /= prefix + std::to_wstring(n) + L".png";
+            extract_image(images.view(n), *encoder, pixel_buffers[thread], path.c_str());
+        });
     }
 
-    void extract_image(stdext::multi_ref<stdext::input_stream, stdext::seekable> input, game_id game, int index, const wchar_t* output_path)
+    void extract_image(const wcdx::archive::archive& images, game_id game, int index, const wchar_t* output_path)
     {
-        auto& stream = input.as<stdext::input_stream>();
-        auto& seeker = input.as<stdext::seekable>();
-
         if (output_path == nullptr)
             throw std::runtime_error("No output file specified");
 
-        auto size = stream.read<uint32_t>();
-        auto header_offset = unsigned(4 + 4 * index);
-        if (size <= header_offset)
+        if (size_t(index) >= images.size())
             throw std::runtime_error("Invalid index");
 
-        auto first_image_offset = stream.read<uint32_t>();
-        if (first_image_offset <= header_offset)
-            throw std::runtime_error("Invalid index");
-
-        seeker.set_position(header_offset);
-        auto image_offset = stream.read<uint32_t>();
-
-        seeker.set_position(image_offset);
-        extract_image(stream, game, output_path);
+        wcdx::image::png_encoder encoder(load_palette(game));
+        std::vector<std::byte> pixels;
+        extract_image(images.view(size_t(index)), encoder, pixels, output_path);
     }
 
-    void extract_image(stdext::input_stream& input, game_id game, const wchar_t* output_path)
+    void extract_image(stdext::array_view<const std::byte> image, wcdx::image::png_encoder& encoder, std::vector<std::byte>& pixels, const wchar_t* output_path)
     {
-        auto dimensions = read_image_dimensions(input);
-        if (dimensions.p1.x > dimensions.p2.x || dimensions.p1.y > dimensions.p2.y)
+        auto header = wcdx::image::read_sprite_header(image);
+        auto width = unsigned(header.width());
+        auto height = unsigned(header.height());
+        if (width == 0 || height == 0)
             throw std::runtime_error("Invalid image data");
 
-        auto width = unsigned(dimensions.p2.x - dimensions.p1.x);
-        auto height = unsigned(dimensions.p2.y - dimensions.p1.y);
+        pixels.resize(size_t(width) * height);
+        wcdx::image::decode_sprite(image, { pixels.data(), pixels.size() });
 
+        stdext::file_output_stream out(output_path);
+        encoder.encode({ width, height }, { pixels.data(), pixels.size() }, out);
+    }
+
+    stdext::array_view<const std::byte> load_palette(game_id game)
+    {
         WORD resid = game == game_id::wc1 ? RESOURCE_ID_WC1PAL : RESOURCE_ID_WC2PAL;
         size_t palette_offset = game == game_id::wc1 ? 0x30 : 0;
 
@@ -410,74 +428,15 @@ namespace
         auto resp = ::LoadResource(nullptr, res);
         auto palette_data = static_cast<const std::byte*>(::LockResource(resp));
         auto palette_size = ::SizeofResource(nullptr, res);
-        assert(palette_size > palette_offset);
-
-        size_t buffer_size = width * height;
-        auto bitmap_data = std::make_unique<std::byte[]>(buffer_size);
-        std::fill_n(bitmap_data.get(), buffer_size, std::byte(0xFF));
-
-        uint16_t seg_flags;
-        while ((seg_flags = input.read<uint16_t>()) != 0)
-        {
-            auto seg_width = seg_flags >> 1;
+        assert(palette_size >= palette_offset + 3 * 256);
 
-            auto x = input.read<int16_t>();
-            auto y = input.read<int16_t>();
-
-            x -= dimensions.p1.x;
-            y -= dimensions.p1.y;
-
-            auto segment_data = bitmap_data.get() + (y * width) + x;
-            if ((seg_flags & 1) != 0)
-            {
-                while (seg_width > 0)
-                {
-                    auto run_flags = input.read<uint8_t>();
-                    auto run_width = run_flags >> 1;
-                    if ((run_flags & 1) != 0)
-                    {
-                        auto color = input.read<std::byte>();
-                        std::fill_n(segment_data, run_width, color);
-                    }
-                    else
-                        input.read_all(segment_data, run_width);
-
-                    seg_width -= run_width;
-                    segment_data += run_width;
-                }
-            }
-            else
-                input.read_all(segment_data, seg_width);
-        }
-
-        stdext::array_view<const std::byte> palette_view(palette_data + palette_offset, palette_size - palette_offset);
-        stdext::memory_input_stream pixels(bitmap_data.get(), buffer_size);
-        stdext::file_output_stream out(output_path);
-        wcdx::image::write_image({ width, height }, palette_view, pixels, out);
+        // GAME.PAL is an ILBM file; only its color map is needed.
+        return { palette_data + palette_offset, 3 * 256 };
     }
 
-    void pack_images(const std::vector<const wchar_t*>& input_paths, game_id game, const std::vector<point>& reference_points, const wchar_t* output_path)
+    void pack_images(const std::vector<const wchar_t*>& input_paths, game_id game, const std::vector<point>& reference_points, bool dither, const wchar_t* output_path)
     {
-        WORD resid = game == game_id::wc1 ? RESOURCE_ID_WC1PAL : RESOURCE_ID_WC2PAL;
-        size_t offset = game == game_id::wc1 ? 0x30 : 0;
-
-        auto res = ::FindResource(nullptr, MAKEINTRESOURCE(resid), RT_RCDATA);
-        if (res == nullptr)
-            throw std::system_error(::GetLastError(), std::system_category());
-        auto resp = ::LoadResource(nullptr, res);
-        auto palette_data = ::LockResource(resp);
-        WICColor colors[256];
-
-        auto palette_p = static_cast<const BYTE*>(palette_data) + offset;
-        auto color_p = colors;
-        for (size_t n = 0; n < std::size(colors); ++n)
-        {
-            auto red = *palette_p++;
-            auto green = *palette_p++;
-            auto blue = *palette_p++;
-            *color_p++ = blue | (green << 8) | (red << 16) | (0xFF << 24);
-        }
-        colors[std::size(colors) - 1] &= 0x00FFFFFF; // last entry transparent
+        wcdx::image::color_quantizer quantizer(load_palette(game));
 
         HRESULT hr;
         COM_REQUIRE_SUCCESS(::CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED));
@@ -486,10 +445,6 @@ namespace
         IWICImagingFactoryPtr imaging_factory;
         COM_REQUIRE_SUCCESS(imaging_factory.CreateInstance(CLSID_WICImagingFactory));
 
-        IWICPalettePtr palette;
-        COM_REQUIRE_SUCCESS(imaging_factory->CreatePalette(&palette));
-        COM_REQUIRE_SUCCESS(palette->InitializeCustom(colors, std::size(colors)));
-
         // Figure out how many images we're writing
         UINT image_count = 0;
         for (const auto& path : input_paths)
@@ -507,6 +462,7 @@ namespace
         for (size_t n = 0; n < image_count; ++n)
             output.write(uint32_t(0));  // image offset
 
+        wcdx::image::sprite_encoder encoder;
         stdext::stream_position offset_position = 4;
         auto image_position = output.position();
         output.set_position(offset_position);
@@ -528,7 +484,7 @@ namespace
                 offset_position = output.position();
                 output.set_position(image_position);
 
-                pack_image(imaging_factory, palette, frame, *reference_point, output);
+                pack_image(imaging_factory, quantizer, dither, frame, *reference_point, encoder, output);
                 image_position = output.position();
             }
 
@@ -539,111 +495,23 @@ namespace
         output.write(uint32_t(image_position));
     }
 
-    void pack_image(const IWICImagingFactoryPtr& imaging_factory, const IWICPalettePtr& palette, const IWICBitmapFrameDecodePtr& input, point reference_point, stdext::output_stream& output)
+    void pack_image(const IWICImagingFactoryPtr& imaging_factory, const wcdx::image::color_quantizer& quantizer, bool dither, const IWICBitmapFrameDecodePtr& input, point reference_point, wcdx::image::sprite_encoder& encoder, stdext::output_stream& output)
     {
         HRESULT hr;
         IWICFormatConverterPtr converter;
         COM_REQUIRE_SUCCESS(imaging_factory->CreateFormatConverter(&converter));
-        COM_REQUIRE_SUCCESS(converter->Initialize(input, GUID_WICPixelFormat8bppIndexed, WICBitmapDitherTypeNone, palette, 0.5, WICBitmapPaletteTypeCustom));
+        COM_REQUIRE_SUCCESS(converter->Initialize(input, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom));
 
         UINT width, height;
         COM_REQUIRE_SUCCESS(converter->GetSize(&width, &height));
 
-        std::vector<BYTE> pixels(width * height);
-        COM_REQUIRE_SUCCESS(converter->CopyPixels(nullptr, width, pixels.size(), pixels.data()));
-
-        output.write(int16_t(width - 1 - reference_point.x));   // right
-        output.write(int16_t(reference_point.x));               // left
-        output.write(int16_t(reference_point.y));               // top
-        output.write(int16_t(height - 1 - reference_point.y));  // bottom
-
-        auto p = pixels.data();
-        auto p_first = p;
-        auto p_last = p + pixels.size();
-
-        // Search for non-transparent pixels
-        while ((p = std::find_if(p, p_last, [](BYTE pixel) { return pixel != 0xFF; })) != p_last)
-        {
-            // Get the location of the segment
-            auto offset = p - p_first;
-            auto x = offset % width;
-            auto y = offset / width;
-
-            // Get the width of the segment
-            auto row_last = p_first + width * (y + 1);
-            auto seg_first = p;
-            auto seg_last = std::find(seg_first, row_last, 0xFF);
-            while (p != seg_last)
-            {
-                // Check for runs in the segment
-                auto run_first = p;
-                auto run_last = p;
-                auto run_length = 0;
-                while ((run_first = std::adjacent_find(run_first, seg_last)) != seg_last)
-                {
-                    run_last = std::find_if(run_first, seg_last, [&](BYTE pixel) { return pixel != *run_first; });
-                    run_length = run_last - run_first;
-                    if (run_length > 3 || (run_length > 2 && run_last == seg_last))
-                        break;
-
-                    run_first = run_last;
-                }
-
-                if (p == seg_first && run_first == seg_last)
-                {
-                    // No runs; just write the segment verbatim
-                    auto length = seg_last - seg_first;
-                    output.write(uint16_t(length << 1));
-                    output.write(int16_t(x - reference_point.x));
-                    output.write(int16_t(y - reference_point.y));
-                    output.write_all(p, length);
-                    p = seg_last;
-                }
-                else
-                {
-                    // Break up the segment into runs and intervening verbatim chunks
-                    if (p == seg_first)
-                    {
-                        auto length = seg_last - seg_first;
-                        output.write(uint16_t((length << 1) | 1));
-                        output.write(int16_t(x - reference_point.x));
-                        output.write(int16_t(y - reference_point.y));
-                    }
-
-                    if (p != run_first)
-                    {
-                        auto length = run_first - p;
-                        output.write(uint8_t(length << 1));
-                        output.write_all(p, length);
-                        p = run_first;
-                    }
+        std::vector<BYTE> bgra(4 * size_t(width) * height);
+        COM_REQUIRE_SUCCESS(converter->CopyPixels(nullptr, 4 * width, UINT(bgra.size()), bgra.data()));
 
-                    if (run_first < run_last)
-                    {
-                        output.write(uint8_t((run_length << 1) | 1));
-                        output.write(*p);
-                        p = run_last;
-                    }
-                }
-            }
-        }
-
-        output.write(uint16_t(0));
-    }
-
-    rect read_image_dimensions(stdext::input_stream& input)
-    {
-        auto right_extent = input.read<int16_t>();
-        auto left_extent = input.read<int16_t>();
-        auto top_extent = input.read<int16_t>();
-        auto bottom_extent = input.read<int16_t>();
-
-        rect dim =
-        {
-            { -left_extent, -top_extent },
-            { right_extent + 1, bottom_extent + 1 }
-        };
+        std::vector<std::byte> pixels(size_t(width) * height);
+        quantizer.quantize({ width, height }, { reinterpret_cast<const std::byte*>(bgra.data()), bgra.size() }, { pixels.data(), pixels.size() }, dither);
 
-        return dim;
+        auto sprite = encoder.encode({ width, height }, { pixels.data(), pixels.size() }, reference_point.x, reference_point.y);
+        output.write_all(sprite.data(), sprite.size());
     }
 }
@@ -1,6 +1,9 @@
-#include "wcaudio_stream.h"
 #include "wave.h"
 
+#include <audio/wave.h>
+#include <audio/wcaudio_stream.h>
+#include <parallel/parallel.h>
+
 #include <stdext/array_view.h>
 #include <stdext/file.h>
 #include <stdext/scope_guard.h>
@@ -8,19 +11,23 @@
 #include <stdext/utility.h>
 
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 #include <string_view>
-#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <cstdlib>
 #include <cstddef>
 
 
 using namespace std::literals;
+using wcdx::audio::no_trigger;
 
 namespace
 {
@@ -37,7 +44,10 @@ namespace
         mode_wav            = 0x080,
         mode_loop           = 0x100,
         mode_single         = 0x200,
-        mode_debug_info     = 0x400
+        mode_debug_info     = 0x400,
+        mode_start          = 0x800,
+        mode_batch          = 0x1000,
+        mode_jobs           = 0x2000
     };
 
     struct program_options
@@ -46,9 +56,12 @@ namespace
         int track = -1;
         const wchar_t* stream_path = nullptr;
         const wchar_t* wav_path = nullptr;
+        const wchar_t* batch_path = nullptr;
         uint8_t trigger = no_trigger;
         uint8_t intensity = 15; // default for WC1 (selects patrol music)
         int loops = -1;
+        int start = 0;
+        unsigned jobs = 0;
     };
 
     class usage_error : public std::runtime_error
@@ -61,6 +74,7 @@ namespace
     void diagnose_unrecognized(const wchar_t* str);
     void show_tracks(program_options& options);
     void select_track(program_options& options);
+    void render_batch(const program_options& options);
     int parse_int(const wchar_t* str);
 }
 
@@ -168,6 +182,40 @@ int wmain(int argc, wchar_t* argv[])
                     if (options.loops < 0)
                         throw usage_error("The -loop option cannot be negative.");
                 }
+                else if (*arg + 1 == L"start"sv)
+                {
+                    if ((options.program_mode & mode_start) != 0)
+                        throw usage_error("The -start option can only be used once.");
+
+                    options.program_mode |= mode_start;
+                    diagnose_mode(options.program_mode);
+                    options.start = parse_int(*++arg);
+                    if (options.start < 0)
+                        throw usage_error("The -start option cannot be negative.");
+                }
+                else if (*arg + 1 == L"batch"sv)
+                {
+                    if ((options.program_mode & mode_batch) != 0)
+                        throw usage_error("The -batch option can only be used once.");
+
+                    options.program_mode |= mode_batch;
+                    diagnose_mode(options.program_mode);
+                    options.batch_path = *++arg;
+                    if (options.batch_path == nullptr)
+                        throw usage_error("Expected output directory path.");
+                }
+                else if (*arg + 1 == L"jobs"sv)
+                {
+                    if ((options.program_mode & mode_jobs) != 0)
+                        throw usage_error("The -jobs option can only be used once.");
+
+                    options.program_mode |= mode_jobs;
+                    diagnose_mode(options.program_mode);
+                    auto value = parse_int(*++arg);
+                    if (value < 0)
+                        throw usage_error("The -jobs option cannot be negative.");
+                    options.jobs = unsigned(value);
+                }
                 else if (*arg + 1 == L"single"sv)
                 {
                     if ((options.program_mode & mode_single) != 0)
@@ -207,11 +255,23 @@ int wmain(int argc, wchar_t* argv[])
             return EXIT_SUCCESS;
         }
 
+        if ((options.program_mode & mode_jobs) != 0 && (options.program_mode & mode_batch) == 0)
+            throw usage_error("The -jobs option can only be used with -batch.");
+
+        if ((options.program_mode & mode_batch) != 0)
+        {
+            if ((options.program_mode & mode_stream) == 0)
+                throw usage_error("Expected STR file path.");
+
+            render_batch(options);
+            return EXIT_SUCCESS;
+        }
+
         if ((options.program_mode & mode_track) != 0)
             select_track(options);
 
         stdext::file_input_stream file(options.stream_path);
-        wcaudio_stream stream(file);
+        wcdx::audio::wcaudio_stream stream(file);
 
         if ((options.program_mode & mode_show_triggers) != 0)
         {
@@ -225,20 +285,15 @@ int wmain(int argc, wchar_t* argv[])
             return EXIT_SUCCESS;
         }
 
-        std::unordered_map<uint32_t, unsigned> chunk_frame_map;
-        chunk_frame_map.reserve(128);
-
-        stream.on_next_chunk([&](uint32_t chunk_index, unsigned frame_count)
-        {
-            chunk_frame_map.insert({ chunk_index, frame_count });
-        });
         stream.on_loop([&](uint32_t chunk_index, unsigned frame_count)
         {
             stdext::discard(frame_count);
             if ((options.program_mode & mode_debug_info) != 0)
             {
+                // Taken from the track rather than from the chunks played, which miss any
+                // skipped over by -start.
                 std::cout << "Loop to chunk " << chunk_index
-                    << " (frame index " << chunk_frame_map[chunk_index] << ')'
+                    << " (frame index " << stream.chunk_frame(chunk_index) << ')'
                     << std::endl;
             }
             return options.loops < 0 || options.loops-- != 0;
@@ -247,11 +302,10 @@ int wmain(int argc, wchar_t* argv[])
         {
             if ((options.program_mode & mode_debug_info) != 0)
                 std::cout << "Start track at chunk " << chunk_index << std::endl;
-            chunk_frame_map.insert({ chunk_index, 0 });
         });
         stream.on_next_track([&](uint32_t chunk_index, unsigned frame_count)
         {
-            chunk_frame_map.insert({ chunk_index, frame_count });
+            stdext::discard(frame_count);
             if ((options.program_mode & mode_debug_info) != 0)
                 std::cout << "Switch to track at chunk " << chunk_index << std::endl;
             return (options.program_mode & mode_single) == 0;
@@ -273,16 +327,38 @@ int wmain(int argc, wchar_t* argv[])
             std::cout << "Press Ctrl-C to end playback." << std::endl;
 
         stream.select(options.trigger, options.intensity);
+        if ((options.program_mode & mode_debug_info) != 0)
+        {
+            std::cout << "Track length: " << stream.frame_count() << " frames ("
+                << stream.frame_count() / stream.sample_rate() << " seconds) before looping or moving on"
+                << std::endl;
+        }
+
+        if ((options.program_mode & mode_start) != 0)
+        {
+            auto frame = uint64_t(options.start) * stream.sample_rate();
+            if (frame > stream.frame_count())
+                throw std::runtime_error("The -start time is past the end of the track.");
+            stream.seek_to_frame(unsigned(frame));
+        }
 
         if ((options.program_mode & mode_wav) != 0)
         {
             if (options.loops < 0)
                 options.loops = 0;
             stdext::file_output_stream out(options.wav_path);
-            write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+            wcdx::audio::write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
         }
         else
-            play_wave(stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+        {
+            auto stats = play_wave(stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+            if ((options.program_mode & mode_debug_info) != 0)
+            {
+                std::cout << "Underruns: " << stats.underruns << " of " << stats.periods << " periods\n"
+                    << "Ring fill: " << stats.min_fill << " bytes minimum, " << stats.average_fill() << " bytes average, of "
+                    << stats.ring_capacity << " bytes" << std::endl;
+            }
+        }
 
         return EXIT_SUCCESS;
     }
@@ -458,6 +534,7 @@ namespace
             L"  " << invocation << L" [<options>...] -trigger <num> <filename>\n"
             L"  " << invocation << L" -show-tracks (wc1|wc2)\n"
             L"  " << invocation << L" -show-triggers <filename>\n"
+            L"  " << invocation << L" [-loop <num>] [-single] [-jobs <count>] -batch <output_dir> <filename>\n"
             L"\n"
             L"The first form selects a music track to play.  The command must be invoked from\n"
             L"the game directory (the same directory containing the STREAMS directory).  The\n"
@@ -472,6 +549,14 @@ namespace
             L"intensities supported by a given stream file, use the -show-triggers option.\n"
             L"This form may be used with any stream file.\n"
             L"\n"
+            L"The last form writes every track in the stream file to a WAV file in\n"
+            L"<output_dir>, one for each combination of trigger and intensity listed by\n"
+            L"-show-triggers, plus one for each intensity with no trigger.  Tracks are\n"
+            L"written on several threads at once; -jobs sets the number of threads, which by\n"
+            L"default is the number of processors.  Tracks are played as they would be with\n"
+            L"-o, so they don't loop unless -loop is given.  When every track has been\n"
+            L"written, manifest.csv in <output_dir> lists each file and its length.\n"
+            L"\n"
             L"Options:\n"
             L"  -o <filename>\n"
             L"    Instead of playing music, write it to a WAV file.\n"
@@ -492,6 +577,12 @@ namespace
             L"    If the track does not have a loop point, this option is ignored.  If this\n"
             L"    option is not specified, the track will loop indefinitely.\n"
             L"\n"
+            L"  -start <num>\n"
+            L"    Begin playback <num> seconds into the track instead of at its beginning.\n"
+            L"    The time must fall within the first pass through the track, before it\n"
+            L"    loops or moves on to another track.  Frame numbers printed by -debug-info\n"
+            L"    still count from the beginning of the track.\n"
+            L"\n"
             L"  -single\n"
             L"    Stop playback at transition points instead of following the transition to\n"
             L"    the next track.\n"
@@ -501,7 +592,9 @@ namespace
             L"    information that tells the player how to loop a track or how to progress\n"
             L"    from one track to another.  This information will be printed out as it is\n"
             L"    encountered.  If the -o option is being used, this option will also print\n"
-            L"    corresponding frame numbers in the output file.\n";
+            L"    corresponding frame numbers in the output file.  When playback ends, the\n"
+            L"    number of times the player ran out of decoded music (underruns) and how\n"
+            L"    full its buffer of decoded music stayed are printed as well.\n";
     }
 
     void diagnose_mode(uint32_t mode)
@@ -514,6 +607,8 @@ namespace
             throw usage_error("The -show-tracks option cannot be used with other options.");
         if ((mode & mode_show_triggers) != 0 && (mode & ~mode_stream) != mode_show_triggers)
             throw usage_error("The -show-triggers option cannot be used with other options.");
+        if ((mode & mode_batch) != 0 && (mode & ~(mode_batch | mode_stream | mode_loop | mode_single | mode_jobs)) != 0)
+            throw usage_error("The -batch option can only be used with -loop, -single, and -jobs.");
     }
 
     void diagnose_unrecognized(const wchar_t* str)
@@ -596,6 +691,76 @@ namespace
         }
     }
 
+    void render_batch(const program_options& options)
+    {
+        struct batch_track
+        {
+            uint8_t trigger;
+            uint8_t intensity;
+            std::wstring filename;
+            unsigned frame_count;
+        };
+
+        // The stream file's tables are loaded once and shared by every track.  Each thread
+        // opens the file for itself on first use and reuses it for all the tracks it
+        // handles, so no two streams ever share a file position.
+        std::shared_ptr<const wcdx::audio::wcaudio_file> audio_file;
+        {
+            stdext::file_input_stream file(options.stream_path);
+            audio_file = std::make_shared<const wcdx::audio::wcaudio_file>(file);
+        }
+
+        std::vector<batch_track> tracks;
+        for (auto [trigger, intensity] : wcdx::audio::track_selections(*audio_file))
+        {
+            auto filename = (trigger == no_trigger ? L"untriggered"s : L"trigger" + std::to_wstring(trigger))
+                + L"-intensity" + std::to_wstring(intensity) + L".wav";
+            tracks.push_back({ trigger, intensity, std::move(filename), 0 });
+        }
+
+        std::filesystem::path output_path(options.batch_path);
+        std::filesystem::create_directories(output_path);
+
+        auto loops = options.loops < 0 ? 0 : options.loops;
+        auto single = (options.program_mode & mode_single) != 0;
+        auto frame_size = audio_file->channels() * ((audio_file->bits_per_sample() + 7) / 8);
+
+        std::vector<std::unique_ptr<stdext::file_input_stream>> files(wcdx::parallel::job_count(tracks.size(), options.jobs));
+        wcdx::parallel::for_each_index(tracks.size(), options.jobs, [&](size_t n, unsigned thread)
+        {
+            auto& file = files[thread];
+            if (file == nullptr)
+                file = std::make_unique<stdext::file_input_stream>(options.stream_path);
+
+            auto& track = tracks[n];
+            wcdx::audio::wcaudio_stream stream(audio_file, *file);
+
+            wcdx::audio::set_batch_handlers(stream, unsigned(loops), !single);
+            stream.select(track.trigger, track.intensity);
+
+            stdext::file_output_stream out((output_path / track.filename).c_str());
+            auto size = wcdx::audio::write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+            track.frame_count = unsigned(size / frame_size);
+        });
+
+        std::ofstream manifest(output_path / L"manifest.csv");
+        manifest << "trigger,intensity,file,frames,seconds\n" << std::fixed << std::setprecision(3);
+        for (auto& track : tracks)
+        {
+            if (track.trigger != no_trigger)
+                manifest << unsigned(track.trigger);
+            manifest << ',' << unsigned(track.intensity)
+                << ',' << stdext::to_mbstring(track.filename.c_str())
+                << ',' << track.frame_count
+                << ',' << double(track.frame_count) / audio_file->sample_rate()
+                << '\n';
+        }
+
+        manifest.close();
+        if (!manifest)
+            throw std::runtime_error("Failed to write the manifest.");
+    }
+
     int parse_int(const wchar_t* str)
     {
         if (str == nullptr)
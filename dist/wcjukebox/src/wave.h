@@ -1,12 +1,12 @@
 #pragma once
 
-#include <stdext/multi.h>
+#include <audio/playback.h>
+
 #include <stdext/stream.h>
 
 #include <cstdint>
 
 
-using seekable_output_stream_ref = stdext::multi_ref<stdext::output_stream, stdext::seekable>;
-
-void play_wave(stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size);
-void write_wave(seekable_output_stream_ref out, stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size);
+// Plays everything that can be read from in through DirectSound.  Samples are read on a
+// separate thread, so in's handlers are called from it.
+wcdx::audio::playback_stats play_wave(stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size);
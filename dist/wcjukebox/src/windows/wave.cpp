@@ -5,6 +5,8 @@
 #include <stdext/string.h>
 #include <stdext/utility.h>
 
+#include <algorithm>
+
 #define NOMINMAX
 struct IUnknown;
 #include <Windows.h>
@@ -20,146 +22,209 @@ _COM_SMARTPTR_TYPEDEF(IDirectSoundNotify8, IID_IDirectSoundNotify8);
 
 namespace
 {
+    // Plays through a looping DirectSound buffer split into two halves.  Each half is one
+    // period; while one is playing, the other is refilled.
+    class dsound_sink : public wcdx::audio::pcm_sink
+    {
+    public:
+        dsound_sink(uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size);
+        dsound_sink(const dsound_sink&) = delete;
+        dsound_sink& operator = (const dsound_sink&) = delete;
+        ~dsound_sink() override;
+
+    public:
+        size_t period_size() const override { return _chunk_size; }
+        bool realtime() const override { return true; }
+        void write(const std::byte* data, size_t size) override;
+        void drain() override;
+
+    private:
+        uint32_t next_offset();
+        void fill(uint32_t offset, const std::byte* data, size_t size);
+
+    private:
+        IDirectSound8Ptr _ds8;
+        IDirectSoundBuffer8Ptr _dsbuffer8;
+        HANDLE _position_event = nullptr;
+        uint32_t _chunk_size;
+        bool _playing = false;
+    };
+
     HWND DirectSoundWindow();
-    size_t fill_buffer(IDirectSoundBuffer8* dsbuffer8, uint32_t offset, stdext::input_stream& stream, uint32_t size);
 }
 
-void play_wave(stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size)
+wcdx::audio::playback_stats play_wave(stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size)
 try
 {
-    IDirectSound8Ptr ds8;
-    auto hr = ::DirectSoundCreate8(&DSDEVID_DefaultPlayback, &ds8, nullptr);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+    dsound_sink sink(channels, sample_rate, bits_per_sample, buffer_size);
 
-    // DirectSound needs a window handle for SetCooperativeLevel (nullptr doesn't work).
-    hr = ds8->SetCooperativeLevel(DirectSoundWindow(), DSSCL_PRIORITY);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+    // The decoder stays up to a second ahead of the device, and always at least a few
+    // periods.
+    auto bytes_per_second = size_t(sample_rate) * channels * ((bits_per_sample + 7) / 8);
+    return wcdx::audio::play_stream(in, sink, std::max(bytes_per_second, sink.period_size() * 4));
+}
+catch (const _com_error& e)
+{
+    // Convert the exception to runtime_error so that main can catch it.
+    throw std::runtime_error(stdext::to_mbstring(e.ErrorMessage()));
+}
 
-    DSBUFFERDESC desc =
+namespace
+{
+    dsound_sink::dsound_sink(uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size)
     {
-        sizeof(desc),
-        DSBCAPS_PRIMARYBUFFER,
-        0, 0, nullptr,
-        DS3DALG_DEFAULT
-    };
+        auto hr = ::DirectSoundCreate8(&DSDEVID_DefaultPlayback, &_ds8, nullptr);
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
 
-    IDirectSoundBufferPtr dsbuffer_primary;
-    hr = ds8->CreateSoundBuffer(&desc, &dsbuffer_primary, nullptr);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+        // DirectSound needs a window handle for SetCooperativeLevel (nullptr doesn't work).
+        hr = _ds8->SetCooperativeLevel(DirectSoundWindow(), DSSCL_PRIORITY);
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
 
-    auto bytes_per_sample = (bits_per_sample + 7) / 8;
-    PCMWAVEFORMAT format =
-    {
+        DSBUFFERDESC desc =
         {
-            WAVE_FORMAT_PCM,
-            channels,
-            sample_rate,
-            DWORD(sample_rate * channels * bytes_per_sample),
-            WORD(channels * bytes_per_sample)
-        },
-        bits_per_sample
-    };
+            sizeof(desc),
+            DSBCAPS_PRIMARYBUFFER,
+            0, 0, nullptr,
+            DS3DALG_DEFAULT
+        };
+
+        IDirectSoundBufferPtr dsbuffer_primary;
+        hr = _ds8->CreateSoundBuffer(&desc, &dsbuffer_primary, nullptr);
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
 
-    hr = dsbuffer_primary->SetFormat(reinterpret_cast<LPWAVEFORMATEX>(&format));
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+        auto bytes_per_sample = (bits_per_sample + 7) / 8;
+        PCMWAVEFORMAT format =
+        {
+            {
+                WAVE_FORMAT_PCM,
+                channels,
+                sample_rate,
+                DWORD(sample_rate * channels * bytes_per_sample),
+                WORD(channels * bytes_per_sample)
+            },
+            bits_per_sample
+        };
+
+        hr = dsbuffer_primary->SetFormat(reinterpret_cast<LPWAVEFORMATEX>(&format));
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
 
-    // Force an even buffer size so that chunk_size can be exactly half.  In practice,
-    // this will never change the value.
-    buffer_size &= ~uint32_t(1);
-    auto chunk_size = uint32_t(buffer_size / 2);
+        // Force an even buffer size so that _chunk_size can be exactly half.  In practice,
+        // this will never change the value.
+        buffer_size &= ~uint32_t(1);
+        _chunk_size = uint32_t(buffer_size / 2);
 
-    desc =
-    {
-        sizeof(desc),
-        DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_GLOBALFOCUS | DSBCAPS_CTRLPOSITIONNOTIFY,
-        DWORD(buffer_size),
-        0,
-        reinterpret_cast<WAVEFORMATEX*>(&format),
-        DS3DALG_DEFAULT
-    };
+        desc =
+        {
+            sizeof(desc),
+            DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_GLOBALFOCUS | DSBCAPS_CTRLPOSITIONNOTIFY,
+            DWORD(buffer_size),
+            0,
+            reinterpret_cast<WAVEFORMATEX*>(&format),
+            DS3DALG_DEFAULT
+        };
+
+        IDirectSoundBufferPtr dsbuffer;
+        hr = _ds8->CreateSoundBuffer(&desc, &dsbuffer, nullptr);
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
 
-    IDirectSoundBufferPtr dsbuffer;
-    hr = ds8->CreateSoundBuffer(&desc, &dsbuffer, nullptr);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+        _dsbuffer8 = std::move(dsbuffer);
+        if (_dsbuffer8 == nullptr)
+            _com_raise_error(E_NOINTERFACE);
 
-    IDirectSoundBuffer8Ptr dsbuffer8 = std::move(dsbuffer);
-    if (dsbuffer8 == nullptr)
-        _com_raise_error(E_NOINTERFACE);
+        auto notify = IDirectSoundNotify8Ptr(_dsbuffer8);
+        if (notify == nullptr)
+            _com_raise_error(E_NOINTERFACE);
 
-    auto notify = IDirectSoundNotify8Ptr(dsbuffer8);
-    if (notify == nullptr)
-        _com_raise_error(E_NOINTERFACE);
+        _position_event = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (_position_event == nullptr)
+            throw std::system_error(::GetLastError(), std::system_category());
+
+        DSBPOSITIONNOTIFY positions[] =
+        {
+            { 0, _position_event },
+            { _chunk_size, _position_event },
+        };
+        hr = notify->SetNotificationPositions(DWORD(std::size(positions)), positions);
+        if (FAILED(hr))
+        {
+            ::CloseHandle(_position_event);
+            throw std::system_error(hr, dsound_category());
+        }
+    }
 
-    auto position_event = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    if (position_event == nullptr)
-        throw std::system_error(::GetLastError(), std::system_category());
-    at_scope_exit([&] { ::CloseHandle(position_event); });
+    dsound_sink::~dsound_sink()
+    {
+        if (_playing)
+            _dsbuffer8->Stop();
+        ::CloseHandle(_position_event);
+    }
 
-    DSBPOSITIONNOTIFY positions[] =
+    void dsound_sink::write(const std::byte* data, size_t size)
     {
-        { 0, position_event },
-        { chunk_size, position_event },
-    };
-    hr = notify->SetNotificationPositions(DWORD(std::size(positions)), positions);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
+        if (_playing)
+        {
+            fill(next_offset(), data, size);
+            return;
+        }
 
-    auto done = fill_buffer(dsbuffer8, 0, in, chunk_size) == 0;
-    if (done)
-        return;
+        // The first period goes in before playback starts.
+        fill(0, data, size);
+        auto hr = _dsbuffer8->Play(0, 0, DSBPLAY_LOOPING);
+        if (FAILED(hr))
+            throw std::system_error(hr, dsound_category());
+        _playing = true;
+    }
 
-    hr = dsbuffer8->Play(0, 0, DSBPLAY_LOOPING);
-    if (FAILED(hr))
-        throw std::system_error(hr, dsound_category());
-    at_scope_exit([&]{ dsbuffer8->Stop(); });
+    void dsound_sink::drain()
+    {
+        if (!_playing)
+            return;
+
+        // Silence the half after the last period, then wait for the last period to finish.
+        fill(next_offset(), nullptr, 0);
+        ::WaitForSingleObject(_position_event, INFINITE);
+        _dsbuffer8->Stop();
+        _playing = false;
+    }
 
-    while (!done)
+    // Waits for playback to move into one half of the buffer and returns the offset of the
+    // other.
+    uint32_t dsound_sink::next_offset()
     {
-        auto wait_result = ::WaitForSingleObject(position_event, INFINITE);
+        auto wait_result = ::WaitForSingleObject(_position_event, INFINITE);
         if (wait_result == WAIT_FAILED)
             throw std::system_error(::GetLastError(), std::system_category());
 
         DWORD play;
-        hr = dsbuffer8->GetCurrentPosition(&play, nullptr);
+        auto hr = _dsbuffer8->GetCurrentPosition(&play, nullptr);
         if (FAILED(hr))
             throw std::system_error(hr, dsound_category());
 
-        auto buffer_offset = play < chunk_size ? chunk_size : 0;
-        done = fill_buffer(dsbuffer8, buffer_offset, in, chunk_size) == 0;
+        return play < _chunk_size ? _chunk_size : 0;
     }
 
-    ::WaitForSingleObject(position_event, INFINITE);
-}
-catch (const _com_error& e)
-{
-    // Convert the exception to runtime_error so that main can catch it.
-    throw std::runtime_error(stdext::to_mbstring(e.ErrorMessage()));
-}
-
-namespace
-{
-    HWND DirectSoundWindow()
-    {
-        static auto window = ::CreateWindow(L"BUTTON", L"Hidden DirectSound Window", WS_POPUP, 0, 0, 0, 0, nullptr, nullptr, nullptr, nullptr);
-        return window;
-    }
-
-    size_t fill_buffer(IDirectSoundBuffer8* dsbuffer8, uint32_t offset, stdext::input_stream& stream, uint32_t size)
+    void dsound_sink::fill(uint32_t offset, const std::byte* data, size_t size)
     {
         std::byte* buffer;
         DWORD buffer_bytes;
-        auto hr = dsbuffer8->Lock(offset, size, reinterpret_cast<LPVOID*>(&buffer), &buffer_bytes, nullptr, nullptr, 0);
+        auto hr = _dsbuffer8->Lock(offset, _chunk_size, reinterpret_cast<LPVOID*>(&buffer), &buffer_bytes, nullptr, nullptr, 0);
         if (FAILED(hr))
             throw std::system_error(hr, dsound_category());
-        at_scope_exit([&] { dsbuffer8->Unlock(buffer, buffer_bytes, nullptr, 0); });
+        at_scope_exit([&] { _dsbuffer8->Unlock(buffer, buffer_bytes, nullptr, 0); });
+
+        size = std::min(size, size_t(buffer_bytes));
+        std::copy_n(data, size, buffer);
+        std::fill_n(buffer + size, buffer_bytes - size, std::byte());
+    }
 
-        auto bytes = stream.read(buffer, buffer_bytes);
-        std::fill_n(buffer + bytes, buffer_bytes - bytes, std::byte());
-        return bytes;
+    HWND DirectSoundWindow()
+    {
+        static auto window = ::CreateWindow(L"BUTTON", L"Hidden DirectSound Window", WS_POPUP, 0, 0, 0, 0, nullptr, nullptr, nullptr, nullptr);
+        return window;
     }
 }
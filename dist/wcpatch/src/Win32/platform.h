@@ -1,9 +0,0 @@
-#ifndef PLATFORM_INCLUDED
-#define PLATFORM_INCLUDED
-#pragma once
-
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-
-#endif
@@ -1,69 +1,39 @@
-#include "resource_stream.h"
-#include "md5.h"
-#include "res/resources.h"
+#include <patch/patch.h>
+#include <parallel/parallel.h>
+
+#include <dif_tables.h>
 
 #include <stdext/file.h>
-#include <stdext/multi.h>
-#include <stdext/string_view.h>
-#include <stdext/unicode.h>
+#include <stdext/string.h>
+#include <stdext/utility.h>
 
-#include <algorithm>
+#include <filesystem>
 #include <iostream>
-#include <map>
-#include <optional>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <system_error>
 #include <vector>
 
 #include <cstdint>
-#include <cstdio>
 #include <cstdlib>
-#include <cstring>
 #include <cwchar>
 
 
-struct section_header_t
-{
-    char name[8];
-    uint32_t virtual_size;
-    uint32_t virtual_address;
-    uint32_t raw_data_size;
-    uint32_t raw_data_offset;
-    uint32_t relocations_offset;
-    uint32_t line_numbers_offset;
-    uint16_t relocation_count;
-    uint16_t line_number_count;
-    uint32_t characteristics;
-};
-
-struct import_entry_t
-{
-    uint32_t lookup_virtual_address;
-    uint32_t timestamp;
-    uint32_t forwarder_chain;
-    uint32_t dllname_virtual_address;
-    uint32_t import_table_virtual_address;
-};
-
 static void show_usage(const wchar_t* invocation);
 
-static bool patch_image(stdext::multi_ref<stdext::stream, stdext::seekable> file_data);
-static bool apply_dif(stdext::multi_ref<stdext::stream, stdext::seekable> file_data, uint32_t hash);
-
-static std::optional<std::string> read_line(stdext::multi_ref<stdext::input_stream, stdext::seekable> is);
-
-static const import_entry_t import_entry_null = { };
-
-static const char PESignature[] = { 'P', 'E', '\0', '\0' };
-static const uint16_t OptionalHeader_PE32Signature = 0x10B;
-static const uint16_t OptionalHeader_PE32PlusSignature = 0x20B;
+static void patch_file(const wchar_t* input_path, const std::filesystem::path& output_path, bool headers_only);
+static bool patch_batch(const std::vector<const wchar_t*>& input_paths, const wchar_t* output_dir, bool headers_only, unsigned jobs);
 
 int wmain(int argc, wchar_t* argv[])
 {
     try
     {
-        const wchar_t* input_path = nullptr;
-        const wchar_t* output_path = nullptr;
+        std::vector<const wchar_t*> paths;
+        const wchar_t* batch_path = nullptr;
         bool headers_only = false;
+        bool jobs_set = false;
+        unsigned jobs = 0;
 
         stdext::discard(argc);
         for (const wchar_t* const* arg = argv + 1; *arg != nullptr; ++arg)
@@ -77,65 +47,67 @@ int wmain(int argc, wchar_t* argv[])
             case L'/':
                 if (wcscmp(*arg + 1, L"headers-only") == 0)
                     headers_only = true;
+                else if (wcscmp(*arg + 1, L"batch") == 0)
+                {
+                    batch_path = *++arg;
+                    if (batch_path == nullptr)
+                    {
+                        std::cerr << "No output directory specified.\n";
+                        show_usage(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                }
+                else if (wcscmp(*arg + 1, L"jobs") == 0)
+                {
+                    wchar_t* end = nullptr;
+                    auto value = *++arg != nullptr ? wcstol(*arg, &end, 10) : -1;
+                    if (end == nullptr || *end != L'\0' || value < 0)
+                    {
+                        std::cerr << "Bad value for -jobs.\n";
+                        show_usage(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    jobs = unsigned(value);
+                    jobs_set = true;
+                }
                 break;
 
             default:
-                if (input_path == nullptr)
-                    input_path = *arg;
-                else if (output_path == nullptr)
-                    output_path = *arg;
-                else
-                {
-                    show_usage(argv[0]);
-                    return EXIT_FAILURE;
-                }
+                paths.push_back(*arg);
             }
         }
 
-        if (input_path == nullptr)
+        if (paths.empty())
         {
             std::cerr << "No input file specified.\n";
             show_usage(argv[0]);
             return EXIT_FAILURE;
         }
 
-        if (output_path == nullptr)
+        if (batch_path != nullptr)
+            return patch_batch(paths, batch_path, headers_only, jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        if (jobs_set)
         {
-            std::cerr << "No output file specified.\n";
+            std::cerr << "The -jobs option can only be used with -batch.\n";
             show_usage(argv[0]);
             return EXIT_FAILURE;
         }
 
-        // Read the input file into an in-memory buffer.
-        std::vector<std::byte> file_buffer;
+        if (paths.size() == 1)
         {
-            stdext::file_input_stream input_file(input_path);
-            input_file.seek(stdext::seek_from::end, 0);
-            size_t size = size_t(input_file.position());
-            file_buffer.resize(size);
-            input_file.seek(stdext::seek_from::begin, 0);
-            input_file.read_all(file_buffer.data(), file_buffer.size());
-        }
-
-        auto hash = md5_hash(file_buffer.data(), file_buffer.size());
-
-        // stdext streams are very good for reading and writing heterogeneous data.
-        stdext::memory_stream file_data(file_buffer.data(), file_buffer.size());
-
-        if (!patch_image(file_data))
-            return EXIT_FAILURE;
-
-        if (!headers_only && !apply_dif(file_data, hash.a ^ hash.b ^ hash.c ^ hash.d))
+            std::cerr << "No output file specified.\n";
+            show_usage(argv[0]);
             return EXIT_FAILURE;
+        }
 
-        stdext::file_output_stream output_file(output_path);
-        if (output_file.write(file_buffer.data(), file_buffer.size()) != file_buffer.size())
+        if (paths.size() > 2)
         {
-            std::cerr << "Error writing to output file.\n";
             show_usage(argv[0]);
             return EXIT_FAILURE;
         }
 
+        patch_file(paths[0], paths[1], headers_only);
         return EXIT_SUCCESS;
     }
     catch (const std::exception& e)
@@ -152,286 +124,81 @@ int wmain(int argc, wchar_t* argv[])
 
 void show_usage(const wchar_t* invocation)
 {
-    std::wcout << L"Usage:\n\t" << invocation << L" <input_path> <output_path>\n";
+    std::wcout << L"Usage:\n"
+        L"\t" << invocation << L" [-headers-only] <input_path> <output_path>\n"
+        L"\t" << invocation << L" [-headers-only] [-jobs <count>] -batch <output_dir> <input_path>...\n"
+        L"\n"
+        L"The second form patches each input file into <output_dir>, under the same file\n"
+        L"name, working on several files at once; -jobs sets the number of threads, which\n"
+        L"by default matches the number of processors.  A file that can't be patched\n"
+        L"doesn't stop the others, but makes the exit status nonzero.\n";
 }
 
-bool patch_image(stdext::multi_ref<stdext::stream, stdext::seekable> file_data)
+void patch_file(const wchar_t* input_path, const std::filesystem::path& output_path, bool headers_only)
 {
-    auto& stream = file_data.as<stdext::stream>();
-    auto& seekable = file_data.as<stdext::seekable>();
-
-    // Read offset of PE header
-    seekable.set_position(0x3C);
-    auto offset = stream.read<uint32_t>();
-
-    // Read PE signature
-    seekable.seek(stdext::seek_from::begin, offset);
-    char signature[4];
-    if (stream.read(signature) != std::size(signature) || !std::equal(std::begin(signature), std::end(signature), std::begin(PESignature)))
-    {
-        std::wcerr << L"Error: Input file is not a valid executable.\n";
-        return false;
-    }
+    std::error_code ec;
+    if (std::filesystem::equivalent(input_path, output_path, ec))
+        throw std::runtime_error("The output file must be different from the input file.");
 
-    // Read number of sections
-    seekable.seek(stdext::seek_from::current, 2);
-    auto section_count = stream.read<uint16_t>();
-    if (section_count == 0)
+    // Read the input file into an in-memory buffer.
+    std::vector<std::byte> file_buffer;
     {
-        std::wcerr << L"Error: Input file has no sections.\n";
-        return false;
+        stdext::file_input_stream input_file(input_path);
+        input_file.seek(stdext::seek_from::end, 0);
+        size_t size = size_t(input_file.position());
+        file_buffer.resize(size);
+        input_file.seek(stdext::seek_from::begin, 0);
+        input_file.read_all(file_buffer.data(), file_buffer.size());
     }
 
-    // Read optional header size
-    seekable.seek(stdext::seek_from::current, 12);
-    auto header_size = stream.read<uint16_t>();
+    wcdx::patch::patch_executable(file_buffer, dif_tables::patches, headers_only);
 
-    // Set the IMAGE_FILE_RELOCS_STRIPPED flag
-    auto flags = stream.read<uint16_t>();
-    seekable.seek(stdext::seek_from::current, -2);
-    stream.write(uint16_t(flags | 1));
+    stdext::file_output_stream output_file(output_path.c_str());
+    if (output_file.write(file_buffer.data(), file_buffer.size()) != file_buffer.size())
+        throw std::runtime_error("Error writing to output file.");
+}
 
-    auto pe_type_signature = stream.read<uint16_t>();
-    if (pe_type_signature != OptionalHeader_PE32Signature && pe_type_signature != OptionalHeader_PE32PlusSignature)
+bool patch_batch(const std::vector<const wchar_t*>& input_paths, const wchar_t* output_dir, bool headers_only, unsigned jobs)
+{
+    std::set<std::filesystem::path> filenames;
+    for (auto input_path : input_paths)
     {
-        std::wcerr << L"Error: Input file is not a valid executable.\n";
-        return false;
+        if (!filenames.insert(std::filesystem::path(input_path).filename()).second)
+            throw std::runtime_error("More than one input file is named " + stdext::to_mbstring(input_path) + ".");
     }
 
-    // Set the minimum OS fields to Windows XP
-    seekable.seek(stdext::seek_from::current, 38);
-    stream.write(uint16_t(5));
-    stream.write(uint16_t(1));
-    seekable.seek(stdext::seek_from::current, 4);
-    stream.write(uint16_t(5));
-    stream.write(uint16_t(1));
-
-    // Set the NX-compatible bit
-    seekable.seek(stdext::seek_from::current, 18);
-    flags = stream.read<uint16_t>();
-    flags |= 0x0100;
-    seekable.seek(stdext::seek_from::current, -2);
-    stream.write(flags);
-
-    // Skip to the data directories and clear out the relocation table entry.
-    seekable.seek(stdext::seek_from::current, 20);
-    auto count = stream.read<uint32_t>();
-    if (count >= 6)
-    {
-        seekable.seek(stdext::seek_from::current, 5 * 8);
-        stream.write(uint32_t(0));  // relocation data offset
-        stream.write(uint32_t(0));  // relocation data size
-
-        // Skip to the section tables.
-        seekable.seek(stdext::seek_from::current, header_size - 96 - (6 * 8));  // seek past the optional header
-    }
-    else
-        seekable.seek(stdext::seek_from::current, header_size - 96);    // Skip to the section tables.
+    std::filesystem::path output_path(output_dir);
+    std::filesystem::create_directories(output_path);
 
-    section_header_t section_header = { };  // shouldn't have to initialize here, but MSVC issues C4701 if I don't
+    // Each file is patched independently, so one that fails is reported alongside the rest
+    // instead of cutting the batch short.
+    std::vector<std::string> errors(input_paths.size());
+    wcdx::parallel::for_each_index(input_paths.size(), jobs, [&](size_t n)
     {
-        unsigned section_header_index = 0;
-        for (; section_header_index < section_count; ++section_header_index)
+        try
         {
-            section_header = stream.read<section_header_t>();
-            if (strcmp(section_header.name, ".idata") == 0)
-                break;
+            patch_file(input_paths[n], output_path / std::filesystem::path(input_paths[n]).filename(), headers_only);
         }
-
-        if (section_header_index == section_count)
+        catch (const std::exception& e)
         {
-            std::wcerr << L"Error: Input file has no imports.\n";
-            return false;
+            errors[n] = e.what();
         }
-    }
-
-    // Skip to the import tables.
-    seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset);
-
-    // The import tables specify RVAs for import entries, so we'll need the base
-    // address of the section in order to locate the imports in the input file.
-    uint32_t idata_base_rva = section_header.virtual_address;
-
-    // Skip past the directory tables.
-    import_entry_t import_entry;
-    while (true)
-    {
-        import_entry = stream.read<import_entry_t>();
-        if (memcmp(&import_entry, &import_entry_null, sizeof(import_entry_t)) == 0)
+        catch (...)
         {
-            std::wcerr << L"Error: Input file does not import ddraw.dll.\n";
-            return false;
+            errors[n] = "Unknown error";
         }
+    });
 
-        auto import_entry_position = seekable.position();
-        seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + import_entry.dllname_virtual_address - idata_base_rva);
-        auto import_name_position = seekable.position();
-        std::string dll_name;
-        for (char ch; (ch = stream.read<char>()) != '\0'; )
-            dll_name.push_back(ch);
-        if (_stricmp(dll_name.c_str(), "ddraw.dll") == 0)
-        {
-            seekable.set_position(import_name_position);
-            const char import_name[] = "wcdx.dll";
-            stream.write_all(import_name);
-            break;
-        }
-
-        seekable.set_position(import_entry_position);
-    }
-
-    seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + import_entry.lookup_virtual_address - idata_base_rva);
-    if (pe_type_signature != OptionalHeader_PE32Signature)
-    {
-        std::wcerr << L"Error: Input file missing PE32 signature.\n";
-        return false;
-    }
-
-    stdext::stream_position lookup_position = 0;
-    while (true)
-    {
-        auto lookup = stream.read<uint32_t>();
-        if (lookup == 0)
-        {
-            std::wcerr << L"Error: Input file does not import DirectDrawCreate.\n";
-            return false;
-        }
-
-        if ((lookup & 0x80000000) == 0)
-        {
-            lookup_position = seekable.position();
-            seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + lookup - idata_base_rva + 2);
-            auto name_position = seekable.position();
-
-            std::string name;
-            for (char ch; (ch = stream.read<char>()) != '\0'; )
-                name += ch;
-            if (name == "DirectDrawCreate")
-            {
-                seekable.set_position(name_position - 2);
-                break;
-            }
-            seekable.set_position(lookup_position);
-        }
-    }
-
-    assert(lookup_position != 0);
-
-    stream.write(uint16_t(0));
-    const char function_name[] = "WcdxCreate";
-    stream.write_all(function_name);
-
-    seekable.set_position(lookup_position);
-    stream.write(0);
-    return true;
-}
-
-bool apply_dif(stdext::multi_ref<stdext::stream, stdext::seekable> file_data, uint32_t hash)
-{
-    static const std::map<uint32_t, uint32_t> diffs =
-    {
-        { 0x8c99fb40, RESOURCE_ID_WING1_DIFF },
-        { 0xfce65eac, RESOURCE_ID_TRANSFER_DIFF },
-        { 0xa6ddc22a, RESOURCE_ID_SM1_DIFF },
-        { 0x74350efd, RESOURCE_ID_SM2_DIFF },
-        { 0x067a8af5, RESOURCE_ID_WING2_DIFF },
-        { 0x91f07afd, RESOURCE_ID_SO1_DIFF },
-        { 0x049f706e, RESOURCE_ID_SO2_DIFF }
-    };
-
-    resource_stream resource;
+    size_t failures = 0;
+    for (size_t n = 0; n != input_paths.size(); ++n)
     {
-        auto i = diffs.find(hash);
-        if (i == diffs.end())
-            return false;
-
-        resource = resource_stream(i->second);
-    }
-
-    auto line = read_line(resource);
-    if (line == std::nullopt)
-        return false;
-
-    // Skip the UTF-8 byte order mark, if present
-    auto gen = stdext::make_generator(*line);
-    auto i = stdext::extract_utf32(gen) == stdext::UNICODE_BYTE_ORDER_MARK ? gen.base() : line->begin();
-
-    char tag[] = "This difference file has been created by IDA";
-    if (std::mismatch(i, line->end(), std::begin(tag), std::end(tag)).second != std::end(tag) - 1)
-        return false;
-
-    while ((line = read_line(resource)) != std::nullopt)
-    {
-        if (line->empty())
-            continue;
-
-        auto n = line->find(':');
-        if (n == std::string::npos)
+        if (errors[n].empty())
             continue;
-        stdext::string_view address_str(line->data(), n);
-
-        n = line->find_first_not_of(' ', n + 1);
-        if (n == std::string::npos)
-            return false;
-        auto m = line->find(' ', n);
-        if (n == std::string::npos)
-            return false;
-        stdext::string_view original_value_str(line->data() + n, m - n);
-
-        n = line->find_first_not_of(' ', m + 1);
-        if (n == std::string::npos)
-            return false;
-        m = line->find(' ', n);
-        if (m == std::string::npos)
-            m = line->length();
-        stdext::string_view replacement_value_str(line->data() + n, m - n);
-
-        if (line->find_first_not_of(' ', m + 1) != std::string::npos)
-            return false;
 
-        if (original_value_str.compare("FFFFFFFF") == 0)
-            continue;
-
-        uint32_t offset = stoul(address_str, nullptr, 16);
-        auto original_value = std::byte(stoul(original_value_str, nullptr, 16));
-        auto replacement_value = std::byte(stoul(replacement_value_str, nullptr, 16));
-
-        auto& stream = file_data.as<stdext::stream>();
-        auto& seekable = file_data.as<stdext::seekable>();
-        seekable.seek(stdext::seek_from::begin, offset);
-        auto value = stream.read<std::byte>();
-        if (value != original_value)
-            return false;
-        seekable.seek(stdext::seek_from::current, -1);
-        stream.write(replacement_value);
+        std::cerr << stdext::to_mbstring(input_paths[n]) << ": " << errors[n] << '\n';
+        ++failures;
     }
 
-    return true;
-}
-
-std::optional<std::string> read_line(stdext::multi_ref<stdext::input_stream, stdext::seekable> is)
-{
-    auto& stream = is.as<stdext::input_stream>();
-    auto& seekable = is.as<stdext::seekable>();
-
-    char ch;
-    if (stream.read(&ch, 1) == 0)
-        return std::nullopt;
-
-    seekable.seek(stdext::seek_from::current, -1);
-    auto position = seekable.position();
-    size_t length = 0;
-    while (stream.read(&ch, 1) == 1 && (ch != '\r') && (ch != '\n'))
-        ++length;
-    seekable.set_position(position);
-
-    std::string line;
-    line.reserve(length);
-    while (stream.read(&ch, 1) == 1 && (ch != '\r') && (ch != '\n'))
-        line += ch;
-
-    if ((ch == '\r') && stream.read(&ch, 1) == 1 && (ch != '\n'))
-        seekable.seek(stdext::seek_from::current, -1);
-
-    return line;
+    std::cout << "Patched " << input_paths.size() - failures << " of " << input_paths.size() << " files.\n";
+    return failures == 0;
 }
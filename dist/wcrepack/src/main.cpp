@@ -0,0 +1,215 @@
+#include <audio/repack.h>
+#include <audio/wcaudio_stream.h>
+
+#include <stdext/file.h>
+#include <stdext/string.h>
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cwchar>
+
+
+namespace
+{
+    enum : uint32_t
+    {
+        mode_none           = 0x0,
+        mode_repack         = 0x1,
+        mode_verify         = 0x2,
+        mode_loop           = 0x4,
+
+        mode_operation_mask = mode_repack | mode_verify
+    };
+
+    struct program_options
+    {
+        uint32_t mode = mode_none;
+        std::vector<const wchar_t*> input_paths;
+        const wchar_t* output_path = nullptr;
+        unsigned loops = 1;
+    };
+
+    class usage_error : public std::runtime_error
+    {
+        using runtime_error::runtime_error;
+    };
+
+    void show_usage(const wchar_t* invocation);
+    void repack(const wchar_t* input_path, const wchar_t* output_path);
+    bool verify(const wchar_t* original_path, const wchar_t* repacked_path, unsigned loops);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    std::wstring invocation = argc > 0 ? std::filesystem::path(argv[0]).filename() : "wcrepack";
+
+    try
+    {
+        if (argc == 1)
+        {
+            show_usage(invocation.c_str());
+            return EXIT_SUCCESS;
+        }
+
+        program_options options;
+
+        for (int n = 1; n < argc; ++n)
+        {
+            if (argv[n][0] == L'-')
+            {
+                if (wcscmp(argv[n], L"-o") == 0)
+                {
+                    if (options.output_path != nullptr)
+                        throw usage_error("Only one output path can be specified.");
+
+                    if (++n == argc)
+                        throw usage_error("Missing output path");
+
+                    options.mode |= mode_repack;
+                    options.output_path = argv[n];
+                }
+                else if (wcscmp(argv[n], L"-verify") == 0)
+                {
+                    if ((options.mode & mode_verify) != 0)
+                        throw usage_error("The -verify option can only be used once.");
+
+                    options.mode |= mode_verify;
+                }
+                else if (wcscmp(argv[n], L"-loop") == 0)
+                {
+                    if ((options.mode & mode_loop) != 0)
+                        throw usage_error("The -loop option can only be used once.");
+
+                    if (++n == argc)
+                        throw usage_error("No value for -loop");
+
+                    wchar_t* endp;
+                    auto loops = wcstol(argv[n], &endp, 10);
+                    if (*endp != L'\0' || loops < 0)
+                        throw usage_error("Bad value for -loop");
+
+                    options.mode |= mode_loop;
+                    options.loops = unsigned(loops);
+                }
+                else
+                    throw usage_error("Unrecognized option: " + stdext::to_mbstring(argv[n]));
+            }
+            else
+            {
+                if (options.input_paths.size() == 2)
+                    throw usage_error("Unrecognized argument: " + stdext::to_mbstring(argv[n]));
+                options.input_paths.push_back(argv[n]);
+            }
+        }
+
+        switch (options.mode & mode_operation_mask)
+        {
+        case mode_repack:
+            if ((options.mode & mode_loop) != 0)
+                throw usage_error("The -loop option can only be used with -verify.");
+            if (options.input_paths.size() != 1)
+                throw usage_error("Expected one input path");
+            repack(options.input_paths.front(), options.output_path);
+            break;
+
+        case mode_verify:
+            if (options.input_paths.size() != 2)
+                throw usage_error("The -verify option requires an original and a repacked path");
+            if (!verify(options.input_paths[0], options.input_paths[1], options.loops))
+                return EXIT_FAILURE;
+            break;
+
+        case mode_none:
+            throw usage_error("No output path specified");
+
+        default:
+            throw usage_error("The -verify option cannot be used with -o.");
+        }
+
+        return EXIT_SUCCESS;
+    }
+    catch (const usage_error& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        show_usage(invocation.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+    }
+    catch (...)
+    {
+        std::cerr << "Unknown error" << '\n';
+    }
+
+    return EXIT_FAILURE;
+}
+
+namespace
+{
+    void show_usage(const wchar_t* invocation)
+    {
+        std::wcout <<
+            L"Usage: " << invocation << " -o <output_path> <input_path>\n"
+            L"       " << invocation << " [-loop <num>] -verify <original_path> <repacked_path>\n"
+            L"\n"
+            L"The first form writes a copy of the STR file at <input_path> to <output_path>\n"
+            L"with the music rearranged so that the pieces of each track are stored in the\n"
+            L"order they are played.  Playback then reads through the file from start to end\n"
+            L"instead of jumping back and forth across it.  The music itself, and how one\n"
+            L"track leads to another, are unchanged.\n"
+            L"\n"
+            L"The second form plays every track in both files, for every trigger and\n"
+            L"intensity, and checks that the output of each is identical.  Each track is\n"
+            L"allowed to loop <num> times, once if -loop is not given.  The tracks that\n"
+            L"differ are listed, and the exit status is nonzero if there are any.\n";
+    }
+
+    void repack(const wchar_t* input_path, const wchar_t* output_path)
+    {
+        std::error_code ec;
+        if (std::filesystem::equivalent(input_path, output_path, ec))
+            throw usage_error("The output path must be different from the input path.");
+
+        stdext::file_input_stream in(input_path);
+        wcdx::audio::wcaudio_file file(in);
+        stdext::file_output_stream out(output_path);
+        auto moved = wcdx::audio::repack_stream(file, in, out);
+        std::cout << "Moved " << moved << " chunks.\n";
+    }
+
+    bool verify(const wchar_t* original_path, const wchar_t* repacked_path, unsigned loops)
+    {
+        stdext::file_input_stream original(original_path);
+        auto original_file = std::make_shared<const wcdx::audio::wcaudio_file>(original);
+        stdext::file_input_stream repacked(repacked_path);
+        auto repacked_file = std::make_shared<const wcdx::audio::wcaudio_file>(repacked);
+
+        auto mismatches = wcdx::audio::compare_streams(original_file, original, repacked_file, repacked, loops);
+        for (auto [trigger, intensity] : mismatches)
+        {
+            if (trigger == wcdx::audio::no_trigger)
+                std::cout << "Mismatch with no trigger at intensity " << unsigned(intensity) << '\n';
+            else
+                std::cout << "Mismatch at trigger " << unsigned(trigger) << ", intensity " << unsigned(intensity) << '\n';
+        }
+
+        auto count = wcdx::audio::track_selections(*original_file).size();
+        if (!mismatches.empty())
+        {
+            std::cout << mismatches.size() << " of " << count << " tracks differ.\n";
+            return false;
+        }
+
+        std::cout << "All " << count << " tracks match.\n";
+        return true;
+    }
+}
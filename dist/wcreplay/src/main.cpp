@@ -0,0 +1,256 @@
+#include <frame/recording.h>
+#include <image/png.h>
+
+#include <stdext/array_view.h>
+#include <stdext/file.h>
+#include <stdext/string.h>
+
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cwchar>
+#include <cwctype>
+
+
+namespace
+{
+    enum : uint32_t
+    {
+        mode_none           = 0x0,
+        mode_info           = 0x1,
+        mode_export         = 0x2,
+
+        mode_operation_mask = mode_info | mode_export
+    };
+
+    struct program_options
+    {
+        uint32_t mode = mode_none;
+        const wchar_t* input_path = nullptr;
+        const wchar_t* output_path = nullptr;
+        size_t first_frame = 0;
+        size_t last_frame = SIZE_MAX;
+    };
+
+    class usage_error : public std::runtime_error
+    {
+        using runtime_error::runtime_error;
+    };
+
+    void show_usage(const wchar_t* invocation);
+    void diagnose_options(const program_options& options);
+    size_t parse_frame_number(const wchar_t* arg);
+
+    void show_info(const wchar_t* input_path);
+    void export_frames(const wchar_t* input_path, const wchar_t* output_path, size_t first_frame, size_t last_frame);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    std::wstring invocation = argc > 0 ? std::filesystem::path(argv[0]).filename() : "wcreplay";
+
+    try
+    {
+        if (argc == 1)
+        {
+            show_usage(invocation.c_str());
+            return EXIT_SUCCESS;
+        }
+
+        program_options options;
+
+        for (int n = 1; n < argc; ++n)
+        {
+            if (argv[n][0] == L'-')
+            {
+                if (wcscmp(argv[n], L"-info") == 0)
+                {
+                    if ((options.mode & mode_info) != 0)
+                        throw usage_error("The -info option can only be used once.");
+
+                    options.mode |= mode_info;
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-export") == 0)
+                {
+                    if ((options.mode & mode_export) != 0)
+                        throw usage_error("The -export option can only be used once.");
+
+                    options.mode |= mode_export;
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-from") == 0)
+                {
+                    if (++n == argc)
+                        throw usage_error("Missing frame number");
+
+                    options.first_frame = parse_frame_number(argv[n]);
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-to") == 0)
+                {
+                    if (++n == argc)
+                        throw usage_error("Missing frame number");
+
+                    options.last_frame = parse_frame_number(argv[n]);
+                    diagnose_options(options);
+                }
+                else if (wcscmp(argv[n], L"-o") == 0)
+                {
+                    if (options.output_path != nullptr)
+                        throw usage_error("Only one output path can be specified.");
+                    if (++n == argc)
+                        throw usage_error("Missing output path");
+
+                    options.output_path = argv[n];
+                    diagnose_options(options);
+                }
+                else
+                {
+                    throw usage_error("Unrecognized option: " + stdext::to_mbstring(argv[n]));
+                }
+            }
+            else
+            {
+                if (options.input_path != nullptr)
+                    throw usage_error("Unrecognized argument: " + stdext::to_mbstring(argv[n]));
+                options.input_path = argv[n];
+            }
+        }
+
+        if (options.input_path == nullptr)
+            throw usage_error("No input path specified");
+
+        switch (options.mode & mode_operation_mask)
+        {
+        case mode_info:
+            show_info(options.input_path);
+            break;
+
+        case mode_export:
+            export_frames(options.input_path, options.output_path, options.first_frame, options.last_frame);
+            break;
+
+        default:
+            throw usage_error("No command option specified");
+        }
+
+        return EXIT_SUCCESS;
+    }
+    catch (const usage_error& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        show_usage(invocation.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+    }
+    catch (...)
+    {
+        std::cerr << "Unknown error" << '\n';
+    }
+
+    return EXIT_FAILURE;
+}
+
+namespace
+{
+    void show_usage(const wchar_t* invocation)
+    {
+        std::wcout <<
+            L"Usage: " << invocation << " -info <input_path>\n"
+            L"       " << invocation << " [-o <output_path>] -export [-from <frame>] [-to <frame>] <input_path>\n"
+            L"\n"
+            L"Plays back a frame recording made by wcdx.  wcdx records every session in\n"
+            L"%LOCALAPPDATA%\\wcdx\\session.wcfr, replacing the recording of the session\n"
+            L"before it.  Once that file reaches half of the space allowed for recording,\n"
+            L"it is renamed session.previous.wcfr and a new one is started.  The space\n"
+            L"allowed is set in megabytes by the Recording value under Software\\wcdx in the\n"
+            L"registry; the default is 64, and 0 turns recording off.\n"
+            L"\n"
+            L"The -info option plays back the whole recording and reports its size, the\n"
+            L"number of frames it holds, and how many of them changed the palette.\n"
+            L"\n"
+            L"The -export option plays back the recording and saves each frame as a PNG\n"
+            L"image in a directory at <output_path>.  If <output_path> is not given, the\n"
+            L"current directory is used; if it does not exist, a new directory will be\n"
+            L"created.  Frames are numbered starting from 0, and are saved in files named\n"
+            L"with the frame number.  The -from and -to options limit the export to frames\n"
+            L"<frame> and later or <frame> and earlier, respectively.\n";
+    }
+
+    void diagnose_options(const program_options& options)
+    {
+        if ((options.mode & mode_operation_mask) == (mode_info | mode_export))
+            throw usage_error("The -info and -export options cannot be used together.");
+        if (options.first_frame > options.last_frame)
+            throw usage_error("The first frame to export comes after the last one.");
+    }
+
+    size_t parse_frame_number(const wchar_t* arg)
+    {
+        wchar_t* endp;
+        auto frame = wcstoull(arg, &endp, 10);
+        if (!iswdigit(*arg) || *endp != L'\0' || frame > SIZE_MAX)
+            throw usage_error("Bad frame number: " + stdext::to_mbstring(arg));
+        return size_t(frame);
+    }
+
+    void show_info(const wchar_t* input_path)
+    {
+        stdext::file_input_stream file(input_path);
+        wcdx::frame::recording_reader reader(file);
+
+        size_t palette_changes = 0;
+        while (reader.next())
+        {
+            if (reader.palette_changed())
+                ++palette_changes;
+        }
+
+        std::cout << "Frame size:      " << reader.width() << 'x' << reader.height() << '\n'
+            << "Frames:          " << reader.frame_number() << '\n'
+            << "Palette changes: " << palette_changes << '\n'
+            << "Recording size:  " << std::filesystem::file_size(input_path) << " bytes\n";
+    }
+
+    void export_frames(const wchar_t* input_path, const wchar_t* output_path, size_t first_frame, size_t last_frame)
+    {
+        auto dir = std::filesystem::current_path();
+        if (output_path == nullptr)
+            output_path = dir.c_str();
+        std::filesystem::create_directories(output_path);
+
+        stdext::file_input_stream file(input_path);
+        wcdx::frame::recording_reader reader(file);
+
+        // Encoders take their palette on construction, so a new one is made whenever the
+        // palette changes.  Frames before the first one exported still have to be played
+        // back, since each frame only holds what changed.
+        std::unique_ptr<wcdx::image::png_encoder> encoder;
+        while (reader.frame_number() <= last_frame && reader.next())
+        {
+            if (reader.palette_changed())
+                encoder = nullptr;
+
+            auto index = reader.frame_number() - 1;
+            if (index < first_frame)
+                continue;
+
+            if (encoder == nullptr)
+                encoder = std::make_unique<wcdx::image::png_encoder>(reader.palette_rgb());
+
+            wchar_t name[32];
+            swprintf(name, std::size(name), L"%06zu.png", index);
+            stdext::file_output_stream out((std::filesystem::path(output_path) /= name).c_str());
+            encoder->encode({ reader.width(), reader.height() }, reader.pixels(), out);
+        }
+    }
+}
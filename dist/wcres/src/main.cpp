@@ -1,3 +1,8 @@
+#include <archive/archive.h>
+#include <lzw/lzw.h>
+#include <parallel/parallel.h>
+
+#include <stdext/array_view.h>
 #include <stdext/file.h>
 #include <stdext/string.h>
 #include <stdext/utility.h>
@@ -5,14 +10,14 @@
 #include <algorithm>
 #include <filesystem>
 #include <iostream>
-#include <stack>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
-#include <climits>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cwchar>
 
 
@@ -42,30 +47,24 @@ namespace
         using runtime_error::runtime_error;
     };
 
-    class bit_input_stream
+    // A resource as it is stored in an archive.
+    struct stored_resource
     {
-    public:
-        explicit bit_input_stream(stdext::input_stream& stream) noexcept;
-        bit_input_stream(const bit_input_stream&) = delete;
-        bit_input_stream& operator = (const bit_input_stream&) = delete;
-
-    public:
-        template <class Int, STDEXT_REQUIRES(std::is_integral_v<Int>)>
-        Int read(size_t bit_width);
-
-    private:
-        stdext::input_stream* _stream;
-        size_t _src_bit_position = CHAR_BIT;
-        std::byte _src_byte;
+        uint32_t type;
+        std::vector<std::byte> data;
     };
 
     void show_usage(const wchar_t* invocation);
     void diagnose_options(const program_options& options);
 
-    void extract_all(stdext::file_input_stream& input_file, const wchar_t* output_path);
-    void extract_one(stdext::file_input_stream& input_file, unsigned index, const wchar_t* output_path);
-    void extract_uncompressed(stdext::input_stream& input_file, stdext::output_stream& output_file);
-    void extract_compressed(stdext::input_stream& input_file, stdext::output_stream& output_file);
+    void extract_all(const wcdx::archive::archive& archive, const wchar_t* output_path);
+    void extract_one(const wcdx::archive::archive& archive, size_t index, const wchar_t* output_path);
+    void pack(const std::vector<const wchar_t*>& input_paths, const wchar_t* output_path);
+    void replace(const wchar_t* archive_path, unsigned index, const wchar_t* resource_path, const wchar_t* output_path);
+
+    std::vector<std::byte> read_file(const wchar_t* path);
+    stored_resource store_resource(stdext::array_view<const std::byte> resource);
+    void write_archive(const wchar_t* output_path, const std::vector<stored_resource>& resources);
 }
 
 int wmain(int argc, wchar_t* argv[])
@@ -124,6 +123,14 @@ int wmain(int argc, wchar_t* argv[])
                         throw usage_error("The -replace option can only be used once.");
 
                     options.mode |= mode_replace;
+                    if (++n != argc)
+                    {
+                        wchar_t* endp;
+                        options.index = unsigned(wcstoul(argv[n], &endp, 10));
+                        if (*endp != L'\0')
+                            throw usage_error("Bad resource index: " + stdext::to_mbstring(argv[n]));
+                    }
+
                     diagnose_options(options);
                 }
                 else if (wcscmp(argv[n], L"-o") == 0)
@@ -140,7 +147,9 @@ int wmain(int argc, wchar_t* argv[])
             }
             else
             {
-                if (options.input_paths.size() > 0 && (options.mode & mode_pack) != mode_pack)
+                auto max_input_paths = (options.mode & mode_pack) != 0 ? options.input_paths.max_size()
+                    : (options.mode & mode_replace) != 0 ? 2 : 1;
+                if (options.input_paths.size() == max_input_paths)
                     throw usage_error("Unrecognized argument: " + stdext::to_mbstring(argv[n]));
                 options.input_paths.push_back(argv[n]);
             }
@@ -149,19 +158,34 @@ int wmain(int argc, wchar_t* argv[])
         if (options.input_paths.size() == 0)
             throw usage_error("No input path specified");
 
-        stdext::file_input_stream input_file(options.input_paths.front());
         switch (options.mode & mode_operation_mask)
         {
         case mode_extract:
-            extract_one(input_file, options.index, options.output_path);
+            {
+                wcdx::archive::archive archive(options.input_paths.front(), 0);
+                extract_one(archive, options.index, options.output_path);
+            }
             break;
 
         case mode_extract_all:
-            extract_all(input_file, options.output_path);
+            {
+                wcdx::archive::archive archive(options.input_paths.front(), 0);
+                extract_all(archive, options.output_path);
+            }
             break;
 
         case mode_pack:
+            if (options.output_path == nullptr)
+                throw usage_error("No output path specified");
+            pack(options.input_paths, options.output_path);
+            break;
+
         case mode_replace:
+            if (options.input_paths.size() != 2)
+                throw usage_error("The -replace option requires an archive path and a resource path");
+            if (options.output_path == nullptr)
+                throw usage_error("No output path specified");
+            replace(options.input_paths[0], options.index, options.input_paths[1], options.output_path);
             break;
 
         default:
@@ -189,45 +213,18 @@ int wmain(int argc, wchar_t* argv[])
 
 namespace
 {
-    bit_input_stream::bit_input_stream(stdext::input_stream& stream) noexcept
-        : _stream(&stream)
-    {
-    }
-
-    template <class Int, STDEXT_REQUIRED(std::is_integral_v<Int>)>
-    Int bit_input_stream::read(size_t bit_width)
-    {
-        Int result = {};
-        size_t dst_bit_position = 0;
-        while (bit_width != 0)
-        {
-            if (_src_bit_position == CHAR_BIT)
-            {
-                _src_byte = _stream->read<std::byte>();
-                _src_bit_position = 0;
-            }
-            size_t bits_used = stdext::min(bit_width, size_t(CHAR_BIT - _src_bit_position));
-            auto byte = (_src_byte >> _src_bit_position) & std::byte((1 << bits_used) - 1);
-            _src_bit_position += bits_used;
-            bit_width -= bits_used;
-            result |= Int(byte) << dst_bit_position;
-            dst_bit_position += bits_used;
-        }
-
-        return result;
-    }
-
     void show_usage(const wchar_t* invocation)
     {
         std::wcout <<
             L"Usage: " << invocation << " -o <output_path> -extract <resource_index> <input_path>\n"
             L"       " << invocation << " -o <output_path> -extract-all <input_path>\n"
             L"       " << invocation << " -o <output_path> -pack <input_path>...\n"
-            L"       " << invocation << " -o <output_path> -replace <resource_index> <input_path>\n"
+            L"       " << invocation << " -o <output_path> -replace <resource_index> <archive_path> <input_path>\n"
             L"\n"
             L"With -extract or -extract-all, extracts resources from files found in the\n"
             L"GAMEDAT folder of wc1 and wc2.  With -pack, creates a new archive from the given\n"
-            L"input files.\n"
+            L"input files.  With -replace, creates a copy of an archive with one resource\n"
+            L"replaced.\n"
             L"\n"
             L"The -extract option extracts a single resource from a file and saves it at\n"
             L"<output_path>.  Resources in a file are numbered starting from 0, with the\n"
@@ -241,7 +238,12 @@ namespace
             L"extracting resources from an archive, the -pack option creates a new archive\n"
             L"at <output_path> from the given <input_path> arguments.  Any number of\n"
             L"<input_path>s may be given.  Resources will be packed in the same order as they\n"
-            L"appear on the command line.\n";
+            L"appear on the command line.  Each resource is compressed unless compression\n"
+            L"would make it larger.\n"
+            L"\n"
+            L"The -replace option reads the archive at <archive_path> and writes a copy of it\n"
+            L"to <output_path>, with resource number <resource_index> replaced by the\n"
+            L"contents of <input_path>.  All other resources are copied unchanged.\n";
     }
 
     void diagnose_options(const program_options& options)
@@ -249,131 +251,115 @@ namespace
         stdext::discard(options);
     }
 
-    void extract_all(stdext::file_input_stream& input_file, const wchar_t* output_path)
+    void extract_all(const wcdx::archive::archive& archive, const wchar_t* output_path)
     {
-        [[maybe_unused]] auto file_size = input_file.read<uint32_t>();
-        auto first_resource_offset = input_file.read<uint32_t>() & 0x00FFFFFF;
-        auto resource_count = (first_resource_offset - 4) / 4;
-
         auto dir = std::filesystem::current_path();
         if (output_path == nullptr)
             output_path = dir.c_str();
 
+        // Resources are independent of one another, and the archive is only ever read, so
+        // they can all be extracted at once.
         std::filesystem::create_directories(output_path);
-        for (uint32_t n = 0; n < resource_count; ++n)
+        wcdx::parallel::for_each_index(archive.size(), 0, [&](size_t n)
         {
-            input_file.set_position(0);
-            extract_one(input_file, n, (std::filesystem::path(output_path) /= std::to_wstring(n)).c_str());
-        }
+            extract_one(archive, n, (std::filesystem::path(output_path) /= std::to_wstring(n)).c_str());
+        });
     }
 
-    void extract_one(stdext::file_input_stream& input_file, unsigned index, const wchar_t* output_path)
+    void extract_one(const wcdx::archive::archive& archive, size_t index, const wchar_t* output_path)
     {
-        auto descriptor_offset = 4 + (4 * index);
-        auto file_size = input_file.read<uint32_t>();
-        auto first_resource_offset = input_file.read<uint32_t>() & 0x00FFFFFF;
-        if (first_resource_offset <= descriptor_offset)
-            throw std::range_error("Resource index " + std::to_string(index) + " out of range");
+        // Views of uncompressed resources point straight into the mapped archive.
+        auto resource = archive.view(index);
+        stdext::file_output_stream output_file(output_path);
+        output_file.write_all(resource.data(), resource.size());
+    }
 
-        input_file.set_position(descriptor_offset);
-        auto resource_offset = input_file.read<uint32_t>();
-        auto resource_type = resource_offset >> 24;
-        resource_offset &= 0x00FFFFFF;
-        auto resource_size = input_file.position() == first_resource_offset
-            ? file_size - resource_offset
-            : (input_file.read<uint32_t>() & 0x00FFFFFF) - resource_offset;
+    void pack(const std::vector<const wchar_t*>& input_paths, const wchar_t* output_path)
+    {
+        // Compression dominates, and each resource is independent of the others.
+        std::vector<stored_resource> resources(input_paths.size());
+        wcdx::parallel::for_each_index(input_paths.size(), 0, [&](size_t n)
+        {
+            auto resource = read_file(input_paths[n]);
+            resources[n] = store_resource({ resource.data(), resource.size() });
+        });
 
-        input_file.set_position(resource_offset);
-        stdext::substream resource_stream(input_file, resource_size);
-        stdext::file_output_stream output_file(output_path);
+        write_archive(output_path, resources);
+    }
 
-        if (resource_type == 1)
+    void replace(const wchar_t* archive_path, unsigned index, const wchar_t* resource_path, const wchar_t* output_path)
+    {
+        wcdx::archive::archive archive(archive_path, 0);
+        if (index >= archive.size())
+            throw std::range_error("Resource index " + std::to_string(index) + " out of range");
+
+        std::vector<stored_resource> resources(archive.size());
+        for (size_t n = 0; n < archive.size(); ++n)
         {
-            resource_size = resource_stream.read<uint32_t>();
-            extract_compressed(resource_stream, output_file);
+            if (n == index)
+                continue;
+
+            auto data = archive.stored_data(n);
+            resources[n].type = archive.type(n);
+            resources[n].data.assign(data.begin(), data.end());
         }
-        else
-            extract_uncompressed(resource_stream, output_file);
 
-        if (output_file.position() != resource_size)
-            throw std::runtime_error("Resource size mismatch");
+        auto resource = read_file(resource_path);
+        resources[index] = store_resource({ resource.data(), resource.size() });
+        write_archive(output_path, resources);
     }
 
-    void extract_uncompressed(stdext::input_stream& input_file, stdext::output_stream& output_file)
+    std::vector<std::byte> read_file(const wchar_t* path)
     {
-        std::byte buf[0x1000];
-        size_t bytes;
-        while ((bytes = input_file.read(buf)) != 0)
-            output_file.write_all(buf, bytes);
+        stdext::file_input_stream file(path);
+        std::vector<std::byte> data(size_t(std::filesystem::file_size(path)));
+        file.read_all(data.data(), data.size());
+        return data;
     }
 
-    void extract_compressed(stdext::input_stream& input_file, stdext::output_stream& output_file)
+    stored_resource store_resource(stdext::array_view<const std::byte> resource)
     {
-        static constexpr size_t min_code_width = 9;
-        static constexpr size_t max_code_width = 12;
-        static constexpr size_t initial_table_size = 0x102;
-        static constexpr uint16_t reset_code = 0x100;
-        static constexpr uint16_t stop_code = 0x101;
-
-        struct entry
+        stored_resource stored;
+        auto compressed = wcdx::lzw::compress(resource);
+        if (compressed.size() + sizeof(uint32_t) < resource.size())
         {
-            uint16_t prev_index;
-            std::byte value;
-        } table[1 << max_code_width];
-        std::stack<std::byte> stack;
-
-        bit_input_stream bit_reader(input_file);
-        auto code = bit_reader.read<uint16_t>(min_code_width);
-        if (code == stop_code)
-            return;
-        if (code != reset_code)
-            throw std::runtime_error("Compressed data stream missing reset code");
-
-        do
+            auto resource_size = uint32_t(resource.size());
+            stored.type = wcdx::archive::resource_type_compressed;
+            stored.data.resize(sizeof(resource_size) + compressed.size());
+            std::memcpy(stored.data.data(), &resource_size, sizeof(resource_size));
+            std::memcpy(stored.data.data() + sizeof(resource_size), compressed.data(), compressed.size());
+        }
+        else
         {
-            size_t code_width = min_code_width;
-            size_t code_width_threshold = 1 << code_width;
-            size_t table_size = initial_table_size;
-            uint16_t prev_code = code;
-            while ((code = bit_reader.read<uint16_t>(code_width)) != reset_code && code != stop_code)
-            {
-                size_t index = code;
-                if (index > table_size)
-                    throw std::range_error("Decompressor table index out of range");
+            stored.type = wcdx::archive::resource_type_uncompressed;
+            stored.data.assign(resource.begin(), resource.end());
+        }
 
-                if (index == table_size)
-                {
-                    if (prev_code == reset_code)
-                        throw std::range_error("Decompressor table index out of range");
-                    index = prev_code;
-                }
+        return stored;
+    }
 
-                while (index > 0xFF)
-                {
-                    stack.push(table[index].value);
-                    index = table[index].prev_index;
-                }
+    void write_archive(const wchar_t* output_path, const std::vector<stored_resource>& resources)
+    {
+        // The header is the total file size followed by one descriptor per resource, each
+        // holding a 24-bit offset with the resource type in the high byte.
+        std::vector<uint32_t> header(1 + resources.size());
+        size_t offset = sizeof(uint32_t) * header.size();
+        for (size_t n = 0; n < resources.size(); ++n)
+        {
+            if (offset > wcdx::archive::max_resource_offset)
+                throw std::length_error("Archive too large");
 
-                auto first_value = std::byte(index);
-                output_file.write(first_value);
-                for (; !stack.empty(); stack.pop())
-                    output_file.write(stack.top());
+            header[1 + n] = uint32_t(offset) | (resources[n].type << 24);
+            offset += resources[n].data.size();
+        }
 
-                if (prev_code != reset_code)
-                {
-                    table[table_size].prev_index = prev_code;
-                    table[table_size].value = first_value;
-                    if (code == table_size)
-                        output_file.write(first_value);
-                    if (++table_size == code_width_threshold && code_width != max_code_width)
-                    {
-                        ++code_width;
-                        code_width_threshold <<= 1;
-                    }
-                }
+        if (offset > UINT32_MAX)
+            throw std::length_error("Archive too large");
+        header[0] = uint32_t(offset);
 
-                prev_code = code;
-            }
-        } while (code != stop_code);
+        stdext::file_output_stream output_file(output_path);
+        output_file.write_all(reinterpret_cast<const std::byte*>(header.data()), sizeof(uint32_t) * header.size());
+        for (auto& resource : resources)
+            output_file.write_all(resource.data.data(), resource.data.size());
     }
 }
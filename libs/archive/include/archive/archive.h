@@ -0,0 +1,114 @@
+#ifndef ARCHIVE_INCLUDED
+#define ARCHIVE_INCLUDED
+#pragma once
+
+#include "mapped_file.h"
+#include "resource_cache.h"
+
+#include <stdext/array_view.h>
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::archive
+{
+    // Archives start with the total file size, followed by a table of resource descriptors.
+    // Each descriptor holds a 24-bit offset from the start of the file, with the resource type
+    // in the high byte.  Resources are stored back to back in table order, so each one ends
+    // where the next begins (or at the end of the file).
+    enum : uint32_t
+    {
+        resource_type_uncompressed  = 0,
+        resource_type_compressed    = 1,    // uint32_t decompressed size, then LZW data
+    };
+
+    constexpr uint32_t max_resource_offset = 0x00FFFFFF;
+
+    struct resource_entry
+    {
+        uint32_t offset;
+        uint32_t size;      // stored size
+        uint32_t type;
+    };
+
+    // Indexes an archive held in memory.  The archive data is borrowed, not copied, and must
+    // outlive the reader.  The descriptor table is parsed and validated once, on construction.
+    class reader
+    {
+    public:
+        explicit reader(stdext::array_view<const std::byte> archive);
+
+    public:
+        size_t size() const noexcept { return _entries.size(); }
+        const resource_entry& entry(size_t index) const;
+
+        // The resource's bytes exactly as stored in the archive.
+        stdext::array_view<const std::byte> stored_data(size_t index) const;
+        // The resource's size after decompression.
+        size_t resource_size(size_t index) const;
+        // Writes the decompressed resource into output, which must hold exactly
+        // resource_size(index) bytes.
+        void extract(size_t index, stdext::array_view<std::byte> output) const;
+
+    private:
+        stdext::array_view<const std::byte> _archive;
+        std::vector<resource_entry> _entries;
+    };
+
+    // The contents of a resource.  Holds a reference to cached data, so the view remains
+    // valid even if the cache evicts it.
+    class resource_view
+    {
+    public:
+        resource_view(stdext::array_view<const std::byte> data, resource_data owner = nullptr) noexcept
+            : _owner(std::move(owner)), _data(data.data()), _size(data.size()) { }
+
+    public:
+        const std::byte* data() const noexcept { return _data; }
+        size_t size() const noexcept { return _size; }
+        const std::byte* begin() const noexcept { return _data; }
+        const std::byte* end() const noexcept { return _data + _size; }
+
+        operator stdext::array_view<const std::byte>() const noexcept { return { _data, _size }; }
+
+    private:
+        resource_data _owner;
+        const std::byte* _data;
+        size_t _size;
+    };
+
+    // Random access to the resources in an archive.  Uncompressed resources are viewed in
+    // place; compressed ones are decompressed on first use and kept in a cache of bounded
+    // size.  All const members may be called concurrently.
+    class archive
+    {
+    public:
+        static constexpr size_t default_cache_capacity = 16 << 20;
+
+    public:
+        // Maps the file at path for the lifetime of the archive.
+        explicit archive(const std::filesystem::path& path, size_t cache_capacity = default_cache_capacity);
+        // Borrows data, which must outlive the archive.
+        explicit archive(stdext::array_view<const std::byte> data, size_t cache_capacity = default_cache_capacity);
+        archive(const archive&) = delete;
+        archive& operator = (const archive&) = delete;
+
+    public:
+        size_t size() const noexcept { return _reader.size(); }
+        uint32_t type(size_t index) const { return _reader.entry(index).type; }
+        stdext::array_view<const std::byte> stored_data(size_t index) const { return _reader.stored_data(index); }
+        resource_view view(size_t index) const;
+
+    private:
+        std::unique_ptr<mapped_file> _file;
+        reader _reader;
+        mutable resource_cache _cache;
+    };
+}
+
+#endif
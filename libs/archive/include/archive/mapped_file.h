@@ -0,0 +1,31 @@
+#ifndef ARCHIVE_MAPPED_FILE_INCLUDED
+#define ARCHIVE_MAPPED_FILE_INCLUDED
+#pragma once
+
+#include <filesystem>
+
+#include <cstddef>
+
+
+namespace wcdx::archive
+{
+    // A read-only view of an entire file, mapped into memory.
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::filesystem::path& path);
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator = (const mapped_file&) = delete;
+        ~mapped_file();
+
+    public:
+        const std::byte* data() const noexcept { return _data; }
+        size_t size() const noexcept { return _size; }
+
+    private:
+        const std::byte* _data = nullptr;
+        size_t _size = 0;
+    };
+}
+
+#endif
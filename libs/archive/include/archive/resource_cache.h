@@ -0,0 +1,59 @@
+#ifndef ARCHIVE_RESOURCE_CACHE_INCLUDED
+#define ARCHIVE_RESOURCE_CACHE_INCLUDED
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::archive
+{
+    using resource_data = std::shared_ptr<const std::vector<std::byte>>;
+
+    // Holds recently used decompressed resources, evicting the least recently used ones once
+    // their total size exceeds the capacity.  Entries are shared, so data handed out stays
+    // valid after it is evicted.  All members may be called concurrently.
+    class resource_cache
+    {
+    public:
+        explicit resource_cache(size_t capacity) noexcept : _capacity(capacity) { }
+        resource_cache(const resource_cache&) = delete;
+        resource_cache& operator = (const resource_cache&) = delete;
+
+    public:
+        size_t capacity() const noexcept { return _capacity; }
+        size_t size() const;
+
+        // Returns the cached data for index and marks it most recently used, or returns null.
+        resource_data find(size_t index);
+        // Adds data for index and returns the cached entry.  If another thread has already
+        // added the same index, its entry is kept and returned instead.  Data larger than the
+        // whole cache is returned without being cached.
+        resource_data insert(size_t index, resource_data data);
+        void clear();
+
+    private:
+        void evict();
+
+    private:
+        struct entry
+        {
+            size_t index;
+            resource_data data;
+        };
+
+    private:
+        const size_t _capacity;
+        mutable std::mutex _mutex;
+        size_t _size = 0;
+        std::list<entry> _entries;      // most recently used first
+        std::unordered_map<size_t, std::list<entry>::iterator> _lookup;
+    };
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include <archive/archive.h>
+
+#include <lzw/lzw.h>
+
+#include <stdext/array_view.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <cstring>
+
+
+namespace wcdx::archive
+{
+    namespace
+    {
+        uint32_t read_uint32(stdext::array_view<const std::byte> data, size_t offset);
+    }
+
+    reader::reader(stdext::array_view<const std::byte> archive)
+        : _archive(archive)
+    {
+        auto file_size = read_uint32(archive, 0);
+        auto first_resource_offset = read_uint32(archive, 4) & max_resource_offset;
+        if (file_size > archive.size() || first_resource_offset < 8 || first_resource_offset > file_size)
+            throw std::runtime_error("Invalid archive header");
+
+        auto resource_count = (first_resource_offset - 4) / 4;
+        _entries.reserve(resource_count);
+        auto descriptor = read_uint32(archive, 4);
+        for (uint32_t n = 0; n < resource_count; ++n)
+        {
+            auto offset = descriptor & max_resource_offset;
+            auto type = descriptor >> 24;
+            uint32_t end = file_size;
+            if (n + 1 != resource_count)
+            {
+                descriptor = read_uint32(archive, 4 + 4 * (n + 1));
+                end = descriptor & max_resource_offset;
+            }
+
+            if (offset < first_resource_offset || end < offset || end > file_size)
+                throw std::runtime_error("Invalid offset for resource " + std::to_string(n));
+
+            _entries.push_back({ offset, end - offset, type });
+        }
+    }
+
+    const resource_entry& reader::entry(size_t index) const
+    {
+        if (index >= _entries.size())
+            throw std::range_error("Resource index " + std::to_string(index) + " out of range");
+
+        return _entries[index];
+    }
+
+    stdext::array_view<const std::byte> reader::stored_data(size_t index) const
+    {
+        auto& e = entry(index);
+        return { _archive.data() + e.offset, e.size };
+    }
+
+    size_t reader::resource_size(size_t index) const
+    {
+        auto& e = entry(index);
+        if (e.type != resource_type_compressed)
+            return e.size;
+
+        if (e.size < sizeof(uint32_t))
+            throw std::runtime_error("Compressed resource too small");
+        return read_uint32(_archive, e.offset);
+    }
+
+    void reader::extract(size_t index, stdext::array_view<std::byte> output) const
+    {
+        auto data = stored_data(index);
+        if (output.size() != resource_size(index))
+            throw std::length_error("Output buffer does not match resource size");
+
+        if (entry(index).type != resource_type_compressed)
+        {
+            // An empty resource may come with a null output buffer, which memcpy won't take.
+            if (data.size() != 0)
+                std::memcpy(output.data(), data.data(), data.size());
+            return;
+        }
+
+        auto compressed = stdext::array_view<const std::byte>(data.data() + sizeof(uint32_t), data.size() - sizeof(uint32_t));
+        if (wcdx::lzw::decompress(compressed, output) != output.size())
+            throw std::runtime_error("Resource size mismatch");
+    }
+
+    archive::archive(const std::filesystem::path& path, size_t cache_capacity)
+        : _file(std::make_unique<mapped_file>(path)), _reader({ _file->data(), _file->size() }), _cache(cache_capacity)
+    {
+    }
+
+    archive::archive(stdext::array_view<const std::byte> data, size_t cache_capacity)
+        : _reader(data), _cache(cache_capacity)
+    {
+    }
+
+    resource_view archive::view(size_t index) const
+    {
+        if (type(index) != resource_type_compressed)
+            return _reader.stored_data(index);
+
+        if (auto data = _cache.find(index))
+            return { { data->data(), data->size() }, data };
+
+        // Decompress without holding the cache lock, so readers of other resources aren't
+        // held up.  Two threads may both decompress the same resource; only one copy is kept.
+        auto data = std::make_shared<std::vector<std::byte>>(_reader.resource_size(index));
+        _reader.extract(index, { data->data(), data->size() });
+        auto cached = _cache.insert(index, std::move(data));
+        return { { cached->data(), cached->size() }, cached };
+    }
+
+    namespace
+    {
+        uint32_t read_uint32(stdext::array_view<const std::byte> data, size_t offset)
+        {
+            if (data.size() < offset + sizeof(uint32_t))
+                throw std::runtime_error("Archive truncated");
+
+            uint32_t value;
+            std::memcpy(&value, data.data() + offset, sizeof(value));
+            return value;
+        }
+    }
+}
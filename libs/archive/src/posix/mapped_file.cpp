@@ -0,0 +1,49 @@
+#include <archive/mapped_file.h>
+
+#include <stdext/scope_guard.h>
+
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace wcdx::archive
+{
+    mapped_file::mapped_file(const std::filesystem::path& path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw std::system_error(errno, std::generic_category());
+        at_scope_exit([&]{ ::close(fd); });
+
+        struct stat status;
+        if (::fstat(fd, &status) == -1)
+            throw std::system_error(errno, std::generic_category());
+        if (uint64_t(status.st_size) > SIZE_MAX)
+            throw std::length_error("File too large to map");
+
+        // Empty files can't be mapped.
+        if (status.st_size == 0)
+            return;
+
+        auto view = ::mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category());
+
+        _data = static_cast<const std::byte*>(view);
+        _size = size_t(status.st_size);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (_data != nullptr)
+            ::munmap(const_cast<std::byte*>(_data), _size);
+    }
+}
@@ -0,0 +1,61 @@
+#include <archive/resource_cache.h>
+
+
+namespace wcdx::archive
+{
+    size_t resource_cache::size() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _size;
+    }
+
+    resource_data resource_cache::find(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _lookup.find(index);
+        if (i == _lookup.end())
+            return nullptr;
+
+        _entries.splice(_entries.begin(), _entries, i->second);
+        return i->second->data;
+    }
+
+    resource_data resource_cache::insert(size_t index, resource_data data)
+    {
+        if (data->size() > _capacity)
+            return data;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _lookup.find(index);
+        if (i != _lookup.end())
+        {
+            _entries.splice(_entries.begin(), _entries, i->second);
+            return i->second->data;
+        }
+
+        _entries.push_front({ index, data });
+        _lookup.emplace(index, _entries.begin());
+        _size += data->size();
+        evict();
+        return data;
+    }
+
+    void resource_cache::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _lookup.clear();
+        _entries.clear();
+        _size = 0;
+    }
+
+    void resource_cache::evict()
+    {
+        while (_size > _capacity)
+        {
+            auto& oldest = _entries.back();
+            _size -= oldest.data->size();
+            _lookup.erase(oldest.index);
+            _entries.pop_back();
+        }
+    }
+}
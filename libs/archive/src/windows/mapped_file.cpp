@@ -0,0 +1,53 @@
+#include <archive/mapped_file.h>
+
+#include <stdext/scope_guard.h>
+
+#include <stdexcept>
+#include <system_error>
+
+#include <cstdint>
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+
+namespace wcdx::archive
+{
+    mapped_file::mapped_file(const std::filesystem::path& path)
+    {
+        auto file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::system_error(::GetLastError(), std::system_category());
+        at_scope_exit([&]{ ::CloseHandle(file); });
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file, &size))
+            throw std::system_error(::GetLastError(), std::system_category());
+        if (uint64_t(size.QuadPart) > SIZE_MAX)
+            throw std::length_error("File too large to map");
+
+        // Empty files can't be mapped.
+        if (size.QuadPart == 0)
+            return;
+
+        // The view keeps the mapping alive, so neither handle is needed once it exists.
+        auto mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            throw std::system_error(::GetLastError(), std::system_category());
+        at_scope_exit([&]{ ::CloseHandle(mapping); });
+
+        auto view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr)
+            throw std::system_error(::GetLastError(), std::system_category());
+
+        _data = static_cast<const std::byte*>(view);
+        _size = size_t(size.QuadPart);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (_data != nullptr)
+            ::UnmapViewOfFile(_data);
+    }
+}
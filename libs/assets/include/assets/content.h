@@ -0,0 +1,39 @@
+#ifndef ASSETS_CONTENT_INCLUDED
+#define ASSETS_CONTENT_INCLUDED
+#pragma once
+
+#include <string_view>
+
+#include <cstddef>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::assets
+{
+    enum class content_type
+    {
+        unknown,
+        archive,        // resources of mixed or unknown types
+        image_set,      // an archive holding only sprites
+        font_set,       // an archive holding only fonts, like fonts.fnt
+        font,
+        stream,         // STR music
+    };
+
+    // Names used in manifests.  parse_content_type returns unknown for names it doesn't know.
+    const char* content_type_name(content_type type) noexcept;
+    content_type parse_content_type(std::string_view name) noexcept;
+
+    // Works out what data holds from the checks the readers make on their headers: the
+    // "STRM" magic for streams, a descriptor table of whole words ending within the file for
+    // archives, and glyphs inside the data for fonts.  An archive is an image set or font set
+    // if every one of its resources passes the sprite or font checks, which means compressed
+    // resources are decompressed to look at them.
+    content_type identify(stdext::array_view<const std::byte> data);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef ASSETS_MANIFEST_INCLUDED
+#define ASSETS_MANIFEST_INCLUDED
+#pragma once
+
+#include "content.h"
+
+#include <patch/md5.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace wcdx::assets
+{
+    using content_hash = patch::md5_hash;
+
+    // 32 lowercase hex digits, in digest order.  parse_content_hash throws if text isn't in
+    // that form.
+    std::string to_string(const content_hash& hash);
+    content_hash parse_content_hash(std::string_view text);
+
+    struct manifest_entry
+    {
+        // The file's path under its source's name, like "wc2/GAMEDAT/FONTS.FNT", with
+        // "#<index>" added for each archive the resource is nested in.
+        std::string source;
+        content_hash hash;
+        content_type type;
+        // The directory under objects/ holding what was extracted, or empty if nothing was
+        // extracted for this entry itself (as for archives, whose resources have their own).
+        std::string object;
+    };
+
+    // What was extracted from each input, and from what content.  Saved as a text file with a
+    // header line followed by one line per entry: hash,type,object,source.  The source comes
+    // last so that it needn't be quoted.  Entries are kept sorted by source.
+    class manifest
+    {
+    public:
+        // Returns an empty manifest if there's no file at path.  Throws if it can't be read
+        // or isn't a manifest.
+        static manifest load(const std::filesystem::path& path);
+        // Writes a temporary file next to path and renames it over path, so an interrupted
+        // save leaves the previous manifest in place.
+        void save(const std::filesystem::path& path) const;
+
+    public:
+        const std::vector<manifest_entry>& entries() const noexcept { return _entries; }
+
+        // Keeps entries sorted; replaces any entry with the same source.
+        void add(manifest_entry entry);
+        void add(const std::vector<manifest_entry>& entries);
+        // The entry for source followed by every entry nested in it, or an empty list.
+        std::vector<manifest_entry> find(std::string_view source) const;
+
+    private:
+        std::vector<manifest_entry> _entries;
+    };
+}
+
+#endif
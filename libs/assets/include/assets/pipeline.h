@@ -0,0 +1,61 @@
+#ifndef ASSETS_PIPELINE_INCLUDED
+#define ASSETS_PIPELINE_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::assets
+{
+    struct pipeline_source
+    {
+        // Put in front of the paths of this source's files in the manifest, like "wc1".
+        std::string name;
+        std::filesystem::path directory;
+        // 256 RGB triples, used for the source's images and fonts.
+        stdext::array_view<const std::byte> palette;
+    };
+
+    struct pipeline_stats
+    {
+        size_t files = 0;
+        // Files whose content and outputs the manifest already covered.
+        size_t unchanged_files = 0;
+        // Manifest entries made for everything else, the files themselves included.
+        size_t resources = 0;
+        size_t objects_written = 0;
+        // Outputs found already extracted, in this run or an earlier one.
+        size_t objects_shared = 0;
+        // One message per file that couldn't be processed, in file order.  Failed files are
+        // left out of the manifest, so they're tried again next time.
+        std::vector<std::string> errors;
+    };
+
+    // Extracts everything it recognizes (see identify) from every file under each source's
+    // directory into output_directory, which ends up holding:
+    //
+    //  manifest.csv        what each file and nested resource is and where its output went
+    //  objects/<key>/      what was extracted from one piece of content:
+    //                          image sets:     <index>.png for each sprite
+    //                          fonts:          atlas.png and atlas.metrics
+    //                          streams:        a .wav file for each track
+    //                          other resources of archives: resource.bin
+    //
+    // Archives are opened and each of their resources is handled in turn, to any depth.  An
+    // object's key is the hash of its content, followed for images and fonts by part of the
+    // palette's hash, so identical content found in several places, or in several games, is
+    // extracted once.  Files whose hash matches the previous run's manifest, and whose
+    // objects are all still there, are skipped.
+    //
+    // Work is spread across jobs threads (zero selects the default); each file, nested
+    // resource, and stream track is its own task.
+    pipeline_stats run_pipeline(const std::vector<pipeline_source>& sources, const std::filesystem::path& output_directory, unsigned jobs = 0);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include <assets/content.h>
+
+#include <archive/archive.h>
+#include <image/font.h>
+#include <image/sprite.h>
+
+#include <stdext/array_view.h>
+
+#include <exception>
+#include <iterator>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace wcdx::assets
+{
+    namespace
+    {
+        constexpr const char* content_type_names[] =
+        {
+            "unknown",
+            "archive",
+            "image-set",
+            "font-set",
+            "font",
+            "stream",
+        };
+
+        bool is_archive(stdext::array_view<const std::byte> data) noexcept;
+        bool is_sprite(stdext::array_view<const std::byte> data) noexcept;
+        bool is_font(stdext::array_view<const std::byte> data) noexcept;
+        uint32_t read_uint32(const std::byte* p) noexcept;
+    }
+
+    const char* content_type_name(content_type type) noexcept
+    {
+        return content_type_names[size_t(type)];
+    }
+
+    content_type parse_content_type(std::string_view name) noexcept
+    {
+        for (size_t n = 0; n != std::size(content_type_names); ++n)
+        {
+            if (name == content_type_names[n])
+                return content_type(n);
+        }
+
+        return content_type::unknown;
+    }
+
+    content_type identify(stdext::array_view<const std::byte> data)
+    {
+        if (data.size() >= 4 && std::memcmp(data.data(), "STRM", 4) == 0)
+            return content_type::stream;
+
+        if (is_archive(data))
+        {
+            archive::archive resources(data, 0);
+            bool fonts = true;
+            bool sprites = true;
+            for (size_t n = 0; n != resources.size() && (fonts || sprites); ++n)
+            {
+                // A resource that can't be decompressed rules out both.
+                try
+                {
+                    auto resource = resources.view(n);
+                    fonts = fonts && is_font(resource);
+                    sprites = sprites && is_sprite(resource);
+                }
+                catch (const std::exception&)
+                {
+                    fonts = sprites = false;
+                }
+            }
+
+            // Fonts are checked first; their headers can pass for sprite extents.
+            return fonts ? content_type::font_set
+                : sprites ? content_type::image_set
+                : content_type::archive;
+        }
+
+        if (is_font(data))
+            return content_type::font;
+
+        return content_type::unknown;
+    }
+
+    namespace
+    {
+        bool is_archive(stdext::array_view<const std::byte> data) noexcept
+        {
+            if (data.size() < 8)
+                return false;
+
+            // The descriptor table runs from offset 4 to the first resource, one word per
+            // resource.
+            auto file_size = read_uint32(data.data());
+            auto first_offset = read_uint32(data.data() + 4) & archive::max_resource_offset;
+            if (file_size > data.size() || first_offset < 8 || first_offset % 4 != 0 || first_offset > file_size)
+                return false;
+
+            try
+            {
+                archive::reader reader(data);
+                for (size_t n = 0; n != reader.size(); ++n)
+                {
+                    auto type = reader.entry(n).type;
+                    if (type != archive::resource_type_uncompressed && type != archive::resource_type_compressed)
+                        return false;
+                }
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool is_sprite(stdext::array_view<const std::byte> data) noexcept
+        {
+            try
+            {
+                // Plenty of data has plausible extents, so the segments have to decode too.
+                // Anything past the game's screen size isn't a sprite.
+                auto header = image::read_sprite_header(data);
+                if (header.width() <= 0 || header.height() <= 0 || header.width() > 640 || header.height() > 480)
+                    return false;
+
+                std::vector<std::byte> pixels(size_t(header.width()) * size_t(header.height()));
+                image::decode_sprite(data, { pixels.data(), pixels.size() });
+                return true;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        bool is_font(stdext::array_view<const std::byte> data) noexcept
+        {
+            // The color index is a palette index, so its high byte is zero.
+            if (data.size() < image::font::header_size || data[3] != std::byte(0))
+                return false;
+
+            try
+            {
+                image::font font(data);
+                if (font.height() == 0)
+                    return false;
+
+                for (unsigned n = 0; n != image::font::glyph_count; ++n)
+                {
+                    if (font.width(n) != 0)
+                        return true;
+                }
+
+                return false;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        uint32_t read_uint32(const std::byte* p) noexcept
+        {
+            // Archives are little-endian, as are all of our targets.
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include <assets/manifest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+
+namespace wcdx::assets
+{
+    namespace
+    {
+        constexpr std::string_view manifest_header = "hash,type,object,source";
+
+        bool source_less(const manifest_entry& entry, std::string_view source) noexcept;
+        bool is_nested(std::string_view source, std::string_view parent) noexcept;
+    }
+
+    std::string to_string(const content_hash& hash)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+
+        std::string text;
+        text.reserve(32);
+        for (auto word : { hash.a, hash.b, hash.c, hash.d })
+        {
+            for (unsigned n = 0; n != 4; ++n, word >>= 8)
+            {
+                text.push_back(digits[(word >> 4) & 0xF]);
+                text.push_back(digits[word & 0xF]);
+            }
+        }
+
+        return text;
+    }
+
+    content_hash parse_content_hash(std::string_view text)
+    {
+        if (text.size() != 32)
+            throw std::runtime_error("Invalid content hash: " + std::string(text));
+
+        uint32_t words[4] = { };
+        for (size_t n = 0; n != 32; ++n)
+        {
+            auto c = text[n];
+            uint32_t digit = c >= '0' && c <= '9' ? uint32_t(c - '0')
+                : c >= 'a' && c <= 'f' ? uint32_t(c - 'a' + 10)
+                : throw std::runtime_error("Invalid content hash: " + std::string(text));
+
+            // Each byte is two digits, high first; bytes run from the low end of each word.
+            auto shift = 8 * ((n / 2) % 4) + (n % 2 == 0 ? 4 : 0);
+            words[n / 8] |= digit << shift;
+        }
+
+        return { words[0], words[1], words[2], words[3] };
+    }
+
+    manifest manifest::load(const std::filesystem::path& path)
+    {
+        manifest result;
+
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec))
+            return result;
+
+        std::ifstream in(path);
+        if (!in)
+            throw std::runtime_error("Failed to open the manifest.");
+
+        std::string line;
+        if (!std::getline(in, line) || line != manifest_header)
+            throw std::runtime_error("Not a manifest: " + path.string());
+
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+                continue;
+
+            auto hash_end = line.find(',');
+            auto type_end = hash_end == std::string::npos ? hash_end : line.find(',', hash_end + 1);
+            auto object_end = type_end == std::string::npos ? type_end : line.find(',', type_end + 1);
+            if (object_end == std::string::npos)
+                throw std::runtime_error("Malformed manifest line: " + line);
+
+            std::string_view text(line);
+            manifest_entry entry;
+            entry.hash = parse_content_hash(text.substr(0, hash_end));
+            entry.type = parse_content_type(text.substr(hash_end + 1, type_end - hash_end - 1));
+            entry.object = text.substr(type_end + 1, object_end - type_end - 1);
+            entry.source = text.substr(object_end + 1);
+            result.add(std::move(entry));
+        }
+
+        if (in.bad())
+            throw std::runtime_error("Failed to read the manifest.");
+
+        return result;
+    }
+
+    void manifest::save(const std::filesystem::path& path) const
+    {
+        auto temp_path = path;
+        temp_path += ".tmp";
+
+        {
+            std::ofstream out(temp_path);
+            out << manifest_header << '\n';
+            for (auto& entry : _entries)
+                out << to_string(entry.hash) << ',' << content_type_name(entry.type) << ',' << entry.object << ',' << entry.source << '\n';
+
+            out.close();
+            if (!out)
+                throw std::runtime_error("Failed to write the manifest.");
+        }
+
+        std::filesystem::rename(temp_path, path);
+    }
+
+    void manifest::add(manifest_entry entry)
+    {
+        auto i = std::lower_bound(_entries.begin(), _entries.end(), entry.source, source_less);
+        if (i != _entries.end() && i->source == entry.source)
+            *i = std::move(entry);
+        else
+            _entries.insert(i, std::move(entry));
+    }
+
+    void manifest::add(const std::vector<manifest_entry>& entries)
+    {
+        // Large batches are cheaper to merge in one go than to insert one at a time.
+        _entries.insert(_entries.end(), entries.begin(), entries.end());
+        std::stable_sort(_entries.begin(), _entries.end(), [](const manifest_entry& a, const manifest_entry& b)
+        {
+            return a.source < b.source;
+        });
+
+        // The sort keeps entries for the same source in the order they were added, and the
+        // last one wins.
+        auto out = _entries.begin();
+        for (auto i = _entries.begin(); i != _entries.end(); ++i)
+        {
+            if (i + 1 != _entries.end() && (i + 1)->source == i->source)
+                continue;
+            if (out != i)
+                *out = std::move(*i);
+            ++out;
+        }
+        _entries.erase(out, _entries.end());
+    }
+
+    std::vector<manifest_entry> manifest::find(std::string_view source) const
+    {
+        auto i = std::lower_bound(_entries.begin(), _entries.end(), source, source_less);
+        if (i == _entries.end() || i->source != source)
+            return { };
+
+        // Sources sorting between this one and its nested entries (like "a b" between "a"
+        // and "a#0") are skipped over.
+        std::vector<manifest_entry> entries(1, *i);
+        auto nested = std::string(source) + '#';
+        for (i = std::lower_bound(i, _entries.end(), nested, source_less); i != _entries.end() && is_nested(i->source, source); ++i)
+            entries.push_back(*i);
+
+        return entries;
+    }
+
+    namespace
+    {
+        bool source_less(const manifest_entry& entry, std::string_view source) noexcept
+        {
+            return entry.source < source;
+        }
+
+        bool is_nested(std::string_view source, std::string_view parent) noexcept
+        {
+            return source.size() > parent.size() && source.compare(0, parent.size(), parent) == 0 && source[parent.size()] == '#';
+        }
+    }
+}
@@ -0,0 +1,591 @@
+#include <assets/pipeline.h>
+#include <assets/content.h>
+#include <assets/manifest.h>
+
+#include <archive/archive.h>
+#include <audio/wave.h>
+#include <audio/wcaudio_stream.h>
+#include <image/font.h>
+#include <image/png.h>
+#include <image/sprite.h>
+#include <parallel/work_pool.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+
+namespace wcdx::assets
+{
+    namespace
+    {
+        constexpr std::string_view manifest_name = "manifest.csv";
+        constexpr std::string_view objects_name = "objects";
+        constexpr std::string_view partial_suffix = ".partial";
+
+        // Keeps whatever a piece of content points into alive while tasks are working on it.
+        using data_owner = std::shared_ptr<const void>;
+
+        // Writes through the standard library, which takes paths on every platform.
+        class file_output : public stdext::output_stream, public stdext::seekable
+        {
+        public:
+            explicit file_output(const std::filesystem::path& path);
+
+        public:
+            // Throws if anything failed to make it to the file.
+            void close();
+
+        protected:
+            size_t do_write(const std::byte* buffer, size_t size) override;
+            stdext::stream_position do_position() const override;
+            void do_set_position(stdext::stream_position position) override;
+            stdext::stream_position do_seek(stdext::seek_from from, stdext::stream_offset offset) override;
+            stdext::stream_position do_end_position() const override;
+
+        private:
+            mutable std::ofstream _file;
+            std::filesystem::path _path;
+        };
+
+        // One input file, along with everything found in it.  Its entries only make it into
+        // the manifest if nothing in it failed.
+        struct file_job
+        {
+            const pipeline_source* source;
+            std::filesystem::path path;
+            std::string name;
+            std::string palette_tag;
+
+            std::mutex mutex;
+            std::vector<manifest_entry> entries;
+            std::string error;
+            std::atomic<bool> failed = false;
+            bool unchanged = false;
+
+            void add(manifest_entry entry);
+            void fail(const std::string& message);
+        };
+
+        // A stream's tracks are written by separate tasks into one object; the last to finish
+        // completes it.
+        struct stream_object
+        {
+            data_owner owner;
+            stdext::array_view<const std::byte> data;
+            std::shared_ptr<const audio::wcaudio_file> file;
+            std::string key;
+            std::atomic<size_t> remaining;
+        };
+
+        class pipeline_run
+        {
+        public:
+            pipeline_run(const std::filesystem::path& output_directory, manifest previous, unsigned jobs);
+
+        public:
+            void submit(file_job& job);
+            void wait() { _pool.wait(); }
+
+            size_t unchanged_files() const noexcept { return _unchanged_files; }
+            size_t objects_written() const noexcept { return _objects_written; }
+            size_t objects_shared() const noexcept { return _objects_shared; }
+
+        private:
+            void process_file(file_job& job, unsigned thread);
+            void process_content(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const content_hash& hash, const std::string& source, unsigned thread);
+            void submit_resources(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const std::string& source);
+            void submit_tracks(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const std::string& key);
+            void write_track(stream_object& object, audio::track_selection track);
+
+            // Returns true if the caller should write the object, or false if it's already
+            // been written or claimed by another task.
+            bool claim(const std::string& key);
+            std::filesystem::path begin_object(const std::string& key);
+            void finish_object(const std::string& key);
+            bool objects_exist(const std::vector<manifest_entry>& entries) const;
+
+            void write_image_set(stdext::array_view<const std::byte> data, const std::filesystem::path& directory, image::png_encoder& encoder);
+            void write_font(stdext::array_view<const std::byte> data, const std::filesystem::path& directory, image::png_encoder& encoder);
+            image::png_encoder& encoder(unsigned thread, stdext::array_view<const std::byte> palette);
+
+            template <class Function>
+            void guarded(file_job& job, Function&& function);
+
+        private:
+            std::filesystem::path _objects_directory;
+            manifest _previous;
+
+            std::mutex _mutex;
+            std::set<std::string> _claimed;
+            std::atomic<size_t> _unchanged_files;
+            std::atomic<size_t> _objects_written;
+            std::atomic<size_t> _objects_shared;
+
+            // Encoders are per thread and per palette, and created on first use.
+            std::vector<std::map<const std::byte*, std::unique_ptr<image::png_encoder>>> _encoders;
+
+            // Declared last so that its threads are gone before anything they use.
+            parallel::work_pool _pool;
+        };
+
+        std::vector<std::filesystem::path> list_files(const std::filesystem::path& directory, const std::filesystem::path& output_directory);
+        std::string top_level_name(std::string_view source);
+        bool is_palette_dependent(content_type type) noexcept;
+        content_hash hash_content(stdext::array_view<const std::byte> data);
+    }
+
+    pipeline_stats run_pipeline(const std::vector<pipeline_source>& sources, const std::filesystem::path& output_directory, unsigned jobs)
+    {
+        std::filesystem::create_directories(output_directory / objects_name);
+        auto manifest_path = output_directory / manifest_name;
+        auto previous = manifest::load(manifest_path);
+
+        std::vector<std::unique_ptr<file_job>> file_jobs;
+        std::set<std::string> source_names;
+        for (auto& source : sources)
+        {
+            if (!source_names.insert(source.name).second)
+                throw std::runtime_error("Source name used more than once: " + source.name);
+            if (source.palette.size() != 3 * 256)
+                throw std::runtime_error("Invalid palette for source " + source.name);
+
+            auto palette_tag = to_string(hash_content(source.palette)).substr(0, 8);
+            for (auto& path : list_files(source.directory, output_directory))
+            {
+                auto job = std::make_unique<file_job>();
+                job->source = &source;
+                job->path = path;
+                job->name = source.name + '/' + std::filesystem::relative(path, source.directory).generic_string();
+                job->palette_tag = palette_tag;
+                file_jobs.push_back(std::move(job));
+            }
+        }
+
+        // Entries from sources not included in this run are kept as they were.
+        manifest current;
+        {
+            std::vector<manifest_entry> kept;
+            for (auto& entry : previous.entries())
+            {
+                if (source_names.count(top_level_name(entry.source)) == 0)
+                    kept.push_back(entry);
+            }
+            current.add(kept);
+        }
+
+        pipeline_stats stats;
+        stats.files = file_jobs.size();
+        {
+            pipeline_run run(output_directory, std::move(previous), jobs);
+            for (auto& job : file_jobs)
+                run.submit(*job);
+            run.wait();
+
+            stats.unchanged_files = run.unchanged_files();
+            stats.objects_written = run.objects_written();
+            stats.objects_shared = run.objects_shared();
+        }
+
+        std::vector<manifest_entry> entries;
+        for (auto& job : file_jobs)
+        {
+            if (job->failed)
+            {
+                stats.errors.push_back(job->name + ": " + job->error);
+                continue;
+            }
+
+            if (!job->unchanged)
+                stats.resources += job->entries.size();
+            entries.insert(entries.end(), job->entries.begin(), job->entries.end());
+        }
+
+        current.add(entries);
+        current.save(manifest_path);
+        return stats;
+    }
+
+    namespace
+    {
+        file_output::file_output(const std::filesystem::path& path)
+            : _file(path, std::ios::binary | std::ios::trunc), _path(path)
+        {
+            if (!_file)
+                throw std::runtime_error("Failed to create " + path.string());
+        }
+
+        void file_output::close()
+        {
+            _file.close();
+            if (!_file)
+                throw std::runtime_error("Failed to write " + _path.string());
+        }
+
+        size_t file_output::do_write(const std::byte* buffer, size_t size)
+        {
+            _file.write(reinterpret_cast<const char*>(buffer), std::streamsize(size));
+            return _file ? size : 0;
+        }
+
+        stdext::stream_position file_output::do_position() const
+        {
+            return stdext::stream_position(_file.tellp());
+        }
+
+        void file_output::do_set_position(stdext::stream_position position)
+        {
+            _file.seekp(std::streamoff(position));
+        }
+
+        stdext::stream_position file_output::do_seek(stdext::seek_from from, stdext::stream_offset offset)
+        {
+            auto direction = from == stdext::seek_from::begin ? std::ios::beg
+                : from == stdext::seek_from::current ? std::ios::cur
+                : std::ios::end;
+            _file.seekp(std::streamoff(offset), direction);
+            return do_position();
+        }
+
+        stdext::stream_position file_output::do_end_position() const
+        {
+            auto position = _file.tellp();
+            _file.seekp(0, std::ios::end);
+            auto end = _file.tellp();
+            _file.seekp(position);
+            return stdext::stream_position(end);
+        }
+
+        void file_job::add(manifest_entry entry)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.push_back(std::move(entry));
+        }
+
+        void file_job::fail(const std::string& message)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failed)
+            {
+                error = message;
+                failed = true;
+            }
+        }
+
+        pipeline_run::pipeline_run(const std::filesystem::path& output_directory, manifest previous, unsigned jobs)
+            : _objects_directory(output_directory / objects_name), _previous(std::move(previous)),
+            _unchanged_files(0), _objects_written(0), _objects_shared(0), _pool(jobs)
+        {
+            _encoders.resize(_pool.size());
+        }
+
+        void pipeline_run::submit(file_job& job)
+        {
+            _pool.submit([this, &job](unsigned thread)
+            {
+                guarded(job, [&] { process_file(job, thread); });
+            });
+        }
+
+        void pipeline_run::process_file(file_job& job, unsigned thread)
+        {
+            auto file = std::make_shared<archive::mapped_file>(job.path);
+            stdext::array_view<const std::byte> data(file->data(), file->size());
+            auto hash = hash_content(data);
+
+            // Unchanged content is skipped as long as what was extracted from it is still
+            // there to be found.
+            auto previous = _previous.find(job.name);
+            if (!previous.empty() && previous.front().hash == hash && objects_exist(previous))
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.entries = std::move(previous);
+                job.unchanged = true;
+                ++_unchanged_files;
+                return;
+            }
+
+            process_content(job, std::move(file), data, hash, job.name, thread);
+        }
+
+        void pipeline_run::process_content(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const content_hash& hash, const std::string& source, unsigned thread)
+        {
+            auto type = identify(data);
+
+            // Files that aren't game data of any sort we know of are noted, but not copied.
+            std::string key;
+            auto nested = source.find('#') != std::string::npos;
+            if (type != content_type::archive && type != content_type::font_set && (type != content_type::unknown || nested))
+            {
+                key = to_string(hash);
+                if (is_palette_dependent(type))
+                    key += '-' + job.palette_tag;
+            }
+
+            job.add({ source, hash, type, key });
+
+            switch (type)
+            {
+            case content_type::archive:
+            case content_type::font_set:
+                submit_resources(job, std::move(owner), data, source);
+                break;
+
+            case content_type::image_set:
+                if (claim(key))
+                {
+                    write_image_set(data, begin_object(key), encoder(thread, job.source->palette));
+                    finish_object(key);
+                }
+                break;
+
+            case content_type::font:
+                if (claim(key))
+                {
+                    write_font(data, begin_object(key), encoder(thread, job.source->palette));
+                    finish_object(key);
+                }
+                break;
+
+            case content_type::stream:
+                if (claim(key))
+                    submit_tracks(job, std::move(owner), data, key);
+                break;
+
+            case content_type::unknown:
+                if (!key.empty() && claim(key))
+                {
+                    file_output out(begin_object(key) / "resource.bin");
+                    out.write_all(data.data(), data.size());
+                    out.close();
+                    finish_object(key);
+                }
+                break;
+            }
+        }
+
+        void pipeline_run::submit_resources(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const std::string& source)
+        {
+            // Compressed resources are decompressed by whichever task handles them, and each is
+            // only viewed once, so there's nothing for a cache to do.
+            auto resources = std::make_shared<const archive::archive>(data, 0);
+            for (size_t n = 0; n != resources->size(); ++n)
+            {
+                _pool.submit([this, &job, owner, resources, n, source](unsigned thread)
+                {
+                    if (job.failed)
+                        return;
+
+                    guarded(job, [&]
+                    {
+                        struct resource_data
+                        {
+                            data_owner archive_owner;
+                            std::shared_ptr<const archive::archive> resources;
+                            archive::resource_view view;
+                        };
+
+                        auto resource = std::make_shared<resource_data>(resource_data{ owner, resources, resources->view(n) });
+                        stdext::array_view<const std::byte> view = resource->view;
+                        process_content(job, std::move(resource), view, hash_content(view), source + '#' + std::to_string(n), thread);
+                    });
+                });
+            }
+        }
+
+        void pipeline_run::submit_tracks(file_job& job, data_owner owner, stdext::array_view<const std::byte> data, const std::string& key)
+        {
+            // The stream's tables are loaded once and shared by every track, as in wcjukebox's
+            // batch mode; each track reads the samples through its own stream.
+            std::shared_ptr<const audio::wcaudio_file> file;
+            {
+                stdext::memory_input_stream in(data.data(), data.size());
+                file = std::make_shared<const audio::wcaudio_file>(in);
+            }
+
+            auto tracks = audio::track_selections(*file);
+            auto object = std::make_shared<stream_object>();
+            object->owner = std::move(owner);
+            object->data = data;
+            object->file = std::move(file);
+            object->key = key;
+            object->remaining = tracks.size();
+
+            begin_object(key);
+            for (auto track : tracks)
+            {
+                _pool.submit([this, &job, object, track](unsigned)
+                {
+                    if (!job.failed)
+                        guarded(job, [&] { write_track(*object, track); });
+
+                    if (--object->remaining == 0 && !job.failed)
+                        guarded(job, [&] { finish_object(object->key); });
+                });
+            }
+        }
+
+        void pipeline_run::write_track(stream_object& object, audio::track_selection track)
+        {
+            stdext::memory_input_stream in(object.data.data(), object.data.size());
+            audio::wcaudio_stream stream(object.file, in);
+
+            // Each track is played through once.
+            audio::set_batch_handlers(stream, 0);
+            stream.select(track.trigger, track.intensity);
+
+            auto name = (track.trigger == audio::no_trigger ? std::string("untriggered") : "trigger" + std::to_string(track.trigger))
+                + "-intensity" + std::to_string(track.intensity) + ".wav";
+            auto path = _objects_directory / (object.key + std::string(partial_suffix)) / name;
+
+            file_output out(path);
+            audio::write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+            out.close();
+        }
+
+        bool pipeline_run::claim(const std::string& key)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_claimed.insert(key).second)
+                {
+                    ++_objects_shared;
+                    return false;
+                }
+            }
+
+            std::error_code ec;
+            if (std::filesystem::is_directory(_objects_directory / key, ec))
+            {
+                ++_objects_shared;
+                return false;
+            }
+
+            return true;
+        }
+
+        // Objects are written under a temporary name and renamed once complete, so a run
+        // that's interrupted never leaves a partial object where it would be mistaken for a
+        // finished one.
+        std::filesystem::path pipeline_run::begin_object(const std::string& key)
+        {
+            auto path = _objects_directory / (key + std::string(partial_suffix));
+            std::filesystem::remove_all(path);
+            std::filesystem::create_directory(path);
+            return path;
+        }
+
+        void pipeline_run::finish_object(const std::string& key)
+        {
+            std::filesystem::rename(_objects_directory / (key + std::string(partial_suffix)), _objects_directory / key);
+            ++_objects_written;
+        }
+
+        bool pipeline_run::objects_exist(const std::vector<manifest_entry>& entries) const
+        {
+            std::error_code ec;
+            return std::all_of(entries.begin(), entries.end(), [&](const manifest_entry& entry)
+            {
+                return entry.object.empty() || std::filesystem::is_directory(_objects_directory / entry.object, ec);
+            });
+        }
+
+        void pipeline_run::write_image_set(stdext::array_view<const std::byte> data, const std::filesystem::path& directory, image::png_encoder& encoder)
+        {
+            archive::archive images(data, 0);
+            std::vector<std::byte> pixels;
+            for (size_t n = 0; n != images.size(); ++n)
+            {
+                auto sprite = images.view(n);
+                auto header = image::read_sprite_header(sprite);
+                auto width = unsigned(header.width());
+                auto height = unsigned(header.height());
+                pixels.resize(size_t(width) * height);
+                image::decode_sprite(sprite, { pixels.data(), pixels.size() });
+
+                file_output out(directory / (std::to_string(n) + ".png"));
+                encoder.encode({ width, height }, { pixels.data(), pixels.size() }, out);
+                out.close();
+            }
+        }
+
+        void pipeline_run::write_font(stdext::array_view<const std::byte> data, const std::filesystem::path& directory, image::png_encoder& encoder)
+        {
+            auto atlas = image::pack_atlas(image::font(data));
+            {
+                file_output out(directory / "atlas.png");
+                encoder.encode({ atlas.width, atlas.height }, { atlas.pixels.data(), atlas.pixels.size() }, out);
+                out.close();
+            }
+
+            auto metrics = image::atlas_metrics(atlas);
+            file_output out(directory / "atlas.metrics");
+            out.write_all(metrics.data(), metrics.size());
+            out.close();
+        }
+
+        image::png_encoder& pipeline_run::encoder(unsigned thread, stdext::array_view<const std::byte> palette)
+        {
+            auto& encoder = _encoders[thread][palette.data()];
+            if (encoder == nullptr)
+                encoder = std::make_unique<image::png_encoder>(palette);
+            return *encoder;
+        }
+
+        // Failures are confined to the file they happened in; the rest of the run goes on.
+        template <class Function>
+        void pipeline_run::guarded(file_job& job, Function&& function)
+        {
+            try
+            {
+                function();
+            }
+            catch (const std::exception& e)
+            {
+                job.fail(e.what());
+            }
+        }
+
+        std::vector<std::filesystem::path> list_files(const std::filesystem::path& directory, const std::filesystem::path& output_directory)
+        {
+            std::vector<std::filesystem::path> files;
+            for (auto i = std::filesystem::recursive_directory_iterator(directory); i != std::filesystem::recursive_directory_iterator(); ++i)
+            {
+                std::error_code ec;
+                if (i->is_directory() && std::filesystem::equivalent(i->path(), output_directory, ec))
+                    i.disable_recursion_pending();
+                else if (i->is_regular_file())
+                    files.push_back(i->path());
+            }
+
+            // Directory order varies from one file system to the next.
+            std::sort(files.begin(), files.end());
+            return files;
+        }
+
+        std::string top_level_name(std::string_view source)
+        {
+            return std::string(source.substr(0, source.find('/')));
+        }
+
+        bool is_palette_dependent(content_type type) noexcept
+        {
+            return type == content_type::image_set || type == content_type::font;
+        }
+
+        content_hash hash_content(stdext::array_view<const std::byte> data)
+        {
+            return content_hash(data.data(), data.size());
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef AUDIO_PCM_RING_INCLUDED
+#define AUDIO_PCM_RING_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <cstddef>
+
+
+namespace wcdx::audio
+{
+    // A ring of PCM bytes passed from one thread that decodes them to one that plays them.
+    // The ring has one producer and one consumer, and neither ever takes a lock: only the
+    // producer advances _head and only the consumer advances _tail.  Neither side blocks
+    // either; a full or empty ring just moves fewer bytes, and it's up to the caller to
+    // decide whether to wait.
+    class pcm_ring
+    {
+    public:
+        // capacity is rounded up to a power of two.
+        explicit pcm_ring(size_t capacity);
+        pcm_ring(const pcm_ring&) = delete;
+        pcm_ring& operator = (const pcm_ring&) = delete;
+
+    public:
+        size_t capacity() const noexcept { return _mask + 1; }
+        // The number of bytes waiting to be read.  Exact on the consumer's thread; on the
+        // producer's, the consumer may have read more since.
+        size_t size() const noexcept;
+
+        // Producer: copies as much of data as there's room for and returns the number of
+        // bytes copied.
+        size_t write(const std::byte* data, size_t size) noexcept;
+        // Producer: marks the end of the data.  Nothing can be written afterward.
+        void close() noexcept;
+
+        // Consumer: copies up to size bytes out of the ring and returns the number copied.
+        size_t read(std::byte* buffer, size_t size) noexcept;
+        // Consumer: true once the producer has closed the ring.  Everything it wrote before
+        // closing is visible to size() and read() by then.
+        bool closed() const noexcept { return _closed.load(std::memory_order_acquire); }
+
+    private:
+        std::unique_ptr<std::byte[]> _data;
+        size_t _mask;
+
+        // Both count bytes since the ring was created, so _head - _tail is the fill level
+        // even after they wrap.
+        std::atomic<size_t> _head;
+        std::atomic<size_t> _tail;
+        std::atomic<bool> _closed;
+    };
+}
+
+#endif
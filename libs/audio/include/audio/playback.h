@@ -0,0 +1,102 @@
+#ifndef AUDIO_PLAYBACK_INCLUDED
+#define AUDIO_PLAYBACK_INCLUDED
+#pragma once
+
+#include <chrono>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    class input_stream;
+    class output_stream;
+}
+
+namespace wcdx::audio
+{
+    // Where played samples go.  The sink takes samples a period at a time, at its own pace.
+    class pcm_sink
+    {
+    public:
+        virtual ~pcm_sink();
+
+    public:
+        // The number of bytes taken by each call to write.
+        virtual size_t period_size() const = 0;
+        // Whether the sink plays at a fixed rate, like a sound device.  A real-time sink
+        // can't be kept waiting, so a period that isn't ready in time is played as silence.
+        virtual bool realtime() const = 0;
+
+        // Blocks until the sink is ready for another period, then takes size bytes.  size
+        // is period_size() for every period but the last, which may be shorter.
+        virtual void write(const std::byte* data, size_t size) = 0;
+        // Blocks until everything written has been played.
+        virtual void drain() = 0;
+    };
+
+    // Discards samples.  If period_duration isn't zero, the sink is real-time and takes a
+    // period every period_duration; otherwise it takes them as fast as they come.
+    class null_sink : public pcm_sink
+    {
+    public:
+        explicit null_sink(size_t period_size, std::chrono::microseconds period_duration = { });
+
+    public:
+        size_t period_size() const override { return _period_size; }
+        bool realtime() const override { return _period_duration.count() != 0; }
+        void write(const std::byte* data, size_t size) override;
+        void drain() override { }
+
+        uint64_t bytes_played() const noexcept { return _bytes_played; }
+
+    private:
+        size_t _period_size;
+        std::chrono::microseconds _period_duration;
+        std::chrono::steady_clock::time_point _next_period;
+        uint64_t _bytes_played = 0;
+    };
+
+    // Writes samples to a stream, as fast as they come.  The stream must outlive the sink.
+    class stream_sink : public pcm_sink
+    {
+    public:
+        stream_sink(stdext::output_stream& out, size_t period_size) noexcept;
+
+    public:
+        size_t period_size() const override { return _period_size; }
+        bool realtime() const override { return false; }
+        void write(const std::byte* data, size_t size) override;
+        void drain() override { }
+
+    private:
+        stdext::output_stream* _out;
+        size_t _period_size;
+    };
+
+    struct playback_stats
+    {
+        size_t ring_capacity = 0;
+        // Periods given to the sink, and how many of those the ring couldn't fill in time
+        // before the end of the stream.
+        uint64_t periods = 0;
+        uint64_t underruns = 0;
+        // Bytes waiting in the ring each time the sink was ready for a period, up to the
+        // end of the stream.
+        size_t min_fill = 0;
+        uint64_t total_fill = 0;
+        uint64_t fill_samples = 0;
+
+        size_t average_fill() const noexcept { return fill_samples != 0 ? size_t(total_fill / fill_samples) : 0; }
+    };
+
+    // Plays everything that can be read from in through sink.  A decoder thread reads ahead
+    // from in into a ring of ring_size bytes while the calling thread feeds the sink from
+    // it, so a slow read or handler only drains the ring for a while instead of holding up
+    // the sink.  Anything in's reads call, such as wcaudio_stream's handlers, runs on the
+    // decoder thread.  Rethrows the first error from either thread once both have stopped.
+    playback_stats play_stream(stdext::input_stream& in, pcm_sink& sink, size_t ring_size);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef AUDIO_REPACK_INCLUDED
+#define AUDIO_REPACK_INCLUDED
+#pragma once
+
+#include <audio/wave.h>
+#include <audio/wcaudio_stream.h>
+
+#include <stdext/multi.h>
+#include <stdext/stream.h>
+
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::audio
+{
+    using seekable_input_stream_ref = stdext::multi_ref<stdext::input_stream, stdext::seekable>;
+
+    // Writes a copy of the STR file in in to out with the sample data moved so that the
+    // chunks of each track are stored in the order they're played, and returns the number of
+    // chunks whose data moved.  file must have been loaded from in.  Chunk indices and the
+    // link tables are unchanged; only the chunk headers' offsets are rewritten.  Chunks
+    // whose data overlaps are kept together, and bytes among the sample data that no chunk
+    // uses are kept, after the data of every chunk.
+    size_t repack_stream(const wcaudio_file& file, seekable_input_stream_ref in, seekable_output_stream_ref out);
+
+    // Plays every track in two STR files side by side, with each allowed to loop the given
+    // number of times, and returns the ones whose samples or transitions differ.  Both files
+    // must have the same triggers and intensities.
+    std::vector<track_selection> compare_streams(std::shared_ptr<const wcaudio_file> file1, seekable_input_stream_ref in1,
+        std::shared_ptr<const wcaudio_file> file2, seekable_input_stream_ref in2, unsigned loops);
+}
+
+#endif
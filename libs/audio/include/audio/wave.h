@@ -0,0 +1,21 @@
+#ifndef AUDIO_WAVE_INCLUDED
+#define AUDIO_WAVE_INCLUDED
+#pragma once
+
+#include <stdext/multi.h>
+#include <stdext/stream.h>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::audio
+{
+    using seekable_output_stream_ref = stdext::multi_ref<stdext::output_stream, stdext::seekable>;
+
+    // Writes everything that can be read from in to out as a PCM WAVE file, and returns the
+    // number of bytes of sample data written.
+    size_t write_wave(seekable_output_stream_ref out, stdext::input_stream& in, uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t buffer_size);
+}
+
+#endif
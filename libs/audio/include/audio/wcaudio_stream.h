@@ -0,0 +1,319 @@
+#ifndef AUDIO_WCAUDIO_STREAM_INCLUDED
+#define AUDIO_WCAUDIO_STREAM_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/multi.h>
+#include <stdext/stream.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::audio
+{
+    constexpr auto end_of_track = uint32_t(-1);
+    constexpr auto no_trigger = uint8_t(-1);
+
+    struct chunk_header;
+    struct stream_chunk_link;
+    struct stream_trigger_link;
+    class wcaudio_stream;
+
+    struct stream_file_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint8_t channels;
+        uint8_t bits_per_sample;
+        uint16_t sample_rate;
+        uint32_t buffer_size;
+        uint32_t reserved1;
+        uint32_t chunk_headers_offset;
+        uint32_t chunk_count;
+        uint32_t chunk_link_offset;
+        uint32_t chunk_link_count;
+        uint32_t trigger_link_offset;
+        uint32_t trigger_link_count;
+        uint32_t file_buffer_size;
+        uint32_t file_entry_offset;
+        uint32_t file_entry_count;
+        uint32_t thing5_offset;
+        uint32_t thing5_count;
+        uint32_t thing6_offset;
+        uint32_t thing6_count;
+        uint8_t reserved2[32];
+    };
+
+    // The tables of an STR file: its header, its chunks and their links, and where playback
+    // goes at the end of each chunk, worked out for every chunk when the file is loaded so
+    // that moving on to the next chunk doesn't search its links.  A loaded file is never
+    // modified, so any number of streams on any number of threads can share one.
+    class wcaudio_file
+    {
+    public:
+        explicit wcaudio_file(stdext::multi_ref<stdext::input_stream, stdext::seekable> stream);
+        wcaudio_file(const wcaudio_file&) = delete;
+        wcaudio_file& operator = (const wcaudio_file&) = delete;
+        ~wcaudio_file();
+
+    public:
+        uint8_t channels() const;
+        uint8_t bits_per_sample() const;
+        uint16_t sample_rate() const;
+        uint32_t buffer_size() const;
+
+        std::vector<uint8_t> triggers() const;
+        std::vector<uint8_t> intensities() const;
+
+    private:
+        friend class wcaudio_stream;
+        friend class stream_repacker;
+        struct chunk_transition;
+
+    private:
+        chunk_transition link_transition(uint32_t chunk_index, uint8_t trigger) const;
+        unsigned frame_size() const;
+        unsigned chunk_frames(const chunk_header& chunk) const;
+
+    private:
+        stream_file_header _file_header;
+
+        std::vector<chunk_header> _chunks;
+        std::vector<stream_chunk_link> _chunk_links;
+        std::vector<stream_trigger_link> _trigger_links;
+
+        // Where each chunk goes when no trigger is pending, and for chunks that pick the
+        // next one by intensity, 256 entries of _nearest_chunks giving the closest link for
+        // each intensity.
+        std::vector<chunk_transition> _transitions;
+        std::vector<uint32_t> _nearest_chunks;
+    };
+
+    // A trigger and intensity to pass to wcaudio_stream::select.
+    struct track_selection
+    {
+        uint8_t trigger;
+        uint8_t intensity;
+    };
+
+    // Returns every way of starting playback of the file: each of its intensities with no
+    // trigger, and then each of its triggers at each intensity.  A file with no intensities
+    // is taken to have just intensity 0.
+    std::vector<track_selection> track_selections(const wcaudio_file& file);
+
+    // Handlers called by set_batch_handlers before it decides whether playback goes on.
+    struct batch_observers
+    {
+        std::function<void (uint32_t chunk_index, unsigned frame_count)> loop;
+        std::function<void (uint32_t chunk_index)> start_track;
+        std::function<void (uint32_t chunk_index, unsigned frame_count)> next_track;
+    };
+
+    // Sets up a stream to play each selection through to an end, as when every track is
+    // written to a file of its own.  Loops are followed loops times.  Playback moves on to
+    // other tracks only if next_tracks is set, and never to one that has already played, so
+    // tracks that lead into one another don't play forever; running off the end of the file
+    // back to chunk 0 always stops.  Call before each select.
+    void set_batch_handlers(wcaudio_stream& stream, unsigned loops, bool next_tracks = true, batch_observers observers = { });
+
+    // Plays back the music in an STR file as a stream of PCM samples.  Sample data is
+    // fetched through a read-ahead window of up to read_ahead_size bytes of the current
+    // chunk, so the underlying stream sees a few large sequential reads rather than one seek
+    // and read for every call.  The stream must not be read or moved by anything else while
+    // it's in use.
+    class wcaudio_stream : public stdext::input_stream
+    {
+    public:
+        using next_chunk_handler = std::function<void (uint32_t chunk_index, unsigned frame_count)>;
+        using loop_handler = std::function<bool (uint32_t chunk_index, unsigned frame_count)>;
+        using start_track_handler = std::function<void (uint32_t chunk_index)>;
+        using next_track_handler = std::function<bool (uint32_t chunk_index, unsigned frame_count)>;
+        using prev_track_handler = std::function<void (unsigned frame_count)>;
+        using end_of_stream_handler = std::function<void (unsigned frame_count)>;
+
+        static constexpr size_t default_read_ahead_size = 0x40000;
+
+    public:
+        // Loads the file's tables from the stream and plays from it.
+        explicit wcaudio_stream(stdext::multi_ref<stdext::input_stream, stdext::seekable> stream, size_t read_ahead_size = default_read_ahead_size);
+        // Plays a file that's already been loaded, reading samples from the stream, which
+        // must hold the same file.
+        wcaudio_stream(std::shared_ptr<const wcaudio_file> file, stdext::multi_ref<stdext::input_stream, stdext::seekable> stream, size_t read_ahead_size = default_read_ahead_size);
+        ~wcaudio_stream() override;
+
+    public:
+        const std::shared_ptr<const wcaudio_file>& file() const noexcept { return _file; }
+
+        uint8_t channels() const;
+        uint8_t bits_per_sample() const;
+        uint16_t sample_rate() const;
+        uint32_t buffer_size() const;
+
+        std::vector<uint8_t> triggers() const;
+        std::vector<uint8_t> intensities() const;
+
+        void select(uint8_t trigger, uint8_t intensity);
+
+        // The number of frames in the selected track, played straight through to where it
+        // loops back or ends, or 0 if no track is selected.
+        unsigned frame_count() const;
+        // Moves playback to the given frame of the selected track, from 0 up to and
+        // including frame_count().  No handlers are called for the chunks passed over.
+        void seek_to_frame(unsigned frame);
+        // The frame the given chunk starts at, counting from the start of the track now
+        // playing, as for the chunk a loop handler is told playback is looping back to.
+        // Throws std::range_error if the chunk isn't part of the track.
+        unsigned chunk_frame(uint32_t chunk_index);
+
+        void on_next_chunk(next_chunk_handler handler);
+        void on_loop(loop_handler handler);
+        void on_start_track(start_track_handler handler);
+        void on_next_track(next_track_handler handler);
+        void on_prev_track(prev_track_handler handler);
+        void on_end_of_stream(end_of_stream_handler handler);
+
+    private:
+        // The chunks a track plays through, and the frame each one starts at, followed by
+        // the frame the track ends at.
+        struct track_index
+        {
+            std::vector<uint32_t> chunks;
+            std::vector<unsigned> frame_offsets;
+        };
+
+    private:
+        size_t do_read(std::byte* buffer, size_t size) override;
+        size_t do_skip(size_t size) override;
+
+        uint32_t next_chunk_index(const wcaudio_file::chunk_transition& transition, uint8_t intensity);
+        bool fill_read_ahead(uint32_t offset, uint32_t end_offset);
+        const track_index& index_track(uint32_t chunk_index, uint8_t intensity);
+
+    private:
+        std::shared_ptr<const wcaudio_file> _file;
+        stdext::multi_ptr<stdext::input_stream, stdext::seekable> _stream;
+
+        // Tracks are indexed the first time they're selected, by starting chunk and
+        // intensity.
+        std::map<std::pair<uint32_t, uint8_t>, track_index> _tracks;
+        const track_index* _track = nullptr;
+        uint32_t _track_first_chunk_index = 0;
+
+        next_chunk_handler _next_chunk_handler;
+        loop_handler _loop_handler;
+        start_track_handler _start_track_handler;
+        next_track_handler _next_track_handler;
+        prev_track_handler _prev_track_handler;
+        end_of_stream_handler _end_of_stream_handler;
+
+        const chunk_header* _current_chunk = nullptr;
+        uint32_t _current_chunk_offset = 0;
+        uint8_t _current_intensity = 0;
+
+        unsigned _frame_count = 0;
+        uint32_t _first_chunk_index = 0;
+
+        // The read-ahead window holds file bytes [_read_ahead_offset, _read_ahead_offset +
+        // _read_ahead_length).  _stream_offset is where the underlying stream is positioned,
+        // or end_of_track if that isn't known.
+        std::unique_ptr<std::byte[]> _read_ahead;
+        size_t _read_ahead_size;
+        uint32_t _read_ahead_offset = 0;
+        uint32_t _read_ahead_length = 0;
+        uint32_t _stream_offset = end_of_track;
+    };
+
+    inline uint8_t wcaudio_file::channels() const
+    {
+        return _file_header.channels;
+    }
+
+    inline uint8_t wcaudio_file::bits_per_sample() const
+    {
+        return _file_header.bits_per_sample;
+    }
+
+    inline uint16_t wcaudio_file::sample_rate() const
+    {
+        return _file_header.sample_rate;
+    }
+
+    inline uint32_t wcaudio_file::buffer_size() const
+    {
+        return _file_header.buffer_size;
+    }
+
+    inline uint8_t wcaudio_stream::channels() const
+    {
+        return _file->channels();
+    }
+
+    inline uint8_t wcaudio_stream::bits_per_sample() const
+    {
+        return _file->bits_per_sample();
+    }
+
+    inline uint16_t wcaudio_stream::sample_rate() const
+    {
+        return _file->sample_rate();
+    }
+
+    inline uint32_t wcaudio_stream::buffer_size() const
+    {
+        return _file->buffer_size();
+    }
+
+    inline std::vector<uint8_t> wcaudio_stream::triggers() const
+    {
+        return _file->triggers();
+    }
+
+    inline std::vector<uint8_t> wcaudio_stream::intensities() const
+    {
+        return _file->intensities();
+    }
+
+    inline unsigned wcaudio_stream::frame_count() const
+    {
+        return _track != nullptr ? _track->frame_offsets.back() : 0;
+    }
+
+    inline void wcaudio_stream::on_next_chunk(next_chunk_handler handler)
+    {
+        _next_chunk_handler = std::move(handler);
+    }
+
+    inline void wcaudio_stream::on_loop(loop_handler handler)
+    {
+        _loop_handler = std::move(handler);
+    }
+
+    inline void wcaudio_stream::on_start_track(start_track_handler handler)
+    {
+        _start_track_handler = std::move(handler);
+    }
+
+    inline void wcaudio_stream::on_next_track(next_track_handler handler)
+    {
+        _next_track_handler = std::move(handler);
+    }
+
+    inline void wcaudio_stream::on_prev_track(prev_track_handler handler)
+    {
+        _prev_track_handler = std::move(handler);
+    }
+
+    inline void wcaudio_stream::on_end_of_stream(end_of_stream_handler handler)
+    {
+        _end_of_stream_handler = std::move(handler);
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <audio/pcm_ring.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstring>
+
+
+namespace wcdx::audio
+{
+    pcm_ring::pcm_ring(size_t capacity)
+        : _head(0), _tail(0), _closed(false)
+    {
+        if (capacity == 0)
+            throw std::range_error("Ring capacity must be at least one byte");
+
+        size_t rounded = 1;
+        while (rounded < capacity)
+            rounded <<= 1;
+
+        _data = std::make_unique<std::byte[]>(rounded);
+        _mask = rounded - 1;
+    }
+
+    size_t pcm_ring::size() const noexcept
+    {
+        // Loading _tail first means the difference can't go negative on either thread.
+        auto tail = _tail.load(std::memory_order_acquire);
+        return _head.load(std::memory_order_acquire) - tail;
+    }
+
+    size_t pcm_ring::write(const std::byte* data, size_t size) noexcept
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        size = std::min(size, capacity() - (head - _tail.load(std::memory_order_acquire)));
+
+        // The bytes go in at most two pieces: up to the end of the buffer, then from the
+        // start.
+        auto offset = head & _mask;
+        auto first = std::min(size, capacity() - offset);
+        std::memcpy(_data.get() + offset, data, first);
+        std::memcpy(_data.get(), data + first, size - first);
+
+        _head.store(head + size, std::memory_order_release);
+        return size;
+    }
+
+    void pcm_ring::close() noexcept
+    {
+        _closed.store(true, std::memory_order_release);
+    }
+
+    size_t pcm_ring::read(std::byte* buffer, size_t size) noexcept
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        size = std::min(size, _head.load(std::memory_order_acquire) - tail);
+
+        auto offset = tail & _mask;
+        auto first = std::min(size, capacity() - offset);
+        std::memcpy(buffer, _data.get() + offset, first);
+        std::memcpy(buffer + first, _data.get(), size - first);
+
+        _tail.store(tail + size, std::memory_order_release);
+        return size;
+    }
+}
@@ -0,0 +1,172 @@
+#include <audio/playback.h>
+#include <audio/pcm_ring.h>
+
+#include <stdext/scope_guard.h>
+#include <stdext/stream.h>
+#include <stdext/utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+
+namespace wcdx::audio
+{
+    namespace
+    {
+        // Neither thread sleeps on the other, so each checks back this often while it's
+        // waiting for the ring to fill or empty.
+        constexpr std::chrono::milliseconds ring_poll_interval(1);
+
+        void decode(stdext::input_stream& in, pcm_ring& ring, const std::atomic<bool>& stopping, size_t block_size);
+    }
+
+    pcm_sink::~pcm_sink() = default;
+
+    null_sink::null_sink(size_t period_size, std::chrono::microseconds period_duration)
+        : _period_size(period_size), _period_duration(period_duration), _next_period(std::chrono::steady_clock::now())
+    {
+    }
+
+    void null_sink::write(const std::byte* data, size_t size)
+    {
+        stdext::discard(data);
+        if (_period_duration.count() != 0)
+        {
+            std::this_thread::sleep_until(_next_period);
+            _next_period = std::max(_next_period + _period_duration, std::chrono::steady_clock::now());
+        }
+
+        _bytes_played += size;
+    }
+
+    stream_sink::stream_sink(stdext::output_stream& out, size_t period_size) noexcept
+        : _out(&out), _period_size(period_size)
+    {
+    }
+
+    void stream_sink::write(const std::byte* data, size_t size)
+    {
+        _out->write_all(data, size);
+    }
+
+    playback_stats play_stream(stdext::input_stream& in, pcm_sink& sink, size_t ring_size)
+    {
+        auto period_size = sink.period_size();
+        if (period_size == 0 || ring_size < period_size)
+            throw std::range_error("The ring must hold at least one period");
+
+        pcm_ring ring(ring_size);
+        std::atomic<bool> stopping(false);
+        std::exception_ptr decoder_error;
+
+        // The decoder's error is published by closing the ring.
+        std::thread decoder([&]
+        {
+            try
+            {
+                decode(in, ring, stopping, period_size);
+            }
+            catch (...)
+            {
+                decoder_error = std::current_exception();
+            }
+            ring.close();
+        });
+
+        // However the sink's side ends, the decoder has to be stopped before the ring
+        // and stream go away.
+        at_scope_exit([&]
+        {
+            stopping.store(true, std::memory_order_relaxed);
+            decoder.join();
+        });
+
+        playback_stats stats;
+        stats.ring_capacity = ring.capacity();
+        stats.min_fill = ring.capacity();
+
+        // Let the decoder get ahead before the sink starts taking periods.
+        auto prefill = std::max(ring.capacity() / 2, period_size);
+        while (ring.size() < prefill && !ring.closed())
+            std::this_thread::sleep_for(ring_poll_interval);
+
+        auto buffer = std::make_unique<std::byte[]>(period_size);
+        while (true)
+        {
+            // Checking for the end first means the fill level includes everything the
+            // decoder wrote before closing the ring.
+            auto closed = ring.closed();
+            auto fill = ring.size();
+            if (!closed)
+            {
+                stats.min_fill = std::min(stats.min_fill, fill);
+                stats.total_fill += fill;
+                ++stats.fill_samples;
+
+                if (fill < period_size)
+                {
+                    ++stats.underruns;
+                    if (!sink.realtime())
+                    {
+                        while (ring.size() < period_size && !ring.closed())
+                            std::this_thread::sleep_for(ring_poll_interval);
+                        closed = ring.closed();
+                    }
+                }
+            }
+
+            auto bytes = ring.read(buffer.get(), period_size);
+            if (bytes == 0 && closed)
+                break;
+
+            // A real-time sink that's run ahead of the decoder plays silence for the rest
+            // of the period; only the last period can come up short otherwise.
+            if (bytes < period_size && !closed)
+            {
+                std::fill(buffer.get() + bytes, buffer.get() + period_size, std::byte());
+                bytes = period_size;
+            }
+
+            sink.write(buffer.get(), bytes);
+            ++stats.periods;
+        }
+
+        if (decoder_error != nullptr)
+            std::rethrow_exception(decoder_error);
+
+        sink.drain();
+        if (stats.fill_samples == 0)
+            stats.min_fill = 0;
+        return stats;
+    }
+
+    namespace
+    {
+        void decode(stdext::input_stream& in, pcm_ring& ring, const std::atomic<bool>& stopping, size_t block_size)
+        {
+            auto buffer = std::make_unique<std::byte[]>(block_size);
+            while (!stopping.load(std::memory_order_relaxed))
+            {
+                auto bytes = in.read(buffer.get(), block_size);
+                if (bytes == 0)
+                    return;
+
+                for (size_t written = 0; written < bytes; )
+                {
+                    auto count = ring.write(buffer.get() + written, bytes - written);
+                    written += count;
+                    if (count == 0)
+                    {
+                        if (stopping.load(std::memory_order_relaxed))
+                            return;
+                        std::this_thread::sleep_for(ring_poll_interval);
+                    }
+                }
+            }
+        }
+    }
+}
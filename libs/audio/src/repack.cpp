@@ -0,0 +1,346 @@
+#include <audio/repack.h>
+
+#include "stream_format.h"
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+
+namespace wcdx::audio
+{
+    class stream_repacker
+    {
+    public:
+        static size_t repack(const wcaudio_file& file, seekable_input_stream_ref in, seekable_output_stream_ref out);
+
+    private:
+        // A run of the file's sample data that moves as a unit: the data of one or more
+        // overlapping chunks, or bytes between chunks that no chunk uses.
+        struct block
+        {
+            uint32_t start_offset;
+            uint32_t end_offset;
+            uint32_t new_start_offset;
+            bool placed;
+        };
+
+    private:
+        static std::vector<uint32_t> playback_order(const wcaudio_file& file);
+        static std::vector<block> sample_blocks(const wcaudio_file& file);
+        static void check_tables(const wcaudio_file& file, uint32_t start_offset, uint32_t end_offset);
+        static void copy(seekable_input_stream_ref in, seekable_output_stream_ref out, uint64_t offset, uint64_t size, std::byte* buffer, size_t buffer_size);
+    };
+
+    namespace
+    {
+        struct playback_event
+        {
+            char kind;
+            uint32_t chunk_index;
+            unsigned frame_count;
+
+            bool operator == (const playback_event& other) const noexcept
+            {
+                return kind == other.kind && chunk_index == other.chunk_index && frame_count == other.frame_count;
+            }
+        };
+
+        constexpr size_t copy_buffer_size = 0x100000;
+        constexpr size_t compare_buffer_size = 0x10000;
+
+        void watch(wcaudio_stream& stream, std::vector<playback_event>& events, unsigned loops);
+        size_t read_full(stdext::input_stream& in, std::byte* buffer, size_t size);
+        bool same_playback(wcaudio_stream& stream1, wcaudio_stream& stream2, std::byte* buffer1, std::byte* buffer2);
+    }
+
+    size_t repack_stream(const wcaudio_file& file, seekable_input_stream_ref in, seekable_output_stream_ref out)
+    {
+        return stream_repacker::repack(file, in, out);
+    }
+
+    std::vector<track_selection> compare_streams(std::shared_ptr<const wcaudio_file> file1, seekable_input_stream_ref in1,
+        std::shared_ptr<const wcaudio_file> file2, seekable_input_stream_ref in2, unsigned loops)
+    {
+        auto selections = track_selections(*file1);
+        auto selections2 = track_selections(*file2);
+        if (!std::equal(selections.begin(), selections.end(), selections2.begin(), selections2.end(),
+            [](const track_selection& a, const track_selection& b) { return a.trigger == b.trigger && a.intensity == b.intensity; }))
+        {
+            throw std::runtime_error("The streams have different triggers or intensities.");
+        }
+
+        auto buffer1 = std::make_unique<std::byte[]>(compare_buffer_size);
+        auto buffer2 = std::make_unique<std::byte[]>(compare_buffer_size);
+
+        std::vector<track_selection> mismatches;
+        for (auto selection : selections)
+        {
+            wcaudio_stream stream1(file1, in1);
+            wcaudio_stream stream2(file2, in2);
+
+            std::vector<playback_event> events1, events2;
+            watch(stream1, events1, loops);
+            watch(stream2, events2, loops);
+            stream1.select(selection.trigger, selection.intensity);
+            stream2.select(selection.trigger, selection.intensity);
+
+            if (stream1.frame_count() != stream2.frame_count()
+                || !same_playback(stream1, stream2, buffer1.get(), buffer2.get())
+                || events1 != events2)
+            {
+                mismatches.push_back(selection);
+            }
+        }
+
+        return mismatches;
+    }
+
+    size_t stream_repacker::repack(const wcaudio_file& file, seekable_input_stream_ref in, seekable_output_stream_ref out)
+    {
+        auto blocks = sample_blocks(file);
+        auto end_offset = in.as<stdext::seekable>().end_position();
+        if (blocks.empty())
+        {
+            auto buffer = std::make_unique<std::byte[]>(copy_buffer_size);
+            copy(in, out, 0, end_offset, buffer.get(), copy_buffer_size);
+            return 0;
+        }
+
+        auto samples_start = blocks.front().start_offset;
+        auto samples_end = blocks.back().end_offset;
+        if (samples_end > end_offset)
+            throw std::runtime_error("Invalid stream.");
+        check_tables(file, samples_start, samples_end);
+
+        auto block_at = [&](uint32_t offset)
+        {
+            auto i = std::upper_bound(blocks.begin(), blocks.end(), offset,
+                [](uint32_t value, const block& b) { return value < b.start_offset; });
+            return i - 1;
+        };
+
+        // Blocks are laid out in the order their chunks are first played, followed by any
+        // that are never played, in their original order.
+        std::vector<size_t> layout;
+        layout.reserve(blocks.size());
+        for (auto chunk_index : playback_order(file))
+        {
+            auto& chunk = file._chunks[chunk_index];
+            if (chunk.end_offset == chunk.start_offset)
+                continue;
+
+            auto i = block_at(chunk.start_offset);
+            if (!std::exchange(i->placed, true))
+                layout.push_back(size_t(i - blocks.begin()));
+        }
+
+        for (size_t n = 0; n < blocks.size(); ++n)
+        {
+            if (!blocks[n].placed)
+                layout.push_back(n);
+        }
+
+        auto offset = samples_start;
+        for (auto n : layout)
+        {
+            blocks[n].new_start_offset = offset;
+            offset += blocks[n].end_offset - blocks[n].start_offset;
+        }
+
+        // Empty chunks outside the sample data stay where they are.
+        size_t moved = 0;
+        auto chunks = file._chunks;
+        for (auto& chunk : chunks)
+        {
+            if (chunk.start_offset < samples_start || chunk.start_offset > samples_end)
+                continue;
+
+            auto i = block_at(chunk.start_offset);
+            auto start_offset = i->new_start_offset + (chunk.start_offset - i->start_offset);
+            if (start_offset != chunk.start_offset)
+                ++moved;
+            chunk.end_offset = start_offset + (chunk.end_offset - chunk.start_offset);
+            chunk.start_offset = start_offset;
+        }
+
+        auto buffer = std::make_unique<std::byte[]>(copy_buffer_size);
+        copy(in, out, 0, samples_start, buffer.get(), copy_buffer_size);
+        for (auto n : layout)
+            copy(in, out, blocks[n].start_offset, blocks[n].end_offset - blocks[n].start_offset, buffer.get(), copy_buffer_size);
+        copy(in, out, samples_end, end_offset - samples_end, buffer.get(), copy_buffer_size);
+
+        // The chunk headers are outside the sample data, so they're where they were.
+        auto& seeker = out.as<stdext::seekable>();
+        auto position = seeker.position();
+        seeker.set_position(file._file_header.chunk_headers_offset);
+        out.as<stdext::output_stream>().write_all(chunks.data(), chunks.size());
+        seeker.set_position(position);
+
+        return moved;
+    }
+
+    std::vector<uint32_t> stream_repacker::playback_order(const wcaudio_file& file)
+    {
+        auto chunk_count = uint32_t(file._chunks.size());
+        std::vector<uint32_t> order;
+        order.reserve(chunk_count);
+        std::vector<bool> visited(chunk_count);
+
+        // A depth-first walk from chunk 0, following the chunk played next with no trigger
+        // before any links, so each track's chunks come out in the order they're played.
+        std::vector<uint32_t> pending(1, 0);
+        while (!pending.empty())
+        {
+            auto chunk_index = pending.back();
+            pending.pop_back();
+            if (chunk_index >= chunk_count || visited[chunk_index])
+                continue;
+
+            visited[chunk_index] = true;
+            order.push_back(chunk_index);
+
+            // Successors are pushed in reverse, so the last one pushed is visited first.
+            const auto& chunk = file._chunks[chunk_index];
+            stdext::array_view<const stream_trigger_link> trigger_links(file._trigger_links.data() + chunk.trigger_link_index, chunk.trigger_link_count);
+            stdext::array_view<const stream_chunk_link> chunk_links(file._chunk_links.data() + chunk.chunk_link_index, chunk.chunk_link_count);
+
+            auto stops = false;
+            for (auto i = trigger_links.size(); i-- != 0; )
+            {
+                if (trigger_links[i].trigger == 64 || trigger_links[i].trigger == 65)
+                    stops = true;
+                else
+                    pending.push_back(uint32_t(trigger_links[i].chunk_index));
+            }
+
+            for (auto i = chunk_links.size(); i-- != 0; )
+                pending.push_back(uint32_t(chunk_links[i].chunk_index));
+
+            if (chunk_links.empty() && !stops)
+                pending.push_back(chunk_index + 1);
+        }
+
+        for (uint32_t n = 0; n < chunk_count; ++n)
+        {
+            if (!visited[n])
+                order.push_back(n);
+        }
+
+        return order;
+    }
+
+    auto stream_repacker::sample_blocks(const wcaudio_file& file) -> std::vector<block>
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        ranges.reserve(file._chunks.size());
+        for (auto& chunk : file._chunks)
+        {
+            if (chunk.end_offset != chunk.start_offset)
+                ranges.push_back({ chunk.start_offset, chunk.end_offset });
+        }
+        std::sort(ranges.begin(), ranges.end());
+
+        // Overlapping chunks are merged, and the gaps between chunks become blocks of their
+        // own, so the blocks cover the sample data with no gaps.
+        std::vector<block> blocks;
+        for (auto [start_offset, end_offset] : ranges)
+        {
+            if (!blocks.empty() && start_offset < blocks.back().end_offset)
+            {
+                blocks.back().end_offset = std::max(blocks.back().end_offset, end_offset);
+                continue;
+            }
+
+            if (!blocks.empty() && start_offset > blocks.back().end_offset)
+                blocks.push_back({ blocks.back().end_offset, start_offset, 0, false });
+            blocks.push_back({ start_offset, end_offset, 0, false });
+        }
+
+        return blocks;
+    }
+
+    void stream_repacker::check_tables(const wcaudio_file& file, uint32_t start_offset, uint32_t end_offset)
+    {
+        auto& header = file._file_header;
+        auto overlaps = [&](uint64_t offset, uint64_t size)
+        {
+            return size != 0 && offset < end_offset && offset + size > start_offset;
+        };
+
+        // Tables whose entries we don't know the size of only have their offsets checked.
+        if (overlaps(0, sizeof(stream_file_header))
+            || overlaps(header.chunk_headers_offset, uint64_t(header.chunk_count) * sizeof(chunk_header))
+            || overlaps(header.chunk_link_offset, uint64_t(header.chunk_link_count) * sizeof(stream_chunk_link))
+            || overlaps(header.trigger_link_offset, uint64_t(header.trigger_link_count) * sizeof(stream_trigger_link))
+            || overlaps(header.file_entry_offset, header.file_entry_count != 0 ? 1 : 0)
+            || overlaps(header.thing5_offset, header.thing5_count != 0 ? 1 : 0)
+            || overlaps(header.thing6_offset, header.thing6_count != 0 ? 1 : 0))
+        {
+            throw std::runtime_error("The stream's tables are mixed in with its sample data.");
+        }
+    }
+
+    void stream_repacker::copy(seekable_input_stream_ref in, seekable_output_stream_ref out, uint64_t offset, uint64_t size, std::byte* buffer, size_t buffer_size)
+    {
+        auto& reader = in.as<stdext::input_stream>();
+        auto& writer = out.as<stdext::output_stream>();
+        in.as<stdext::seekable>().set_position(offset);
+        while (size != 0)
+        {
+            auto length = size_t(std::min(uint64_t(buffer_size), size));
+            reader.read_all(buffer, length);
+            writer.write_all(buffer, length);
+            size -= length;
+        }
+    }
+
+    namespace
+    {
+        void watch(wcaudio_stream& stream, std::vector<playback_event>& events, unsigned loops)
+        {
+            stream.on_next_chunk([&](uint32_t chunk_index, unsigned frame_count)
+            {
+                events.push_back({ 'n', chunk_index, frame_count });
+            });
+            batch_observers observers;
+            observers.loop = [&](uint32_t chunk_index, unsigned frame_count) { events.push_back({ 'l', chunk_index, frame_count }); };
+            observers.start_track = [&](uint32_t chunk_index) { events.push_back({ 's', chunk_index, 0 }); };
+            observers.next_track = [&](uint32_t chunk_index, unsigned frame_count) { events.push_back({ 't', chunk_index, frame_count }); };
+            set_batch_handlers(stream, loops, true, std::move(observers));
+            stream.on_prev_track([&](unsigned frame_count)
+            {
+                events.push_back({ 'p', end_of_track, frame_count });
+            });
+            stream.on_end_of_stream([&](unsigned frame_count)
+            {
+                events.push_back({ 'e', end_of_track, frame_count });
+            });
+        }
+
+        size_t read_full(stdext::input_stream& in, std::byte* buffer, size_t size)
+        {
+            size_t total = 0;
+            size_t bytes;
+            while (total < size && (bytes = in.read(buffer + total, size - total)) != 0)
+                total += bytes;
+            return total;
+        }
+
+        bool same_playback(wcaudio_stream& stream1, wcaudio_stream& stream2, std::byte* buffer1, std::byte* buffer2)
+        {
+            size_t bytes;
+            do
+            {
+                bytes = read_full(stream1, buffer1, compare_buffer_size);
+                if (read_full(stream2, buffer2, compare_buffer_size) != bytes || !std::equal(buffer1, buffer1 + bytes, buffer2))
+                    return false;
+            } while (bytes != 0);
+
+            return true;
+        }
+    }
+}
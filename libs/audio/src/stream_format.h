@@ -0,0 +1,39 @@
+#ifndef AUDIO_STREAM_FORMAT_INCLUDED
+#define AUDIO_STREAM_FORMAT_INCLUDED
+#pragma once
+
+#include <cstdint>
+
+
+namespace wcdx::audio
+{
+    // The tables of an STR file, as they're stored in it.  A chunk's sample data lies at
+    // [start_offset, end_offset) in the file, and its links are the given ranges of the
+    // trigger and chunk link tables.
+    struct chunk_header
+    {
+        uint32_t start_offset;
+        uint32_t end_offset;
+        uint32_t trigger_link_count;
+        uint32_t trigger_link_index;
+        uint32_t chunk_link_count;
+        uint32_t chunk_link_index;
+    };
+
+#pragma pack(push)
+#pragma pack(1)
+    struct stream_chunk_link
+    {
+        uint8_t intensity;
+        uint32_t chunk_index;
+    };
+
+    struct stream_trigger_link
+    {
+        uint8_t trigger;
+        uint32_t chunk_index;
+    };
+#pragma pack(pop)
+}
+
+#endif
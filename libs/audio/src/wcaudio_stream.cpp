@@ -0,0 +1,454 @@
+#include <audio/wcaudio_stream.h>
+
+#include "stream_format.h"
+
+#include <stdext/endian.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <cstdlib>
+#include <cstring>
+
+
+using namespace stdext::literals;
+
+namespace wcdx::audio
+{
+    namespace
+    {
+        enum class transition_kind : uint8_t
+        {
+            end_of_stream,      // trigger link 64
+            prev_track,         // trigger link 65
+            start_track,        // trigger link matching the trigger
+            nearest_intensity,  // chunk link closest to the intensity
+            next_chunk,         // no links; the chunk after this one
+            first_chunk         // no links and no chunk after this one
+        };
+
+        constexpr unsigned intensity_count = 0x100;
+    }
+
+    struct wcaudio_file::chunk_transition
+    {
+        transition_kind kind;
+        uint32_t chunk_index;
+        // The first of the chunk's entries in _nearest_chunks, if it has chunk links.
+        uint32_t nearest_chunks;
+    };
+
+    wcaudio_file::wcaudio_file(stdext::multi_ref<stdext::input_stream, stdext::seekable> stream)
+    {
+        auto& in = stream.as<stdext::input_stream>();
+        auto& seeker = stream.as<stdext::seekable>();
+
+        _file_header = in.read<stream_file_header>();
+        if (_file_header.magic != "STRM"_4cc || _file_header.chunk_count == 0)
+            throw std::runtime_error("Invalid stream.");
+
+        _chunks.resize(_file_header.chunk_count);
+        seeker.seek(stdext::seek_from::begin, _file_header.chunk_headers_offset);
+        in.read_all(_chunks.data(), _chunks.size());
+
+        _chunk_links.resize(_file_header.chunk_link_count);
+        seeker.seek(stdext::seek_from::begin, _file_header.chunk_link_offset);
+        in.read_all(_chunk_links.data(), _chunk_links.size());
+
+        _trigger_links.resize(_file_header.trigger_link_count);
+        seeker.seek(stdext::seek_from::begin, _file_header.trigger_link_offset);
+        in.read_all(_trigger_links.data(), _trigger_links.size());
+
+        _transitions.resize(_chunks.size());
+        for (size_t n = 0; n < _chunks.size(); ++n)
+        {
+            const auto& chunk = _chunks[n];
+            if (chunk.end_offset < chunk.start_offset
+                || uint64_t(chunk.trigger_link_index) + chunk.trigger_link_count > _trigger_links.size()
+                || uint64_t(chunk.chunk_link_index) + chunk.chunk_link_count > _chunk_links.size())
+            {
+                throw std::runtime_error("Invalid stream.");
+            }
+
+            if (chunk.chunk_link_count == 0)
+                continue;
+
+            // Ties go to the first link, as they would searching the links in order.
+            _transitions[n].nearest_chunks = uint32_t(_nearest_chunks.size());
+            stdext::array_view<const stream_chunk_link> chunk_links(_chunk_links.data() + chunk.chunk_link_index, chunk.chunk_link_count);
+            for (unsigned intensity = 0; intensity < intensity_count; ++intensity)
+            {
+                auto closest_intensity_level = int(intensity_count);
+                uint32_t closest_chunk_index = 0;
+                for (auto& link : chunk_links)
+                {
+                    auto delta = std::abs(link.intensity - int(intensity));
+                    if (delta < closest_intensity_level)
+                    {
+                        closest_intensity_level = delta;
+                        closest_chunk_index = link.chunk_index;
+                    }
+                }
+
+                _nearest_chunks.push_back(closest_chunk_index);
+            }
+        }
+
+        for (uint32_t n = 0; n < _chunks.size(); ++n)
+            _transitions[n] = link_transition(n, no_trigger);
+    }
+
+    wcaudio_file::~wcaudio_file() = default;
+
+    std::vector<uint8_t> wcaudio_file::triggers() const
+    {
+        auto& chunk = _chunks[0];
+        stdext::array_view<const stream_trigger_link> trigger_links(_trigger_links.data() + chunk.trigger_link_index, chunk.trigger_link_count);
+        std::vector<uint8_t> triggers;
+        triggers.reserve(trigger_links.size());
+        for (auto& link : trigger_links)
+            triggers.push_back(link.trigger);
+        return triggers;
+    }
+
+    std::vector<uint8_t> wcaudio_file::intensities() const
+    {
+        auto& index_chunk = _chunks[0];
+        stdext::array_view<const stream_chunk_link> chunk_links(_chunk_links.data() + index_chunk.chunk_link_index, index_chunk.chunk_link_count);
+        std::vector<uint8_t> intensities;
+        intensities.reserve(chunk_links.size());
+        for (auto& link : chunk_links)
+            intensities.push_back(link.intensity);
+        return intensities;
+    }
+
+    std::vector<track_selection> track_selections(const wcaudio_file& file)
+    {
+        auto triggers = file.triggers();
+        triggers.insert(triggers.begin(), no_trigger);
+        auto intensities = file.intensities();
+        if (intensities.empty())
+            intensities.push_back(0);
+
+        std::vector<track_selection> selections;
+        selections.reserve(triggers.size() * intensities.size());
+        for (auto trigger : triggers)
+        {
+            for (auto intensity : intensities)
+                selections.push_back({ trigger, intensity });
+        }
+
+        return selections;
+    }
+
+    void set_batch_handlers(wcaudio_stream& stream, unsigned loops, bool next_tracks, batch_observers observers)
+    {
+        // The first chunk of each track played so far; the first is the selection itself.
+        auto played = std::make_shared<std::vector<uint32_t>>();
+        auto play = [played](uint32_t chunk_index)
+        {
+            if (!played->empty() && (chunk_index == 0 || std::find(played->begin(), played->end(), chunk_index) != played->end()))
+                return false;
+            played->push_back(chunk_index);
+            return true;
+        };
+
+        stream.on_loop([loops, observe = std::move(observers.loop)](uint32_t chunk_index, unsigned frame_count) mutable
+        {
+            if (observe != nullptr)
+                observe(chunk_index, frame_count);
+            return loops-- != 0;
+        });
+        stream.on_start_track([play, observe = std::move(observers.start_track)](uint32_t chunk_index)
+        {
+            if (observe != nullptr)
+                observe(chunk_index);
+            play(chunk_index);
+        });
+        stream.on_next_track([played, play, next_tracks, observe = std::move(observers.next_track)](uint32_t chunk_index, unsigned frame_count)
+        {
+            if (observe != nullptr)
+                observe(chunk_index, frame_count);
+            return (next_tracks || played->empty()) && play(chunk_index);
+        });
+    }
+
+    auto wcaudio_file::link_transition(uint32_t chunk_index, uint8_t trigger) const -> chunk_transition
+    {
+        auto transition = _transitions[chunk_index];
+
+        const auto& chunk = _chunks[chunk_index];
+        stdext::array_view<const stream_trigger_link> trigger_links(_trigger_links.data() + chunk.trigger_link_index, chunk.trigger_link_count);
+        for (auto& link : trigger_links)
+        {
+            switch (link.trigger)
+            {
+            case 64:
+                transition.kind = transition_kind::end_of_stream;
+                return transition;
+            case 65:
+                transition.kind = transition_kind::prev_track;
+                return transition;
+            default:
+                if (link.trigger == trigger)
+                {
+                    transition.kind = transition_kind::start_track;
+                    transition.chunk_index = link.chunk_index;
+                    return transition;
+                }
+                break;
+            }
+        }
+
+        if (chunk.chunk_link_count != 0)
+            transition.kind = transition_kind::nearest_intensity;
+        else if (chunk_index + 1 == _chunks.size())
+        {
+            transition.kind = transition_kind::first_chunk;
+            transition.chunk_index = 0;
+        }
+        else
+        {
+            transition.kind = transition_kind::next_chunk;
+            transition.chunk_index = chunk_index + 1;
+        }
+
+        return transition;
+    }
+
+    unsigned wcaudio_file::frame_size() const
+    {
+        return _file_header.channels * ((_file_header.bits_per_sample + 7) / 8);
+    }
+
+    unsigned wcaudio_file::chunk_frames(const chunk_header& chunk) const
+    {
+        return (chunk.end_offset - chunk.start_offset) / frame_size();
+    }
+
+    wcaudio_stream::wcaudio_stream(stdext::multi_ref<stdext::input_stream, stdext::seekable> stream, size_t read_ahead_size)
+        : wcaudio_stream(std::make_shared<const wcaudio_file>(stream), stream, read_ahead_size)
+    {
+    }
+
+    wcaudio_stream::wcaudio_stream(std::shared_ptr<const wcaudio_file> file, stdext::multi_ref<stdext::input_stream, stdext::seekable> stream, size_t read_ahead_size)
+        : _file(std::move(file)), _stream(&stream), _read_ahead_size(read_ahead_size)
+    {
+        if (read_ahead_size == 0)
+            throw std::range_error("Read-ahead size must be at least one byte");
+
+        _read_ahead = std::make_unique<std::byte[]>(read_ahead_size);
+    }
+
+    wcaudio_stream::~wcaudio_stream() = default;
+
+    void wcaudio_stream::select(uint8_t trigger, uint8_t intensity)
+    {
+        auto chunk_index = next_chunk_index(_file->link_transition(0, trigger), intensity);
+        if (chunk_index == end_of_track)
+            return;
+
+        _current_chunk = &_file->_chunks[chunk_index];
+        _current_chunk_offset = 0;
+        _current_intensity = intensity;
+
+        _frame_count = 0;
+
+        _track = &index_track(chunk_index, intensity);
+        _track_first_chunk_index = _first_chunk_index;
+    }
+
+    void wcaudio_stream::seek_to_frame(unsigned frame)
+    {
+        if (frame > frame_count())
+            throw std::range_error("Frame is past the end of the track");
+        if (_track == nullptr)
+            return;
+
+        // The last chunk holding the frame; chunks with no frames of their own start at the
+        // same frame as the one after them.
+        auto& offsets = _track->frame_offsets;
+        auto position = std::upper_bound(offsets.begin(), offsets.end() - 1, frame) - offsets.begin() - 1;
+
+        _current_chunk = &_file->_chunks[_track->chunks[position]];
+        _current_chunk_offset = (frame - offsets[position]) * _file->frame_size();
+        _frame_count = offsets[position];
+        _first_chunk_index = _track_first_chunk_index;
+    }
+
+    size_t wcaudio_stream::do_read(std::byte* buffer, size_t size)
+    {
+        size_t total_bytes = 0;
+        auto p = buffer;
+        while (size != 0 && _current_chunk != nullptr)
+        {
+            auto chunk_size = _current_chunk->end_offset - _current_chunk->start_offset;
+            auto bytes = std::min(size_t(chunk_size - _current_chunk_offset), size);
+
+            // Skipped samples are never fetched.
+            if (buffer != nullptr && bytes != 0)
+            {
+                auto offset = _current_chunk->start_offset + _current_chunk_offset;
+                if (offset - _read_ahead_offset >= _read_ahead_length && !fill_read_ahead(offset, _current_chunk->end_offset))
+                    break;
+
+                auto window_offset = offset - _read_ahead_offset;
+                bytes = std::min(bytes, size_t(_read_ahead_length - window_offset));
+                std::memcpy(p, _read_ahead.get() + window_offset, bytes);
+                p += bytes;
+            }
+
+            size -= bytes;
+            total_bytes += bytes;
+            _current_chunk_offset += uint32_t(bytes);
+            if (_current_chunk_offset == chunk_size)
+            {
+                _frame_count += _file->chunk_frames(*_current_chunk);
+                _current_chunk_offset = 0;
+
+                auto index = next_chunk_index(_file->_transitions[_current_chunk - _file->_chunks.data()], _current_intensity);
+                if (index == end_of_track)
+                {
+                    _current_chunk = nullptr;
+                    break;
+                }
+
+                _current_chunk = &_file->_chunks[index];
+            }
+        }
+
+        return total_bytes;
+    }
+
+    size_t wcaudio_stream::do_skip(size_t size)
+    {
+        return do_read(nullptr, size);
+    }
+
+    unsigned wcaudio_stream::chunk_frame(uint32_t chunk_index)
+    {
+        auto& track = index_track(_first_chunk_index, _current_intensity);
+        auto position = std::find(track.chunks.begin(), track.chunks.end(), chunk_index);
+        if (position == track.chunks.end())
+            throw std::range_error("Chunk is not part of the track");
+        return track.frame_offsets[position - track.chunks.begin()];
+    }
+
+    uint32_t wcaudio_stream::next_chunk_index(const wcaudio_file::chunk_transition& transition, uint8_t intensity)
+    {
+        switch (transition.kind)
+        {
+        case transition_kind::end_of_stream:
+            if (_end_of_stream_handler != nullptr)
+                _end_of_stream_handler(_frame_count);
+            return end_of_track;
+
+        case transition_kind::prev_track:
+            if (_prev_track_handler != nullptr)
+                _prev_track_handler(_frame_count);
+            return end_of_track;
+
+        case transition_kind::start_track:
+            if (transition.chunk_index >= _file->_chunks.size())
+                throw std::runtime_error("Invalid stream.");
+            if (_start_track_handler != nullptr)
+                _start_track_handler(transition.chunk_index);
+            _first_chunk_index = transition.chunk_index;
+            return transition.chunk_index;
+
+        case transition_kind::nearest_intensity:
+        {
+            auto chunk_index = _file->_nearest_chunks[transition.nearest_chunks + intensity];
+            if (chunk_index >= _file->_chunks.size())
+                throw std::runtime_error("Invalid stream.");
+
+            // Before anything has been played, every chunk starts a new track.
+            auto current_chunk_index = _current_chunk != nullptr ? uint32_t(_current_chunk - _file->_chunks.data()) : end_of_track;
+            if (current_chunk_index != end_of_track && chunk_index == current_chunk_index + 1)
+            {
+                if (_next_chunk_handler != nullptr)
+                    _next_chunk_handler(chunk_index, _frame_count);
+            }
+            else if (current_chunk_index != end_of_track && chunk_index < current_chunk_index
+                     && chunk_index >= _first_chunk_index)
+            {
+                if (_loop_handler != nullptr && !_loop_handler(chunk_index, _frame_count))
+                    return end_of_track;
+            }
+            else
+            {
+                if (_next_track_handler != nullptr && !_next_track_handler(chunk_index, _frame_count))
+                    return end_of_track;
+                _first_chunk_index = chunk_index;
+            }
+
+            return chunk_index;
+        }
+
+        case transition_kind::next_chunk:
+            if (_next_chunk_handler != nullptr)
+                _next_chunk_handler(transition.chunk_index, _frame_count);
+            return transition.chunk_index;
+
+        case transition_kind::first_chunk:
+            _first_chunk_index = 0;
+            if (_next_track_handler != nullptr && !_next_track_handler(0, _frame_count))
+                return end_of_track;
+            return 0;
+        }
+
+        return end_of_track;
+    }
+
+    // Follows the chunks from the first one of a track for as long as it plays straight
+    // through.  Each chunk goes on to one with a higher index, so the walk stops where the
+    // track loops back, moves on to another track, or ends.
+    auto wcaudio_stream::index_track(uint32_t chunk_index, uint8_t intensity) -> const track_index&
+    {
+        auto [entry, inserted] = _tracks.try_emplace({ chunk_index, intensity });
+        auto& track = entry->second;
+        if (!inserted)
+            return track;
+
+        unsigned frame = 0;
+        while (true)
+        {
+            track.chunks.push_back(chunk_index);
+            track.frame_offsets.push_back(frame);
+            frame += _file->chunk_frames(_file->_chunks[chunk_index]);
+
+            auto& transition = _file->_transitions[chunk_index];
+            if (transition.kind == transition_kind::next_chunk)
+                chunk_index = transition.chunk_index;
+            else if (transition.kind == transition_kind::nearest_intensity && chunk_index + 1 < _file->_chunks.size()
+                     && _file->_nearest_chunks[transition.nearest_chunks + intensity] == chunk_index + 1)
+            {
+                ++chunk_index;
+            }
+            else
+                break;
+        }
+
+        track.frame_offsets.push_back(frame);
+        return track;
+    }
+
+    bool wcaudio_stream::fill_read_ahead(uint32_t offset, uint32_t end_offset)
+    {
+        // Nothing else moves the stream, so reading on from where the last fetch ended needs
+        // no seek.
+        _read_ahead_length = 0;
+        if (std::exchange(_stream_offset, end_of_track) != offset)
+            _stream.as<stdext::seekable>()->set_position(offset);
+
+        auto size = std::min(_read_ahead_size, size_t(end_offset - offset));
+        auto bytes = _stream.as<stdext::input_stream>()->read(_read_ahead.get(), size);
+
+        _read_ahead_offset = offset;
+        _read_ahead_length = uint32_t(bytes);
+        _stream_offset = offset + uint32_t(bytes);
+        return bytes != 0;
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef FILEIO_READ_CACHE_INCLUDED
+#define FILEIO_READ_CACHE_INCLUDED
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::archive
+{
+    class mapped_file;
+}
+
+namespace wcdx::fileio
+{
+    // The descriptor calls the cache falls back to for files it hasn't mapped.  Each behaves
+    // like its C runtime namesake (lseek, read, filelength), returning -1 on failure.
+    class descriptor_io
+    {
+    public:
+        virtual ~descriptor_io();
+
+    public:
+        virtual long seek(int filedesc, long offset, int method) = 0;
+        virtual long read(int filedesc, void* data, unsigned int size) = 0;
+        virtual long length(int filedesc) = 0;
+    };
+
+    struct read_cache_stats
+    {
+        // Calls answered from a mapping, and calls passed through to descriptor_io.
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t bytes_served = 0;
+        // Descriptors currently served from a mapping.
+        uint64_t mapped_files = 0;
+    };
+
+    // Serves reads, seeks and lengths of read-only files from memory mappings.  A descriptor
+    // is only served from its mapping once it's been attached; every other descriptor goes
+    // straight to descriptor_io, so files open for writing see no change in behavior.  The
+    // descriptor's own file position isn't touched while it's attached; the cache keeps its
+    // own.  Not thread-safe.
+    class read_cache
+    {
+    public:
+        // If enabled is false, nothing is ever attached and every call goes to io.  io must
+        // outlive the cache.
+        explicit read_cache(descriptor_io& io, bool enabled = true);
+        read_cache(const read_cache&) = delete;
+        read_cache& operator = (const read_cache&) = delete;
+        ~read_cache();
+
+    public:
+        bool enabled() const noexcept { return _enabled; }
+
+        // Maps the file at path, which filedesc has just opened for reading only, and serves
+        // filedesc from the mapping from now on.  Returns false, leaving filedesc to io, if
+        // the file can't be mapped.
+        bool attach(int filedesc, const std::filesystem::path& path);
+        // Forgets filedesc; called before the descriptor is closed.
+        void detach(int filedesc) noexcept;
+        // Hands every descriptor mapping the file at path back to io, moving each one's file
+        // position to where the cache had it.  Called when the file is opened for writing,
+        // as its mapping would no longer reflect its contents.
+        void release(const std::filesystem::path& path);
+
+        // Each returns false on failure.  An offset of -1 reads from the current position.
+        bool read(int filedesc, long offset, unsigned int size, void* data);
+        bool seek(int filedesc, long offset, int method, long& position);
+        bool length(int filedesc, long& length);
+
+        read_cache_stats stats() const noexcept { return _stats; }
+
+    private:
+        struct mapped_descriptor
+        {
+            std::unique_ptr<archive::mapped_file> file;
+            std::filesystem::path path;
+            long position = 0;
+        };
+
+    private:
+        mapped_descriptor* find(int filedesc) noexcept;
+
+    private:
+        descriptor_io* _io;
+        bool _enabled;
+        // Indexed by descriptor; the C runtime hands out the lowest free one, so this stays
+        // small.
+        std::vector<std::unique_ptr<mapped_descriptor>> _descriptors;
+        read_cache_stats _stats;
+    };
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include <fileio/read_cache.h>
+
+#include <archive/mapped_file.h>
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <system_error>
+
+#include <cstdio>
+#include <cstring>
+
+
+namespace wcdx::fileio
+{
+    descriptor_io::~descriptor_io() = default;
+
+    read_cache::read_cache(descriptor_io& io, bool enabled)
+        : _io(&io), _enabled(enabled)
+    {
+    }
+
+    read_cache::~read_cache() = default;
+
+    bool read_cache::attach(int filedesc, const std::filesystem::path& path)
+    {
+        if (!_enabled || filedesc < 0)
+            return false;
+
+        auto descriptor = std::make_unique<mapped_descriptor>();
+        try
+        {
+            descriptor->file = std::make_unique<archive::mapped_file>(path);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        // Positions are longs, so larger files are left to io.
+        if (descriptor->file->size() > size_t(std::numeric_limits<long>::max()))
+            return false;
+
+        descriptor->path = path;
+        if (size_t(filedesc) >= _descriptors.size())
+            _descriptors.resize(size_t(filedesc) + 1);
+        if (_descriptors[filedesc] == nullptr)
+            ++_stats.mapped_files;
+        _descriptors[filedesc] = std::move(descriptor);
+        return true;
+    }
+
+    void read_cache::detach(int filedesc) noexcept
+    {
+        if (find(filedesc) == nullptr)
+            return;
+
+        _descriptors[filedesc] = nullptr;
+        --_stats.mapped_files;
+    }
+
+    void read_cache::release(const std::filesystem::path& path)
+    {
+        for (size_t filedesc = 0; filedesc != _descriptors.size(); ++filedesc)
+        {
+            auto& descriptor = _descriptors[filedesc];
+            if (descriptor == nullptr)
+                continue;
+
+            std::error_code ec;
+            if (descriptor->path != path && !std::filesystem::equivalent(descriptor->path, path, ec))
+                continue;
+
+            _io->seek(int(filedesc), descriptor->position, SEEK_SET);
+            descriptor = nullptr;
+            --_stats.mapped_files;
+        }
+    }
+
+    bool read_cache::read(int filedesc, long offset, unsigned int size, void* data)
+    {
+        auto descriptor = find(filedesc);
+        if (descriptor == nullptr)
+        {
+            ++_stats.misses;
+            if (offset != -1 && _io->seek(filedesc, offset, SEEK_SET) == -1)
+                return false;
+            return _io->read(filedesc, data, size) != -1;
+        }
+
+        ++_stats.hits;
+        if (offset != -1)
+        {
+            if (offset < 0)
+                return false;
+            descriptor->position = offset;
+        }
+
+        // Like read, a read at or past the end of the file succeeds with whatever's there.
+        auto file_size = descriptor->file->size();
+        auto position = size_t(descriptor->position);
+        auto count = position < file_size ? std::min(size_t(size), file_size - position) : 0;
+        if (count != 0)
+            std::memcpy(data, descriptor->file->data() + position, count);
+
+        descriptor->position += long(count);
+        _stats.bytes_served += count;
+        return true;
+    }
+
+    bool read_cache::seek(int filedesc, long offset, int method, long& position)
+    {
+        auto descriptor = find(filedesc);
+        if (descriptor == nullptr)
+        {
+            ++_stats.misses;
+            position = _io->seek(filedesc, offset, method);
+            return position != -1;
+        }
+
+        ++_stats.hits;
+        long long base;
+        switch (method)
+        {
+        case SEEK_SET:
+            base = 0;
+            break;
+
+        case SEEK_CUR:
+            base = descriptor->position;
+            break;
+
+        case SEEK_END:
+            base = (long long)descriptor->file->size();
+            break;
+
+        default:
+            position = -1;
+            return false;
+        }
+
+        // Seeking past the end is allowed, but not before the start.
+        auto target = base + offset;
+        if (target < 0 || target > std::numeric_limits<long>::max())
+        {
+            position = -1;
+            return false;
+        }
+
+        descriptor->position = long(target);
+        position = descriptor->position;
+        return true;
+    }
+
+    bool read_cache::length(int filedesc, long& length)
+    {
+        auto descriptor = find(filedesc);
+        if (descriptor == nullptr)
+        {
+            ++_stats.misses;
+            length = _io->length(filedesc);
+            return length != -1;
+        }
+
+        ++_stats.hits;
+        length = long(descriptor->file->size());
+        return true;
+    }
+
+    read_cache::mapped_descriptor* read_cache::find(int filedesc) noexcept
+    {
+        if (filedesc < 0 || size_t(filedesc) >= _descriptors.size())
+            return nullptr;
+        return _descriptors[filedesc].get();
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef FRAME_CONVERT_INCLUDED
+#define FRAME_CONVERT_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::frame
+{
+    class dirty_rows;
+
+    // Replaces each of count palette indices with its 32-bit color from a 256-entry palette.
+    // Uses AVX2 gathers when the processor supports them, and a portable loop otherwise.
+    void convert_indices(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept;
+
+    // The portable loop used by convert_indices when AVX2 isn't available.
+    void convert_indices_portable(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept;
+
+    // Whether convert_indices will use AVX2 on this processor.
+    bool has_vector_conversion() noexcept;
+
+    // Converts every dirty span of an indexed frame.  frame holds one index per pixel, row by
+    // row, dirty.width() pixels to a row.  colors points at the pixel for the top left corner
+    // of dirty.bounds(), and consecutive rows of colors are pitch bytes apart.
+    void convert_dirty_rows(const dirty_rows& dirty, const std::byte* frame, const uint32_t* palette, void* colors, ptrdiff_t pitch) noexcept;
+}
+
+#endif
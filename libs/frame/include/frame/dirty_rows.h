@@ -0,0 +1,65 @@
+#ifndef FRAME_DIRTY_ROWS_INCLUDED
+#define FRAME_DIRTY_ROWS_INCLUDED
+#pragma once
+
+#include <vector>
+
+
+namespace wcdx::frame
+{
+    // A horizontal range of pixels, [left, right).
+    struct row_span
+    {
+        unsigned left;
+        unsigned right;
+
+        bool empty() const noexcept { return left >= right; }
+    };
+
+    // A rectangle of pixels, [left, right) by [top, bottom).
+    struct frame_rect
+    {
+        unsigned left;
+        unsigned top;
+        unsigned right;
+        unsigned bottom;
+
+        bool empty() const noexcept { return left >= right || top >= bottom; }
+    };
+
+    // Tracks which pixels of a frame have changed since it was last presented.  Each row
+    // keeps a single span covering everything written to it, so marking is constant time
+    // per row and the pixels between two separate writes to one row are counted as dirty.
+    class dirty_rows
+    {
+    public:
+        dirty_rows(unsigned width, unsigned height);
+
+    public:
+        unsigned width() const noexcept { return _width; }
+        unsigned height() const noexcept { return _height; }
+
+        // Marks a rectangle as changed.  Parts of it outside the frame are ignored.
+        void mark(int x, int y, unsigned width, unsigned height) noexcept;
+        void mark_all() noexcept;
+        void clear() noexcept;
+
+        bool any() const noexcept { return _bounds.top < _bounds.bottom; }
+        bool all() const noexcept { return _full_rows == _height; }
+
+        // The smallest rectangle enclosing every dirty span.  Empty when nothing is dirty.
+        const frame_rect& bounds() const noexcept { return _bounds; }
+
+        // The dirty span of row y.  Empty if the row is clean.
+        row_span row(unsigned y) const noexcept { return _spans[y]; }
+
+    private:
+        unsigned _width;
+        unsigned _height;
+        std::vector<row_span> _spans;
+        frame_rect _bounds;
+        unsigned _full_rows;
+    };
+}
+
+#endif
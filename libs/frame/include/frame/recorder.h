@@ -0,0 +1,111 @@
+#ifndef FRAME_RECORDER_INCLUDED
+#define FRAME_RECORDER_INCLUDED
+#pragma once
+
+#include "recording.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    class output_stream;
+}
+
+namespace wcdx::frame
+{
+    // Records frames without holding up the thread that presents them.  Each frame is copied
+    // into a fixed ring of slots, and a background thread encodes the slots in order and
+    // writes them out as a recording.  A slot only holds a palette when the palette changed,
+    // so an unchanged palette costs nothing to record.  The ring has one producer and one consumer, so
+    // neither side ever takes a lock to hand over a frame; if the writer falls behind and the
+    // ring fills up, new frames are dropped rather than waited for.
+    //
+    // A recorder can also split its output into segments of a bounded size, each a complete
+    // recording of its own that starts with a full frame, so that a long session can be
+    // recorded into a bounded amount of space by discarding old segments.
+    class frame_recorder
+    {
+    public:
+        static constexpr unsigned default_capacity = 16;
+
+        // Called on the writer thread to start each segment.  The returned stream must stay
+        // valid until the next call or until the recorder is destroyed.
+        using segment_opener = std::function<stdext::output_stream& ()>;
+
+    public:
+        // The stream must outlive the recorder.  capacity is the number of frames the ring
+        // can hold.
+        frame_recorder(unsigned width, unsigned height, stdext::output_stream& out, unsigned capacity = default_capacity);
+        // Starts a new segment, with a call to open_segment, once the current one has grown to
+        // segment_size bytes or more.  A segment_size of zero never starts another segment.
+        frame_recorder(unsigned width, unsigned height, segment_opener open_segment, uint64_t segment_size, unsigned capacity = default_capacity);
+        frame_recorder(const frame_recorder&) = delete;
+        frame_recorder& operator = (const frame_recorder&) = delete;
+        // Writes any frames still in the ring before returning.
+        ~frame_recorder();
+
+    public:
+        // Copies width * height palette indices into the ring, along with a 256-color X8R8G8B8
+        // palette if palette_changed is set; otherwise the frame keeps the palette of the
+        // frame before it.  A palette change passed with a dropped frame is carried over to
+        // the next frame recorded.  Returns false if the frame was dropped because the ring
+        // was full or the recording has failed.  Only one thread may record frames.
+        bool record(const std::byte* pixels, const uint32_t* palette, bool palette_changed = true) noexcept;
+
+        // Writes all frames recorded so far and stops the background thread.  Rethrows the
+        // first error the writer ran into, if any.  No frames can be recorded afterward.
+        void finish();
+
+        size_t recorded_frames() const noexcept { return _head.load(std::memory_order_relaxed); }
+        size_t dropped_frames() const noexcept { return _dropped.load(std::memory_order_relaxed); }
+        // Only meaningful once the recorder has finished.
+        size_t segments() const noexcept { return _segments; }
+
+    private:
+        void write_frames() noexcept;
+        void stop() noexcept;
+
+    private:
+        recording_encoder _encoder;
+        segment_opener _open_segment;
+        uint64_t _segment_size;
+        // Only used by the writer.
+        stdext::output_stream* _out;
+        size_t _segments;
+        size_t _frame_size;
+        unsigned _capacity;
+        std::unique_ptr<std::byte[]> _pixels;
+        std::unique_ptr<uint32_t[]> _palettes;
+        std::unique_ptr<bool[]> _palette_changed;
+        // Only used by the recording thread: whether the next frame recorded carries a palette.
+        bool _palette_pending;
+        // Only used by the writer: the palette of the last frame written.
+        uint32_t _palette[256];
+
+        // _head counts frames handed to the ring and is only written by the recording
+        // thread; _tail counts frames written out and is only written by the writer.
+        std::atomic<size_t> _head;
+        std::atomic<size_t> _tail;
+        std::atomic<size_t> _dropped;
+        std::atomic<bool> _stopping;
+        std::atomic<bool> _failed;
+        std::atomic<bool> _waiting;
+        std::exception_ptr _error;
+
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::thread _writer;
+    };
+}
+
+#endif
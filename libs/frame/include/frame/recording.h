@@ -0,0 +1,106 @@
+#ifndef FRAME_RECORDING_INCLUDED
+#define FRAME_RECORDING_INCLUDED
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+    class input_stream;
+}
+
+namespace wcdx::frame
+{
+    // A recording is a sequence of indexed frames, each stored as the differences from the
+    // frame before it.  All values are little-endian.
+    //
+    //  header:     "WCFR", uint16 version, uint16 width, uint16 height
+    //  frame:      record* 0x00
+    //  record:     0x01 uint8 first uint8 (count - 1) (red green blue){count}
+    //                  - palette entries [first, first + count) changed
+    //              0x02 uint16 x uint16 y uint16 length byte{length}
+    //                  - pixels [x, x + length) of row y changed
+    //
+    // Every pixel and palette entry is zero before the first frame.
+    constexpr uint16_t recording_version = 1;
+
+    // Produces a recording one frame at a time.  Working buffers are kept between calls, so
+    // once they've grown to fit, encoding another frame doesn't allocate.
+    class recording_encoder
+    {
+    public:
+        recording_encoder(unsigned width, unsigned height);
+        recording_encoder(const recording_encoder&) = delete;
+        recording_encoder& operator = (const recording_encoder&) = delete;
+
+    public:
+        unsigned width() const noexcept { return _width; }
+        unsigned height() const noexcept { return _height; }
+
+        // The header that starts every recording.  The encoder starts over from a blank frame,
+        // so the next frame is encoded in full.
+        stdext::array_view<const std::byte> header();
+
+        // Encodes width * height palette indices and a 256-color X8R8G8B8 palette as the next
+        // frame.  The returned data is owned by the encoder and remains valid until the next
+        // call.
+        stdext::array_view<const std::byte> encode(const std::byte* pixels, const uint32_t* palette);
+
+    private:
+        void encode_palette(const uint32_t* palette);
+        void encode_row(unsigned y, const std::byte* row, std::byte* previous);
+
+    private:
+        unsigned _width;
+        unsigned _height;
+        std::vector<std::byte> _pixels;
+        uint32_t _palette[256];
+        std::vector<std::byte> _output;
+    };
+
+    // Plays back a recording one frame at a time.
+    class recording_reader
+    {
+    public:
+        // Reads the header.  The stream must outlive the reader.
+        explicit recording_reader(stdext::input_stream& in);
+        recording_reader(const recording_reader&) = delete;
+        recording_reader& operator = (const recording_reader&) = delete;
+
+    public:
+        unsigned width() const noexcept { return _width; }
+        unsigned height() const noexcept { return _height; }
+
+        // Applies the next frame.  Returns false at the end of the recording.
+        bool next();
+
+        // The number of frames applied so far.
+        size_t frame_number() const noexcept { return _frame_number; }
+        // Whether the last frame changed any palette entries.
+        bool palette_changed() const noexcept { return _palette_changed; }
+
+        // The current frame, width * height palette indices.
+        stdext::array_view<const std::byte> pixels() const noexcept;
+        // The current palette as X8R8G8B8 colors.
+        const uint32_t* palette() const noexcept { return _palette; }
+        // The current palette as one byte each of red, green, and blue.
+        stdext::array_view<const std::byte> palette_rgb() const noexcept;
+
+    private:
+        stdext::input_stream* _in;
+        unsigned _width;
+        unsigned _height;
+        size_t _frame_number;
+        bool _palette_changed;
+        std::vector<std::byte> _pixels;
+        uint32_t _palette[256];
+        std::byte _palette_rgb[3 * 256];
+    };
+}
+
+#endif
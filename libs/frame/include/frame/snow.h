@@ -0,0 +1,30 @@
+#ifndef FRAME_SNOW_INCLUDED
+#define FRAME_SNOW_INCLUDED
+#pragma once
+
+#include <random>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::frame
+{
+    // Draws the static the games show on comm screens: each pixel of a rectangle becomes
+    // either the given color index or zero, at random.
+    class snow_generator
+    {
+    public:
+        explicit snow_generator(uint32_t seed);
+
+    public:
+        // Fills the width by height rectangle at (x, y) of an indexed frame whose rows are
+        // pitch bytes apart.
+        void fill(std::byte color_index, int x, int y, unsigned width, unsigned height, size_t pitch, std::byte* pixels);
+
+    private:
+        std::independent_bits_engine<std::mt19937, 1, unsigned int> _random_bit;
+    };
+}
+
+#endif
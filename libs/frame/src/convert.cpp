@@ -0,0 +1,125 @@
+#include <frame/convert.h>
+#include <frame/dirty_rows.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FRAME_HAS_AVX2_KERNEL 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FRAME_TARGET_AVX2
+#else
+#define FRAME_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define FRAME_HAS_AVX2_KERNEL 0
+#endif
+
+
+namespace wcdx::frame
+{
+    namespace
+    {
+#if FRAME_HAS_AVX2_KERNEL
+        bool detect_avx2() noexcept;
+        void convert_indices_avx2(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept;
+#endif
+    }
+
+    void convert_indices(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept
+    {
+#if FRAME_HAS_AVX2_KERNEL
+        if (has_vector_conversion())
+            return convert_indices_avx2(indices, palette, colors, count);
+#endif
+        convert_indices_portable(indices, palette, colors, count);
+    }
+
+    void convert_indices_portable(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept
+    {
+        // Unrolled so that four independent lookups can be in flight at once.
+        auto bytes = reinterpret_cast<const uint8_t*>(indices);
+        size_t n = 0;
+        for (; n + 4 <= count; n += 4)
+        {
+            colors[n] = palette[bytes[n]];
+            colors[n + 1] = palette[bytes[n + 1]];
+            colors[n + 2] = palette[bytes[n + 2]];
+            colors[n + 3] = palette[bytes[n + 3]];
+        }
+        for (; n < count; ++n)
+            colors[n] = palette[bytes[n]];
+    }
+
+    bool has_vector_conversion() noexcept
+    {
+#if FRAME_HAS_AVX2_KERNEL
+        static const bool supported = detect_avx2();
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    void convert_dirty_rows(const dirty_rows& dirty, const std::byte* frame, const uint32_t* palette, void* colors, ptrdiff_t pitch) noexcept
+    {
+        auto& bounds = dirty.bounds();
+        auto dest = static_cast<std::byte*>(colors);
+        for (auto y = bounds.top; y < bounds.bottom; ++y, dest += pitch)
+        {
+            auto span = dirty.row(y);
+            if (span.empty())
+                continue;
+
+            convert_indices(frame + size_t(y) * dirty.width() + span.left, palette,
+                reinterpret_cast<uint32_t*>(dest) + (span.left - bounds.left), span.right - span.left);
+        }
+    }
+
+    namespace
+    {
+#if FRAME_HAS_AVX2_KERNEL
+        bool detect_avx2() noexcept
+        {
+#if defined(_MSC_VER)
+            // AVX2 needs the processor to support it and the OS to save the YMM registers.
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+
+            constexpr int osxsave_avx = 1 << 27 | 1 << 28;
+            __cpuid(info, 1);
+            if ((info[2] & osxsave_avx) != osxsave_avx || (_xgetbv(0) & 6) != 6)
+                return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & 1 << 5) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        FRAME_TARGET_AVX2 void convert_indices_avx2(const std::byte* indices, const uint32_t* palette, uint32_t* colors, size_t count) noexcept
+        {
+            // Widen eight indices at a time to 32 bits and gather their colors in one go.
+            auto table = reinterpret_cast<const int*>(palette);
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                auto low = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + n)));
+                auto high = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + n + 8)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + n), _mm256_i32gather_epi32(table, low, 4));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + n + 8), _mm256_i32gather_epi32(table, high, 4));
+            }
+            if (n + 8 <= count)
+            {
+                auto group = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + n)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + n), _mm256_i32gather_epi32(table, group, 4));
+                n += 8;
+            }
+            for (; n < count; ++n)
+                colors[n] = palette[uint8_t(indices[n])];
+        }
+#endif
+    }
+}
@@ -0,0 +1,77 @@
+#include <frame/dirty_rows.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstdint>
+
+
+namespace wcdx::frame
+{
+    namespace
+    {
+        constexpr row_span empty_span = { 0, 0 };
+        constexpr frame_rect empty_rect = { 0, 0, 0, 0 };
+
+        unsigned clamp(int64_t value, unsigned limit) noexcept
+        {
+            return unsigned(std::clamp(value, int64_t(0), int64_t(limit)));
+        }
+    }
+
+    dirty_rows::dirty_rows(unsigned width, unsigned height)
+        : _width(width), _height(height), _spans(height, empty_span), _bounds(empty_rect), _full_rows(0)
+    {
+        if (width == 0 || height == 0)
+            throw std::range_error("Invalid frame dimensions");
+    }
+
+    void dirty_rows::mark(int x, int y, unsigned width, unsigned height) noexcept
+    {
+        auto left = clamp(x, _width);
+        auto right = clamp(int64_t(x) + width, _width);
+        auto top = clamp(y, _height);
+        auto bottom = clamp(int64_t(y) + height, _height);
+        if (left >= right || top >= bottom)
+            return;
+
+        if (any())
+        {
+            _bounds.left = std::min(_bounds.left, left);
+            _bounds.top = std::min(_bounds.top, top);
+            _bounds.right = std::max(_bounds.right, right);
+            _bounds.bottom = std::max(_bounds.bottom, bottom);
+        }
+        else
+        {
+            _bounds = { left, top, right, bottom };
+        }
+
+        for (auto row = top; row < bottom; ++row)
+        {
+            auto& span = _spans[row];
+            auto was_full = span.left == 0 && span.right == _width;
+            if (span.empty())
+                span = { left, right };
+            else
+                span = { std::min(span.left, left), std::max(span.right, right) };
+            if (!was_full && span.left == 0 && span.right == _width)
+                ++_full_rows;
+        }
+    }
+
+    void dirty_rows::mark_all() noexcept
+    {
+        mark(0, 0, _width, _height);
+    }
+
+    void dirty_rows::clear() noexcept
+    {
+        if (!any())
+            return;
+
+        std::fill(_spans.begin() + _bounds.top, _spans.begin() + _bounds.bottom, empty_span);
+        _bounds = empty_rect;
+        _full_rows = 0;
+    }
+}
@@ -0,0 +1,151 @@
+#include <frame/recorder.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+#include <cstring>
+
+
+namespace wcdx::frame
+{
+    namespace
+    {
+        constexpr size_t palette_size = 256;
+
+        // The recording thread wakes the writer without taking the lock, so a wakeup can be
+        // missed; the writer checks back this often in case it was.
+        constexpr std::chrono::milliseconds writer_poll_interval(50);
+    }
+
+    frame_recorder::frame_recorder(unsigned width, unsigned height, stdext::output_stream& out, unsigned capacity)
+        : frame_recorder(width, height, [&out]() -> stdext::output_stream& { return out; }, 0, capacity)
+    {
+    }
+
+    frame_recorder::frame_recorder(unsigned width, unsigned height, segment_opener open_segment, uint64_t segment_size, unsigned capacity)
+        : _encoder(width, height), _open_segment(std::move(open_segment)), _segment_size(segment_size)
+        , _out(nullptr), _segments(0), _frame_size(size_t(width) * height), _capacity(capacity)
+        , _palette_pending(true), _palette(), _head(0), _tail(0), _dropped(0), _stopping(false), _failed(false), _waiting(false)
+    {
+        if (capacity == 0)
+            throw std::range_error("Recorder capacity must be at least one frame");
+
+        _pixels = std::make_unique<std::byte[]>(_frame_size * capacity);
+        _palettes = std::make_unique<uint32_t[]>(palette_size * capacity);
+        _palette_changed = std::make_unique<bool[]>(capacity);
+        _writer = std::thread([this] { write_frames(); });
+    }
+
+    frame_recorder::~frame_recorder()
+    {
+        stop();
+    }
+
+    bool frame_recorder::record(const std::byte* pixels, const uint32_t* palette, bool palette_changed) noexcept
+    {
+        _palette_pending = _palette_pending || palette_changed;
+
+        auto head = _head.load(std::memory_order_relaxed);
+        if (_failed.load(std::memory_order_relaxed) || _stopping.load(std::memory_order_relaxed)
+            || head - _tail.load(std::memory_order_acquire) == _capacity)
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        auto slot = head % _capacity;
+        std::memcpy(_pixels.get() + slot * _frame_size, pixels, _frame_size);
+        _palette_changed[slot] = _palette_pending;
+        if (_palette_pending)
+        {
+            std::memcpy(_palettes.get() + slot * palette_size, palette, palette_size * sizeof(*palette));
+            _palette_pending = false;
+        }
+
+        // Publishing the frame and checking for a sleeping writer are both sequentially
+        // consistent, pairing with the writer's own store and load in the other order.
+        _head.store(head + 1);
+        if (_waiting.load())
+            _wake.notify_one();
+        return true;
+    }
+
+    void frame_recorder::finish()
+    {
+        stop();
+        if (_error)
+            std::rethrow_exception(_error);
+    }
+
+    void frame_recorder::write_frames() noexcept
+    {
+        try
+        {
+            uint64_t written = 0;
+            auto start_segment = [&]
+            {
+                _out = &_open_segment();
+                ++_segments;
+                auto header = _encoder.header();
+                _out->write_all(header.data(), header.size());
+                written = header.size();
+            };
+
+            start_segment();
+            while (true)
+            {
+                auto tail = _tail.load(std::memory_order_relaxed);
+                if (tail == _head.load())
+                {
+                    // Anything recorded before stopping was published first, so one more look
+                    // at _head is enough to be sure the ring has drained.
+                    if (_stopping.load())
+                    {
+                        if (tail == _head.load())
+                            break;
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _waiting.store(true);
+                    _wake.wait_for(lock, writer_poll_interval, [&] { return tail != _head.load() || _stopping.load(); });
+                    _waiting.store(false);
+                    continue;
+                }
+
+                auto slot = tail % _capacity;
+                if (_palette_changed[slot])
+                    std::memcpy(_palette, _palettes.get() + slot * palette_size, sizeof(_palette));
+                if (_segment_size != 0 && written >= _segment_size)
+                    start_segment();
+
+                auto frame = _encoder.encode(_pixels.get() + slot * _frame_size, _palette);
+                _out->write_all(frame.data(), frame.size());
+                written += frame.size();
+                _tail.store(tail + 1, std::memory_order_release);
+            }
+        }
+        catch (...)
+        {
+            _error = std::current_exception();
+            _failed.store(true);
+        }
+    }
+
+    void frame_recorder::stop() noexcept
+    {
+        if (!_writer.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping.store(true);
+        }
+        _wake.notify_one();
+        _writer.join();
+    }
+}
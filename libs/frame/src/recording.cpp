@@ -0,0 +1,238 @@
+#include <frame/recording.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <cstring>
+
+
+namespace wcdx::frame
+{
+    namespace
+    {
+        constexpr std::byte recording_signature[] = { std::byte('W'), std::byte('C'), std::byte('F'), std::byte('R') };
+        constexpr size_t header_size = std::size(recording_signature) + 3 * sizeof(uint16_t);
+
+        enum : uint8_t
+        {
+            record_end_frame    = 0x00,
+            record_palette      = 0x01,
+            record_span         = 0x02,
+        };
+
+        // Bytes of overhead per record.  Runs of unchanged data shorter than this are cheaper
+        // to repeat than to split around.
+        constexpr unsigned palette_record_size = 3;
+        constexpr unsigned span_record_size = 7;
+
+        constexpr uint32_t rgb_mask = 0x00FFFFFF;
+
+        void write_uint16(std::vector<std::byte>& out, unsigned value);
+        unsigned read_uint16(const std::byte* p);
+    }
+
+    recording_encoder::recording_encoder(unsigned width, unsigned height)
+        : _width(width), _height(height), _pixels(size_t(width) * height), _palette()
+    {
+        if (width == 0 || height == 0 || width > UINT16_MAX || height > UINT16_MAX)
+            throw std::range_error("Invalid frame dimensions");
+    }
+
+    stdext::array_view<const std::byte> recording_encoder::header()
+    {
+        std::fill(_pixels.begin(), _pixels.end(), std::byte(0));
+        std::fill(std::begin(_palette), std::end(_palette), 0);
+
+        _output.assign(std::begin(recording_signature), std::end(recording_signature));
+        write_uint16(_output, recording_version);
+        write_uint16(_output, _width);
+        write_uint16(_output, _height);
+        return { _output.data(), _output.size() };
+    }
+
+    stdext::array_view<const std::byte> recording_encoder::encode(const std::byte* pixels, const uint32_t* palette)
+    {
+        _output.clear();
+        encode_palette(palette);
+
+        auto previous = _pixels.data();
+        for (unsigned y = 0; y < _height; ++y)
+        {
+            encode_row(y, pixels, previous);
+            pixels += _width;
+            previous += _width;
+        }
+
+        _output.push_back(std::byte(record_end_frame));
+        return { _output.data(), _output.size() };
+    }
+
+    void recording_encoder::encode_palette(const uint32_t* palette)
+    {
+        auto changed = [&](unsigned n) { return (palette[n] & rgb_mask) != _palette[n]; };
+
+        unsigned n = 0;
+        while (n < 256)
+        {
+            if (!changed(n))
+            {
+                ++n;
+                continue;
+            }
+
+            // A single unchanged entry costs as much as starting a new record, so the record
+            // carries on across it.
+            auto first = n++;
+            while (n < 256 && (changed(n) || (n + 1 < 256 && changed(n + 1))))
+                ++n;
+
+            _output.push_back(std::byte(record_palette));
+            _output.push_back(std::byte(first));
+            _output.push_back(std::byte(n - first - 1));
+            for (auto index = first; index < n; ++index)
+            {
+                auto color = palette[index] & rgb_mask;
+                _output.push_back(std::byte(color >> 16));
+                _output.push_back(std::byte(color >> 8));
+                _output.push_back(std::byte(color));
+                _palette[index] = color;
+            }
+        }
+    }
+
+    void recording_encoder::encode_row(unsigned y, const std::byte* row, std::byte* previous)
+    {
+        if (std::memcmp(row, previous, _width) == 0)
+            return;
+
+        unsigned x = 0;
+        while (true)
+        {
+            while (x < _width && row[x] == previous[x])
+                ++x;
+            if (x == _width)
+                break;
+
+            auto left = x;
+            auto right = x + 1;
+            for (x = right; x < _width && x - right < span_record_size; ++x)
+            {
+                if (row[x] != previous[x])
+                    right = x + 1;
+            }
+
+            _output.push_back(std::byte(record_span));
+            write_uint16(_output, left);
+            write_uint16(_output, y);
+            write_uint16(_output, right - left);
+            _output.insert(_output.end(), row + left, row + right);
+            std::memcpy(previous + left, row + left, right - left);
+            x = right;
+        }
+    }
+
+    recording_reader::recording_reader(stdext::input_stream& in)
+        : _in(&in), _frame_number(0), _palette_changed(false), _palette(), _palette_rgb()
+    {
+        std::byte header[header_size];
+        _in->read_all(header, header_size);
+        if (!std::equal(std::begin(recording_signature), std::end(recording_signature), header))
+            throw std::runtime_error("Not a frame recording");
+
+        auto p = header + std::size(recording_signature);
+        if (read_uint16(p) != recording_version)
+            throw std::runtime_error("Unsupported frame recording version");
+
+        _width = read_uint16(p + 2);
+        _height = read_uint16(p + 4);
+        if (_width == 0 || _height == 0)
+            throw std::runtime_error("Invalid frame recording dimensions");
+        _pixels.resize(size_t(_width) * _height);
+    }
+
+    bool recording_reader::next()
+    {
+        _palette_changed = false;
+        for (bool first = true; ; first = false)
+        {
+            std::byte type[1];
+            if (_in->read(type) != 1)
+            {
+                if (first)
+                    return false;
+                throw std::runtime_error("Frame recording truncated");
+            }
+
+            switch (uint8_t(type[0]))
+            {
+            case record_end_frame:
+                ++_frame_number;
+                return true;
+
+            case record_palette:
+                {
+                    std::byte range[2];
+                    _in->read_all(range, 2);
+                    auto start = unsigned(range[0]);
+                    auto count = unsigned(range[1]) + 1;
+                    if (start + count > 256)
+                        throw std::runtime_error("Palette record outside palette");
+
+                    _in->read_all(_palette_rgb + 3 * start, 3 * count);
+                    for (auto index = start; index < start + count; ++index)
+                    {
+                        auto rgb = _palette_rgb + 3 * index;
+                        _palette[index] = uint32_t(rgb[0]) << 16 | uint32_t(rgb[1]) << 8 | uint32_t(rgb[2]);
+                    }
+                    _palette_changed = true;
+                }
+                break;
+
+            case record_span:
+                {
+                    std::byte span[6];
+                    _in->read_all(span, 6);
+                    auto x = read_uint16(span);
+                    auto y = read_uint16(span + 2);
+                    auto length = read_uint16(span + 4);
+                    if (length == 0 || y >= _height || x + length > _width)
+                        throw std::runtime_error("Span record outside frame");
+
+                    _in->read_all(_pixels.data() + size_t(y) * _width + x, length);
+                }
+                break;
+
+            default:
+                throw std::runtime_error("Invalid frame recording record");
+            }
+        }
+    }
+
+    stdext::array_view<const std::byte> recording_reader::pixels() const noexcept
+    {
+        return { _pixels.data(), _pixels.size() };
+    }
+
+    stdext::array_view<const std::byte> recording_reader::palette_rgb() const noexcept
+    {
+        return _palette_rgb;
+    }
+
+    namespace
+    {
+        void write_uint16(std::vector<std::byte>& out, unsigned value)
+        {
+            out.push_back(std::byte(value));
+            out.push_back(std::byte(value >> 8));
+        }
+
+        unsigned read_uint16(const std::byte* p)
+        {
+            return unsigned(p[0]) | unsigned(p[1]) << 8;
+        }
+    }
+}
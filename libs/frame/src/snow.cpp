@@ -0,0 +1,21 @@
+#include <frame/snow.h>
+
+
+namespace wcdx::frame
+{
+    snow_generator::snow_generator(uint32_t seed)
+        : _random_bit(seed)
+    {
+    }
+
+    void snow_generator::fill(std::byte color_index, int x, int y, unsigned width, unsigned height, size_t pitch, std::byte* pixels)
+    {
+        for (unsigned h = 0; h != height; ++h)
+        {
+            auto p = pixels + ptrdiff_t(y) * ptrdiff_t(pitch) + x;
+            for (unsigned w = 0; w != width; ++w)
+                *p++ = std::byte(_random_bit() * unsigned(color_index));
+            ++y;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef IMAGE_FONT_INCLUDED
+#define IMAGE_FONT_INCLUDED
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::image
+{
+    // Wing Commander II fonts hold 256 glyphs of a single height.  All values are
+    // little-endian.
+    //
+    //  header:     uint16 height, uint16 color index
+    //  widths:     uint8 width[256]
+    //  positions:  uint8 position_low[256], uint8 position_high[256]
+    //                  - where each glyph's pixels start, from the start of the font
+    //  pixels:     byte{width * height} per glyph, row by row
+    class font
+    {
+    public:
+        static constexpr size_t glyph_count = 0x100;
+        static constexpr size_t header_size = 4 + 3 * glyph_count;
+
+    public:
+        // Copies the font's pixels into a single block.  Throws if the data is truncated or
+        // any glyph's pixels lie outside it.
+        explicit font(stdext::array_view<const std::byte> data);
+
+    public:
+        unsigned height() const noexcept { return _height; }
+        unsigned width(unsigned glyph) const noexcept { return _widths[glyph]; }
+        // width(glyph) * height() pixels, row by row.
+        const std::byte* pixels(unsigned glyph) const noexcept { return _pixels.get() + _offsets[glyph]; }
+
+    private:
+        unsigned _height;
+        std::array<uint8_t, glyph_count> _widths;
+        // Offsets into _pixels, which holds everything after the font's header.
+        std::array<uint16_t, glyph_count> _offsets;
+        std::unique_ptr<std::byte[]> _pixels;
+    };
+
+    struct atlas_entry
+    {
+        uint16_t x;
+        uint16_t y;
+        uint8_t width;
+        uint8_t height;
+    };
+
+    // Every glyph of a font packed into a single image with power-of-two sides, which a
+    // renderer can upload as one texture.  Glyphs are laid out left to right in rows of the
+    // font's height, at whichever width gives the smallest image, preferring the squarest
+    // among equals.  Pixels not covered by any glyph are transparent_index.
+    struct font_atlas
+    {
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned font_height = 0;
+        std::vector<std::byte> pixels;
+        std::array<atlas_entry, font::glyph_count> entries = { };
+    };
+
+    font_atlas pack_atlas(const font& font);
+
+    // The atlas's glyph positions, in the form written alongside its image.  All values are
+    // little-endian.
+    //
+    //  header:     "WCFA", uint16 version, uint16 atlas width, uint16 atlas height,
+    //              uint16 font height, uint16 glyph count
+    //  glyph:      uint16 x, uint16 y, uint8 width, uint8 height
+    //                  - one per glyph, in order; empty glyphs have zero width
+    constexpr uint16_t atlas_metrics_version = 1;
+
+    std::vector<std::byte> atlas_metrics(const font_atlas& atlas);
+}
+
+#endif
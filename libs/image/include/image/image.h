@@ -1,3 +1,7 @@
+#ifndef IMAGE_INCLUDED
+#define IMAGE_INCLUDED
+#pragma once
+
 #include <cstddef>
 
 
@@ -18,5 +22,11 @@ namespace wcdx::image
         unsigned height;
     };
 
+    // The last palette entry is transparent in every image the games use.
+    constexpr std::byte transparent_index { 0xFF };
+
+    // Writes a single PNG image.  When writing many images, use a png_encoder instead.
     void write_image(const image_descriptor& descriptor, stdext::array_view<const std::byte> palette, stdext::input_stream& pixels, stdext::multi_ref<stdext::output_stream, stdext::seekable> out);
 }
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef IMAGE_PALETTE_INCLUDED
+#define IMAGE_PALETTE_INCLUDED
+#pragma once
+
+#include "image.h"
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::image
+{
+    // Maps true color pixels to the nearest color of a 256-color palette, by squared
+    // distance in RGB space, with ties going to the lower index.  The last palette entry is
+    // reserved for transparency and is never chosen for an opaque pixel.
+    //
+    // The color cube is divided into cells, and each cell keeps the few palette colors that
+    // could be nearest to some color inside it.  These lists are built once, on construction,
+    // so looking up a color only compares it against a handful of candidates.  A quantizer
+    // never changes after construction and may be shared between threads.
+    class color_quantizer
+    {
+    public:
+        // The palette holds one byte each of red, green, and blue for 256 colors.
+        explicit color_quantizer(stdext::array_view<const std::byte> palette);
+
+    public:
+        std::byte nearest(uint8_t red, uint8_t green, uint8_t blue) const noexcept;
+
+        // Converts width * height pixels, stored row by row from the top as four bytes each
+        // of blue, green, red, and alpha, into palette indices.  Pixels with an alpha of 0 or 1
+        // become the transparent index.  When dither is set, each opaque pixel's quantization
+        // error is diffused to its opaque neighbors (Floyd-Steinberg).
+        void quantize(const image_descriptor& descriptor, stdext::array_view<const std::byte> bgra, stdext::array_view<std::byte> indices, bool dither = false) const;
+
+    private:
+        struct candidate
+        {
+            uint8_t red;
+            uint8_t green;
+            uint8_t blue;
+            uint8_t index;
+        };
+
+    private:
+        std::vector<uint32_t> _cells;
+        std::vector<candidate> _candidates;
+        candidate _colors[256];
+    };
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef IMAGE_PNG_INCLUDED
+#define IMAGE_PNG_INCLUDED
+#pragma once
+
+#include "image.h"
+
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+    class output_stream;
+}
+
+namespace wcdx::image
+{
+    class deflater;
+
+    // Encodes 8-bit indexed PNG images.  The palette is converted once, on construction, and
+    // working buffers are reused from one image to the next, so a single encoder can write
+    // any number of images without further setup.  An encoder may only be used by one
+    // thread at a time.
+    class png_encoder
+    {
+    public:
+        static constexpr unsigned default_compression_level = 6;
+        static constexpr unsigned max_compression_level = 9;
+
+    public:
+        // The palette holds one byte each of red, green, and blue for 256 colors.  The last
+        // color is written as transparent.
+        explicit png_encoder(stdext::array_view<const std::byte> palette, unsigned compression_level = default_compression_level);
+        png_encoder(const png_encoder&) = delete;
+        png_encoder& operator = (const png_encoder&) = delete;
+        ~png_encoder();
+
+    public:
+        unsigned compression_level() const noexcept { return _compression_level; }
+        // 0 stores pixels without compression; max_compression_level is smallest and slowest.
+        void set_compression_level(unsigned level);
+
+        // Encodes width * height palette indices, stored row by row from the top.  The
+        // returned data is owned by the encoder and remains valid until the next call.
+        stdext::array_view<const std::byte> encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels);
+        void encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels, stdext::output_stream& out);
+
+    private:
+        std::unique_ptr<deflater> _deflater;
+        unsigned _compression_level;
+        std::vector<std::byte> _palette_chunks;     // PLTE and tRNS, ready to copy
+        std::vector<std::byte> _scanlines;
+        std::vector<std::byte> _output;
+    };
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef IMAGE_SPRITE_INCLUDED
+#define IMAGE_SPRITE_INCLUDED
+#pragma once
+
+#include "image.h"
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::image
+{
+    // Sprites are the images stored in image sets.  Each begins with its extents around a
+    // reference point, followed by a list of horizontal segments of opaque pixels.  A segment
+    // header holds the segment's width (shifted left by one), its position relative to the
+    // reference point, and a flag in the low bit.  Unflagged segments are followed by their
+    // pixels.  Flagged segments are made up of runs, each with a one-byte header holding the
+    // run's length (shifted left by one) and a flag: flagged runs repeat a single pixel,
+    // and unflagged runs are followed by their pixels.  A zero segment header ends the list.
+    struct sprite_header
+    {
+        int16_t right_extent;
+        int16_t left_extent;
+        int16_t top_extent;
+        int16_t bottom_extent;
+
+        int width() const noexcept { return int(left_extent) + right_extent + 1; }
+        int height() const noexcept { return int(top_extent) + bottom_extent + 1; }
+    };
+
+    // Throws if sprite is too short to hold a header or the extents are invalid.
+    sprite_header read_sprite_header(stdext::array_view<const std::byte> sprite);
+
+    // Decodes sprite into pixels, which must hold width() * height() bytes.  Pixels not
+    // covered by any segment are set to transparent_index.  Throws if the data is truncated
+    // or any segment falls outside the sprite's extents.
+    void decode_sprite(stdext::array_view<const std::byte> sprite, stdext::array_view<std::byte> pixels);
+
+    // Encodes images as sprites using as few bytes as the format allows.  Each row's opaque
+    // pixels form segments, and each segment is split into fill and literal runs by a
+    // linear-time search for the cheapest split.  Working buffers are reused from one image
+    // to the next.  An encoder may only be used by one thread at a time.
+    class sprite_encoder
+    {
+    public:
+        static constexpr size_t max_segment_width = 0x7FFF;
+        static constexpr size_t max_run_width = 0x7F;
+
+    public:
+        sprite_encoder() = default;
+        sprite_encoder(const sprite_encoder&) = delete;
+        sprite_encoder& operator = (const sprite_encoder&) = delete;
+
+    public:
+        // Encodes width * height palette indices, stored row by row from the top, with the
+        // reference point at (reference_x, reference_y) from the top left corner.  Pixels set
+        // to transparent_index are left out.  The returned data is owned by the encoder and
+        // remains valid until the next call.
+        stdext::array_view<const std::byte> encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels, int reference_x, int reference_y);
+
+    private:
+        void encode_segment(const std::byte* pixels, size_t width, int x, int y);
+        void write_uint16(unsigned value);
+
+    private:
+        std::vector<uint32_t> _costs;
+        std::vector<uint8_t> _runs;
+        std::vector<uint8_t> _path;
+        std::vector<std::byte> _output;
+    };
+}
+
+#endif
@@ -0,0 +1,672 @@
+#include "deflate.h"
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+
+namespace wcdx::image
+{
+    namespace
+    {
+        constexpr unsigned window_size = 1 << 15;
+        constexpr unsigned hash_bits = 15;
+        constexpr unsigned min_match = 3;
+        constexpr unsigned max_match = 258;
+        constexpr size_t max_block_symbols = 1 << 14;
+        constexpr size_t max_stored_block = 0xFFFF;
+
+        constexpr unsigned end_of_block = 256;
+        constexpr unsigned litlen_code_count = 286;
+        constexpr unsigned distance_code_count = 30;
+        constexpr unsigned code_length_code_count = 19;
+        constexpr unsigned max_code_length = 15;
+        constexpr unsigned max_code_length_code_length = 7;
+
+        enum : uint32_t
+        {
+            block_stored    = 0,
+            block_fixed     = 1,
+            block_dynamic   = 2,
+        };
+
+        // How hard each level looks for matches.  The search stops after max_chain candidates
+        // or once a match of nice_length is found.  Matches shorter than lazy_length are
+        // only taken if the next position doesn't start a longer one.
+        struct level_parameters
+        {
+            unsigned max_chain;
+            unsigned nice_length;
+            unsigned lazy_length;
+        };
+
+        constexpr level_parameters levels[] =
+        {
+            {    0,   0,   0 },
+            {    4,   8,   0 },
+            {    8,  16,   0 },
+            {   16,  32,   0 },
+            {   16,  16,  16 },
+            {   32,  32,  32 },
+            {  128, 128, 128 },
+            {  256, 258, 258 },
+            { 1024, 258, 258 },
+            { 4096, 258, 258 },
+        };
+        static_assert(std::size(levels) == deflater::max_level + 1);
+
+        constexpr uint16_t length_base[] =
+        {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+        };
+        constexpr uint8_t length_extra_bits[] =
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+        };
+        constexpr uint16_t distance_base[] =
+        {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+        };
+        constexpr uint8_t distance_extra_bits[] =
+        {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+        };
+        constexpr uint8_t code_length_order[] =
+        {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+        };
+
+        struct symbol_tables
+        {
+            // Indexed by length - min_match.
+            uint8_t length_code[max_match - min_match + 1];
+            // Indexed by distance - 1 for short distances, and by 256 + ((distance - 1) >> 7)
+            // for the rest.
+            uint8_t distance_code[512];
+        };
+
+        const symbol_tables& tables();
+        unsigned length_code(unsigned length);
+        unsigned distance_code(unsigned distance);
+
+        template <size_t Size>
+        struct huffman_code
+        {
+            uint8_t lengths[Size];
+            uint16_t codes[Size];       // bit-reversed, ready to write least significant bit first
+        };
+
+        template <size_t Size>
+        void build_code(const uint32_t (&frequencies)[Size], unsigned max_length, huffman_code<Size>& code);
+        void build_lengths(const uint32_t* frequencies, unsigned count, unsigned max_length, uint8_t* lengths);
+        void assign_codes(const uint8_t* lengths, unsigned count, uint16_t* codes);
+
+        struct fixed_codes
+        {
+            huffman_code<288> litlen;
+            huffman_code<32> distance;
+        };
+
+        const fixed_codes& fixed();
+    }
+
+    class deflater::bit_writer
+    {
+    public:
+        explicit bit_writer(std::vector<std::byte>& output) noexcept : _output(output) { }
+        bit_writer(const bit_writer&) = delete;
+        bit_writer& operator = (const bit_writer&) = delete;
+
+    public:
+        void write(uint32_t bits, unsigned count)
+        {
+            _bits |= uint64_t(bits) << _count;
+            _count += count;
+            if (_count >= 32)
+            {
+                std::byte word[4] = { std::byte(_bits), std::byte(_bits >> 8), std::byte(_bits >> 16), std::byte(_bits >> 24) };
+                _output.insert(_output.end(), std::begin(word), std::end(word));
+                _bits >>= 32;
+                _count -= 32;
+            }
+        }
+
+        // Pads the output to a byte boundary.
+        void align()
+        {
+            for (; _count > 0; _count -= std::min(_count, 8u))
+            {
+                _output.push_back(std::byte(_bits));
+                _bits >>= 8;
+            }
+        }
+
+        // Only valid at a byte boundary.
+        void write_bytes(const std::byte* data, size_t size)
+        {
+            _output.insert(_output.end(), data, data + size);
+        }
+
+    private:
+        std::vector<std::byte>& _output;
+        uint64_t _bits = 0;
+        unsigned _count = 0;
+    };
+
+    void deflater::compress(stdext::array_view<const std::byte> input, unsigned level, std::vector<std::byte>& output)
+    {
+        if (level > max_level)
+            throw std::range_error("Invalid compression level");
+        if (input.size() > std::numeric_limits<uint32_t>::max() - window_size)
+            throw std::length_error("Input too large to compress");
+
+        bit_writer out(output);
+        if (level == 0)
+        {
+            write_stored(input.data(), input.size(), true, out);
+            out.align();
+            return;
+        }
+
+        // Hash chains: _head holds the most recent position (plus one, so zero means none)
+        // for each hash of three bytes, and _prev links each position in the window to the
+        // previous one with the same hash.
+        _head.assign(size_t(1) << hash_bits, 0);
+        _prev.resize(window_size);
+        _symbols.clear();
+        _symbols.reserve(max_block_symbols);
+
+        auto& parameters = levels[level];
+        auto data = input.data();
+        auto size = uint32_t(input.size());
+
+        auto hash = [&](uint32_t pos)
+        {
+            auto key = uint32_t(data[pos]) | uint32_t(data[pos + 1]) << 8 | uint32_t(data[pos + 2]) << 16;
+            return (key * 2654435761u) >> (32 - hash_bits);
+        };
+
+        auto insert = [&](uint32_t pos)
+        {
+            if (pos + min_match > size)
+                return;
+
+            auto& head = _head[hash(pos)];
+            _prev[pos & (window_size - 1)] = head;
+            head = pos + 1;
+        };
+
+        // Returns the length of the longest match for pos (zero if there is none) and sets
+        // distance.  Must be called before pos is inserted.
+        auto find_match = [&](uint32_t pos, uint32_t& distance) -> uint32_t
+        {
+            auto limit = std::min(max_match, size - pos);
+            if (limit < min_match)
+                return 0;
+
+            uint32_t best_length = min_match - 1;
+            auto candidate = _head[hash(pos)];
+            for (auto chain = parameters.max_chain; candidate != 0 && chain != 0; --chain)
+            {
+                auto match = candidate - 1;
+                if (pos - match > window_size)
+                    break;
+
+                if (data[match + best_length] == data[pos + best_length])
+                {
+                    uint32_t length = 0;
+                    while (length < limit && data[match + length] == data[pos + length])
+                        ++length;
+
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        distance = pos - match;
+                        if (length >= parameters.nice_length || length == limit)
+                            break;
+                    }
+                }
+
+                candidate = _prev[match & (window_size - 1)];
+            }
+
+            return best_length >= min_match ? best_length : 0;
+        };
+
+        uint32_t block_start = 0;
+        auto end_block = [&](uint32_t pos, bool final)
+        {
+            write_block(data + block_start, pos - block_start, final, out);
+            _symbols.clear();
+            block_start = pos;
+        };
+
+        uint32_t pos = 0;
+        uint32_t pending_length = 0;
+        uint32_t pending_distance = 0;
+        bool have_pending = false;
+        while (pos < size)
+        {
+            uint32_t length, distance = 0;
+            if (have_pending)
+            {
+                length = pending_length;
+                distance = pending_distance;
+                have_pending = false;
+            }
+            else
+                length = find_match(pos, distance);
+            insert(pos);
+
+            if (length != 0 && length < parameters.lazy_length && pos + 1 < size)
+            {
+                pending_length = find_match(pos + 1, pending_distance);
+                have_pending = true;
+                if (pending_length > length)
+                    length = 0;
+            }
+
+            if (length != 0)
+            {
+                _symbols.push_back(distance << 16 | (length - min_match));
+                for (auto last = pos + length; ++pos != last; )
+                    insert(pos);
+                have_pending = false;
+            }
+            else
+            {
+                _symbols.push_back(uint32_t(data[pos]));
+                ++pos;
+            }
+
+            if (_symbols.size() == max_block_symbols)
+                end_block(pos, pos == size);
+        }
+
+        if (!_symbols.empty() || size == 0)
+            end_block(pos, true);
+        out.align();
+    }
+
+    void deflater::write_stored(const std::byte* data, size_t size, bool final, bit_writer& out)
+    {
+        do
+        {
+            auto block_size = std::min(size, max_stored_block);
+            size -= block_size;
+            out.write(final && size == 0 ? 1 : 0, 1);
+            out.write(block_stored, 2);
+            out.align();
+            out.write(uint32_t(block_size) | uint32_t(~block_size & 0xFFFF) << 16, 32);
+            out.write_bytes(data, block_size);
+            data += block_size;
+        } while (size != 0);
+    }
+
+    void deflater::write_block(const std::byte* block, size_t block_size, bool final, bit_writer& out)
+    {
+        uint32_t litlen_frequencies[litlen_code_count] = { };
+        uint32_t distance_frequencies[distance_code_count] = { };
+        for (auto symbol : _symbols)
+        {
+            auto distance = symbol >> 16;
+            if (distance == 0)
+                ++litlen_frequencies[symbol];
+            else
+            {
+                ++litlen_frequencies[end_of_block + 1 + length_code((symbol & 0xFFFF) + min_match)];
+                ++distance_frequencies[distance_code(distance)];
+            }
+        }
+        litlen_frequencies[end_of_block] = 1;
+
+        huffman_code<litlen_code_count> litlen;
+        huffman_code<distance_code_count> distance;
+        build_code(litlen_frequencies, max_code_length, litlen);
+        build_code(distance_frequencies, max_code_length, distance);
+
+        // Trim unused codes from the end of each table, then run-length encode the code
+        // lengths as described in RFC 1951 section 3.2.7.
+        unsigned litlen_count = litlen_code_count;
+        while (litlen_count > end_of_block + 1 && litlen.lengths[litlen_count - 1] == 0)
+            --litlen_count;
+        unsigned distance_count = distance_code_count;
+        while (distance_count > 1 && distance.lengths[distance_count - 1] == 0)
+            --distance_count;
+
+        uint8_t all_lengths[litlen_code_count + distance_code_count];
+        std::copy_n(litlen.lengths, litlen_count, all_lengths);
+        std::copy_n(distance.lengths, distance_count, all_lengths + litlen_count);
+        auto all_count = litlen_count + distance_count;
+
+        struct code_length_symbol
+        {
+            uint8_t symbol;
+            uint8_t extra;
+        };
+        code_length_symbol code_length_symbols[litlen_code_count + distance_code_count];
+        unsigned code_length_symbol_count = 0;
+        uint32_t code_length_frequencies[code_length_code_count] = { };
+        auto emit = [&](unsigned symbol, unsigned extra)
+        {
+            code_length_symbols[code_length_symbol_count++] = { uint8_t(symbol), uint8_t(extra) };
+            ++code_length_frequencies[symbol];
+        };
+
+        for (unsigned n = 0; n < all_count; )
+        {
+            auto value = all_lengths[n];
+            unsigned run = 1;
+            while (n + run < all_count && all_lengths[n + run] == value)
+                ++run;
+            n += run;
+
+            if (value == 0)
+            {
+                for (; run >= 11; run -= std::min(run, 138u))
+                    emit(18, std::min(run, 138u) - 11);
+                if (run >= 3)
+                {
+                    emit(17, run - 3);
+                    run = 0;
+                }
+            }
+            else
+            {
+                emit(value, 0);
+                --run;
+                for (; run >= 3; run -= std::min(run, 6u))
+                    emit(16, std::min(run, 6u) - 3);
+            }
+
+            for (; run > 0; --run)
+                emit(value, 0);
+        }
+
+        huffman_code<code_length_code_count> code_length;
+        build_code(code_length_frequencies, max_code_length_code_length, code_length);
+        unsigned code_length_count = code_length_code_count;
+        while (code_length_count > 4 && code_length.lengths[code_length_order[code_length_count - 1]] == 0)
+            --code_length_count;
+
+        // Pick whichever block type is smallest.
+        auto& fixed_litlen = fixed().litlen;
+        auto& fixed_distance = fixed().distance;
+
+        size_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_length_count;
+        for (unsigned n = 0; n < code_length_symbol_count; ++n)
+        {
+            auto symbol = code_length_symbols[n].symbol;
+            dynamic_bits += code_length.lengths[symbol] + (symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0);
+        }
+
+        size_t fixed_bits = 3;
+        for (unsigned n = 0; n < litlen_code_count; ++n)
+        {
+            auto extra = n > end_of_block ? length_extra_bits[n - end_of_block - 1] : 0;
+            dynamic_bits += size_t(litlen_frequencies[n]) * (litlen.lengths[n] + extra);
+            fixed_bits += size_t(litlen_frequencies[n]) * (fixed_litlen.lengths[n] + extra);
+        }
+        for (unsigned n = 0; n < distance_code_count; ++n)
+        {
+            dynamic_bits += size_t(distance_frequencies[n]) * (distance.lengths[n] + distance_extra_bits[n]);
+            fixed_bits += size_t(distance_frequencies[n]) * (fixed_distance.lengths[n] + distance_extra_bits[n]);
+        }
+
+        auto stored_blocks = std::max(size_t(1), (block_size + max_stored_block - 1) / max_stored_block);
+        auto stored_bits = stored_blocks * (3 + 7 + 32) + 8 * block_size;
+        if (stored_bits <= std::min(dynamic_bits, fixed_bits))
+        {
+            write_stored(block, block_size, final, out);
+            return;
+        }
+
+        auto write_symbols = [&](const uint8_t* litlen_lengths, const uint16_t* litlen_codes, const uint8_t* distance_lengths, const uint16_t* distance_codes)
+        {
+            for (auto symbol : _symbols)
+            {
+                auto distance_value = symbol >> 16;
+                if (distance_value == 0)
+                {
+                    out.write(litlen_codes[symbol], litlen_lengths[symbol]);
+                    continue;
+                }
+
+                auto length_value = (symbol & 0xFFFF) + min_match;
+                auto lcode = length_code(length_value);
+                out.write(litlen_codes[end_of_block + 1 + lcode], litlen_lengths[end_of_block + 1 + lcode]);
+                out.write(length_value - length_base[lcode], length_extra_bits[lcode]);
+
+                auto dcode = distance_code(distance_value);
+                out.write(distance_codes[dcode], distance_lengths[dcode]);
+                out.write(distance_value - distance_base[dcode], distance_extra_bits[dcode]);
+            }
+
+            out.write(litlen_codes[end_of_block], litlen_lengths[end_of_block]);
+        };
+
+        out.write(final ? 1 : 0, 1);
+        if (fixed_bits <= dynamic_bits)
+        {
+            out.write(block_fixed, 2);
+            write_symbols(fixed_litlen.lengths, fixed_litlen.codes, fixed_distance.lengths, fixed_distance.codes);
+            return;
+        }
+
+        out.write(block_dynamic, 2);
+        out.write(litlen_count - 257, 5);
+        out.write(distance_count - 1, 5);
+        out.write(code_length_count - 4, 4);
+        for (unsigned n = 0; n < code_length_count; ++n)
+            out.write(code_length.lengths[code_length_order[n]], 3);
+
+        for (unsigned n = 0; n < code_length_symbol_count; ++n)
+        {
+            auto& item = code_length_symbols[n];
+            out.write(code_length.codes[item.symbol], code_length.lengths[item.symbol]);
+            if (item.symbol == 16)
+                out.write(item.extra, 2);
+            else if (item.symbol == 17)
+                out.write(item.extra, 3);
+            else if (item.symbol == 18)
+                out.write(item.extra, 7);
+        }
+
+        write_symbols(litlen.lengths, litlen.codes, distance.lengths, distance.codes);
+    }
+
+    namespace
+    {
+        const symbol_tables& tables()
+        {
+            static const symbol_tables instance = []
+            {
+                symbol_tables t = { };
+                for (unsigned code = 0; code < std::size(length_base); ++code)
+                {
+                    for (unsigned n = 0; n < (1u << length_extra_bits[code]); ++n)
+                    {
+                        auto index = length_base[code] - min_match + n;
+                        if (index < std::size(t.length_code))
+                            t.length_code[index] = uint8_t(code);
+                    }
+                }
+
+                for (unsigned code = 0; code < std::size(distance_base); ++code)
+                {
+                    for (unsigned n = 0; n < (1u << distance_extra_bits[code]); ++n)
+                    {
+                        unsigned value = distance_base[code] - 1 + n;
+                        t.distance_code[value < 256 ? value : 256 + (value >> 7)] = uint8_t(code);
+                    }
+                }
+
+                return t;
+            }();
+
+            return instance;
+        }
+
+        unsigned length_code(unsigned length)
+        {
+            return tables().length_code[length - min_match];
+        }
+
+        unsigned distance_code(unsigned distance)
+        {
+            auto value = distance - 1;
+            return tables().distance_code[value < 256 ? value : 256 + (value >> 7)];
+        }
+
+        template <size_t Size>
+        void build_code(const uint32_t (&frequencies)[Size], unsigned max_length, huffman_code<Size>& code)
+        {
+            // A code needs at least two symbols to be complete, and a block always needs at
+            // least one distance code, even if it has no matches.  Give the first unused
+            // symbols a nominal frequency until there are two.
+            uint32_t adjusted[Size];
+            std::copy(std::begin(frequencies), std::end(frequencies), adjusted);
+            auto used = size_t(std::count_if(std::begin(adjusted), std::end(adjusted), [](uint32_t f) { return f != 0; }));
+            for (size_t n = 0; used < 2 && n < Size; ++n)
+            {
+                if (adjusted[n] == 0)
+                {
+                    adjusted[n] = 1;
+                    ++used;
+                }
+            }
+
+            build_lengths(adjusted, unsigned(Size), max_length, code.lengths);
+            assign_codes(code.lengths, unsigned(Size), code.codes);
+        }
+
+        void build_lengths(const uint32_t* frequencies, unsigned count, unsigned max_length, uint8_t* lengths)
+        {
+            constexpr unsigned max_symbols = 288;
+            uint32_t scaled[max_symbols];
+            std::copy_n(frequencies, count, scaled);
+
+            // Standard Huffman construction with two queues: leaves sorted by weight, and
+            // internal nodes, which are created in order of increasing weight.  If the
+            // deepest leaf exceeds max_length, flatten the weights and try again.
+            while (true)
+            {
+                uint16_t leaves[max_symbols];
+                unsigned leaf_count = 0;
+                for (unsigned n = 0; n < count; ++n)
+                {
+                    lengths[n] = 0;
+                    if (scaled[n] != 0)
+                        leaves[leaf_count++] = uint16_t(n);
+                }
+
+                std::sort(leaves, leaves + leaf_count, [&](uint16_t a, uint16_t b)
+                {
+                    return scaled[a] != scaled[b] ? scaled[a] < scaled[b] : a < b;
+                });
+
+                uint32_t weights[2 * max_symbols];
+                uint16_t parents[2 * max_symbols];
+                for (unsigned n = 0; n < leaf_count; ++n)
+                    weights[n] = scaled[leaves[n]];
+
+                unsigned next_leaf = 0;
+                unsigned next_internal = leaf_count;
+                unsigned node_count = leaf_count;
+                auto take = [&]
+                {
+                    if (next_leaf < leaf_count && (next_internal == node_count || weights[next_leaf] <= weights[next_internal]))
+                        return next_leaf++;
+                    return next_internal++;
+                };
+
+                while (node_count < 2 * leaf_count - 1)
+                {
+                    auto a = take();
+                    auto b = take();
+                    weights[node_count] = weights[a] + weights[b];
+                    parents[a] = parents[b] = uint16_t(node_count);
+                    ++node_count;
+                }
+
+                // Parents always come after their children, so one backward pass assigns
+                // every depth.
+                uint16_t depths[2 * max_symbols];
+                depths[node_count - 1] = 0;
+                for (auto n = node_count - 1; n-- > 0; )
+                    depths[n] = uint16_t(depths[parents[n]] + 1);
+
+                unsigned deepest = 0;
+                for (unsigned n = 0; n < leaf_count; ++n)
+                    deepest = std::max(deepest, unsigned(depths[n]));
+
+                if (deepest <= max_length)
+                {
+                    for (unsigned n = 0; n < leaf_count; ++n)
+                        lengths[leaves[n]] = uint8_t(depths[n]);
+                    return;
+                }
+
+                for (unsigned n = 0; n < count; ++n)
+                {
+                    if (scaled[n] != 0)
+                        scaled[n] = (scaled[n] + 1) / 2;
+                }
+            }
+        }
+
+        void assign_codes(const uint8_t* lengths, unsigned count, uint16_t* codes)
+        {
+            unsigned length_counts[max_code_length + 1] = { };
+            for (unsigned n = 0; n < count; ++n)
+                ++length_counts[lengths[n]];
+            length_counts[0] = 0;
+
+            unsigned next_code[max_code_length + 1];
+            unsigned code = 0;
+            for (unsigned bits = 1; bits <= max_code_length; ++bits)
+            {
+                code = (code + length_counts[bits - 1]) << 1;
+                next_code[bits] = code;
+            }
+
+            for (unsigned n = 0; n < count; ++n)
+            {
+                auto length = lengths[n];
+                codes[n] = 0;
+                if (length == 0)
+                    continue;
+
+                auto value = next_code[length]++;
+                unsigned reversed = 0;
+                for (unsigned bit = 0; bit < length; ++bit)
+                    reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+                codes[n] = uint16_t(reversed);
+            }
+        }
+
+        const fixed_codes& fixed()
+        {
+            static const fixed_codes instance = []
+            {
+                fixed_codes codes;
+                for (unsigned n = 0; n < 288; ++n)
+                    codes.litlen.lengths[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+                assign_codes(codes.litlen.lengths, 288, codes.litlen.codes);
+
+                std::fill(std::begin(codes.distance.lengths), std::end(codes.distance.lengths), uint8_t(5));
+                assign_codes(codes.distance.lengths, 32, codes.distance.codes);
+                return codes;
+            }();
+
+            return instance;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef IMAGE_DEFLATE_INCLUDED
+#define IMAGE_DEFLATE_INCLUDED
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::image
+{
+    // Produces raw deflate streams (RFC 1951).  Working buffers are kept between calls, so
+    // once they've grown to fit, compressing another input doesn't allocate.
+    class deflater
+    {
+    public:
+        static constexpr unsigned max_level = 9;
+
+    public:
+        deflater() = default;
+        deflater(const deflater&) = delete;
+        deflater& operator = (const deflater&) = delete;
+
+    public:
+        // Appends the compressed form of input to output.  Level 0 stores the data without
+        // compression; higher levels search harder for matches, up to max_level.
+        void compress(stdext::array_view<const std::byte> input, unsigned level, std::vector<std::byte>& output);
+
+    private:
+        class bit_writer;
+
+    private:
+        void write_stored(const std::byte* data, size_t size, bool final, bit_writer& out);
+        void write_block(const std::byte* block, size_t block_size, bool final, bit_writer& out);
+
+    private:
+        std::vector<uint32_t> _head;
+        std::vector<uint32_t> _prev;
+        std::vector<uint32_t> _symbols;
+    };
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include <image/font.h>
+#include <image/image.h>
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <climits>
+#include <cstring>
+
+
+namespace wcdx::image
+{
+    namespace
+    {
+        constexpr std::byte atlas_signature[] = { std::byte('W'), std::byte('C'), std::byte('F'), std::byte('A') };
+        // Positions in the metrics are 16 bits wide.
+        constexpr unsigned max_atlas_size = 0x8000;
+
+        unsigned round_up_pow2(unsigned value) noexcept;
+        template <class Place> unsigned lay_out(const font& font, unsigned atlas_width, Place&& place);
+        void write_uint16(std::vector<std::byte>& out, unsigned value);
+    }
+
+    font::font(stdext::array_view<const std::byte> data)
+        : _height(), _widths(), _offsets()
+    {
+        if (data.size() < header_size)
+            throw std::runtime_error("Font data truncated");
+
+        auto p = data.data();
+        _height = unsigned(p[0]) | unsigned(p[1]) << 8;
+        auto widths = p + 4;
+        auto positions_low = widths + glyph_count;
+        auto positions_high = positions_low + glyph_count;
+
+        // Only the span from the header to the end of the last glyph is kept.
+        size_t end = header_size;
+        for (size_t n = 0; n < glyph_count; ++n)
+        {
+            _widths[n] = uint8_t(widths[n]);
+            auto size = size_t(_widths[n]) * _height;
+            if (size == 0)
+                continue;
+
+            auto position = size_t(positions_low[n]) | size_t(positions_high[n]) << 8;
+            if (position < header_size || position > data.size() || size > data.size() - position)
+                throw std::runtime_error("Glyph outside font data");
+
+            _offsets[n] = uint16_t(position - header_size);
+            end = std::max(end, position + size);
+        }
+
+        _pixels = std::make_unique<std::byte[]>(end - header_size);
+        std::memcpy(_pixels.get(), p + header_size, end - header_size);
+    }
+
+    font_atlas pack_atlas(const font& font)
+    {
+        if (font.height() > UINT8_MAX)
+            throw std::range_error("Font too tall for an atlas");
+
+        unsigned widest = 1;
+        for (unsigned n = 0; n < font::glyph_count; ++n)
+            widest = std::max(widest, font.width(n));
+
+        // Once everything fits in one row, widening the atlas only adds empty space.
+        unsigned best_width = 0;
+        unsigned best_height = 0;
+        for (auto width = round_up_pow2(widest); width <= max_atlas_size; width *= 2)
+        {
+            auto rows = lay_out(font, width, [](unsigned, unsigned, unsigned) { });
+            auto height = round_up_pow2(std::max(1u, rows * font.height()));
+            auto area = size_t(width) * height;
+            auto best_area = size_t(best_width) * best_height;
+            if (height <= max_atlas_size && (best_width == 0 || area < best_area
+                || (area == best_area && std::max(width, height) < std::max(best_width, best_height))))
+            {
+                best_width = width;
+                best_height = height;
+            }
+            if (rows <= 1)
+                break;
+        }
+        if (best_width == 0)
+            throw std::range_error("Font too large for an atlas");
+
+        font_atlas atlas;
+        atlas.width = best_width;
+        atlas.height = best_height;
+        atlas.font_height = font.height();
+        atlas.pixels.assign(size_t(best_width) * best_height, transparent_index);
+        for (auto& entry : atlas.entries)
+            entry.height = uint8_t(font.height());
+
+        lay_out(font, best_width, [&](unsigned glyph, unsigned x, unsigned y)
+        {
+            auto width = font.width(glyph);
+            atlas.entries[glyph] = { uint16_t(x), uint16_t(y), uint8_t(width), uint8_t(font.height()) };
+
+            auto src = font.pixels(glyph);
+            auto dst = atlas.pixels.data() + size_t(y) * best_width + x;
+            for (unsigned row = 0; row < font.height(); ++row)
+                std::memcpy(dst + size_t(row) * best_width, src + size_t(row) * width, width);
+        });
+
+        return atlas;
+    }
+
+    std::vector<std::byte> atlas_metrics(const font_atlas& atlas)
+    {
+        std::vector<std::byte> out(std::begin(atlas_signature), std::end(atlas_signature));
+        out.reserve(std::size(atlas_signature) + 5 * sizeof(uint16_t) + 6 * atlas.entries.size());
+        write_uint16(out, atlas_metrics_version);
+        write_uint16(out, atlas.width);
+        write_uint16(out, atlas.height);
+        write_uint16(out, atlas.font_height);
+        write_uint16(out, unsigned(atlas.entries.size()));
+
+        for (auto& entry : atlas.entries)
+        {
+            write_uint16(out, entry.x);
+            write_uint16(out, entry.y);
+            out.push_back(std::byte(entry.width));
+            out.push_back(std::byte(entry.height));
+        }
+
+        return out;
+    }
+
+    namespace
+    {
+        unsigned round_up_pow2(unsigned value) noexcept
+        {
+            unsigned result = 1;
+            while (result < value)
+                result *= 2;
+            return result;
+        }
+
+        // Calls place(glyph, x, y) for each non-empty glyph in turn and returns the number of
+        // rows used.
+        template <class Place>
+        unsigned lay_out(const font& font, unsigned atlas_width, Place&& place)
+        {
+            unsigned rows = 0;
+            unsigned x = 0;
+            for (unsigned n = 0; n < font::glyph_count; ++n)
+            {
+                auto width = font.width(n);
+                if (width == 0)
+                    continue;
+
+                if (rows == 0 || width > atlas_width - x)
+                {
+                    ++rows;
+                    x = 0;
+                }
+                place(n, x, (rows - 1) * font.height());
+                x += width;
+            }
+
+            return rows;
+        }
+
+        void write_uint16(std::vector<std::byte>& out, unsigned value)
+        {
+            out.push_back(std::byte(value));
+            out.push_back(std::byte(value >> 8));
+        }
+    }
+}
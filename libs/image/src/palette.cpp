@@ -0,0 +1,199 @@
+#include <image/palette.h>
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <climits>
+#include <cstring>
+
+
+namespace wcdx::image
+{
+    namespace
+    {
+        // Each cell spans eight values of each channel.
+        constexpr unsigned cell_bits = 3;
+        constexpr unsigned cells_per_axis = 256 >> cell_bits;
+        constexpr size_t cell_count = size_t(cells_per_axis) * cells_per_axis * cells_per_axis;
+
+        constexpr size_t opaque_color_count = 255;
+
+        // Matches the 0.5 percent alpha threshold wcimg used to pass to WIC, so only pixels
+        // that are all but invisible become transparent and soft edges keep their color.
+        constexpr uint8_t min_opaque_alpha = 2;
+
+        size_t cell_index(unsigned red, unsigned green, unsigned blue) noexcept
+        {
+            return ((red >> cell_bits) * cells_per_axis + (green >> cell_bits)) * cells_per_axis + (blue >> cell_bits);
+        }
+
+        template <class Color>
+        int component(const Color& color, unsigned channel) noexcept
+        {
+            return channel == 0 ? color.red : channel == 1 ? color.green : color.blue;
+        }
+    }
+
+    color_quantizer::color_quantizer(stdext::array_view<const std::byte> palette)
+    {
+        if (palette.size() != 3 * 256)
+            throw std::length_error("Palette must hold 256 colors");
+
+        for (size_t n = 0; n < 256; ++n)
+            _colors[n] = { uint8_t(palette[3 * n]), uint8_t(palette[3 * n + 1]), uint8_t(palette[3 * n + 2]), uint8_t(n) };
+
+        // For every channel, the squared distances from each color's component to the
+        // nearest and farthest values of each cell's range along that channel.
+        std::vector<uint32_t> nearest_distances(3 * cells_per_axis * opaque_color_count);
+        std::vector<uint32_t> farthest_distances(nearest_distances.size());
+        for (unsigned channel = 0; channel < 3; ++channel)
+        {
+            for (unsigned cell = 0; cell < cells_per_axis; ++cell)
+            {
+                int low = int(cell << cell_bits);
+                int high = low + (1 << cell_bits) - 1;
+                auto offset = (channel * cells_per_axis + cell) * opaque_color_count;
+                for (size_t n = 0; n < opaque_color_count; ++n)
+                {
+                    auto value = component(_colors[n], channel);
+                    int nearest = value < low ? low - value : value > high ? value - high : 0;
+                    int farthest = std::max(value - low, high - value);
+                    nearest_distances[offset + n] = uint32_t(nearest * nearest);
+                    farthest_distances[offset + n] = uint32_t(farthest * farthest);
+                }
+            }
+        }
+
+        // A color can only be nearest to something in a cell if it's no farther from the
+        // cell than some other color is at its farthest.
+        _cells.resize(cell_count + 1);
+        size_t cell = 0;
+        for (unsigned red = 0; red < cells_per_axis; ++red)
+        {
+            auto red_near = nearest_distances.data() + red * opaque_color_count;
+            auto red_far = farthest_distances.data() + red * opaque_color_count;
+            for (unsigned green = 0; green < cells_per_axis; ++green)
+            {
+                auto green_near = nearest_distances.data() + (cells_per_axis + green) * opaque_color_count;
+                auto green_far = farthest_distances.data() + (cells_per_axis + green) * opaque_color_count;
+                for (unsigned blue = 0; blue < cells_per_axis; ++blue)
+                {
+                    auto blue_near = nearest_distances.data() + (2 * cells_per_axis + blue) * opaque_color_count;
+                    auto blue_far = farthest_distances.data() + (2 * cells_per_axis + blue) * opaque_color_count;
+
+                    auto limit = UINT32_MAX;
+                    for (size_t n = 0; n < opaque_color_count; ++n)
+                        limit = std::min(limit, red_far[n] + green_far[n] + blue_far[n]);
+
+                    _cells[cell++] = uint32_t(_candidates.size());
+                    for (size_t n = 0; n < opaque_color_count; ++n)
+                    {
+                        if (red_near[n] + green_near[n] + blue_near[n] <= limit)
+                            _candidates.push_back(_colors[n]);
+                    }
+                }
+            }
+        }
+
+        _cells[cell_count] = uint32_t(_candidates.size());
+    }
+
+    std::byte color_quantizer::nearest(uint8_t red, uint8_t green, uint8_t blue) const noexcept
+    {
+        auto cell = cell_index(red, green, blue);
+        auto p = _candidates.data() + _cells[cell];
+        auto last = _candidates.data() + _cells[cell + 1];
+
+        // Candidates are in palette order, so the first of any equally near colors wins.
+        auto best_distance = UINT_MAX;
+        uint8_t best_index = 0;
+        for (; p != last; ++p)
+        {
+            int dr = int(red) - p->red;
+            int dg = int(green) - p->green;
+            int db = int(blue) - p->blue;
+            auto distance = unsigned(dr * dr + dg * dg + db * db);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best_index = p->index;
+            }
+        }
+
+        return std::byte(best_index);
+    }
+
+    void color_quantizer::quantize(const image_descriptor& descriptor, stdext::array_view<const std::byte> bgra, stdext::array_view<std::byte> indices, bool dither) const
+    {
+        size_t pixel_count = size_t(descriptor.width) * descriptor.height;
+        if (indices.size() != pixel_count || bgra.size() / 4 != pixel_count || bgra.size() % 4 != 0)
+            throw std::length_error("Pixel data does not match image dimensions");
+
+        auto src = reinterpret_cast<const uint8_t*>(bgra.data());
+        auto dst = indices.data();
+        if (!dither)
+        {
+            // Art tends to repeat colors along a row, so remember the last one converted.
+            uint32_t last_pixel = 0;
+            auto last_index = transparent_index;
+            for (size_t n = 0; n < pixel_count; ++n, src += 4)
+            {
+                uint32_t pixel;
+                std::memcpy(&pixel, src, sizeof(pixel));
+                if (src[3] < min_opaque_alpha)
+                    dst[n] = transparent_index;
+                else if (pixel == last_pixel && last_index != transparent_index)
+                    dst[n] = last_index;
+                else
+                {
+                    last_pixel = pixel;
+                    last_index = dst[n] = nearest(src[2], src[1], src[0]);
+                }
+            }
+
+            return;
+        }
+
+        // Errors are kept per channel in sixteenths, for this row and the next, with a spare
+        // entry at each end so neighbors never need bounds checks.
+        size_t row_size = 3 * (size_t(descriptor.width) + 2);
+        std::vector<int> errors(2 * row_size);
+        auto current = errors.data() + 3;
+        auto next = current + row_size;
+        for (unsigned y = 0; y < descriptor.height; ++y)
+        {
+            std::fill_n(next - 3, row_size, 0);
+            for (unsigned x = 0; x < descriptor.width; ++x, src += 4, ++dst)
+            {
+                if (src[3] < min_opaque_alpha)
+                {
+                    *dst = transparent_index;
+                    continue;
+                }
+
+                int value[3];
+                for (unsigned channel = 0; channel < 3; ++channel)
+                    value[channel] = std::clamp(int(src[2 - channel]) + current[3 * x + channel] / 16, 0, 255);
+
+                *dst = nearest(uint8_t(value[0]), uint8_t(value[1]), uint8_t(value[2]));
+                auto& color = _colors[size_t(*dst)];
+                auto right = current + 3 * (size_t(x) + 1);
+                auto below = next + 3 * size_t(x);
+                auto below_left = below - 3;
+                auto below_right = below + 3;
+                for (unsigned channel = 0; channel < 3; ++channel)
+                {
+                    auto error = value[channel] - component(color, channel);
+                    right[channel] += 7 * error;
+                    below_left[channel] += 3 * error;
+                    below[channel] += 5 * error;
+                    below_right[channel] += error;
+                }
+            }
+
+            std::swap(current, next);
+        }
+    }
+}
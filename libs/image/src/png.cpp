@@ -0,0 +1,206 @@
+#include <image/png.h>
+
+#include "deflate.h"
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace wcdx::image
+{
+    namespace
+    {
+        constexpr std::byte png_signature[] =
+        {
+            std::byte(0x89), std::byte('P'), std::byte('N'), std::byte('G'),
+            std::byte('\r'), std::byte('\n'), std::byte(0x1A), std::byte('\n')
+        };
+
+        constexpr uint32_t max_chunk_length = 0x7FFFFFFF;
+
+        size_t begin_chunk(std::vector<std::byte>& out, const char (&type)[5]);
+        void end_chunk(std::vector<std::byte>& out, size_t start);
+        void write_uint32(std::vector<std::byte>& out, uint32_t value);
+        uint32_t crc32(const std::byte* data, size_t size);
+        uint32_t adler32(const std::byte* data, size_t size);
+    }
+
+    png_encoder::png_encoder(stdext::array_view<const std::byte> palette, unsigned compression_level)
+        : _deflater(std::make_unique<deflater>())
+    {
+        if (palette.size() != 3 * 256)
+            throw std::length_error("Palette must hold 256 colors");
+
+        set_compression_level(compression_level);
+
+        auto start = begin_chunk(_palette_chunks, "PLTE");
+        _palette_chunks.insert(_palette_chunks.end(), palette.begin(), palette.end());
+        end_chunk(_palette_chunks, start);
+
+        // Every color is opaque except the last.
+        start = begin_chunk(_palette_chunks, "tRNS");
+        _palette_chunks.insert(_palette_chunks.end(), 255, std::byte(0xFF));
+        _palette_chunks.push_back(std::byte(0));
+        end_chunk(_palette_chunks, start);
+    }
+
+    png_encoder::~png_encoder() = default;
+
+    void png_encoder::set_compression_level(unsigned level)
+    {
+        if (level > max_compression_level)
+            throw std::range_error("Invalid compression level");
+
+        _compression_level = level;
+    }
+
+    stdext::array_view<const std::byte> png_encoder::encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels)
+    {
+        if (descriptor.width == 0 || descriptor.height == 0 || descriptor.width > max_chunk_length || descriptor.height > max_chunk_length)
+            throw std::range_error("Invalid image dimensions");
+        if (pixels.size() / descriptor.height != descriptor.width || pixels.size() % descriptor.height != 0)
+            throw std::length_error("Pixel data does not match image dimensions");
+
+        // Each row is preceded by its filter type.  Filtering rarely helps indexed images, so
+        // every row uses filter type 0 (none) and is copied as-is.
+        size_t row_size = size_t(descriptor.width) + 1;
+        _scanlines.resize(row_size * descriptor.height);
+        auto src = pixels.data();
+        auto dst = _scanlines.data();
+        for (unsigned y = 0; y < descriptor.height; ++y)
+        {
+            *dst = std::byte(0);
+            std::memcpy(dst + 1, src, descriptor.width);
+            src += descriptor.width;
+            dst += row_size;
+        }
+
+        _output.assign(std::begin(png_signature), std::end(png_signature));
+
+        auto start = begin_chunk(_output, "IHDR");
+        write_uint32(_output, descriptor.width);
+        write_uint32(_output, descriptor.height);
+        _output.push_back(std::byte(8));    // bit depth
+        _output.push_back(std::byte(3));    // color type: indexed
+        _output.push_back(std::byte(0));    // compression method: deflate
+        _output.push_back(std::byte(0));    // filter method: adaptive
+        _output.push_back(std::byte(0));    // interlace method: none
+        end_chunk(_output, start);
+
+        _output.insert(_output.end(), _palette_chunks.begin(), _palette_chunks.end());
+
+        // The image data is a zlib stream (RFC 1950), written as a single IDAT chunk.
+        start = begin_chunk(_output, "IDAT");
+        uint8_t level_flags = _compression_level < 2 ? 0 : _compression_level < 6 ? 1 : _compression_level == 6 ? 2 : 3;
+        uint8_t cmf = 0x78;     // deflate with a 32 KiB window
+        uint8_t flg = uint8_t(level_flags << 6);
+        flg |= uint8_t(31 - ((cmf << 8) | flg) % 31);
+        _output.push_back(std::byte(cmf));
+        _output.push_back(std::byte(flg));
+        _deflater->compress({ _scanlines.data(), _scanlines.size() }, _compression_level, _output);
+        write_uint32(_output, adler32(_scanlines.data(), _scanlines.size()));
+        end_chunk(_output, start);
+
+        start = begin_chunk(_output, "IEND");
+        end_chunk(_output, start);
+
+        return { _output.data(), _output.size() };
+    }
+
+    void png_encoder::encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels, stdext::output_stream& out)
+    {
+        auto png = encode(descriptor, pixels);
+        out.write_all(png.data(), png.size());
+    }
+
+    namespace
+    {
+        // Writes a chunk header with a placeholder length and returns its offset.
+        size_t begin_chunk(std::vector<std::byte>& out, const char (&type)[5])
+        {
+            auto start = out.size();
+            write_uint32(out, 0);
+            for (size_t n = 0; n < 4; ++n)
+                out.push_back(std::byte(type[n]));
+            return start;
+        }
+
+        // Fills in the length of the chunk that begins at start and appends its CRC.
+        void end_chunk(std::vector<std::byte>& out, size_t start)
+        {
+            auto length = out.size() - start - 8;
+            if (length > max_chunk_length)
+                throw std::length_error("PNG chunk too large");
+
+            auto crc = crc32(out.data() + start + 4, length + 4);
+            auto p = out.data() + start;
+            p[0] = std::byte(length >> 24);
+            p[1] = std::byte(length >> 16);
+            p[2] = std::byte(length >> 8);
+            p[3] = std::byte(length);
+            write_uint32(out, crc);
+        }
+
+        void write_uint32(std::vector<std::byte>& out, uint32_t value)
+        {
+            std::byte bytes[] = { std::byte(value >> 24), std::byte(value >> 16), std::byte(value >> 8), std::byte(value) };
+            out.insert(out.end(), std::begin(bytes), std::end(bytes));
+        }
+
+        uint32_t crc32(const std::byte* data, size_t size)
+        {
+            struct crc_table
+            {
+                uint32_t values[256];
+            };
+            static const crc_table table = []
+            {
+                crc_table t;
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    auto c = n;
+                    for (unsigned k = 0; k < 8; ++k)
+                        c = (c & 1) != 0 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                    t.values[n] = c;
+                }
+                return t;
+            }();
+
+            uint32_t crc = 0xFFFFFFFF;
+            for (size_t n = 0; n < size; ++n)
+                crc = table.values[(crc ^ uint32_t(data[n])) & 0xFF] ^ (crc >> 8);
+            return crc ^ 0xFFFFFFFF;
+        }
+
+        uint32_t adler32(const std::byte* data, size_t size)
+        {
+            // 5552 is the most bytes that can be summed before s2 could overflow.
+            constexpr uint32_t modulus = 65521;
+            constexpr size_t max_run = 5552;
+
+            uint32_t s1 = 1;
+            uint32_t s2 = 0;
+            while (size > 0)
+            {
+                auto run = std::min(size, max_run);
+                size -= run;
+                for (; run > 0; --run)
+                {
+                    s1 += uint32_t(*data++);
+                    s2 += s1;
+                }
+                s1 %= modulus;
+                s2 %= modulus;
+            }
+
+            return s2 << 16 | s1;
+        }
+    }
+}
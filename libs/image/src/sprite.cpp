@@ -0,0 +1,264 @@
+#include <image/sprite.h>
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <climits>
+#include <cstring>
+
+
+namespace wcdx::image
+{
+    namespace
+    {
+        template <class T>
+        T load(const std::byte* p) noexcept
+        {
+            // Sprites are little-endian, as are all of our targets.
+            T value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+    }
+
+    sprite_header read_sprite_header(stdext::array_view<const std::byte> sprite)
+    {
+        if (sprite.size() < 4 * sizeof(int16_t))
+            throw std::runtime_error("Sprite data truncated");
+
+        auto p = sprite.data();
+        sprite_header header =
+        {
+            load<int16_t>(p),
+            load<int16_t>(p + 2),
+            load<int16_t>(p + 4),
+            load<int16_t>(p + 6),
+        };
+
+        if (header.width() < 0 || header.height() < 0)
+            throw std::runtime_error("Invalid sprite extents");
+        return header;
+    }
+
+    void decode_sprite(stdext::array_view<const std::byte> sprite, stdext::array_view<std::byte> pixels)
+    {
+        auto header = read_sprite_header(sprite);
+        auto width = size_t(header.width());
+        auto height = size_t(header.height());
+        if (pixels.size() != width * height)
+            throw std::length_error("Pixel buffer does not match sprite size");
+
+        std::memset(pixels.data(), int(transparent_index), pixels.size());
+
+        auto p = sprite.data() + 4 * sizeof(int16_t);
+        auto last = sprite.data() + sprite.size();
+        auto require = [&](size_t size)
+        {
+            if (size_t(last - p) < size)
+                throw std::runtime_error("Sprite data truncated");
+        };
+
+        while (true)
+        {
+            require(sizeof(uint16_t));
+            auto segment_flags = load<uint16_t>(p);
+            p += sizeof(uint16_t);
+            if (segment_flags == 0)
+                break;
+
+            require(2 * sizeof(int16_t));
+            auto x = ptrdiff_t(load<int16_t>(p)) + header.left_extent;
+            auto y = ptrdiff_t(load<int16_t>(p + 2)) + header.top_extent;
+            p += 2 * sizeof(int16_t);
+
+            size_t segment_width = segment_flags >> 1;
+            if (x < 0 || y < 0 || size_t(y) >= height || segment_width > width - size_t(x) || size_t(x) > width)
+                throw std::runtime_error("Sprite segment outside image");
+
+            auto dst = pixels.data() + size_t(y) * width + size_t(x);
+            if ((segment_flags & 1) == 0)
+            {
+                require(segment_width);
+                std::memcpy(dst, p, segment_width);
+                p += segment_width;
+                continue;
+            }
+
+            while (segment_width > 0)
+            {
+                require(1);
+                auto run_flags = unsigned(*p++);
+                size_t run_width = run_flags >> 1;
+                if (run_width == 0 || run_width > segment_width)
+                    throw std::runtime_error("Invalid sprite run length");
+
+                // Later runs in the segment overwrite anything written past the end of this
+                // one, so when there's room, whole words are copied at a time.
+                auto padded_width = (run_width + 7) & ~size_t(7);
+                if ((run_flags & 1) != 0)
+                {
+                    require(1);
+                    auto value = *p++;
+                    if (padded_width <= segment_width)
+                    {
+                        uint64_t pattern = uint64_t(value) * 0x0101010101010101;
+                        for (size_t n = 0; n < padded_width; n += 8)
+                            std::memcpy(dst + n, &pattern, 8);
+                    }
+                    else
+                        std::memset(dst, int(value), run_width);
+                }
+                else
+                {
+                    require(run_width);
+                    if (padded_width <= segment_width && padded_width <= size_t(last - p))
+                    {
+                        for (size_t n = 0; n < padded_width; n += 8)
+                            std::memcpy(dst + n, p + n, 8);
+                    }
+                    else
+                        std::memcpy(dst, p, run_width);
+                    p += run_width;
+                }
+
+                dst += run_width;
+                segment_width -= run_width;
+            }
+        }
+    }
+
+    stdext::array_view<const std::byte> sprite_encoder::encode(const image_descriptor& descriptor, stdext::array_view<const std::byte> pixels, int reference_x, int reference_y)
+    {
+        if (descriptor.width == 0 || descriptor.height == 0)
+            throw std::range_error("Invalid image dimensions");
+        if (pixels.size() / descriptor.height != descriptor.width || pixels.size() % descriptor.height != 0)
+            throw std::length_error("Pixel data does not match image dimensions");
+
+        // Every extent, and so every segment position, must fit in 16 bits.
+        long long extents[] =
+        {
+            (long long)descriptor.width - 1 - reference_x,
+            reference_x,
+            reference_y,
+            (long long)descriptor.height - 1 - reference_y,
+        };
+        for (auto extent : extents)
+        {
+            if (extent < SHRT_MIN || extent > SHRT_MAX)
+                throw std::range_error("Image too large for sprite");
+        }
+
+        _output.clear();
+        for (auto extent : extents)
+            write_uint16(unsigned(extent));
+
+        auto row = pixels.data();
+        for (unsigned y = 0; y < descriptor.height; ++y, row += descriptor.width)
+        {
+            auto row_end = row + descriptor.width;
+            auto p = row;
+            while ((p = std::find_if(p, row_end, [](std::byte pixel) { return pixel != transparent_index; })) != row_end)
+            {
+                // Segments wider than the format allows are split.
+                auto segment_end = std::find(p, row_end, transparent_index);
+                while (p != segment_end)
+                {
+                    auto width = std::min(size_t(segment_end - p), max_segment_width);
+                    encode_segment(p, width, int(p - row) - reference_x, int(y) - reference_y);
+                    p += width;
+                }
+            }
+        }
+
+        write_uint16(0);
+        return { _output.data(), _output.size() };
+    }
+
+    void sprite_encoder::encode_segment(const std::byte* pixels, size_t width, int x, int y)
+    {
+        // costs[i] is the fewest bytes that encode the first i pixels as runs, and runs[i] is
+        // the header of the last run in that encoding.  Costs never decrease with i, since
+        // dropping the last pixel never lengthens an encoding, so the cheapest fill ending at
+        // i is the longest one.  The cheapest literal ending at i either extends the one
+        // ending at i - 1 or starts at i - 1.  Starting anew costs costs[i - 1] + 2, so
+        // extending only wins while the literal ending at i - 1 is itself a cheapest
+        // encoding; otherwise any older start is at best tied with the new one.
+        _costs.resize(width + 1);
+        _runs.resize(width + 1);
+
+        // Work through raw pointers; stores to the byte-sized run headers would otherwise
+        // force the vectors' data pointers to be reloaded on every step.
+        auto costs = _costs.data();
+        auto runs = _runs.data();
+        costs[0] = 0;
+
+        uint32_t cost = 0;
+        uint32_t literal_cost = 0;
+        size_t literal_width = max_run_width;
+        size_t fill_start = 0;
+        for (size_t i = 1; i <= width; ++i)
+        {
+            auto j = i - 1;
+            if (literal_width == max_run_width || literal_cost != cost)
+            {
+                literal_cost = cost + 1;
+                literal_width = 0;
+            }
+            ++literal_cost;
+            ++literal_width;
+
+            if (j > 0 && pixels[j] != pixels[j - 1])
+                fill_start = j;
+            auto fill_first = std::max(fill_start, i > max_run_width ? i - max_run_width : 0);
+            auto fill_cost = costs[fill_first] + 2;
+
+            if (fill_cost <= literal_cost)
+            {
+                cost = fill_cost;
+                runs[i] = uint8_t((i - fill_first) << 1 | 1);
+            }
+            else
+            {
+                cost = literal_cost;
+                runs[i] = uint8_t(literal_width << 1);
+            }
+            costs[i] = cost;
+        }
+
+        // Runs only pay off when fills save more than the run headers cost.
+        if (cost >= width)
+        {
+            write_uint16(unsigned(width) << 1);
+            write_uint16(unsigned(x));
+            write_uint16(unsigned(y));
+            _output.insert(_output.end(), pixels, pixels + width);
+            return;
+        }
+
+        _path.clear();
+        for (auto i = width; i > 0; i -= _runs[i] >> 1)
+            _path.push_back(_runs[i]);
+
+        write_uint16(unsigned(width) << 1 | 1);
+        write_uint16(unsigned(x));
+        write_uint16(unsigned(y));
+        for (auto run = _path.rbegin(); run != _path.rend(); ++run)
+        {
+            size_t run_width = *run >> 1;
+            _output.push_back(std::byte(*run));
+            if ((*run & 1) != 0)
+                _output.push_back(*pixels);
+            else
+                _output.insert(_output.end(), pixels, pixels + run_width);
+            pixels += run_width;
+        }
+    }
+
+    void sprite_encoder::write_uint16(unsigned value)
+    {
+        _output.push_back(std::byte(value));
+        _output.push_back(std::byte(value >> 8));
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef LZW_INCLUDED
+#define LZW_INCLUDED
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+
+
+namespace stdext
+{
+    template <class T> class array_view;
+}
+
+namespace wcdx::lzw
+{
+    // Compressed resources store a sequence of variable-width codes, packed least significant
+    // bit first.  Codes start out 9 bits wide and grow to at most 12 bits as the dictionary
+    // fills.  The reset code clears the dictionary; the stop code ends the stream.
+    constexpr unsigned min_code_width = 9;
+    constexpr unsigned max_code_width = 12;
+    constexpr unsigned reset_code = 0x100;
+    constexpr unsigned stop_code = 0x101;
+    constexpr unsigned first_dictionary_code = 0x102;
+    constexpr unsigned dictionary_size = 1 << max_code_width;
+
+    // Decompresses input into output and returns the number of bytes written.  Throws if the
+    // stream is malformed or if the decompressed data does not fit in output.
+    size_t decompress(stdext::array_view<const std::byte> input, stdext::array_view<std::byte> output);
+
+    // Compresses input into a stream that decompress can read.  The dictionary is reset
+    // whenever it fills up.
+    std::vector<std::byte> compress(stdext::array_view<const std::byte> input);
+}
+
+#endif
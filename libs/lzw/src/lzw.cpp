@@ -0,0 +1,360 @@
+#include <lzw/lzw.h>
+
+#include <stdext/array_view.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+
+namespace wcdx::lzw
+{
+    namespace
+    {
+        class bit_reader
+        {
+        public:
+            explicit bit_reader(stdext::array_view<const std::byte> input) noexcept
+                : _next(input.data()), _last(input.data() + input.size()) { }
+            bit_reader(const bit_reader&) = delete;
+            bit_reader& operator = (const bit_reader&) = delete;
+
+        public:
+            unsigned read(unsigned bit_width);
+
+        private:
+            void refill(unsigned bit_width);
+
+        private:
+            const std::byte* _next;
+            const std::byte* _last;
+            uint64_t _bits = 0;
+            unsigned _bit_count = 0;
+        };
+
+        class bit_writer
+        {
+        public:
+            explicit bit_writer(std::byte* out) noexcept : _out(out) { }
+            bit_writer(const bit_writer&) = delete;
+            bit_writer& operator = (const bit_writer&) = delete;
+
+        public:
+            void write(unsigned code, unsigned bit_width) noexcept;
+            std::byte* flush() noexcept;
+
+        private:
+            std::byte* _out;
+            uint64_t _bits = 0;
+            unsigned _bit_count = 0;
+        };
+
+        // Maps (prefix code, next byte) pairs to dictionary codes.  Open addressing over a
+        // fixed table twice the size of the dictionary keeps probe sequences short, and the
+        // table never allocates after construction.
+        class dictionary
+        {
+        public:
+            static constexpr unsigned no_code = 0;
+
+        public:
+            dictionary() noexcept { clear(); }
+            dictionary(const dictionary&) = delete;
+            dictionary& operator = (const dictionary&) = delete;
+
+        public:
+            void clear() noexcept;
+            unsigned& find(unsigned prefix, std::byte value) noexcept;
+
+        private:
+            static constexpr unsigned slot_count_bits = max_code_width + 1;
+            static constexpr unsigned slot_count = 1 << slot_count_bits;
+
+            struct slot
+            {
+                uint32_t key;
+                unsigned code;
+            };
+
+        private:
+            slot _slots[slot_count];
+        };
+
+        void copy_string(std::byte*& out, std::byte* out_last, const std::byte* src, size_t length);
+    }
+
+    size_t decompress(stdext::array_view<const std::byte> input, stdext::array_view<std::byte> output)
+    {
+        if (output.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("Decompressor output buffer too large");
+
+        // Every dictionary string is a previously emitted string followed by the first byte of
+        // the string emitted after it.  That means each string can be found verbatim in the
+        // output we've already written, so the dictionary only needs to record where and how
+        // long it is.  Decoding a code then becomes a single forward copy.
+        struct entry
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+        entry table[dictionary_size];
+
+        bit_reader reader(input);
+        auto out_first = output.data();
+        auto out_last = out_first + output.size();
+        auto out = out_first;
+
+        auto code = reader.read(min_code_width);
+        if (code == stop_code)
+            return 0;
+        if (code != reset_code)
+            throw std::runtime_error("Compressed data stream missing reset code");
+
+        do
+        {
+            unsigned code_width = min_code_width;
+            unsigned code_width_threshold = 1 << code_width;
+            unsigned table_size = first_dictionary_code;
+            auto prev_code = code;
+            entry prev = { };
+            while ((code = reader.read(code_width)) != reset_code && code != stop_code)
+            {
+                entry current = { uint32_t(out - out_first), 0 };
+                if (code < reset_code)
+                {
+                    if (out == out_last)
+                        throw std::length_error("Decompressed data exceeds output buffer");
+                    *out++ = std::byte(code);
+                    current.length = 1;
+                }
+                else if (code < table_size)
+                {
+                    auto& string = table[code];
+                    copy_string(out, out_last, out_first + string.offset, string.length);
+                    current.length = string.length;
+                }
+                else if (code == table_size && prev_code != reset_code)
+                {
+                    // The string being defined by this very code: the previous string followed
+                    // by its own first byte.
+                    copy_string(out, out_last, out_first + prev.offset, prev.length);
+                    if (out == out_last)
+                        throw std::length_error("Decompressed data exceeds output buffer");
+                    *out++ = out_first[prev.offset];
+                    current.length = prev.length + 1;
+                }
+                else
+                    throw std::range_error("Decompressor table index out of range");
+
+                if (prev_code != reset_code && table_size != dictionary_size)
+                {
+                    table[table_size] = { prev.offset, prev.length + 1 };
+                    if (++table_size == code_width_threshold && code_width != max_code_width)
+                    {
+                        ++code_width;
+                        code_width_threshold <<= 1;
+                    }
+                }
+
+                prev_code = code;
+                prev = current;
+            }
+        } while (code != stop_code);
+
+        return size_t(out - out_first);
+    }
+
+    std::vector<std::byte> compress(stdext::array_view<const std::byte> input)
+    {
+        // Every code stands for at least one input byte, plus a reset code each time the
+        // dictionary fills and the leading reset and trailing stop codes.  Leave room for the
+        // writer to store whole words.
+        auto max_code_count = input.size() + input.size() / (dictionary_size - first_dictionary_code) + 3;
+        std::vector<std::byte> output((max_code_count * max_code_width + CHAR_BIT - 1) / CHAR_BIT + sizeof(uint64_t));
+        bit_writer writer(output.data());
+
+        if (input.size() == 0)
+        {
+            writer.write(stop_code, min_code_width);
+            output.resize(size_t(writer.flush() - output.data()));
+            return output;
+        }
+
+        auto table = std::make_unique<dictionary>();
+        unsigned next_code;
+        unsigned code_width = min_code_width;
+        unsigned code_width_threshold;
+        unsigned decoder_table_size;
+        bool first_code;
+
+        auto reset = [&]
+        {
+            writer.write(reset_code, code_width);
+            table->clear();
+            next_code = first_dictionary_code;
+            code_width = min_code_width;
+            code_width_threshold = 1 << code_width;
+            decoder_table_size = first_dictionary_code;
+            first_code = true;
+        };
+
+        // The decoder adds each dictionary entry one code later than we do, and widens its
+        // codes based on its own table size, so track that rather than ours.
+        auto emit = [&](unsigned code)
+        {
+            writer.write(code, code_width);
+            if (!first_code && decoder_table_size != dictionary_size
+                && ++decoder_table_size == code_width_threshold && code_width != max_code_width)
+            {
+                ++code_width;
+                code_width_threshold <<= 1;
+            }
+            first_code = false;
+        };
+
+        reset();
+        auto p = input.data();
+        auto last = p + input.size();
+        auto prefix = unsigned(*p++);
+        for (; p != last; ++p)
+        {
+            auto& code = table->find(prefix, *p);
+            if (code != dictionary::no_code)
+            {
+                prefix = code;
+                continue;
+            }
+
+            emit(prefix);
+            if (next_code == dictionary_size)
+                reset();
+            else
+                code = next_code++;
+            prefix = unsigned(*p);
+        }
+
+        emit(prefix);
+        writer.write(stop_code, code_width);
+        output.resize(size_t(writer.flush() - output.data()));
+        return output;
+    }
+
+    namespace
+    {
+        unsigned bit_reader::read(unsigned bit_width)
+        {
+            if (_bit_count < bit_width)
+                refill(bit_width);
+
+            auto value = unsigned(_bits & ((uint64_t(1) << bit_width) - 1));
+            _bits >>= bit_width;
+            _bit_count -= bit_width;
+            return value;
+        }
+
+        void bit_reader::refill(unsigned bit_width)
+        {
+            if (_last - _next >= ptrdiff_t(sizeof(uint64_t)))
+            {
+                // Top up the buffer with a single unaligned load.  Only whole bytes that fit
+                // are consumed; the rest are loaded again next time.  All of our targets are
+                // little-endian, which matches the order in which codes are packed.
+                uint64_t word;
+                std::memcpy(&word, _next, sizeof(word));
+                _bits |= word << _bit_count;
+                _next += (63 - _bit_count) / CHAR_BIT;
+                _bit_count |= 56;
+                return;
+            }
+
+            while (_bit_count <= 56 && _next != _last)
+            {
+                _bits |= uint64_t(*_next++) << _bit_count;
+                _bit_count += CHAR_BIT;
+            }
+
+            if (_bit_count < bit_width)
+                throw std::runtime_error("Unexpected end of compressed data");
+        }
+
+        void copy_string(std::byte*& out, std::byte* out_last, const std::byte* src, size_t length)
+        {
+            if (size_t(out_last - out) < length)
+                throw std::length_error("Decompressed data exceeds output buffer");
+
+            // Most strings are short.  When there's room, copy them in whole words, letting the
+            // final word spill past the end of the string; the spill is overwritten by the next
+            // string.  Words never overlap because the source always ends before out.
+            constexpr size_t word_size = 8;
+            if (size_t(out - src) >= word_size && size_t(out_last - out) >= length + word_size)
+            {
+                auto dst = out;
+                out += length;
+                for (; dst < out; dst += word_size, src += word_size)
+                    std::memcpy(dst, src, word_size);
+                return;
+            }
+
+            std::memcpy(out, src, length);
+            out += length;
+        }
+
+        void bit_writer::write(unsigned code, unsigned bit_width) noexcept
+        {
+            _bits |= uint64_t(code) << _bit_count;
+            _bit_count += bit_width;
+            if (_bit_count >= 32)
+            {
+                // Little-endian store, as in bit_reader::refill.
+                auto word = uint32_t(_bits);
+                std::memcpy(_out, &word, sizeof(word));
+                _out += sizeof(word);
+                _bits >>= 32;
+                _bit_count -= 32;
+            }
+        }
+
+        std::byte* bit_writer::flush() noexcept
+        {
+            for (; _bit_count > 0; _bit_count -= std::min(_bit_count, unsigned(CHAR_BIT)))
+            {
+                *_out++ = std::byte(_bits);
+                _bits >>= CHAR_BIT;
+            }
+
+            return _out;
+        }
+
+        void dictionary::clear() noexcept
+        {
+            for (auto& slot : _slots)
+                slot.key = 0;
+        }
+
+        unsigned& dictionary::find(unsigned prefix, std::byte value) noexcept
+        {
+            // Keys are offset by one so that zero can mark an empty slot.
+            auto key = ((uint32_t(prefix) << CHAR_BIT) | uint32_t(value)) + 1;
+            auto index = (key * 2654435761u) >> (32 - slot_count_bits);
+            while (true)
+            {
+                auto& slot = _slots[index];
+                if (slot.key == key)
+                    return slot.code;
+                if (slot.key == 0)
+                {
+                    slot.key = key;
+                    slot.code = no_code;
+                    return slot.code;
+                }
+
+                index = (index + 1) & (slot_count - 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+#pragma once
+
+#include <stdext/scope_guard.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::parallel
+{
+    // Returns the number of jobs to use when the user hasn't asked for a specific number.
+    unsigned default_job_count() noexcept;
+
+    // Returns the number of threads for_each_index will use for count indices.
+    inline unsigned job_count(size_t count, unsigned jobs) noexcept
+    {
+        if (jobs == 0)
+            jobs = default_job_count();
+        return unsigned(std::max(std::min(size_t(jobs), count), size_t(1)));
+    }
+
+    // Calls function(n) for every n in [0, count), spreading the calls across up to jobs
+    // threads (including the calling thread).  A job count of zero selects
+    // default_job_count().  Indices are handed out one at a time, so uneven work balances
+    // itself.  If any call throws, no further indices are started and the first exception is
+    // rethrown once all threads have finished.
+    //
+    // If function also accepts a thread number, it's called as function(n, thread), where
+    // thread is in [0, job_count(count, jobs)) and is the same for every call made on a given
+    // thread.  Callers can use it to index per-thread state without locking.
+    template <class Function>
+    void for_each_index(size_t count, unsigned jobs, Function&& function)
+    {
+        jobs = job_count(count, jobs);
+        auto call = [&](size_t n, unsigned thread)
+        {
+            if constexpr (std::is_invocable_v<Function&, size_t, unsigned>)
+                function(n, thread);
+            else
+                function(n);
+        };
+
+        if (jobs <= 1)
+        {
+            for (size_t n = 0; n < count; ++n)
+                call(n, 0);
+            return;
+        }
+
+        std::atomic<size_t> next_index(0);
+        std::atomic<bool> failed(false);
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        auto worker = [&](unsigned thread)
+        {
+            try
+            {
+                size_t n;
+                while (!failed.load(std::memory_order_relaxed)
+                    && (n = next_index.fetch_add(1, std::memory_order_relaxed)) < count)
+                {
+                    call(n, thread);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error == nullptr)
+                    error = std::current_exception();
+                failed = true;
+            }
+        };
+
+        {
+            std::vector<std::thread> threads;
+            threads.reserve(jobs - 1);
+            at_scope_exit([&]{ for (auto& thread : threads) thread.join(); });
+
+            for (unsigned n = 1; n < jobs; ++n)
+                threads.emplace_back(worker, n);
+            worker(0);
+        }
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+    }
+}
+
+#endif
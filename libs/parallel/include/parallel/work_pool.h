@@ -0,0 +1,84 @@
+#ifndef PARALLEL_WORK_POOL_INCLUDED
+#define PARALLEL_WORK_POOL_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::parallel
+{
+    // A fixed set of threads running tasks that may themselves submit more tasks, for work
+    // whose shape isn't known up front.  Each thread has its own queue: tasks submitted from
+    // a pool thread go on that thread's queue and are run newest first, so related work
+    // stays together, and a thread with nothing left to do takes the oldest task from
+    // another thread's queue.
+    //
+    // Tasks are called as task(thread), where thread is in [0, size()) and identifies the
+    // pool thread running the task, so callers can index per-thread state without locking.
+    // If a task throws, tasks not yet started are discarded, and the first exception is
+    // rethrown by wait().
+    class work_pool
+    {
+    public:
+        using task = std::function<void (unsigned thread)>;
+
+    public:
+        // A job count of zero selects default_job_count().
+        explicit work_pool(unsigned jobs = 0);
+        work_pool(const work_pool&) = delete;
+        work_pool& operator = (const work_pool&) = delete;
+        // Tasks still queued are discarded; call wait() first to run them.
+        ~work_pool();
+
+    public:
+        unsigned size() const noexcept { return unsigned(_queues.size()); }
+
+        // May be called from any thread, including from within a task.
+        void submit(task t);
+        // Blocks until every submitted task, including any submitted while waiting, has
+        // finished.  Must not be called from within a task.
+        void wait();
+
+    private:
+        struct task_queue
+        {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+    private:
+        void stop() noexcept;
+        void run(unsigned thread);
+        bool take(unsigned thread, task& t);
+
+    private:
+        std::vector<std::unique_ptr<task_queue>> _queues;
+        std::vector<std::thread> _threads;
+        std::atomic<unsigned> _next_queue;
+
+        // Tasks submitted but not yet finished, and tasks sitting in a queue.  The queued
+        // count can briefly go negative when a task is taken before submit counts it.
+        std::atomic<size_t> _pending;
+        std::atomic<ptrdiff_t> _queued;
+
+        std::mutex _mutex;
+        std::condition_variable _work_available;
+        std::condition_variable _idle;
+        std::atomic<bool> _stopping;
+
+        std::atomic<bool> _failed;
+        std::exception_ptr _error;
+    };
+}
+
+#endif
@@ -0,0 +1,11 @@
+#include <parallel/parallel.h>
+
+
+namespace wcdx::parallel
+{
+    unsigned default_job_count() noexcept
+    {
+        auto count = std::thread::hardware_concurrency();
+        return count != 0 ? count : 1;
+    }
+}
@@ -0,0 +1,162 @@
+#include <parallel/work_pool.h>
+#include <parallel/parallel.h>
+
+
+namespace wcdx::parallel
+{
+    namespace
+    {
+        // The pool and thread number of the pool thread this is, if any.
+        thread_local const work_pool* current_pool = nullptr;
+        thread_local unsigned current_thread = 0;
+    }
+
+    work_pool::work_pool(unsigned jobs)
+        : _next_queue(0), _pending(0), _queued(0), _stopping(false), _failed(false)
+    {
+        if (jobs == 0)
+            jobs = default_job_count();
+
+        _queues.reserve(jobs);
+        for (unsigned n = 0; n < jobs; ++n)
+            _queues.push_back(std::make_unique<task_queue>());
+
+        _threads.reserve(jobs);
+        try
+        {
+            for (unsigned n = 0; n < jobs; ++n)
+                _threads.emplace_back([this, n] { run(n); });
+        }
+        catch (...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    work_pool::~work_pool()
+    {
+        stop();
+    }
+
+    void work_pool::submit(task t)
+    {
+        auto queue_index = current_pool == this ? current_thread : _next_queue.fetch_add(1, std::memory_order_relaxed) % size();
+        ++_pending;
+        {
+            auto& queue = *_queues[queue_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(t));
+        }
+
+        // Counting under the lock means a thread about to sleep either sees the new task or
+        // is already waiting when the notification goes out.
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_queued;
+        }
+        _work_available.notify_one();
+    }
+
+    void work_pool::wait()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _idle.wait(lock, [this] { return _pending == 0; });
+        }
+
+        if (_failed)
+        {
+            auto error = std::move(_error);
+            _error = nullptr;
+            _failed = false;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void work_pool::stop() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _work_available.notify_all();
+
+        for (auto& thread : _threads)
+            thread.join();
+        _threads.clear();
+    }
+
+    void work_pool::run(unsigned thread)
+    {
+        current_pool = this;
+        current_thread = thread;
+
+        while (true)
+        {
+            task t;
+            if (!take(thread, t))
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _work_available.wait(lock, [this] { return _stopping || _queued > 0; });
+                if (_stopping)
+                    return;
+                continue;
+            }
+
+            // Once stopping, queued tasks are taken only to be discarded.
+            if (!_failed.load(std::memory_order_relaxed) && !_stopping.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    t(thread);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!_failed)
+                    {
+                        _error = std::current_exception();
+                        _failed = true;
+                    }
+                }
+            }
+
+            t = nullptr;
+            if (--_pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _idle.notify_all();
+            }
+        }
+    }
+
+    bool work_pool::take(unsigned thread, task& t)
+    {
+        auto count = size();
+        for (unsigned n = 0; n < count; ++n)
+        {
+            auto& queue = *_queues[(thread + n) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            // Newest first from this thread's own queue; oldest first from anyone else's.
+            if (n == 0)
+            {
+                t = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                t = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            --_queued;
+            return true;
+        }
+
+        return false;
+    }
+}
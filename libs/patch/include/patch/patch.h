@@ -0,0 +1,61 @@
+#ifndef PATCH_PATCH_INCLUDED
+#define PATCH_PATCH_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/multi.h>
+#include <stdext/stream.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::patch
+{
+    // A run of consecutive bytes changed by a patch.  The patch's data holds the size bytes
+    // expected at offset, followed by the size bytes that replace them.
+    struct patch_range
+    {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t data_offset;
+    };
+
+    // The changes that turn one particular executable into its patched form.  Tables are
+    // generated from .dif files at build time by target_dif_tables (cmake/DifTables.cmake).
+    struct patch_table
+    {
+        uint32_t hash;
+        const patch_range* ranges;
+        size_t range_count;
+        const unsigned char* data;
+    };
+
+    // The key patch tables are looked up by: the four words of the image's MD5 hash, xored
+    // together.
+    uint32_t image_hash(const std::byte* image, size_t size);
+
+    // Returns nullptr if none of the tables is for hash.
+    const patch_table* find_patch(stdext::array_view<const patch_table> tables, uint32_t hash) noexcept;
+
+    // Checks every range against the image before changing anything, so the image is either
+    // fully patched or left untouched.  Returns false if any range lies outside the image or
+    // doesn't hold the expected bytes.
+    bool apply_patch(const patch_table& table, std::byte* image, size_t size) noexcept;
+
+    // Edits the PE headers of a 32-bit executable so that it loads wcdx.dll in place of
+    // ddraw.dll and calls WcdxCreate in place of DirectDrawCreate.  The image is also marked
+    // as NX-compatible and as having no relocations, and its minimum OS version is raised to
+    // Windows XP.  Throws std::runtime_error if the image isn't one that can be patched.
+    void patch_headers(stdext::multi_ref<stdext::stream, stdext::seekable> image);
+
+    // Patches the headers of the executable in image, then applies whichever of tables
+    // matches the unpatched executable.  If headers_only is set, the tables aren't
+    // consulted.  Throws std::runtime_error if the executable isn't recognized or doesn't
+    // match its table.
+    void patch_executable(std::vector<std::byte>& image, stdext::array_view<const patch_table> tables, bool headers_only);
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include <patch/patch.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+
+namespace wcdx::patch
+{
+    namespace
+    {
+        struct section_header_t
+        {
+            char name[8];
+            uint32_t virtual_size;
+            uint32_t virtual_address;
+            uint32_t raw_data_size;
+            uint32_t raw_data_offset;
+            uint32_t relocations_offset;
+            uint32_t line_numbers_offset;
+            uint16_t relocation_count;
+            uint16_t line_number_count;
+            uint32_t characteristics;
+        };
+
+        struct import_entry_t
+        {
+            uint32_t lookup_virtual_address;
+            uint32_t timestamp;
+            uint32_t forwarder_chain;
+            uint32_t dllname_virtual_address;
+            uint32_t import_table_virtual_address;
+        };
+
+        const import_entry_t import_entry_null = { };
+
+        const char PESignature[] = { 'P', 'E', '\0', '\0' };
+        const uint16_t OptionalHeader_PE32Signature = 0x10B;
+        const uint16_t OptionalHeader_PE32PlusSignature = 0x20B;
+
+        std::string read_name(stdext::input_stream& stream);
+        bool equal_ignoring_case(const std::string& a, const char* b) noexcept;
+    }
+
+    void patch_headers(stdext::multi_ref<stdext::stream, stdext::seekable> image)
+    {
+        auto& stream = image.as<stdext::stream>();
+        auto& seekable = image.as<stdext::seekable>();
+
+        // Read offset of PE header
+        seekable.set_position(0x3C);
+        auto offset = stream.read<uint32_t>();
+
+        // Read PE signature
+        seekable.seek(stdext::seek_from::begin, offset);
+        char signature[4];
+        if (stream.read(signature) != std::size(signature) || !std::equal(std::begin(signature), std::end(signature), std::begin(PESignature)))
+            throw std::runtime_error("Input file is not a valid executable.");
+
+        // Read number of sections
+        seekable.seek(stdext::seek_from::current, 2);
+        auto section_count = stream.read<uint16_t>();
+        if (section_count == 0)
+            throw std::runtime_error("Input file has no sections.");
+
+        // Read optional header size
+        seekable.seek(stdext::seek_from::current, 12);
+        auto header_size = stream.read<uint16_t>();
+
+        // Set the IMAGE_FILE_RELOCS_STRIPPED flag
+        auto flags = stream.read<uint16_t>();
+        seekable.seek(stdext::seek_from::current, -2);
+        stream.write(uint16_t(flags | 1));
+
+        auto pe_type_signature = stream.read<uint16_t>();
+        if (pe_type_signature != OptionalHeader_PE32Signature && pe_type_signature != OptionalHeader_PE32PlusSignature)
+            throw std::runtime_error("Input file is not a valid executable.");
+
+        // Set the minimum OS fields to Windows XP
+        seekable.seek(stdext::seek_from::current, 38);
+        stream.write(uint16_t(5));
+        stream.write(uint16_t(1));
+        seekable.seek(stdext::seek_from::current, 4);
+        stream.write(uint16_t(5));
+        stream.write(uint16_t(1));
+
+        // Set the NX-compatible bit
+        seekable.seek(stdext::seek_from::current, 18);
+        flags = stream.read<uint16_t>();
+        flags |= 0x0100;
+        seekable.seek(stdext::seek_from::current, -2);
+        stream.write(flags);
+
+        // Skip to the data directories and clear out the relocation table entry.
+        seekable.seek(stdext::seek_from::current, 20);
+        auto count = stream.read<uint32_t>();
+        if (count >= 6)
+        {
+            seekable.seek(stdext::seek_from::current, 5 * 8);
+            stream.write(uint32_t(0));  // relocation data offset
+            stream.write(uint32_t(0));  // relocation data size
+
+            // Skip to the section tables.
+            seekable.seek(stdext::seek_from::current, header_size - 96 - (6 * 8));  // seek past the optional header
+        }
+        else
+            seekable.seek(stdext::seek_from::current, header_size - 96);    // Skip to the section tables.
+
+        section_header_t section_header = { };  // shouldn't have to initialize here, but MSVC issues C4701 if I don't
+        {
+            unsigned section_header_index = 0;
+            for (; section_header_index < section_count; ++section_header_index)
+            {
+                section_header = stream.read<section_header_t>();
+                if (strncmp(section_header.name, ".idata", sizeof(section_header.name)) == 0)
+                    break;
+            }
+
+            if (section_header_index == section_count)
+                throw std::runtime_error("Input file has no imports.");
+        }
+
+        // Skip to the import tables.
+        seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset);
+
+        // The import tables specify RVAs for import entries, so we'll need the base
+        // address of the section in order to locate the imports in the input file.
+        uint32_t idata_base_rva = section_header.virtual_address;
+
+        // Skip past the directory tables.
+        import_entry_t import_entry;
+        while (true)
+        {
+            import_entry = stream.read<import_entry_t>();
+            if (memcmp(&import_entry, &import_entry_null, sizeof(import_entry_t)) == 0)
+                throw std::runtime_error("Input file does not import ddraw.dll.");
+
+            auto import_entry_position = seekable.position();
+            seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + import_entry.dllname_virtual_address - idata_base_rva);
+            auto import_name_position = seekable.position();
+            if (equal_ignoring_case(read_name(stream), "ddraw.dll"))
+            {
+                seekable.set_position(import_name_position);
+                const char import_name[] = "wcdx.dll";
+                stream.write_all(import_name);
+                break;
+            }
+
+            seekable.set_position(import_entry_position);
+        }
+
+        seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + import_entry.lookup_virtual_address - idata_base_rva);
+        if (pe_type_signature != OptionalHeader_PE32Signature)
+            throw std::runtime_error("Input file missing PE32 signature.");
+
+        stdext::stream_position lookup_position = 0;
+        while (true)
+        {
+            auto lookup = stream.read<uint32_t>();
+            if (lookup == 0)
+                throw std::runtime_error("Input file does not import DirectDrawCreate.");
+
+            if ((lookup & 0x80000000) == 0)
+            {
+                lookup_position = seekable.position();
+                seekable.seek(stdext::seek_from::begin, section_header.raw_data_offset + lookup - idata_base_rva + 2);
+                auto name_position = seekable.position();
+                if (read_name(stream) == "DirectDrawCreate")
+                {
+                    seekable.set_position(name_position - 2);
+                    break;
+                }
+                seekable.set_position(lookup_position);
+            }
+        }
+
+        assert(lookup_position != 0);
+
+        stream.write(uint16_t(0));
+        const char function_name[] = "WcdxCreate";
+        stream.write_all(function_name);
+
+        seekable.set_position(lookup_position);
+        stream.write(uint32_t(0));
+    }
+
+    namespace
+    {
+        std::string read_name(stdext::input_stream& stream)
+        {
+            std::string name;
+            for (char ch; (ch = stream.read<char>()) != '\0'; )
+                name += ch;
+            return name;
+        }
+
+        bool equal_ignoring_case(const std::string& a, const char* b) noexcept
+        {
+            return std::equal(a.begin(), a.end(), b, b + strlen(b), [](char x, char y)
+            {
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            });
+        }
+    }
+}
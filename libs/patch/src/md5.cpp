@@ -0,0 +1,126 @@
+#include <patch/md5.h>
+
+#include <stdexcept>
+
+#include <cstring>
+
+
+namespace wcdx::patch
+{
+    namespace
+    {
+        // Per-round shift amounts and sine-derived constants from RFC 1321.
+        constexpr unsigned shifts[64] =
+        {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+        };
+
+        constexpr uint32_t constants[64] =
+        {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+
+        void transform(md5_hash& state, const unsigned char* block) noexcept;
+    }
+
+    md5_hash::md5_hash(const void* data, size_t size)
+        : a(0x67452301), b(0xefcdab89), c(0x98badcfe), d(0x10325476)
+    {
+        auto bytes = static_cast<const unsigned char*>(data);
+        auto remaining = size;
+        for (; remaining >= 64; remaining -= 64, bytes += 64)
+            transform(*this, bytes);
+
+        // The message is padded with a one bit, then zeros up to 56 bytes into the last
+        // block, then its length in bits.  That takes a second block if fewer than nine
+        // bytes are left over in the first.
+        unsigned char tail[128] = { };
+        // Empty input may come with a null pointer, as from an empty file's mapping.
+        if (remaining != 0)
+            std::memcpy(tail, bytes, remaining);
+        tail[remaining] = 0x80;
+        size_t tail_size = remaining < 56 ? 64 : 128;
+
+        auto bits = uint64_t(size) * 8;
+        for (unsigned n = 0; n != 8; ++n)
+            tail[tail_size - 8 + n] = static_cast<unsigned char>(bits >> (8 * n));
+
+        for (size_t offset = 0; offset != tail_size; offset += 64)
+            transform(*this, tail + offset);
+    }
+
+    md5_hash::md5_hash(std::initializer_list<uint32_t> elems)
+    {
+        if (elems.size() != 4)
+            throw std::invalid_argument("md5_hash must be initialized with four values");
+
+        auto i = begin(elems);
+        a = *i++;
+        b = *i++;
+        c = *i++;
+        d = *i;
+    }
+
+    namespace
+    {
+        void transform(md5_hash& state, const unsigned char* block) noexcept
+        {
+            uint32_t words[16];
+            for (unsigned n = 0; n != 16; ++n)
+            {
+                words[n] = uint32_t(block[4 * n]) | uint32_t(block[4 * n + 1]) << 8
+                    | uint32_t(block[4 * n + 2]) << 16 | uint32_t(block[4 * n + 3]) << 24;
+            }
+
+            auto a = state.a, b = state.b, c = state.c, d = state.d;
+            for (unsigned n = 0; n != 64; ++n)
+            {
+                uint32_t f;
+                unsigned g;
+                switch (n / 16)
+                {
+                case 0:
+                    f = (b & c) | (~b & d);
+                    g = n;
+                    break;
+
+                case 1:
+                    f = (d & b) | (~d & c);
+                    g = (5 * n + 1) % 16;
+                    break;
+
+                case 2:
+                    f = b ^ c ^ d;
+                    g = (3 * n + 5) % 16;
+                    break;
+
+                default:
+                    f = c ^ (b | ~d);
+                    g = (7 * n) % 16;
+                    break;
+                }
+
+                auto sum = a + f + constants[n] + words[g];
+                a = d;
+                d = c;
+                c = b;
+                b += (sum << shifts[n]) | (sum >> (32 - shifts[n]));
+            }
+
+            state.a += a;
+            state.b += b;
+            state.c += c;
+            state.d += d;
+        }
+    }
+}
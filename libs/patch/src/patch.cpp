@@ -0,0 +1,57 @@
+#include <patch/patch.h>
+#include <patch/md5.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstring>
+
+
+namespace wcdx::patch
+{
+    uint32_t image_hash(const std::byte* image, size_t size)
+    {
+        md5_hash hash(image, size);
+        return hash.a ^ hash.b ^ hash.c ^ hash.d;
+    }
+
+    const patch_table* find_patch(stdext::array_view<const patch_table> tables, uint32_t hash) noexcept
+    {
+        auto i = std::find_if(tables.begin(), tables.end(), [&](const patch_table& table) { return table.hash == hash; });
+        return i != tables.end() ? &*i : nullptr;
+    }
+
+    bool apply_patch(const patch_table& table, std::byte* image, size_t size) noexcept
+    {
+        auto ranges = stdext::array_view<const patch_range>(table.ranges, table.range_count);
+        for (auto& range : ranges)
+        {
+            if (range.offset > size || range.size > size - range.offset)
+                return false;
+            if (std::memcmp(image + range.offset, table.data + range.data_offset, range.size) != 0)
+                return false;
+        }
+
+        for (auto& range : ranges)
+            std::memcpy(image + range.offset, table.data + range.data_offset + range.size, range.size);
+        return true;
+    }
+
+    void patch_executable(std::vector<std::byte>& image, stdext::array_view<const patch_table> tables, bool headers_only)
+    {
+        // Tables are keyed by the executable as it was shipped, so the hash has to be taken
+        // before the headers change.
+        auto hash = image_hash(image.data(), image.size());
+
+        stdext::memory_stream image_data(image.data(), image.size());
+        patch_headers(image_data);
+        if (headers_only)
+            return;
+
+        auto table = find_patch(tables, hash);
+        if (table == nullptr)
+            throw std::runtime_error("Input file is not a recognized executable.");
+        if (!apply_patch(*table, image.data(), image.size()))
+            throw std::runtime_error("Input file does not match its patch.");
+    }
+}
@@ -0,0 +1,292 @@
+#include <archive/archive.h>
+#include <archive/resource_cache.h>
+
+#include <stdext/array_view.h>
+
+#include <test/archive.h>
+#include <test/support.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+    using wcdx::test::archive_resource;
+    using wcdx::test::check;
+    using wcdx::test::make_archive;
+    using wcdx::test::put_uint32;
+    using wcdx::test::scratch_directory;
+    using wcdx::test::throws;
+
+    std::vector<std::byte> make_data(size_t size, uint32_t seed);
+    std::vector<archive_resource> make_resources(size_t count, uint32_t seed);
+    wcdx::archive::resource_data make_entry(size_t size);
+
+    void test_reader();
+    void test_invalid_descriptors();
+    void test_cache_eviction();
+    void test_cache_sharing();
+    void test_view();
+    void test_concurrent_views();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("archive", []
+    {
+        test_reader();
+        test_invalid_descriptors();
+        test_cache_eviction();
+        test_cache_sharing();
+        test_view();
+        test_concurrent_views();
+    });
+}
+
+namespace
+{
+    void test_reader()
+    {
+        auto resources = make_resources(4, 1);
+        resources.push_back({ { }, false });
+        auto data = make_archive(resources);
+
+        wcdx::archive::reader reader({ data.data(), data.size() });
+        check(reader.size() == resources.size(), "Bad resource count");
+        for (size_t n = 0; n < resources.size(); ++n)
+        {
+            auto label = "Resource " + std::to_string(n) + ": ";
+            auto& resource = resources[n];
+            auto expected_type = resource.compressed ? wcdx::archive::resource_type_compressed : wcdx::archive::resource_type_uncompressed;
+            check(reader.entry(n).type == expected_type, label + "bad type");
+            check(reader.resource_size(n) == resource.data.size(), label + "bad size");
+
+            std::vector<std::byte> output(reader.resource_size(n));
+            reader.extract(n, { output.data(), output.size() });
+            check(output == resource.data, label + "bad contents");
+
+            auto stored = reader.stored_data(n);
+            if (!resource.compressed)
+                check(std::equal(stored.begin(), stored.end(), resource.data.begin(), resource.data.end()), label + "bad stored data");
+        }
+
+        // Resources sit back to back, the last one running to the end of the file.
+        for (size_t n = 0; n + 1 < reader.size(); ++n)
+            check(reader.entry(n).offset + reader.entry(n).size == reader.entry(n + 1).offset, "Gap between resources " + std::to_string(n) + " and " + std::to_string(n + 1));
+        check(reader.entry(reader.size() - 1).offset == data.size(), "Last resource doesn't end the file");
+
+        check(throws([&] { reader.entry(reader.size()); }), "Resource index past the end accepted");
+        check(throws([&]
+        {
+            std::vector<std::byte> output(reader.resource_size(0) + 1);
+            reader.extract(0, { output.data(), output.size() });
+        }), "Extracted into a buffer of the wrong size");
+    }
+
+    void test_invalid_descriptors()
+    {
+        auto resources = make_resources(3, 2);
+        auto valid = make_archive(resources);
+        check(!throws([&] { wcdx::archive::reader({ valid.data(), valid.size() }); }), "Valid archive rejected");
+
+        auto rejected = [](std::vector<std::byte> data) { return throws([&] { wcdx::archive::reader({ data.data(), data.size() }); }); };
+        auto modified = [&](size_t offset, uint32_t value)
+        {
+            auto data = valid;
+            put_uint32(data, offset, value);
+            return data;
+        };
+        auto descriptor = [&](size_t n)
+        {
+            uint32_t value;
+            std::memcpy(&value, valid.data() + 4 + 4 * n, sizeof(value));
+            return value;
+        };
+
+        // The header.
+        check(rejected({ }), "Empty archive accepted");
+        check(rejected({ valid.begin(), valid.begin() + 6 }), "Truncated header accepted");
+        check(rejected({ valid.begin(), valid.end() - 1 }), "Archive shorter than its file size accepted");
+        check(rejected(modified(4, 4)), "Resource inside the header accepted");
+        check(rejected(modified(4, uint32_t(valid.size() + 1))), "Descriptor table past the end of the file accepted");
+
+        // Offsets out of order, before the resources start, or past the end of the file.
+        check(rejected(modified(8, (descriptor(1) & 0xFF000000) | ((descriptor(0) & wcdx::archive::max_resource_offset) - 1))), "Descriptors out of order accepted");
+        check(rejected(modified(8, (descriptor(1) & 0xFF000000) | 8)), "Resource inside the descriptor table accepted");
+        check(rejected(modified(12, (descriptor(2) & 0xFF000000) | uint32_t(valid.size() + 1))), "Resource past the end of the file accepted");
+
+        // A file size that cuts into resources already in the table.
+        check(rejected(modified(0, (descriptor(2) & wcdx::archive::max_resource_offset) - 1)), "Resource past the stated file size accepted");
+
+        // A compressed resource too small to hold its decompressed size.
+        std::vector<archive_resource> tiny = { { { std::byte(1), std::byte(2) }, false } };
+        auto tiny_data = make_archive(tiny);
+        put_uint32(tiny_data, 4, (wcdx::archive::resource_type_compressed << 24) | 8);
+        wcdx::archive::reader tiny_reader({ tiny_data.data(), tiny_data.size() });
+        check(throws([&] { tiny_reader.resource_size(0); }), "Compressed resource without a size accepted");
+    }
+
+    void test_cache_eviction()
+    {
+        wcdx::archive::resource_cache cache(100);
+        check(cache.capacity() == 100 && cache.size() == 0, "Bad new cache");
+
+        auto first = cache.insert(0, make_entry(40));
+        cache.insert(1, make_entry(40));
+        check(cache.size() == 80, "Bad size after two entries");
+
+        // Using entry 0 makes entry 1 the oldest, so it goes first when entry 2 doesn't fit.
+        check(cache.find(0) == first, "Cached entry not found");
+        cache.insert(2, make_entry(40));
+        check(cache.size() == 80, "Bad size after eviction");
+        check(cache.find(1) == nullptr, "Least recently used entry kept");
+        check(cache.find(0) != nullptr && cache.find(2) != nullptr, "Recently used entry evicted");
+
+        // The size stays within capacity however entries are added.
+        std::mt19937 random(3);
+        for (size_t n = 0; n < 1000; ++n)
+        {
+            cache.insert(random() % 50, make_entry(1 + random() % 60));
+            check(cache.size() <= cache.capacity(), "Cache grew past its capacity");
+        }
+
+        // An entry bigger than the whole cache is handed back without disturbing the rest.
+        cache.clear();
+        check(cache.size() == 0 && cache.find(0) == nullptr, "Cache not cleared");
+        cache.insert(0, make_entry(100));
+        auto huge = make_entry(101);
+        check(cache.insert(1, huge) == huge, "Oversized entry not returned");
+        check(cache.find(1) == nullptr, "Oversized entry cached");
+        check(cache.find(0) != nullptr && cache.size() == 100, "Oversized entry evicted others");
+    }
+
+    void test_cache_sharing()
+    {
+        wcdx::archive::resource_cache cache(100);
+
+        // The first entry added for an index wins.
+        auto first = cache.insert(0, make_entry(10));
+        check(cache.insert(0, make_entry(10)) == first, "Second entry for an index replaced the first");
+        check(cache.size() == 10, "Second entry for an index counted");
+
+        // Evicted data stays valid for whoever holds it.
+        auto held = cache.find(0);
+        cache.insert(1, make_entry(100));
+        check(cache.find(0) == nullptr, "Entry not evicted");
+        check(held->size() == 10 && held.use_count() == 2, "Evicted entry released while held");
+    }
+
+    void test_view()
+    {
+        auto resources = make_resources(6, 4);
+        auto data = make_archive(resources);
+
+        // With room for only one resource at a time, every other view decompresses again.
+        wcdx::archive::archive borrowed({ data.data(), data.size() }, 1000);
+        std::vector<wcdx::archive::resource_view> views;
+        for (size_t pass = 0; pass < 2; ++pass)
+        {
+            for (size_t n = 0; n < resources.size(); ++n)
+            {
+                auto view = borrowed.view(n);
+                check(std::equal(view.begin(), view.end(), resources[n].data.begin(), resources[n].data.end()), "Bad contents for resource " + std::to_string(n));
+                if (!resources[n].compressed)
+                    check(view.data() == borrowed.stored_data(n).data(), "Uncompressed resource copied");
+                views.push_back(std::move(view));
+            }
+        }
+
+        // Views outlive their entries' eviction.
+        for (size_t n = 0; n < views.size(); ++n)
+        {
+            auto& expected = resources[n % resources.size()].data;
+            check(std::equal(views[n].begin(), views[n].end(), expected.begin(), expected.end()), "View changed after eviction");
+        }
+
+        // A mapped file reads the same as memory.
+        scratch_directory scratch("wcdx_archive_test_");
+        auto path = scratch.path() / "test.dat";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        }
+        wcdx::archive::archive mapped(path);
+        check(mapped.size() == resources.size(), "Bad resource count from file");
+        for (size_t n = 0; n < resources.size(); ++n)
+        {
+            auto view = mapped.view(n);
+            check(std::equal(view.begin(), view.end(), resources[n].data.begin(), resources[n].data.end()), "Bad contents from file for resource " + std::to_string(n));
+            check(mapped.type(n) == borrowed.type(n), "Bad type from file");
+        }
+    }
+
+    void test_concurrent_views()
+    {
+        auto resources = make_resources(24, 5);
+        auto data = make_archive(resources);
+
+        // The cache holds a few resources, so threads keep evicting what others are using.
+        wcdx::archive::archive archive({ data.data(), data.size() }, 8000);
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < 8; ++thread)
+        {
+            threads.emplace_back([&, thread]
+            {
+                std::mt19937 random(thread);
+                for (size_t n = 0; n < 2000 && !failed; ++n)
+                {
+                    auto index = random() % resources.size();
+                    auto view = archive.view(index);
+                    auto& expected = resources[index].data;
+                    if (!std::equal(view.begin(), view.end(), expected.begin(), expected.end()))
+                        failed = true;
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+            thread.join();
+        check(!failed, "Bad contents from concurrent views");
+    }
+
+    std::vector<std::byte> make_data(size_t size, uint32_t seed)
+    {
+        // Runs of repeated bytes, so compression has something to find.
+        std::mt19937 random(seed);
+        std::vector<std::byte> data;
+        while (data.size() < size)
+            data.insert(data.end(), std::min<size_t>(size - data.size(), 1 + random() % 16), std::byte(random() % 8));
+        return data;
+    }
+
+    // Alternately compressed and uncompressed resources of assorted sizes.
+    std::vector<archive_resource> make_resources(size_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<archive_resource> resources;
+        for (size_t n = 0; n < count; ++n)
+            resources.push_back({ make_data(100 + random() % 900, seed * 1000 + uint32_t(n)), n % 2 == 0 });
+        return resources;
+    }
+
+    wcdx::archive::resource_data make_entry(size_t size)
+    {
+        return std::make_shared<const std::vector<std::byte>>(size);
+    }
+}
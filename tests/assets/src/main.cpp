@@ -0,0 +1,398 @@
+#include <assets/content.h>
+#include <assets/manifest.h>
+#include <assets/pipeline.h>
+
+#include <audio/wcaudio_stream.h>
+#include <image/font.h>
+
+#include <stdext/array_view.h>
+
+#include <test/archive.h>
+#include <test/font.h>
+#include <test/stream.h>
+#include <test/support.h>
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+    using wcdx::test::check;
+    using wcdx::test::make_archive;
+    using wcdx::test::make_bytes;
+    using wcdx::test::make_font;
+    using wcdx::test::scratch_directory;
+    using wcdx::test::throws;
+
+    std::vector<std::byte> make_text(const std::string& text);
+    std::vector<std::byte> make_track(uint32_t sample_size);
+    std::vector<std::byte> make_palette(int seed);
+    void write_file(const std::filesystem::path& path, const std::vector<std::byte>& data);
+    std::vector<std::byte> read_file(const std::filesystem::path& path);
+    std::vector<std::filesystem::path> list_objects(const std::filesystem::path& output);
+
+    void test_identify();
+    void test_content_hash();
+    void test_manifest();
+    void test_manifest_file();
+    void test_pipeline();
+    void test_pipeline_rerun();
+    void test_pipeline_errors();
+
+    // Decodes to a 5x3 sprite.
+    const std::vector<std::byte> test_sprite = make_bytes(
+    {
+        3, 0,   1, 0,   1, 0,   1, 0,
+        2 << 1, 0,   0xFF, 0xFF,   0xFF, 0xFF,   7, 8,
+        4 << 1 | 1, 0,   0, 0,   1, 0,   3 << 1 | 1, 9,   1 << 1, 10,
+        0, 0,
+    });
+}
+
+int main()
+{
+    return wcdx::test::run_tests("assets", []
+    {
+        test_identify();
+        test_content_hash();
+        test_manifest();
+        test_manifest_file();
+        test_pipeline();
+        test_pipeline_rerun();
+        test_pipeline_errors();
+    });
+}
+
+namespace
+{
+    void test_identify()
+    {
+        using wcdx::assets::content_type;
+        auto identify = [](const std::vector<std::byte>& data)
+        {
+            return wcdx::assets::identify({ data.data(), data.size() });
+        };
+
+        auto font = make_font(6, { 0, 3, 4 });
+        auto image_set = make_archive({ test_sprite, test_sprite });
+        check(identify(make_track(16)) == content_type::stream, "Stream not identified");
+        check(identify(image_set) == content_type::image_set, "Image set not identified");
+        check(identify(make_archive({ font, make_font(2, { 1 }) })) == content_type::font_set, "Font set not identified");
+        check(identify(font) == content_type::font, "Font not identified");
+        check(identify(make_archive({ image_set, font, make_text("raw") })) == content_type::archive, "Archive not identified");
+        check(identify(make_text("plain text that is no kind of game data")) == content_type::unknown, "Text identified");
+        check(identify({ }) == content_type::unknown, "Empty data identified");
+
+        // The descriptor table has to be made of whole words.
+        auto misaligned = image_set;
+        misaligned[4] = std::byte(13);
+        check(identify(misaligned) == content_type::unknown, "Misaligned descriptor table accepted");
+
+        auto oversized = image_set;
+        oversized[0] = std::byte(0xFF);
+        check(identify(oversized) == content_type::unknown, "Archive larger than its data accepted");
+
+        auto bad_type = image_set;
+        bad_type[7] = std::byte(7);
+        check(identify(bad_type) == content_type::unknown, "Unknown resource type accepted");
+
+        auto colorful = font;
+        colorful[3] = std::byte(1);
+        check(identify(colorful) == content_type::unknown, "Font with wide color index accepted");
+
+        for (auto type : { content_type::unknown, content_type::archive, content_type::image_set, content_type::font_set, content_type::font, content_type::stream })
+            check(wcdx::assets::parse_content_type(wcdx::assets::content_type_name(type)) == type, "Content type name does not round-trip");
+    }
+
+    void test_content_hash()
+    {
+        // MD5 of the empty string, in its usual spelling.
+        wcdx::assets::content_hash empty(nullptr, 0);
+        check(wcdx::assets::to_string(empty) == "d41d8cd98f00b204e9800998ecf8427e", "Hash spelled out in the wrong order");
+        check(wcdx::assets::parse_content_hash("d41d8cd98f00b204e9800998ecf8427e") == empty, "Hash does not round-trip");
+
+        check(throws([] { wcdx::assets::parse_content_hash("d41d8cd98f00b204e9800998ecf8427"); }), "Short hash accepted");
+        check(throws([] { wcdx::assets::parse_content_hash("D41D8CD98F00B204E9800998ECF8427E"); }), "Uppercase hash accepted");
+        check(throws([] { wcdx::assets::parse_content_hash("d41d8cd98f00b204e9800998ecf8427g"); }), "Bad digit accepted");
+    }
+
+    void test_manifest()
+    {
+        using wcdx::assets::content_type;
+        auto entry = [](const std::string& source, const std::string& object)
+        {
+            return wcdx::assets::manifest_entry{ source, wcdx::assets::content_hash(source.data(), source.size()), content_type::unknown, object };
+        };
+
+        wcdx::assets::manifest manifest;
+        manifest.add(entry("wc1/b", ""));
+        manifest.add(entry("wc1/a#1", "x"));
+        manifest.add(entry("wc1/a", ""));
+        manifest.add(entry("wc1/a b", "y"));
+        manifest.add({ entry("wc1/a#0", "z"), entry("wc1/a#0#0", "w"), entry("wc1/a#1", "replaced") });
+
+        std::vector<std::string> sources;
+        for (auto& e : manifest.entries())
+            sources.push_back(e.source);
+        check(sources == std::vector<std::string>{ "wc1/a", "wc1/a b", "wc1/a#0", "wc1/a#0#0", "wc1/a#1", "wc1/b" }, "Manifest not sorted by source");
+
+        auto found = manifest.find("wc1/a");
+        check(found.size() == 4, "Nested entries not found");
+        check(found[0].source == "wc1/a" && found[1].source == "wc1/a#0" && found[3].source == "wc1/a#1", "Wrong entries found");
+        check(found[3].object == "replaced", "Later entry did not replace earlier one");
+
+        check(manifest.find("wc1/a#0").size() == 2, "Entries nested in a resource not found");
+        check(manifest.find("wc1/b").size() == 1, "Entry without nested entries not found");
+        check(manifest.find("wc1/c").empty(), "Missing entry found");
+        check(manifest.find("wc1").empty(), "Partial source found");
+    }
+
+    void test_manifest_file()
+    {
+        scratch_directory scratch("wcdx_assets_test_");
+        auto path = scratch.path() / "manifest.csv";
+        check(wcdx::assets::manifest::load(path).entries().empty(), "Missing manifest not empty");
+
+        wcdx::assets::manifest manifest;
+        auto hash = wcdx::assets::content_hash("abc", 3);
+        manifest.add({ "wc2/GAMEDAT/FONTS.FNT", hash, wcdx::assets::content_type::font_set, "" });
+        manifest.add({ "wc2/GAMEDAT/FONTS.FNT#0", hash, wcdx::assets::content_type::font, "0123-4567" });
+        manifest.add({ "wc2/odd, name", hash, wcdx::assets::content_type::unknown, "" });
+        manifest.save(path);
+        check(!std::filesystem::exists(path.string() + ".tmp"), "Temporary manifest left behind");
+
+        auto loaded = wcdx::assets::manifest::load(path);
+        check(loaded.entries().size() == manifest.entries().size(), "Manifest entry count mismatch");
+        for (size_t n = 0; n != loaded.entries().size(); ++n)
+        {
+            auto& a = loaded.entries()[n];
+            auto& b = manifest.entries()[n];
+            check(a.source == b.source && a.hash == b.hash && a.type == b.type && a.object == b.object, "Manifest entry does not round-trip");
+        }
+
+        write_file(path, make_text("not,a,manifest\n"));
+        bool rejected = false;
+        try
+        {
+            wcdx::assets::manifest::load(path);
+        }
+        catch (const std::exception&)
+        {
+            rejected = true;
+        }
+        check(rejected, "Foreign file loaded as a manifest");
+    }
+
+    void test_pipeline()
+    {
+        scratch_directory scratch("wcdx_assets_test_");
+        auto wc1 = scratch.path() / "wc1";
+        auto wc2 = scratch.path() / "wc2";
+        auto output = scratch.path() / "out";
+
+        auto image_set = make_archive({ test_sprite, test_sprite });
+        auto font = make_font(6, { 0, 3, 4 });
+        auto raw = make_text("some resource nobody recognizes");
+        write_file(wc1 / "GAMEDAT" / "IMAGES.V00", make_archive({ image_set, raw, make_archive({ font, raw }) }));
+        write_file(wc1 / "GAMEDAT" / "FONTS.FNT", make_archive({ font, make_font(2, { 1, 1 }) }));
+        write_file(wc1 / "STREAMS" / "MUSIC.STR", make_track(200));
+        write_file(wc1 / "README.TXT", make_text("not game data"));
+        // The same image set and resource, seen by a game with another palette.
+        write_file(wc2 / "GAMEDAT" / "IMAGES.V00", make_archive({ image_set, raw }));
+
+        auto palette1 = make_palette(1);
+        auto palette2 = make_palette(2);
+        std::vector<wcdx::assets::pipeline_source> sources =
+        {
+            { "wc1", wc1, { palette1.data(), palette1.size() } },
+            { "wc2", wc2, { palette2.data(), palette2.size() } },
+        };
+
+        auto stats = wcdx::assets::run_pipeline(sources, output, 4);
+        check(stats.errors.empty(), "Pipeline failed: " + (stats.errors.empty() ? std::string() : stats.errors.front()));
+        check(stats.files == 5 && stats.unchanged_files == 0, "Wrong file count");
+
+        // wc1: IMAGES.V00 (+3, +2 nested), FONTS.FNT (+2), MUSIC.STR, README.TXT; wc2: IMAGES.V00 (+2)
+        check(stats.resources == 6 + 3 + 1 + 1 + 3, "Wrong resource count");
+        // Image set and font for each palette where used, the raw resource once, the two
+        // fonts of FONTS.FNT (one shared with the nested archive), and the stream.
+        check(stats.objects_written == 2 + 1 + 1 + 1 + 1, "Wrong number of objects written");
+        check(stats.objects_shared == 1 + 1 + 1, "Wrong number of objects shared");
+        check(list_objects(output).size() == stats.objects_written, "Objects on disk don't match");
+
+        auto manifest = wcdx::assets::manifest::load(output / "manifest.csv");
+        auto images = manifest.find("wc1/GAMEDAT/IMAGES.V00");
+        check(images.size() == 6, "Nested resources missing from manifest");
+        check(images[0].type == wcdx::assets::content_type::archive && images[0].object.empty(), "Archive has an object of its own");
+        check(images[1].type == wcdx::assets::content_type::image_set, "Image set not recorded");
+        check(images[2].type == wcdx::assets::content_type::unknown && !images[2].object.empty(), "Raw resource not recorded");
+        check(images[3].source == "wc1/GAMEDAT/IMAGES.V00#2" && images[4].type == wcdx::assets::content_type::font, "Nested archive not recorded");
+
+        auto wc2_images = manifest.find("wc2/GAMEDAT/IMAGES.V00");
+        check(wc2_images.size() == 3, "Second source missing from manifest");
+        check(wc2_images[1].hash == images[1].hash && wc2_images[1].object != images[1].object, "Image set shared across palettes");
+        check(wc2_images[2].object == images[2].object, "Raw resource not shared");
+
+        auto sprite = read_file(output / "objects" / images[1].object / "1.png");
+        check(sprite.size() > 8 && std::memcmp(sprite.data() + 1, "PNG", 3) == 0, "Sprite not written as PNG");
+        auto resource = read_file(output / "objects" / images[2].object / "resource.bin");
+        check(resource == raw, "Raw resource not copied");
+        auto metrics = read_file(output / "objects" / images[4].object / "atlas.metrics");
+        check(metrics.size() == 14 + 6 * wcdx::image::font::glyph_count, "Font metrics not written");
+
+        auto music = manifest.find("wc1/STREAMS/MUSIC.STR");
+        check(music.size() == 1 && music[0].type == wcdx::assets::content_type::stream, "Stream not recorded");
+        auto wave = read_file(output / "objects" / music[0].object / "untriggered-intensity0.wav");
+        check(wave.size() == 44 + 200, "Stream track not rendered");
+
+        auto readme = manifest.find("wc1/README.TXT");
+        check(readme.size() == 1 && readme[0].object.empty(), "Unrecognized file given an object");
+    }
+
+    void test_pipeline_rerun()
+    {
+        scratch_directory scratch("wcdx_assets_test_");
+        auto wc1 = scratch.path() / "wc1";
+        auto output = scratch.path() / "out";
+
+        auto font = make_font(6, { 0, 3, 4 });
+        write_file(wc1 / "FONTS.FNT", make_archive({ font }));
+        write_file(wc1 / "IMAGES.V00", make_archive({ test_sprite }));
+
+        auto palette = make_palette(1);
+        std::vector<wcdx::assets::pipeline_source> sources = { { "wc1", wc1, { palette.data(), palette.size() } } };
+        auto first = wcdx::assets::run_pipeline(sources, output, 2);
+        check(first.errors.empty() && first.objects_written == 2, "First run failed");
+
+        auto second = wcdx::assets::run_pipeline(sources, output, 2);
+        check(second.unchanged_files == 2 && second.resources == 0 && second.objects_written == 0, "Unchanged files processed again");
+        check(wcdx::assets::manifest::load(output / "manifest.csv").entries().size() == 3, "Manifest lost entries");
+
+        // A changed file is processed again; its old object stays, as other content may
+        // still refer to it.
+        write_file(wc1 / "FONTS.FNT", make_archive({ make_font(5, { 2 }) }));
+        auto third = wcdx::assets::run_pipeline(sources, output, 2);
+        check(third.unchanged_files == 1 && third.resources == 2 && third.objects_written == 1, "Changed file not processed again");
+
+        // Missing output is put back.
+        auto manifest = wcdx::assets::manifest::load(output / "manifest.csv");
+        auto images = manifest.find("wc1/IMAGES.V00");
+        std::filesystem::remove_all(output / "objects" / images[0].object);
+        auto fourth = wcdx::assets::run_pipeline(sources, output, 2);
+        check(fourth.unchanged_files == 1 && fourth.objects_written == 1, "Missing object not written again");
+        check(std::filesystem::is_directory(output / "objects" / images[0].object), "Missing object not restored");
+
+        // Entries for sources left out of a run are kept.
+        auto none = wcdx::assets::run_pipeline({ }, output, 2);
+        check(none.files == 0 && wcdx::assets::manifest::load(output / "manifest.csv").entries().size() == 3, "Entries for other sources dropped");
+    }
+
+    void test_pipeline_errors()
+    {
+        scratch_directory scratch("wcdx_assets_test_");
+        auto wc1 = scratch.path() / "wc1";
+        auto output = scratch.path() / "out";
+
+        // A stream whose tables run past the end of the file.
+        auto broken = make_track(16);
+        broken.resize(broken.size() - 40);
+        write_file(wc1 / "BROKEN.STR", broken);
+        write_file(wc1 / "FONTS.FNT", make_archive({ make_font(6, { 0, 3, 4 }) }));
+
+        auto palette = make_palette(1);
+        std::vector<wcdx::assets::pipeline_source> sources = { { "wc1", wc1, { palette.data(), palette.size() } } };
+        auto stats = wcdx::assets::run_pipeline(sources, output, 2);
+        check(stats.errors.size() == 1 && stats.errors.front().compare(0, 15, "wc1/BROKEN.STR:") == 0, "Broken file not reported");
+        check(stats.objects_written == 1, "Other files not processed");
+
+        auto manifest = wcdx::assets::manifest::load(output / "manifest.csv");
+        check(manifest.find("wc1/BROKEN.STR").empty(), "Broken file recorded in manifest");
+        check(manifest.find("wc1/FONTS.FNT").size() == 2, "Good file not recorded in manifest");
+
+        // Failed files are tried again.
+        auto again = wcdx::assets::run_pipeline(sources, output, 2);
+        check(again.errors.size() == 1 && again.unchanged_files == 1, "Failed file not tried again");
+
+        auto palette_size = palette.size();
+        palette.resize(palette_size - 1);
+        sources[0].palette = { palette.data(), palette.size() };
+        bool rejected = false;
+        try
+        {
+            wcdx::assets::run_pipeline(sources, output, 2);
+        }
+        catch (const std::exception&)
+        {
+            rejected = true;
+        }
+        check(rejected, "Short palette accepted");
+    }
+
+    std::vector<std::byte> make_text(const std::string& text)
+    {
+        auto p = reinterpret_cast<const std::byte*>(text.data());
+        return { p, p + text.size() };
+    }
+
+    // An empty index chunk linking at intensity 0 to one chunk of samples, which has no
+    // links of its own.
+    std::vector<std::byte> make_track(uint32_t sample_size)
+    {
+        return wcdx::test::make_stream({ { 0, { }, { { 0, 1 } } }, { sample_size, { }, { } } }, [](uint32_t, uint32_t size)
+        {
+            std::vector<std::byte> samples(size);
+            for (size_t n = 0; n != samples.size(); ++n)
+                samples[n] = std::byte(n);
+            return samples;
+        });
+    }
+
+    std::vector<std::byte> make_palette(int seed)
+    {
+        std::vector<std::byte> palette(3 * 256);
+        for (size_t n = 0; n != palette.size(); ++n)
+            palette[n] = std::byte(n * seed);
+        return palette;
+    }
+
+    void write_file(const std::filesystem::path& path, const std::vector<std::byte>& data)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        out.close();
+        if (!out)
+            throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    std::vector<std::byte> read_file(const std::filesystem::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("Failed to open " + path.string());
+
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        auto p = reinterpret_cast<const std::byte*>(data.data());
+        return { p, p + data.size() };
+    }
+
+    std::vector<std::filesystem::path> list_objects(const std::filesystem::path& output)
+    {
+        std::vector<std::filesystem::path> objects;
+        for (auto& entry : std::filesystem::directory_iterator(output / "objects"))
+            objects.push_back(entry.path());
+        return objects;
+    }
+}
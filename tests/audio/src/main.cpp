@@ -0,0 +1,782 @@
+#include <audio/pcm_ring.h>
+#include <audio/playback.h>
+#include <audio/repack.h>
+#include <audio/wave.h>
+#include <audio/wcaudio_stream.h>
+#include <parallel/parallel.h>
+
+#include <stdext/stream.h>
+
+#include <test/stream.h>
+#include <test/support.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace
+{
+    // Reads from memory, counting the reads and seeks made of it.
+    class counting_stream : public stdext::input_stream, public stdext::seekable
+    {
+    public:
+        explicit counting_stream(const std::vector<std::byte>& data) noexcept : _data(data) { }
+
+    public:
+        size_t reads() const noexcept { return _reads; }
+        size_t seeks() const noexcept { return _seeks; }
+        void reset_counts() noexcept { _reads = _seeks = 0; }
+
+    protected:
+        size_t do_read(std::byte* buffer, size_t size) override;
+        stdext::stream_position do_position() const override;
+        void do_set_position(stdext::stream_position position) override;
+        stdext::stream_position do_seek(stdext::seek_from from, stdext::stream_offset offset) override;
+        stdext::stream_position do_end_position() const override;
+
+    private:
+        const std::vector<std::byte>& _data;
+        size_t _position = 0;
+        size_t _reads = 0;
+        size_t _seeks = 0;
+    };
+
+    // Collects everything written to it, at whatever position it has been moved to.
+    class vector_output_stream : public stdext::output_stream, public stdext::seekable
+    {
+    public:
+        const std::vector<std::byte>& data() const noexcept { return _data; }
+
+    protected:
+        size_t do_write(const std::byte* buffer, size_t size) override;
+        stdext::stream_position do_position() const override;
+        void do_set_position(stdext::stream_position position) override;
+        stdext::stream_position do_seek(stdext::seek_from from, stdext::stream_offset offset) override;
+        stdext::stream_position do_end_position() const override;
+
+    private:
+        std::vector<std::byte> _data;
+        size_t _position = 0;
+    };
+
+    // Reads from memory a little at a time, pausing before each read, and fails once it has
+    // read fail_offset bytes.
+    class slow_stream : public stdext::input_stream
+    {
+    public:
+        slow_stream(const std::vector<std::byte>& data, size_t read_size, std::chrono::microseconds delay, size_t fail_offset = size_t(-1)) noexcept
+            : _data(data), _read_size(read_size), _delay(delay), _fail_offset(fail_offset) { }
+
+    protected:
+        size_t do_read(std::byte* buffer, size_t size) override;
+
+    private:
+        const std::vector<std::byte>& _data;
+        size_t _read_size;
+        std::chrono::microseconds _delay;
+        size_t _fail_offset;
+        size_t _position = 0;
+    };
+
+    using wcdx::test::stream_chunk;
+
+    // Chunk 0 starts track 1-3 on trigger 0, track 5-6 on trigger 1 and track 7 on trigger
+    // 2.  Chunk 3 loops back to chunk 2 at low intensity, goes on to chunk 4 (which ends
+    // the stream) at medium intensity, and switches to track 5-6 (which returns to the
+    // previous track) at high intensity.  Chunk 7 is the last chunk and has no links.
+    const std::vector<stream_chunk> test_chunks
+    {
+        { 0, { { 0, 1 }, { 1, 5 }, { 2, 7 } }, { { 10, 1 }, { 50, 5 } } },
+        { 400, { }, { } },
+        { 1000, { }, { } },
+        { 640, { }, { { 10, 2 }, { 30, 4 }, { 50, 5 } } },
+        { 200, { { 64, 0 } }, { } },
+        { 300, { }, { } },
+        { 800, { { 65, 0 } }, { } },
+        { 120, { }, { } },
+    };
+
+    // Plays back a stream, noting each handler call.
+    struct playback
+    {
+        std::vector<std::byte> samples;
+        std::vector<std::string> events;
+        size_t reads;
+        size_t seeks;
+    };
+
+    using wcdx::test::check;
+    using wcdx::test::make_stream;
+
+    std::vector<std::byte> chunk_samples(uint32_t chunk_index, uint32_t size);
+    std::vector<std::byte> expected_samples(std::initializer_list<uint32_t> chunk_indices);
+    playback play(const std::vector<std::byte>& data, uint8_t trigger, uint8_t intensity, unsigned loops, size_t read_size, size_t read_ahead_size);
+    bool stream_throws(const std::vector<std::byte>& data);
+
+    void test_transitions();
+    void test_read_sizes();
+    void test_sequential_reads();
+    void test_skip();
+    void test_seek();
+    void test_shared_file();
+    void test_batch_handlers();
+    void test_repack();
+    void test_invalid_streams();
+    void test_write_wave();
+    void test_ring();
+    void test_playback();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("audio", []
+    {
+        test_transitions();
+        test_read_sizes();
+        test_sequential_reads();
+        test_skip();
+        test_seek();
+        test_shared_file();
+        test_batch_handlers();
+        test_repack();
+        test_invalid_streams();
+        test_write_wave();
+        test_ring();
+        test_playback();
+    });
+}
+
+namespace
+{
+    void test_transitions()
+    {
+        using wcdx::audio::no_trigger;
+        auto data = make_stream(test_chunks, chunk_samples);
+
+        auto looped = play(data, 0, 10, 2, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(looped.samples == expected_samples({ 1, 2, 3, 2, 3, 2, 3 }), "Bad samples for looped track");
+        check(looped.events == std::vector<std::string>
+        {
+            "start 1", "next 2 100", "next 3 350", "loop 2 510", "next 3 760", "loop 2 920", "next 3 1170", "loop 2 1330"
+        }, "Bad handler calls for looped track");
+
+        auto ended = play(data, 0, 30, 0, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(ended.samples == expected_samples({ 1, 2, 3, 4 }), "Bad samples for ended track");
+        check(ended.events == std::vector<std::string>
+        {
+            "start 1", "next 2 100", "next 3 350", "next 4 510", "end 560"
+        }, "Bad handler calls for ended track");
+
+        auto switched = play(data, 0, 50, 0, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(switched.samples == expected_samples({ 1, 2, 3, 5, 6 }), "Bad samples for switched track");
+        check(switched.events == std::vector<std::string>
+        {
+            "start 1", "next 2 100", "next 3 350", "track 5 510", "next 6 585", "prev 785"
+        }, "Bad handler calls for switched track");
+
+        // Without a trigger, playback starts from the index chunk's intensity links.
+        auto untriggered = play(data, no_trigger, 50, 0, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(untriggered.samples == expected_samples({ 5, 6 }), "Bad samples without a trigger");
+        check(untriggered.events == std::vector<std::string>
+        {
+            "track 5 0", "next 6 75", "prev 275"
+        }, "Bad handler calls without a trigger");
+
+        // Running off the last chunk starts over from the first; the handler stops it here.
+        auto wrapped = play(data, 2, 10, 0, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(wrapped.samples == expected_samples({ 7 }), "Bad samples for last chunk");
+        check(wrapped.events == std::vector<std::string>
+        {
+            "start 7", "track 0 30"
+        }, "Bad handler calls for last chunk");
+    }
+
+    void test_read_sizes()
+    {
+        auto data = make_stream(test_chunks, chunk_samples, true);
+        auto expected = play(data, 0, 10, 3, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        for (size_t read_size : { 1, 3, 64, 999, 0x10000 })
+        {
+            for (size_t read_ahead_size : { 1, 7, 256, 0x400 })
+            {
+                auto label = "Read size " + std::to_string(read_size) + ", read-ahead " + std::to_string(read_ahead_size) + ": ";
+                auto result = play(data, 0, 10, 3, read_size, read_ahead_size);
+                check(result.samples == expected.samples, label + "bad samples");
+                check(result.events == expected.events, label + "bad handler calls");
+            }
+        }
+    }
+
+    void test_sequential_reads()
+    {
+        // With every chunk fitting in the read-ahead window, each chunk played takes one read
+        // however small the reads made of the stream.  Seeks are only needed where playback
+        // jumps to a chunk that isn't next in the file.
+        auto forward = play(make_stream(test_chunks, chunk_samples), 0, 10, 2, 16, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(forward.reads == 7, "Chunks not read whole");
+        check(forward.seeks == 3, "Seek made between adjacent chunks");
+
+        auto reversed = play(make_stream(test_chunks, chunk_samples, true), 0, 10, 2, 16, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(reversed.reads == 7, "Chunks not read whole from reversed layout");
+        // Going backward through the file, only the loops from chunk 3 to chunk 2 read on
+        // from where the last read ended.
+        check(reversed.seeks == 5, "Bad seek count for reversed layout");
+
+        // A smaller window reads each chunk in pieces, still without seeking between them.
+        auto pieces = play(make_stream(test_chunks, chunk_samples), 0, 10, 2, 16, 256);
+        check(pieces.seeks == 3, "Seek made within a chunk");
+    }
+
+    void test_skip()
+    {
+        auto data = make_stream(test_chunks, chunk_samples, true);
+        counting_stream file(data);
+        wcdx::audio::wcaudio_stream stream(file);
+        unsigned loops = 1;
+        stream.on_loop([&](uint32_t, unsigned) { return loops-- != 0; });
+        stream.select(0, 10);
+        file.reset_counts();
+
+        // Skip the first two chunks and part of the third.
+        std::vector<std::byte> head(200);
+        check(stream.read(head.data(), head.size()) == head.size(), "Short read before skip");
+        check(stream.skip<std::byte>(1500) == 1500, "Short skip");
+        check(file.reads() == 1, "Skipped samples were read");
+
+        std::vector<std::byte> tail(0x10000);
+        tail.resize(stream.read(tail.data(), tail.size()));
+
+        auto expected = expected_samples({ 1, 2, 3, 2, 3 });
+        check(std::equal(head.begin(), head.end(), expected.begin()), "Bad samples before skip");
+        check(tail.size() == expected.size() - 1700 && std::equal(tail.begin(), tail.end(), expected.begin() + 1700), "Bad samples after skip");
+    }
+
+    void test_seek()
+    {
+        auto data = make_stream(test_chunks, chunk_samples, true);
+        counting_stream file(data);
+        wcdx::audio::wcaudio_stream stream(file);
+        check(stream.frame_count() == 0, "Frames before selecting a track");
+
+        // The looping track runs to the end of chunk 3; the one that goes on to chunk 4 runs
+        // through it; the one that moves on to another track stops short of it.
+        stream.select(0, 30);
+        check(stream.frame_count() == 560, "Bad frame count for ended track");
+        stream.select(0, 50);
+        check(stream.frame_count() == 510, "Bad frame count for switched track");
+        stream.select(1, 10);
+        check(stream.frame_count() == 275, "Bad frame count for second track");
+
+        std::vector<std::string> events;
+        unsigned loops = 1;
+        stream.on_next_chunk([&](uint32_t chunk_index, unsigned frame_count)
+        {
+            events.push_back("next " + std::to_string(chunk_index) + ' ' + std::to_string(frame_count));
+        });
+        stream.on_loop([&](uint32_t chunk_index, unsigned frame_count)
+        {
+            events.push_back("loop " + std::to_string(chunk_index) + ' ' + std::to_string(frame_count));
+            // The chunk looped back to starts where it does in the track, however much of the
+            // track was seeked past.
+            check(stream.chunk_frame(chunk_index) == 100, "Bad frame for loop target");
+            return loops-- != 0;
+        });
+        stream.select(0, 10);
+        check(stream.frame_count() == 510, "Bad frame count for looped track");
+        check(stream.chunk_frame(1) == 0 && stream.chunk_frame(3) == 350, "Bad chunk frames");
+
+        // Seeking into the middle of chunk 2 plays on from there as if everything before it
+        // had been played, without reading what was passed over.
+        file.reset_counts();
+        stream.seek_to_frame(300);
+        check(file.reads() == 0 && file.seeks() == 0, "Seeking read the stream");
+        std::vector<std::byte> samples(0x10000);
+        samples.resize(stream.read(samples.data(), samples.size()));
+        auto expected = expected_samples({ 1, 2, 3, 2, 3 });
+        check(samples.size() == expected.size() - 1200 && std::equal(samples.begin(), samples.end(), expected.begin() + 1200), "Bad samples after seek");
+        check(events == std::vector<std::string>{ "next 3 350", "loop 2 510", "next 3 760", "loop 2 920" }, "Bad handler calls after seek");
+
+        // Seeking back to the start of a chunk, and to the end of the track, which goes
+        // straight on to the loop.
+        for (auto [frame, offset] : { std::make_pair(350u, 1400u), std::make_pair(100u, 400u), std::make_pair(0u, 0u), std::make_pair(510u, 2040u) })
+        {
+            events.clear();
+            loops = 0;
+            stream.seek_to_frame(frame);
+            samples.resize(0x10000);
+            samples.resize(stream.read(samples.data(), samples.size()));
+            expected = expected_samples({ 1, 2, 3, 2, 3 });
+            expected.resize(2040);
+            auto label = "Seek to frame " + std::to_string(frame) + ": ";
+            check(samples.size() == expected.size() - offset && std::equal(samples.begin(), samples.end(), expected.begin() + offset), label + "bad samples");
+            check(!events.empty() && events.back() == "loop 2 510", label + "bad loop frame");
+        }
+
+        bool thrown = false;
+        try
+        {
+            stream.seek_to_frame(511);
+        }
+        catch (const std::range_error&)
+        {
+            thrown = true;
+        }
+        check(thrown, "Seek past the end of the track");
+
+        thrown = false;
+        try
+        {
+            stream.chunk_frame(5);
+        }
+        catch (const std::range_error&)
+        {
+            thrown = true;
+        }
+        check(thrown, "Frame given for a chunk of another track");
+    }
+
+    void test_shared_file()
+    {
+        using wcdx::audio::no_trigger;
+        auto data = make_stream(test_chunks, chunk_samples, true);
+
+        std::shared_ptr<const wcdx::audio::wcaudio_file> audio_file;
+        {
+            counting_stream file(data);
+            audio_file = std::make_shared<const wcdx::audio::wcaudio_file>(file);
+        }
+        check(audio_file->triggers() == std::vector<uint8_t>{ 0, 1, 2 }, "Bad triggers");
+        check(audio_file->intensities() == std::vector<uint8_t>{ 10, 50 }, "Bad intensities");
+
+        // Every track is played at once on several threads, each stream with a file of its
+        // own but all sharing the one set of tables, and each must come out just as it does
+        // from a stream that loaded the tables itself.
+        std::vector<std::pair<uint8_t, uint8_t>> selections;
+        for (auto trigger : { no_trigger, uint8_t(0), uint8_t(1), uint8_t(2) })
+        {
+            for (auto intensity : { uint8_t(10), uint8_t(30), uint8_t(50) })
+                selections.push_back({ trigger, intensity });
+        }
+
+        std::vector<std::vector<std::byte>> samples(selections.size());
+        wcdx::parallel::for_each_index(selections.size(), 4, [&](size_t n)
+        {
+            counting_stream file(data);
+            wcdx::audio::wcaudio_stream stream(audio_file, file, 0x100);
+            unsigned loops = 1;
+            stream.on_loop([&](uint32_t, unsigned) { return loops-- != 0; });
+            stream.on_next_track([](uint32_t chunk_index, unsigned) { return chunk_index != 0; });
+            stream.select(selections[n].first, selections[n].second);
+
+            vector_output_stream out;
+            auto size = wcdx::audio::write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+            samples[n].assign(out.data().begin() + 44, out.data().end());
+            if (size != samples[n].size())
+                throw std::runtime_error("Bad size returned by write_wave");
+        });
+
+        for (size_t n = 0; n != selections.size(); ++n)
+        {
+            auto expected = play(data, selections[n].first, selections[n].second, 1, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+            check(samples[n] == expected.samples, "Bad samples from shared file for trigger " + std::to_string(selections[n].first)
+                + " at intensity " + std::to_string(selections[n].second));
+        }
+    }
+
+    void test_batch_handlers()
+    {
+        // Track 1 goes on to track 3 at intensity 10, which goes back to track 1.  Sizes match
+        // test_chunks, which expected_samples goes by.
+        const std::vector<stream_chunk> cycle_chunks
+        {
+            { 0, { { 0, 1 } }, { { 10, 1 } } },
+            { 400, { }, { { 10, 3 } } },
+            { 1000, { }, { } },
+            { 640, { }, { { 10, 1 } } },
+        };
+        auto data = make_stream(cycle_chunks, chunk_samples);
+
+        auto render = [&](uint8_t trigger, bool next_tracks, std::vector<std::string>* events = nullptr)
+        {
+            counting_stream file(data);
+            wcdx::audio::wcaudio_stream stream(file);
+            wcdx::audio::batch_observers observers;
+            if (events != nullptr)
+                observers.next_track = [&](uint32_t chunk_index, unsigned) { events->push_back("track " + std::to_string(chunk_index)); };
+            wcdx::audio::set_batch_handlers(stream, 0, next_tracks, std::move(observers));
+            stream.select(trigger, 10);
+
+            std::vector<std::byte> samples(0x10000);
+            auto size = stream.read(samples.data(), samples.size());
+            check(stream.read(samples.data(), samples.size()) == 0, "Cycling tracks didn't stop");
+            samples.resize(size);
+            return samples;
+        };
+
+        // Each track plays once; the way back to the first is refused.
+        std::vector<std::string> events;
+        check(render(0, true, &events) == expected_samples({ 1, 3 }), "Bad samples for cycling tracks");
+        check(events == std::vector<std::string>{ "track 3", "track 1" }, "Bad handler calls for cycling tracks");
+        check(render(wcdx::audio::no_trigger, true) == expected_samples({ 1, 3 }), "Bad samples for cycling tracks without a trigger");
+
+        // Without moving on, a selection without a trigger still plays its own track.
+        check(render(wcdx::audio::no_trigger, false) == expected_samples({ 1 }), "Bad samples for a single track without a trigger");
+        check(render(0, false) == expected_samples({ 1 }), "Bad samples for a single track");
+    }
+
+    void test_repack()
+    {
+        auto data = make_stream(test_chunks, chunk_samples, true);
+        std::shared_ptr<const wcdx::audio::wcaudio_file> audio_file;
+        vector_output_stream out;
+        {
+            counting_stream file(data);
+            audio_file = std::make_shared<const wcdx::audio::wcaudio_file>(file);
+            check(wcdx::audio::repack_stream(*audio_file, file, out) == test_chunks.size(), "Bad count of moved chunks");
+        }
+        auto repacked = out.data();
+        check(repacked.size() == data.size(), "Repacking changed the file size");
+
+        std::shared_ptr<const wcdx::audio::wcaudio_file> repacked_file;
+        {
+            counting_stream file(repacked);
+            repacked_file = std::make_shared<const wcdx::audio::wcaudio_file>(file);
+        }
+
+        {
+            counting_stream file1(data), file2(repacked);
+            check(wcdx::audio::compare_streams(audio_file, file1, repacked_file, file2, 2).empty(), "Repacked stream plays differently");
+        }
+
+        // The chunks are now stored in the order they're played, so a looping track reads
+        // as it would from a file laid out that way to begin with.
+        auto forward = play(make_stream(test_chunks, chunk_samples), 0, 10, 2, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        auto reversed = play(data, 0, 10, 2, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        auto result = play(repacked, 0, 10, 2, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+        check(result.samples == forward.samples && result.events == forward.events, "Bad playback of repacked stream");
+        check(result.seeks == forward.seeks && result.seeks < reversed.seeks, "Repacked stream isn't in playback order");
+
+        // Repacking again changes nothing.
+        vector_output_stream again;
+        {
+            counting_stream file(repacked);
+            check(wcdx::audio::repack_stream(*repacked_file, file, again) == 0, "Repacking moved chunks again");
+        }
+        check(again.data() == repacked, "Repacking again changed the file");
+
+        // A damaged sample in chunk 7 is caught, in the tracks that play it.
+        auto damaged = repacked;
+        damaged.back() ^= std::byte(1);
+        counting_stream file1(repacked), file2(damaged);
+        auto mismatches = wcdx::audio::compare_streams(repacked_file, file1, repacked_file, file2, 0);
+        check(!mismatches.empty() && std::all_of(mismatches.begin(), mismatches.end(),
+            [](const wcdx::audio::track_selection& selection) { return selection.trigger == 2; }), "Damaged sample not caught");
+    }
+
+    void test_invalid_streams()
+    {
+        auto data = make_stream(test_chunks, chunk_samples);
+        check(!stream_throws(data), "Valid stream rejected");
+
+        auto bad_magic = data;
+        bad_magic[0] = std::byte('X');
+        check(stream_throws(bad_magic), "Bad magic accepted");
+
+        auto bad_links = test_chunks;
+        bad_links[3].chunk_links.push_back({ 90, uint32_t(test_chunks.size()) });
+        check(!stream_throws(make_stream(bad_links, chunk_samples)), "Unused bad link rejected");
+
+        // A chunk whose links run past the end of the link table.
+        wcdx::audio::stream_file_header header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        auto bad_range = data;
+        auto count_offset = header.chunk_headers_offset + 3 * 6 * sizeof(uint32_t) + 4 * sizeof(uint32_t);
+        uint32_t count = header.chunk_link_count;
+        std::memcpy(&bad_range[count_offset], &count, sizeof(count));
+        check(stream_throws(bad_range), "Link range past the end of the table accepted");
+
+        bool thrown = false;
+        try
+        {
+            counting_stream file(data);
+            wcdx::audio::wcaudio_stream stream(file, 0);
+        }
+        catch (const std::range_error&)
+        {
+            thrown = true;
+        }
+        check(thrown, "Empty read-ahead window accepted");
+    }
+
+    void test_write_wave()
+    {
+        auto data = make_stream(test_chunks, chunk_samples, true);
+        counting_stream file(data);
+        wcdx::audio::wcaudio_stream stream(file);
+        stream.select(0, 30);
+
+        vector_output_stream out;
+        wcdx::audio::write_wave(out, stream, stream.channels(), stream.sample_rate(), stream.bits_per_sample(), stream.buffer_size());
+
+        auto expected = expected_samples({ 1, 2, 3, 4 });
+        auto& wave = out.data();
+        constexpr size_t header_size = 44;
+        check(wave.size() == header_size + expected.size(), "Bad WAVE file size");
+        check(std::equal(expected.begin(), expected.end(), wave.begin() + header_size), "Bad WAVE samples");
+
+        uint32_t riff_size, data_size;
+        std::memcpy(&riff_size, &wave[4], sizeof(riff_size));
+        std::memcpy(&data_size, &wave[40], sizeof(data_size));
+        check(riff_size == wave.size() - 8 && data_size == expected.size(), "Bad WAVE chunk sizes");
+    }
+
+    void test_ring()
+    {
+        wcdx::audio::pcm_ring ring(100);
+        check(ring.capacity() == 128, "Ring capacity not rounded up");
+
+        std::vector<std::byte> data(300);
+        for (size_t n = 0; n < data.size(); ++n)
+            data[n] = std::byte(n * 7);
+
+        // Fill the ring, drain part of it, then fill it again so that the data wraps around
+        // the end of the buffer.
+        check(ring.write(data.data(), 100) == 100, "Bad first write");
+        check(ring.write(data.data() + 100, 50) == 28 && ring.size() == 128, "Bad write to a nearly full ring");
+        std::vector<std::byte> out(300);
+        check(ring.read(out.data(), 60) == 60 && ring.size() == 68, "Bad first read");
+        check(ring.write(data.data() + 128, 100) == 60 && ring.size() == 128, "Bad wrapped write");
+        check(ring.read(out.data() + 60, 300) == 128 && ring.size() == 0, "Bad wrapped read");
+        check(std::equal(out.begin(), out.begin() + 188, data.begin()), "Ring reordered bytes");
+        check(ring.read(out.data(), 10) == 0, "Read from an empty ring");
+
+        check(!ring.closed(), "Ring closed early");
+        ring.close();
+        check(ring.closed(), "Ring not closed");
+    }
+
+    void test_playback()
+    {
+        using namespace std::chrono_literals;
+        auto data = make_stream(test_chunks, chunk_samples, true);
+
+        // Played through the ring, a track comes out exactly as it's read directly.
+        {
+            counting_stream file(data);
+            wcdx::audio::wcaudio_stream stream(file);
+            unsigned loops = 1;
+            stream.on_loop([&](uint32_t, unsigned) { return loops-- != 0; });
+            stream.on_next_track([](uint32_t chunk_index, unsigned) { return chunk_index != 0; });
+            stream.select(0, 10);
+
+            vector_output_stream out;
+            wcdx::audio::stream_sink sink(out, 256);
+            auto stats = wcdx::audio::play_stream(stream, sink, 1024);
+            auto expected = play(data, 0, 10, 1, 0x1000, wcdx::audio::wcaudio_stream::default_read_ahead_size);
+            check(out.data() == expected.samples, "Bad samples played through the ring");
+            check(stats.ring_capacity == 1024 && stats.periods == (expected.samples.size() + 255) / 256, "Bad period count");
+        }
+
+        std::vector<std::byte> pcm(0x2000);
+        for (size_t n = 0; n < pcm.size(); ++n)
+            pcm[n] = std::byte(n * 13);
+
+        // A sink that can wait does when the decoder falls behind, so nothing is lost, but
+        // the wait still counts as an underrun.
+        {
+            slow_stream in(pcm, 64, 200us);
+            vector_output_stream out;
+            wcdx::audio::stream_sink sink(out, 256);
+            auto stats = wcdx::audio::play_stream(in, sink, 1024);
+            check(out.data() == pcm, "Bad samples from a slow decoder");
+            check(stats.underruns != 0 && stats.min_fill < 256, "Slow decoder didn't underrun");
+        }
+
+        // A real-time sink plays silence instead.
+        {
+            slow_stream in(pcm, 64, 200us);
+            wcdx::audio::null_sink sink(256, 100us);
+            auto stats = wcdx::audio::play_stream(in, sink, 1024);
+            check(stats.underruns != 0 && sink.bytes_played() > pcm.size(), "Real-time sink didn't fill underruns with silence");
+        }
+
+        // Errors from the decoder come back to the caller.
+        bool thrown = false;
+        try
+        {
+            slow_stream in(pcm, 64, 0us, 0x1000);
+            wcdx::audio::null_sink sink(256);
+            wcdx::audio::play_stream(in, sink, 1024);
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        check(thrown, "Decoder error lost");
+    }
+
+    size_t slow_stream::do_read(std::byte* buffer, size_t size)
+    {
+        std::this_thread::sleep_for(_delay);
+        if (_position >= _fail_offset)
+            throw std::runtime_error("Read failed");
+
+        size = std::min({ size, _read_size, _data.size() - _position });
+        std::copy_n(_data.data() + _position, size, buffer);
+        _position += size;
+        return size;
+    }
+
+    size_t counting_stream::do_read(std::byte* buffer, size_t size)
+    {
+        ++_reads;
+        size = std::min(size, _data.size() - std::min(_position, _data.size()));
+        std::copy_n(_data.data() + _position, size, buffer);
+        _position += size;
+        return size;
+    }
+
+    stdext::stream_position counting_stream::do_position() const
+    {
+        return _position;
+    }
+
+    void counting_stream::do_set_position(stdext::stream_position position)
+    {
+        ++_seeks;
+        _position = size_t(position);
+    }
+
+    stdext::stream_position counting_stream::do_seek(stdext::seek_from from, stdext::stream_offset offset)
+    {
+        auto base = from == stdext::seek_from::begin ? 0 : from == stdext::seek_from::current ? _position : _data.size();
+        do_set_position(stdext::stream_position(stdext::stream_offset(base) + offset));
+        return _position;
+    }
+
+    stdext::stream_position counting_stream::do_end_position() const
+    {
+        return _data.size();
+    }
+
+    size_t vector_output_stream::do_write(const std::byte* buffer, size_t size)
+    {
+        if (_data.size() < _position + size)
+            _data.resize(_position + size);
+        std::copy_n(buffer, size, _data.data() + _position);
+        _position += size;
+        return size;
+    }
+
+    stdext::stream_position vector_output_stream::do_position() const
+    {
+        return _position;
+    }
+
+    void vector_output_stream::do_set_position(stdext::stream_position position)
+    {
+        _position = size_t(position);
+    }
+
+    stdext::stream_position vector_output_stream::do_seek(stdext::seek_from from, stdext::stream_offset offset)
+    {
+        auto base = from == stdext::seek_from::begin ? 0 : from == stdext::seek_from::current ? _position : _data.size();
+        _position = size_t(stdext::stream_offset(base) + offset);
+        return _position;
+    }
+
+    stdext::stream_position vector_output_stream::do_end_position() const
+    {
+        return _data.size();
+    }
+
+    std::vector<std::byte> chunk_samples(uint32_t chunk_index, uint32_t size)
+    {
+        std::vector<std::byte> samples(size);
+        for (size_t n = 0; n < samples.size(); ++n)
+            samples[n] = std::byte(chunk_index * 37 + n * 11 + n / 256);
+        return samples;
+    }
+
+    std::vector<std::byte> expected_samples(std::initializer_list<uint32_t> chunk_indices)
+    {
+        std::vector<std::byte> samples;
+        for (auto chunk_index : chunk_indices)
+        {
+            auto chunk = chunk_samples(chunk_index, test_chunks[chunk_index].size);
+            samples.insert(samples.end(), chunk.begin(), chunk.end());
+        }
+
+        return samples;
+    }
+
+    // The loop handler allows the given number of loops.  The next track handler stops
+    // playback when the stream runs off its last chunk.
+    playback play(const std::vector<std::byte>& data, uint8_t trigger, uint8_t intensity, unsigned loops, size_t read_size, size_t read_ahead_size)
+    {
+        counting_stream file(data);
+        wcdx::audio::wcaudio_stream stream(file, read_ahead_size);
+
+        playback result;
+        auto note = [&](const char* event, uint32_t chunk_index, unsigned frame_count)
+        {
+            result.events.push_back(event + (chunk_index != wcdx::audio::end_of_track ? ' ' + std::to_string(chunk_index) : "")
+                + ' ' + std::to_string(frame_count));
+        };
+        stream.on_next_chunk([&](uint32_t chunk_index, unsigned frame_count) { note("next", chunk_index, frame_count); });
+        stream.on_loop([&](uint32_t chunk_index, unsigned frame_count)
+        {
+            note("loop", chunk_index, frame_count);
+            return loops-- != 0;
+        });
+        stream.on_start_track([&](uint32_t chunk_index) { result.events.push_back("start " + std::to_string(chunk_index)); });
+        stream.on_next_track([&](uint32_t chunk_index, unsigned frame_count)
+        {
+            note("track", chunk_index, frame_count);
+            return chunk_index != 0;
+        });
+        stream.on_prev_track([&](unsigned frame_count) { note("prev", wcdx::audio::end_of_track, frame_count); });
+        stream.on_end_of_stream([&](unsigned frame_count) { note("end", wcdx::audio::end_of_track, frame_count); });
+
+        stream.select(trigger, intensity);
+        file.reset_counts();
+
+        std::vector<std::byte> buffer(read_size);
+        size_t bytes;
+        while ((bytes = stream.read(buffer.data(), buffer.size())) != 0)
+            result.samples.insert(result.samples.end(), buffer.begin(), buffer.begin() + bytes);
+
+        result.reads = file.reads();
+        result.seeks = file.seeks();
+        return result;
+    }
+
+    bool stream_throws(const std::vector<std::byte>& data)
+    {
+        try
+        {
+            counting_stream file(data);
+            wcdx::audio::wcaudio_stream stream(file);
+        }
+        catch (const std::runtime_error&)
+        {
+            return true;
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,37 @@
+#include "bench.h"
+
+#include <atomic>
+#include <new>
+
+#include <cstdlib>
+
+
+// Replaces the global allocation functions to count allocations.  The other forms of
+// operator new and delete, apart from the over-aligned ones, are defined in terms of these.
+namespace
+{
+    std::atomic<uint64_t> allocations(0);
+}
+
+uint64_t allocation_count() noexcept
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
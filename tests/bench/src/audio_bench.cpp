@@ -0,0 +1,481 @@
+#include "bench.h"
+
+#include <audio/wave.h>
+#include <audio/wcaudio_stream.h>
+
+#include <stdext/multi.h>
+#include <stdext/stream.h>
+#include <stdext/utility.h>
+
+#include <test/stream.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace
+{
+    // Reads a file without buffering, so that every read and seek is a call into the
+    // system, as with the file streams the tools use, and counts them.
+    class counting_stream : public stdext::input_stream, public stdext::seekable
+    {
+    public:
+        explicit counting_stream(const std::filesystem::path& path);
+        counting_stream(const counting_stream&) = delete;
+        counting_stream& operator = (const counting_stream&) = delete;
+        ~counting_stream();
+
+    public:
+        size_t reads() const noexcept { return _reads; }
+        size_t seeks() const noexcept { return _seeks; }
+
+    protected:
+        size_t do_read(std::byte* buffer, size_t size) override;
+        stdext::stream_position do_position() const override;
+        void do_set_position(stdext::stream_position position) override;
+        stdext::stream_position do_seek(stdext::seek_from from, stdext::stream_offset offset) override;
+        stdext::stream_position do_end_position() const override;
+
+    private:
+        std::FILE* _file;
+        size_t _reads = 0;
+        size_t _seeks = 0;
+    };
+
+    // Keeps track of where it is, and either throws away or collects what's written to it.
+    class wave_output_stream : public stdext::output_stream, public stdext::seekable
+    {
+    public:
+        explicit wave_output_stream(bool keep) noexcept : _keep(keep) { }
+
+    public:
+        const std::vector<std::byte>& data() const noexcept { return _data; }
+
+    protected:
+        size_t do_write(const std::byte* buffer, size_t size) override;
+        stdext::stream_position do_position() const override;
+        void do_set_position(stdext::stream_position position) override;
+        stdext::stream_position do_seek(stdext::seek_from from, stdext::stream_offset offset) override;
+        stdext::stream_position do_end_position() const override;
+
+    private:
+        bool _keep;
+        std::vector<std::byte> _data;
+        size_t _position = 0;
+        size_t _size = 0;
+    };
+
+    struct reference_chunk
+    {
+        uint32_t start_offset;
+        uint32_t end_offset;
+        uint32_t trigger_link_count;
+        uint32_t trigger_link_index;
+        uint32_t chunk_link_count;
+        uint32_t chunk_link_index;
+    };
+
+#pragma pack(push)
+#pragma pack(1)
+    struct reference_link
+    {
+        uint8_t value;
+        uint32_t chunk_index;
+    };
+#pragma pack(pop)
+
+    // wcaudio_stream as it was before transitions were worked out up front and samples were
+    // read ahead: a seek and a read for every piece of a chunk, and a search of the chunk's
+    // links at the end of it.  Only the handlers the benchmarks use are kept.
+    class reference_stream : public stdext::input_stream
+    {
+    public:
+        explicit reference_stream(counting_stream& file);
+
+    public:
+        void select(uint8_t trigger, uint8_t intensity);
+        void on_loop(wcdx::audio::wcaudio_stream::loop_handler handler) { _loop_handler = std::move(handler); }
+
+    private:
+        size_t do_read(std::byte* buffer, size_t size) override;
+        uint32_t next_chunk_index(uint32_t chunk_index, uint8_t trigger, uint8_t intensity);
+
+    private:
+        counting_stream* _file;
+        wcdx::audio::stream_file_header _file_header;
+        std::vector<reference_chunk> _chunks;
+        std::vector<reference_link> _chunk_links;
+        std::vector<reference_link> _trigger_links;
+        wcdx::audio::wcaudio_stream::loop_handler _loop_handler;
+
+        reference_chunk* _current_chunk = nullptr;
+        uint32_t _current_chunk_offset = 0;
+        uint8_t _current_intensity = 0;
+        unsigned _frame_count = 0;
+        uint32_t _first_chunk_index = 0;
+    };
+
+    using wcdx::test::make_stream;
+    using wcdx::test::stream_chunk;
+
+    struct render_result
+    {
+        measurement best;
+        size_t reads;
+        size_t seeks;
+    };
+
+    std::vector<std::byte> chunk_samples(uint32_t chunk_index, uint32_t size);
+    std::filesystem::path save_stream(const std::vector<std::byte>& data);
+    template <class Stream>
+    render_result render(const std::filesystem::path& path, unsigned loops, uint8_t intensity, bool keep, std::vector<std::byte>* wave);
+    void print_results(const render_result& reference, const render_result& current);
+}
+
+void run_audio_benchmarks()
+{
+    // A track of ten 48 KB chunks whose last seven loop, rendered the way wcjukebox -o
+    // does.  Sixteen-bit stereo at 22050 Hz.
+    std::vector<stream_chunk> track{ { 0, { { 0, 1 } }, { { 10, 1 } } } };
+    for (uint32_t n = 1; n <= 10; ++n)
+        track.push_back({ 48000, { }, { } });
+    track.back().chunk_links.push_back({ 10, 3 });
+    auto track_path = save_stream(make_stream(track, chunk_samples));
+
+    constexpr unsigned loops = 60;
+    std::vector<std::byte> reference_wave, current_wave;
+    render<reference_stream>(track_path, loops, 10, true, &reference_wave);
+    render<wcdx::audio::wcaudio_stream>(track_path, loops, 10, true, &current_wave);
+    if (current_wave != reference_wave)
+        throw std::runtime_error("Music stream differs from the old path");
+
+    auto track_reference = render<reference_stream>(track_path, loops, 10, false, nullptr);
+    auto track_current = render<wcdx::audio::wcaudio_stream>(track_path, loops, 10, false, nullptr);
+    auto seconds = double(reference_wave.size()) / (22050 * 4);
+    std::cout << "Music stream (" << std::fixed << std::setprecision(0) << seconds << " s looped track to WAV, "
+        << std::setprecision(1) << reference_wave.size() / 1e6 << " MB)\n";
+    print_results(track_reference, track_current);
+    report("music_stream/old", track_reference.best, double(reference_wave.size()) / (1 << 20), "MB");
+    report("music_stream/read_ahead", track_current.best, double(reference_wave.size()) / (1 << 20), "MB");
+
+    // Short chunks with many links, where finding the next chunk is most of the work.  At
+    // intensity 46 the closest link goes on to the next chunk; the last chunk loops.
+    constexpr uint32_t chunk_count = 200;
+    std::mt19937 random(11);
+    std::vector<stream_chunk> dense{ { 0, { { 0, 1 } }, { { 46, 1 } } } };
+    for (uint32_t n = 1; n <= chunk_count; ++n)
+    {
+        stream_chunk chunk{ 256, { }, { } };
+        for (uint8_t trigger = 100; trigger < 108; ++trigger)
+            chunk.trigger_links.push_back({ trigger, 1 + random() % chunk_count });
+        for (uint8_t intensity = 0; intensity < 48; intensity += 2)
+            chunk.chunk_links.push_back({ intensity, intensity == 46 ? n % chunk_count + 1 : 1 + random() % chunk_count });
+        dense.push_back(std::move(chunk));
+    }
+    auto dense_path = save_stream(make_stream(dense, chunk_samples));
+
+    constexpr unsigned dense_loops = 50;
+    render<reference_stream>(dense_path, dense_loops, 46, true, &reference_wave);
+    render<wcdx::audio::wcaudio_stream>(dense_path, dense_loops, 46, true, &current_wave);
+    if (current_wave != reference_wave)
+        throw std::runtime_error("Linked music stream differs from the old path");
+
+    auto dense_reference = render<reference_stream>(dense_path, dense_loops, 46, false, nullptr);
+    auto dense_current = render<wcdx::audio::wcaudio_stream>(dense_path, dense_loops, 46, false, nullptr);
+    auto transitions = double(chunk_count) * (dense_loops + 1);
+    std::cout << "Chunk transitions (" << chunk_count << " chunks of 256 bytes, 8 trigger and 24 chunk links each)\n";
+    print_results(dense_reference, dense_current);
+    std::cout << "  per chunk   " << std::setw(8) << std::setprecision(0) << dense_reference.best.seconds / transitions * 1e9
+        << " ns old, " << dense_current.best.seconds / transitions * 1e9 << " ns now\n";
+    report("chunk_transitions/old", dense_reference.best, transitions, "chunks");
+    report("chunk_transitions/read_ahead", dense_current.best, transitions, "chunks");
+
+    std::filesystem::remove(dense_path);
+}
+
+namespace
+{
+    counting_stream::counting_stream(const std::filesystem::path& path)
+        : _file(std::fopen(path.string().c_str(), "rb"))
+    {
+        if (_file == nullptr)
+            throw std::runtime_error("Can't open " + path.string());
+        std::setvbuf(_file, nullptr, _IONBF, 0);
+    }
+
+    counting_stream::~counting_stream()
+    {
+        std::fclose(_file);
+    }
+
+    size_t counting_stream::do_read(std::byte* buffer, size_t size)
+    {
+        ++_reads;
+        return std::fread(buffer, 1, size, _file);
+    }
+
+    stdext::stream_position counting_stream::do_position() const
+    {
+        return stdext::stream_position(std::ftell(_file));
+    }
+
+    void counting_stream::do_set_position(stdext::stream_position position)
+    {
+        ++_seeks;
+        std::fseek(_file, long(position), SEEK_SET);
+    }
+
+    stdext::stream_position counting_stream::do_seek(stdext::seek_from from, stdext::stream_offset offset)
+    {
+        ++_seeks;
+        std::fseek(_file, long(offset), from == stdext::seek_from::begin ? SEEK_SET : from == stdext::seek_from::current ? SEEK_CUR : SEEK_END);
+        return do_position();
+    }
+
+    stdext::stream_position counting_stream::do_end_position() const
+    {
+        auto position = std::ftell(_file);
+        std::fseek(_file, 0, SEEK_END);
+        auto end = std::ftell(_file);
+        std::fseek(_file, position, SEEK_SET);
+        return stdext::stream_position(end);
+    }
+
+    size_t wave_output_stream::do_write(const std::byte* buffer, size_t size)
+    {
+        if (_keep)
+        {
+            if (_data.size() < _position + size)
+                _data.resize(_position + size);
+            std::copy_n(buffer, size, _data.data() + _position);
+        }
+
+        _position += size;
+        _size = std::max(_size, _position);
+        return size;
+    }
+
+    stdext::stream_position wave_output_stream::do_position() const
+    {
+        return _position;
+    }
+
+    void wave_output_stream::do_set_position(stdext::stream_position position)
+    {
+        _position = size_t(position);
+    }
+
+    stdext::stream_position wave_output_stream::do_seek(stdext::seek_from from, stdext::stream_offset offset)
+    {
+        auto base = from == stdext::seek_from::begin ? 0 : from == stdext::seek_from::current ? _position : _size;
+        _position = size_t(stdext::stream_offset(base) + offset);
+        return _position;
+    }
+
+    stdext::stream_position wave_output_stream::do_end_position() const
+    {
+        return _size;
+    }
+
+    reference_stream::reference_stream(counting_stream& file)
+        : _file(&file)
+    {
+        stdext::input_stream& in = file;
+        _file_header = in.read<wcdx::audio::stream_file_header>();
+
+        _chunks.resize(_file_header.chunk_count);
+        file.set_position(_file_header.chunk_headers_offset);
+        in.read_all(_chunks.data(), _chunks.size());
+
+        _chunk_links.resize(_file_header.chunk_link_count);
+        file.set_position(_file_header.chunk_link_offset);
+        in.read_all(_chunk_links.data(), _chunk_links.size());
+
+        _trigger_links.resize(_file_header.trigger_link_count);
+        file.set_position(_file_header.trigger_link_offset);
+        in.read_all(_trigger_links.data(), _trigger_links.size());
+    }
+
+    void reference_stream::select(uint8_t trigger, uint8_t intensity)
+    {
+        auto chunk_index = next_chunk_index(0, trigger, intensity);
+        if (chunk_index == wcdx::audio::end_of_track)
+            return;
+
+        _current_chunk = &_chunks[chunk_index];
+        _current_chunk_offset = 0;
+        _current_intensity = intensity;
+        _frame_count = 0;
+    }
+
+    size_t reference_stream::do_read(std::byte* buffer, size_t size)
+    {
+        if (_current_chunk == nullptr)
+            return 0;
+
+        stdext::input_stream& in = *_file;
+        size_t total_bytes = 0;
+        auto p = buffer;
+        while (size != 0)
+        {
+            _file->set_position(stdext::stream_position(_current_chunk->start_offset) + _current_chunk_offset);
+            auto chunk_size = _current_chunk->end_offset - _current_chunk->start_offset;
+            auto bytes = in.read(p, std::min(size_t(chunk_size - _current_chunk_offset), size));
+            p += bytes;
+
+            size -= bytes;
+            total_bytes += bytes;
+            _current_chunk_offset += uint32_t(bytes);
+            if (_current_chunk_offset == chunk_size)
+            {
+                _frame_count += chunk_size / (_file_header.channels * ((_file_header.bits_per_sample + 7) / 8));
+                _current_chunk_offset = 0;
+
+                auto index = next_chunk_index(uint32_t(_current_chunk - _chunks.data()), wcdx::audio::no_trigger, _current_intensity);
+                if (index == wcdx::audio::end_of_track)
+                {
+                    _current_chunk = nullptr;
+                    break;
+                }
+
+                _current_chunk = &_chunks[index];
+            }
+        }
+
+        return total_bytes;
+    }
+
+    uint32_t reference_stream::next_chunk_index(uint32_t chunk_index, uint8_t trigger, uint8_t intensity)
+    {
+        const auto& chunk = _chunks[chunk_index];
+        auto track_link_first = _trigger_links.begin() + chunk.trigger_link_index;
+        auto track_link_last = track_link_first + chunk.trigger_link_count;
+        for (; track_link_first != track_link_last; ++track_link_first)
+        {
+            switch (track_link_first->value)
+            {
+            case 64:
+            case 65:
+                return wcdx::audio::end_of_track;
+            default:
+                if (track_link_first->value == trigger)
+                {
+                    _first_chunk_index = track_link_first->chunk_index;
+                    return track_link_first->chunk_index;
+                }
+                break;
+            }
+        }
+
+        auto chunk_link_first = _chunk_links.begin() + chunk.chunk_link_index;
+        auto chunk_link_last = chunk_link_first + chunk.chunk_link_count;
+        auto closest_intensity_level = 256;
+        auto closest_intensity_index = -1;
+        for (; chunk_link_first != chunk_link_last; ++chunk_link_first)
+        {
+            auto delta = abs(chunk_link_first->value - intensity);
+            if (delta < closest_intensity_level)
+            {
+                closest_intensity_level = delta;
+                closest_intensity_index = int(chunk_link_first->chunk_index);
+            }
+        }
+
+        if (closest_intensity_index != -1)
+        {
+            auto current_chunk_index = _current_chunk != nullptr ? _current_chunk - _chunks.data() : -2;
+            if (closest_intensity_index < current_chunk_index && uint32_t(closest_intensity_index) >= _first_chunk_index)
+            {
+                if (_loop_handler != nullptr && !_loop_handler(uint32_t(closest_intensity_index), _frame_count))
+                    return wcdx::audio::end_of_track;
+            }
+            else if (closest_intensity_index != current_chunk_index + 1)
+                _first_chunk_index = uint32_t(closest_intensity_index);
+
+            return uint32_t(closest_intensity_index);
+        }
+
+        if (++chunk_index == _chunks.size())
+        {
+            chunk_index = 0;
+            _first_chunk_index = 0;
+        }
+
+        return chunk_index;
+    }
+
+    // Noise, so that nothing about the samples helps either stream.
+    std::vector<std::byte> chunk_samples(uint32_t chunk_index, uint32_t size)
+    {
+        std::mt19937 random(12 + chunk_index);
+        std::vector<std::byte> samples(size);
+        for (auto& sample : samples)
+            sample = std::byte(random());
+        return samples;
+    }
+
+    // The stream is read from a file so that reads and seeks cost what they do in the tools.
+    std::filesystem::path save_stream(const std::vector<std::byte>& data)
+    {
+        auto path = std::filesystem::temp_directory_path() / "wcdx_bench.str";
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        if (!file)
+            throw std::runtime_error("Can't write " + path.string());
+        return path;
+    }
+
+    // Renders the selected track to a WAVE file, allowing the given number of loops, and
+    // keeps the fastest of a few runs.
+    template <class Stream>
+    render_result render(const std::filesystem::path& path, unsigned loops, uint8_t intensity, bool keep, std::vector<std::byte>* wave)
+    {
+        render_result result = { { std::numeric_limits<double>::infinity(), std::numeric_limits<uint64_t>::max() }, 0, 0 };
+        for (unsigned pass = 0; pass < (keep ? 1 : 5); ++pass)
+        {
+            counting_stream file(path);
+            Stream stream(file);
+            auto remaining = loops;
+            stream.on_loop([&](uint32_t chunk_index, unsigned frame_count)
+            {
+                stdext::discard(chunk_index, frame_count);
+                return remaining-- != 0;
+            });
+            stream.select(0, intensity);
+
+            wave_output_stream out(keep);
+            auto reads = file.reads();
+            auto seeks = file.seeks();
+            auto allocations = allocation_count();
+            auto start = std::chrono::steady_clock::now();
+            wcdx::audio::write_wave(out, stream, 2, 22050, 16, 0x2000);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            result.best.seconds = std::min(result.best.seconds, elapsed.count());
+            result.best.allocations = std::min(result.best.allocations, allocation_count() - allocations);
+            result.reads = file.reads() - reads;
+            result.seeks = file.seeks() - seeks;
+            if (wave != nullptr)
+                *wave = out.data();
+        }
+
+        return result;
+    }
+
+    void print_results(const render_result& reference, const render_result& current)
+    {
+        std::cout << "  old path    " << std::setw(8) << std::setprecision(2) << reference.best.seconds * 1000 << " ms, "
+            << reference.reads << " reads, " << reference.seeks << " seeks\n"
+            << "  read-ahead  " << std::setw(8) << current.best.seconds * 1000 << " ms, "
+            << current.reads << " reads, " << current.seeks << " seeks  ("
+            << reference.best.seconds / current.best.seconds << "x)\n";
+    }
+}
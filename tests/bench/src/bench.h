@@ -0,0 +1,84 @@
+#ifndef BENCH_INCLUDED
+#define BENCH_INCLUDED
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+// The fastest of several runs, and the fewest allocations any run made.  Later runs reuse
+// buffers the first one grew, so the fewest is what a steady caller pays.
+struct measurement
+{
+    double seconds;
+    uint64_t allocations;
+};
+
+// Calls to operator new so far, on any thread.
+uint64_t allocation_count() noexcept;
+
+// Runs function the given number of times and returns the best of the runs.
+template <class Function>
+measurement measure(unsigned iterations, Function&& function)
+{
+    measurement best = { std::numeric_limits<double>::infinity(), std::numeric_limits<uint64_t>::max() };
+    for (unsigned n = 0; n < iterations; ++n)
+    {
+        auto allocations = allocation_count();
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best.seconds = std::min(best.seconds, elapsed.count());
+        best.allocations = std::min(best.allocations, allocation_count() - allocations);
+    }
+
+    return best;
+}
+
+// Adds a result to the JSON report.  work is how much one run processes, counted in unit
+// (like "MB" or "frames"); the report gives it per second.
+void report(const std::string& name, const measurement& result, double work, const char* unit);
+
+// Produces data that compresses roughly like game resources do: runs of repeated phrases
+// mixed with short stretches of noise.
+inline std::vector<std::byte> make_resource_data(size_t size, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<std::byte> data;
+    data.reserve(size);
+    while (data.size() < size)
+    {
+        if (data.size() > 16 && random() % 4 != 0)
+        {
+            auto length = std::min(size_t(3 + random() % 29), size - data.size());
+            auto distance = 1 + random() % std::min(data.size(), size_t(4096));
+            auto src = data.size() - distance;
+            for (size_t n = 0; n < length; ++n)
+                data.push_back(data[src + n]);
+        }
+        else
+        {
+            auto length = std::min(size_t(1 + random() % 8), size - data.size());
+            for (size_t n = 0; n < length; ++n)
+                data.push_back(std::byte(random()));
+        }
+    }
+
+    return data;
+}
+
+void run_lzw_benchmarks();
+void run_sprite_benchmarks();
+void run_palette_benchmarks();
+void run_frame_benchmarks();
+void run_audio_benchmarks();
+void run_snow_benchmarks();
+
+#endif
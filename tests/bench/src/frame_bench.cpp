@@ -0,0 +1,206 @@
+#include "bench.h"
+
+#include <frame/convert.h>
+#include <frame/dirty_rows.h>
+#include <frame/recorder.h>
+#include <frame/recording.h>
+#include <image/png.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+#include <stdext/utility.h>
+
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+
+namespace
+{
+    constexpr unsigned frame_width = 320;
+    constexpr unsigned frame_height = 200;
+
+    // Throws away everything written to it.
+    class null_output_stream : public stdext::output_stream
+    {
+    protected:
+        size_t do_write(const std::byte* buffer, size_t size) override;
+    };
+
+    void run_recording_benchmarks(const std::vector<std::byte>& frame, const std::vector<uint32_t>& palette);
+    void convert_reference(const std::vector<std::byte>& frame, const uint32_t* palette, std::vector<uint32_t>& surface);
+}
+
+void run_frame_benchmarks()
+{
+    std::mt19937 random(9);
+    std::vector<uint32_t> palette(256);
+    for (auto& color : palette)
+        color = uint32_t(random()) | 0xFF000000;
+    std::vector<std::byte> frame(size_t(frame_width) * frame_height);
+    for (auto& index : frame)
+        index = std::byte(random());
+
+    std::vector<uint32_t> expected(frame.size());
+    std::vector<uint32_t> surface(frame.size());
+    convert_reference(frame, palette.data(), expected);
+    wcdx::frame::convert_indices(frame.data(), palette.data(), surface.data(), frame.size());
+    if (surface != expected)
+        throw std::runtime_error("Frame conversion differs from the scalar path");
+
+    constexpr unsigned iterations = 200;
+    auto reference = measure(iterations, [&] { convert_reference(frame, palette.data(), surface); });
+    auto portable = measure(iterations, [&]
+    {
+        wcdx::frame::convert_indices_portable(frame.data(), palette.data(), surface.data(), frame.size());
+    });
+    auto dispatched = measure(iterations, [&]
+    {
+        wcdx::frame::convert_indices(frame.data(), palette.data(), surface.data(), frame.size());
+    });
+
+    // A typical in-flight frame only redraws a few instrument panels.
+    wcdx::frame::dirty_rows dirty(frame_width, frame_height);
+    auto partial = measure(iterations, [&]
+    {
+        dirty.mark(16, 120, 80, 64);
+        dirty.mark(224, 120, 80, 64);
+        dirty.mark(120, 150, 80, 20);
+        auto& bounds = dirty.bounds();
+        wcdx::frame::convert_dirty_rows(dirty, frame.data(), palette.data(),
+            surface.data() + bounds.top * frame_width + bounds.left, frame_width * sizeof(uint32_t));
+        dirty.clear();
+    });
+
+    auto frames = [](const measurement& result) { return 1 / result.seconds / 1000; };
+    std::cout << "Frame conversion (" << frame_width << "x" << frame_height << ", thousand frames/s"
+        << (wcdx::frame::has_vector_conversion() ? ", AVX2" : ", no AVX2") << ")\n"
+        << "  scalar      " << std::setw(8) << std::fixed << std::setprecision(1) << frames(reference) << '\n'
+        << "  portable    " << std::setw(8) << frames(portable)
+        << "  (" << std::setprecision(2) << reference.seconds / portable.seconds << "x)\n"
+        << "  dispatched  " << std::setw(8) << std::setprecision(1) << frames(dispatched)
+        << "  (" << std::setprecision(2) << reference.seconds / dispatched.seconds << "x)\n"
+        << "  dirty rows  " << std::setw(8) << std::setprecision(1) << frames(partial)
+        << "  (" << std::setprecision(2) << reference.seconds / partial.seconds << "x)\n";
+
+    report("present/scalar", reference, 1, "frames");
+    report("present/portable", portable, 1, "frames");
+    report(wcdx::frame::has_vector_conversion() ? "present/avx2" : "present/dispatched", dispatched, 1, "frames");
+    report("present/dirty_rows", partial, 1, "frames");
+
+    run_recording_benchmarks(frame, palette);
+}
+
+namespace
+{
+    void run_recording_benchmarks(const std::vector<std::byte>& first_frame, const std::vector<uint32_t>& palette)
+    {
+        // Gameplay-like frames: a few panels redrawn every frame and an occasional palette fade.
+        constexpr size_t frame_count = 256;
+        std::mt19937 random(10);
+        std::vector<std::vector<std::byte>> frames;
+        std::vector<std::vector<uint32_t>> palettes;
+        auto frame = first_frame;
+        auto current_palette = palette;
+        for (size_t n = 0; n < frame_count; ++n)
+        {
+            for (auto [left, top, width, height] : { std::make_tuple(16u, 120u, 80u, 64u), std::make_tuple(224u, 120u, 80u, 64u) })
+            {
+                for (auto y = top; y < top + height; ++y)
+                {
+                    for (auto x = left + random() % 4; x < left + width; x += 1 + random() % 8)
+                        frame[y * frame_width + x] = std::byte(random());
+                }
+            }
+            if (n % 64 == 63)
+            {
+                for (auto& color : current_palette)
+                    color = (color >> 1) & 0x7F7F7F7F;
+            }
+
+            frames.push_back(frame);
+            palettes.push_back(current_palette);
+        }
+
+        size_t recording_size = 0;
+        auto encode = measure(5, [&]
+        {
+            wcdx::frame::recording_encoder encoder(frame_width, frame_height);
+            recording_size = 0;
+            for (size_t n = 0; n < frame_count; ++n)
+                recording_size += encoder.encode(frames[n].data(), palettes[n].data()).size();
+        });
+
+        // The time the presenting thread spends per frame.  The ring is big enough that no
+        // frame is dropped.
+        measurement record = { std::numeric_limits<double>::infinity(), std::numeric_limits<uint64_t>::max() };
+        for (unsigned pass = 0; pass < 5; ++pass)
+        {
+            null_output_stream out;
+            wcdx::frame::frame_recorder recorder(frame_width, frame_height, out, unsigned(frame_count));
+            auto allocations = allocation_count();
+            auto start = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < frame_count; ++n)
+                recorder.record(frames[n].data(), palettes[n].data());
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            allocations = allocation_count() - allocations;
+            recorder.finish();
+            if (recorder.dropped_frames() != 0)
+                throw std::runtime_error("Recorder dropped frames");
+            record.seconds = std::min(record.seconds, elapsed.count());
+            record.allocations = std::min(record.allocations, allocations);
+        }
+
+        // What the old screenshot path did on the presenting thread when it fired: encode the
+        // last ten frames to PNG.
+        std::vector<std::byte> rgb;
+        for (auto color : palette)
+        {
+            rgb.push_back(std::byte(color >> 16));
+            rgb.push_back(std::byte(color >> 8));
+            rgb.push_back(std::byte(color));
+        }
+        wcdx::image::png_encoder png({ rgb.data(), rgb.size() });
+        auto screenshots = measure(3, [&]
+        {
+            for (size_t n = 0; n < 10; ++n)
+                png.encode({ frame_width, frame_height }, { frames[n].data(), frames[n].size() });
+        });
+
+        std::cout << "Frame recording (" << frame_count << " gameplay frames)\n"
+            << "  record call " << std::setw(8) << std::setprecision(2) << record.seconds / frame_count * 1e6 << " us/frame\n"
+            << "  encode      " << std::setw(8) << encode.seconds / frame_count * 1e6 << " us/frame, "
+            << std::setprecision(0) << double(recording_size) / frame_count << " bytes/frame ("
+            << frame_width * frame_height << " raw)\n"
+            << "  old stall   " << std::setw(8) << std::setprecision(2) << screenshots.seconds * 1000 << " ms per 10 PNG screenshots\n";
+
+        report("recording/record", record, frame_count, "frames");
+        report("recording/encode", encode, frame_count, "frames");
+        report("recording/png_screenshots", screenshots, 10, "frames");
+    }
+
+    size_t null_output_stream::do_write(const std::byte* buffer, size_t size)
+    {
+        stdext::discard(buffer);
+        return size;
+    }
+
+    // The conversion Wcdx::Present used before dirty tracking: every row, every frame.
+    void convert_reference(const std::vector<std::byte>& frame, const uint32_t* palette, std::vector<uint32_t>& surface)
+    {
+        auto src = frame.data();
+        auto dest = surface.data();
+        for (unsigned row = 0; row < frame_height; ++row)
+        {
+            std::transform(src, src + frame_width, dest, [&](std::byte index)
+            {
+                return palette[uint8_t(index)];
+            });
+
+            src += frame_width;
+            dest += frame_width;
+        }
+    }
+}
@@ -0,0 +1,236 @@
+#include "bench.h"
+
+#include <lzw/lzw.h>
+
+#include <stdext/array_view.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stack>
+#include <stdexcept>
+
+#include <climits>
+
+
+namespace
+{
+    std::vector<std::byte> compress_reference(const std::vector<std::byte>& data);
+    std::vector<std::byte> decompress_reference(const std::vector<std::byte>& data);
+}
+
+void run_lzw_benchmarks()
+{
+    static constexpr size_t sizes[] = { 0x1000, 0x10000, 0x100000 };
+
+    std::cout << "LZW decode (MB/s of decompressed output)\n";
+    for (auto size : sizes)
+    {
+        auto data = make_resource_data(size, uint32_t(size));
+        auto compressed = wcdx::lzw::compress({ data.data(), data.size() });
+
+        std::vector<std::byte> output(data.size());
+        auto bytes = wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), output.size() });
+        if (bytes != data.size() || output != data)
+            throw std::runtime_error("LZW round trip mismatch");
+        if (decompress_reference(compressed) != data)
+            throw std::runtime_error("Reference LZW round trip mismatch");
+
+        auto iterations = unsigned(std::max(size_t(3), (size_t(64) << 20) / size / 8));
+        auto reference = measure(iterations, [&] { decompress_reference(compressed); });
+        auto table = measure(iterations, [&]
+        {
+            wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), output.size() });
+        });
+
+        auto megabytes = double(size) / (1 << 20);
+        std::cout << "  " << std::setw(8) << size << " bytes:"
+            << "  reference " << std::setw(8) << std::fixed << std::setprecision(1) << megabytes / reference.seconds
+            << "  table " << std::setw(8) << megabytes / table.seconds
+            << "  (" << std::setprecision(2) << reference.seconds / table.seconds << "x)\n";
+
+        report("lzw_decode/reference/" + std::to_string(size), reference, megabytes, "MB");
+        report("lzw_decode/table/" + std::to_string(size), table, megabytes, "MB");
+    }
+
+    std::cout << "LZW encode (MB/s of uncompressed input)\n";
+    for (auto size : sizes)
+    {
+        auto data = make_resource_data(size, uint32_t(size));
+        auto compressed = wcdx::lzw::compress({ data.data(), data.size() });
+        if (compressed != compress_reference(data))
+            throw std::runtime_error("LZW encoder output differs from reference");
+
+        auto iterations = unsigned(std::max(size_t(3), (size_t(16) << 20) / size / 8));
+        auto reference = measure(iterations, [&] { compress_reference(data); });
+        auto hashed = measure(iterations, [&] { wcdx::lzw::compress({ data.data(), data.size() }); });
+
+        auto megabytes = double(size) / (1 << 20);
+        std::cout << "  " << std::setw(8) << size << " bytes:"
+            << "  reference " << std::setw(8) << std::fixed << std::setprecision(1) << megabytes / reference.seconds
+            << "  hashed " << std::setw(8) << megabytes / hashed.seconds
+            << "  (" << std::setprecision(2) << reference.seconds / hashed.seconds << "x)"
+            << "  ratio " << double(compressed.size()) / size << '\n';
+
+        report("lzw_encode/reference/" + std::to_string(size), reference, megabytes, "MB");
+        report("lzw_encode/hashed/" + std::to_string(size), hashed, megabytes, "MB");
+    }
+}
+
+namespace
+{
+    // A straightforward encoder for the resource format, used to check the output of the
+    // hashed encoder.
+    std::vector<std::byte> compress_reference(const std::vector<std::byte>& data)
+    {
+        std::vector<std::byte> result;
+        uint32_t bits = 0;
+        unsigned bit_count = 0;
+        auto write = [&](unsigned code, unsigned width)
+        {
+            bits |= code << bit_count;
+            bit_count += width;
+            while (bit_count >= CHAR_BIT)
+            {
+                result.push_back(std::byte(bits));
+                bits >>= CHAR_BIT;
+                bit_count -= CHAR_BIT;
+            }
+        };
+
+        std::map<std::pair<unsigned, std::byte>, unsigned> dictionary;
+        unsigned next_code = 0;
+        unsigned decoder_size = 0;
+        unsigned width = 0;
+        bool first = true;
+        auto reset = [&]
+        {
+            write(wcdx::lzw::reset_code, width == 0 ? wcdx::lzw::min_code_width : width);
+            dictionary.clear();
+            next_code = decoder_size = wcdx::lzw::first_dictionary_code;
+            width = wcdx::lzw::min_code_width;
+            first = true;
+        };
+        auto emit = [&](unsigned code)
+        {
+            write(code, width);
+            if (!first && ++decoder_size == (1u << width) && width != wcdx::lzw::max_code_width)
+                ++width;
+            first = false;
+        };
+
+        if (!data.empty())
+        {
+            reset();
+            unsigned prefix = unsigned(data[0]);
+            for (size_t n = 1; n < data.size(); ++n)
+            {
+                auto i = dictionary.find({ prefix, data[n] });
+                if (i != dictionary.end())
+                {
+                    prefix = i->second;
+                    continue;
+                }
+
+                emit(prefix);
+                if (next_code == wcdx::lzw::dictionary_size)
+                    reset();
+                else
+                    dictionary.insert({ { prefix, data[n] }, next_code++ });
+                prefix = unsigned(data[n]);
+            }
+            emit(prefix);
+        }
+
+        write(wcdx::lzw::stop_code, width == 0 ? wcdx::lzw::min_code_width : width);
+        if (bit_count != 0)
+            result.push_back(std::byte(bits));
+        return result;
+    }
+
+    // The decoder wcres used before the table-driven one: one code at a time through a
+    // byte-at-a-time bit reader, strings rebuilt on a stack, and one write per byte.
+    std::vector<std::byte> decompress_reference(const std::vector<std::byte>& data)
+    {
+        size_t src_position = 0;
+        size_t src_bit_position = CHAR_BIT;
+        std::byte src_byte = { };
+        auto read = [&](size_t bit_width)
+        {
+            uint16_t result = 0;
+            size_t dst_bit_position = 0;
+            while (bit_width != 0)
+            {
+                if (src_bit_position == CHAR_BIT)
+                {
+                    if (src_position == data.size())
+                        throw std::runtime_error("Unexpected end of compressed data");
+                    src_byte = data[src_position++];
+                    src_bit_position = 0;
+                }
+                size_t bits_used = std::min(bit_width, size_t(CHAR_BIT - src_bit_position));
+                auto byte = (src_byte >> src_bit_position) & std::byte((1 << bits_used) - 1);
+                src_bit_position += bits_used;
+                bit_width -= bits_used;
+                result |= uint16_t(byte) << dst_bit_position;
+                dst_bit_position += bits_used;
+            }
+
+            return result;
+        };
+
+        struct entry
+        {
+            uint16_t prev_index;
+            std::byte value;
+        } table[wcdx::lzw::dictionary_size];
+        std::stack<std::byte> stack;
+        std::vector<std::byte> output;
+
+        auto code = read(wcdx::lzw::min_code_width);
+        if (code == wcdx::lzw::stop_code)
+            return output;
+
+        do
+        {
+            size_t code_width = wcdx::lzw::min_code_width;
+            size_t code_width_threshold = size_t(1) << code_width;
+            size_t table_size = wcdx::lzw::first_dictionary_code;
+            uint16_t prev_code = code;
+            while ((code = read(code_width)) != wcdx::lzw::reset_code && code != wcdx::lzw::stop_code)
+            {
+                size_t index = code;
+                if (index == table_size)
+                    index = prev_code;
+
+                while (index > 0xFF)
+                {
+                    stack.push(table[index].value);
+                    index = table[index].prev_index;
+                }
+
+                auto first_value = std::byte(index);
+                output.push_back(first_value);
+                for (; !stack.empty(); stack.pop())
+                    output.push_back(stack.top());
+
+                if (prev_code != wcdx::lzw::reset_code)
+                {
+                    table[table_size].prev_index = prev_code;
+                    table[table_size].value = first_value;
+                    if (code == table_size)
+                        output.push_back(first_value);
+                    if (++table_size == code_width_threshold && code_width != wcdx::lzw::max_code_width)
+                    {
+                        ++code_width;
+                        code_width_threshold <<= 1;
+                    }
+                }
+
+                prev_code = code;
+            }
+        } while (code != wcdx::lzw::stop_code);
+
+        return output;
+    }
+}
@@ -0,0 +1,115 @@
+#include "bench.h"
+
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+    struct result
+    {
+        std::string name;
+        measurement best;
+        double work;
+        const char* unit;
+    };
+
+    std::vector<result> results;
+
+    void write_report(const char* path);
+    void write_string(std::ostream& out, const std::string& value);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const char* report_path = nullptr;
+        for (int n = 1; n < argc; ++n)
+        {
+            if (std::strcmp(argv[n], "-json") == 0 && n + 1 < argc)
+                report_path = argv[++n];
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " [-json <output_path>]\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        run_lzw_benchmarks();
+        run_sprite_benchmarks();
+        run_palette_benchmarks();
+        run_frame_benchmarks();
+        run_snow_benchmarks();
+        run_audio_benchmarks();
+
+        if (report_path != nullptr)
+            write_report(report_path);
+        return EXIT_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+    }
+    catch (...)
+    {
+        std::cerr << "Unknown error\n";
+    }
+
+    return EXIT_FAILURE;
+}
+
+void report(const std::string& name, const measurement& result, double work, const char* unit)
+{
+    results.push_back({ name, result, work, unit });
+}
+
+namespace
+{
+    // One object per benchmark, in the order they ran:
+    //
+    //  { "benchmarks": [ { "name": "lzw_decode/table/65536", "seconds": ..., "throughput": ...,
+    //                      "unit": "MB/s", "allocations": ... }, ... ] }
+    //
+    // seconds is the fastest run, throughput the work done per second in that run, and
+    // allocations the fewest calls to operator new made by any run.
+    void write_report(const char* path)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << std::setprecision(9) << "{\n  \"benchmarks\": [";
+        for (size_t n = 0; n < results.size(); ++n)
+        {
+            auto& r = results[n];
+            out << (n == 0 ? "\n" : ",\n") << "    { \"name\": ";
+            write_string(out, r.name);
+            out << ", \"seconds\": " << r.best.seconds
+                << ", \"throughput\": " << r.work / r.best.seconds
+                << ", \"unit\": ";
+            write_string(out, std::string(r.unit) + "/s");
+            out << ", \"allocations\": " << r.best.allocations << " }";
+        }
+        out << "\n  ]\n}\n";
+
+        out.close();
+        if (!out)
+            throw std::runtime_error("Can't write " + std::string(path));
+    }
+
+    void write_string(std::ostream& out, const std::string& value)
+    {
+        out << '"';
+        for (auto c : value)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+}
@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include <image/palette.h>
+
+#include <stdext/array_view.h>
+
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include <climits>
+
+
+namespace
+{
+    std::vector<std::byte> make_ramp_palette();
+    std::vector<std::byte> make_true_color_image(unsigned width, unsigned height, uint32_t seed);
+    void quantize_reference(const std::vector<std::byte>& palette, const std::vector<std::byte>& bgra, std::vector<std::byte>& indices);
+}
+
+void run_palette_benchmarks()
+{
+    auto palette = make_ramp_palette();
+    unsigned width = 640;
+    unsigned height = 480;
+    auto bgra = make_true_color_image(width, height, 8);
+
+    std::vector<std::byte> expected(size_t(width) * height);
+    std::vector<std::byte> indices(expected.size());
+    quantize_reference(palette, bgra, expected);
+
+    auto build = measure(5, [&] { wcdx::image::color_quantizer quantizer({ palette.data(), palette.size() }); });
+    wcdx::image::color_quantizer quantizer({ palette.data(), palette.size() });
+    quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() });
+    if (indices != expected)
+        throw std::runtime_error("Quantizer differs from brute force");
+
+    auto reference = measure(3, [&] { quantize_reference(palette, bgra, indices); });
+    auto lookup = measure(10, [&]
+    {
+        quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() });
+    });
+    auto dithered = measure(10, [&]
+    {
+        quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() }, true);
+    });
+
+    auto megapixels = double(width) * height / 1e6;
+    std::cout << "Palette quantization (" << width << "x" << height << " true color, Mpixels/s)\n"
+        << "  brute force " << std::setw(8) << std::fixed << std::setprecision(1) << megapixels / reference.seconds << '\n'
+        << "  lookup      " << std::setw(8) << megapixels / lookup.seconds
+        << "  (" << std::setprecision(2) << reference.seconds / lookup.seconds << "x)\n"
+        << "  dithered    " << std::setw(8) << std::setprecision(1) << megapixels / dithered.seconds << '\n'
+        << "  table build " << std::setw(8) << std::setprecision(2) << build.seconds * 1000 << " ms\n";
+
+    report("quantize/brute_force", reference, megapixels, "Mpixels");
+    report("quantize/lookup", lookup, megapixels, "Mpixels");
+    report("quantize/dithered", dithered, megapixels, "Mpixels");
+    report("quantize/table_build", build, 1, "tables");
+}
+
+namespace
+{
+    // Sixteen ramps of sixteen shades each, the way the games' palettes are laid out.
+    std::vector<std::byte> make_ramp_palette()
+    {
+        static constexpr uint8_t hues[16][3] =
+        {
+            { 255, 255, 255 }, { 255, 64, 32 }, { 255, 160, 32 }, { 255, 240, 64 },
+            { 128, 255, 64 }, { 32, 192, 64 }, { 32, 255, 224 }, { 32, 128, 255 },
+            { 64, 64, 255 }, { 160, 64, 255 }, { 255, 64, 192 }, { 192, 160, 128 },
+            { 128, 112, 96 }, { 96, 128, 160 }, { 160, 176, 192 }, { 224, 192, 160 },
+        };
+
+        std::vector<std::byte> palette;
+        for (auto& hue : hues)
+        {
+            for (unsigned shade = 0; shade < 16; ++shade)
+            {
+                for (auto component : hue)
+                    palette.push_back(std::byte(component * (shade + 1) / 16));
+            }
+        }
+
+        return palette;
+    }
+
+    // Smooth gradients with a little noise and a transparent border, like rendered art.
+    std::vector<std::byte> make_true_color_image(unsigned width, unsigned height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::byte> bgra;
+        bgra.reserve(4 * size_t(width) * height);
+        for (unsigned y = 0; y < height; ++y)
+        {
+            for (unsigned x = 0; x < width; ++x)
+            {
+                auto noise = int(random() % 9) - 4;
+                auto border = x < 16 || y < 16 || x >= width - 16 || y >= height - 16;
+                bgra.push_back(std::byte(std::clamp(int(255 * y / height) + noise, 0, 255)));
+                bgra.push_back(std::byte(std::clamp(int(255 * x / width) + noise, 0, 255)));
+                bgra.push_back(std::byte(std::clamp(int(255 * (x + y) / (width + height)) + noise, 0, 255)));
+                bgra.push_back(std::byte(border ? 0 : 255));
+            }
+        }
+
+        return bgra;
+    }
+
+    // Compares every pixel against every opaque palette color.
+    void quantize_reference(const std::vector<std::byte>& palette, const std::vector<std::byte>& bgra, std::vector<std::byte>& indices)
+    {
+        for (size_t n = 0; n < indices.size(); ++n)
+        {
+            auto pixel = bgra.data() + 4 * n;
+            if (uint8_t(pixel[3]) < 2)
+            {
+                indices[n] = std::byte(0xFF);
+                continue;
+            }
+
+            auto best_distance = INT_MAX;
+            size_t best_index = 0;
+            for (size_t color = 0; color < 255; ++color)
+            {
+                auto dr = int(pixel[2]) - int(palette[3 * color]);
+                auto dg = int(pixel[1]) - int(palette[3 * color + 1]);
+                auto db = int(pixel[0]) - int(palette[3 * color + 2]);
+                auto distance = dr * dr + dg * dg + db * db;
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best_index = color;
+                }
+            }
+
+            indices[n] = std::byte(best_index);
+        }
+    }
+}
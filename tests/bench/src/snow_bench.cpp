@@ -0,0 +1,56 @@
+#include "bench.h"
+
+#include <frame/snow.h>
+
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+
+namespace
+{
+    constexpr unsigned frame_width = 320;
+    constexpr unsigned frame_height = 200;
+
+    void fill_reference(std::independent_bits_engine<std::mt19937, 1, unsigned int>& random_bit, std::byte color_index, int x, int y, unsigned width, unsigned height, std::byte* pixels);
+}
+
+void run_snow_benchmarks()
+{
+    std::vector<std::byte> expected(size_t(frame_width) * frame_height);
+    std::vector<std::byte> frame(expected.size());
+    std::independent_bits_engine<std::mt19937, 1, unsigned int> random_bit(13);
+    fill_reference(random_bit, std::byte(0x4F), 16, 24, 120, 90, expected.data());
+    wcdx::frame::snow_generator snow(13);
+    snow.fill(std::byte(0x4F), 16, 24, 120, 90, frame_width, frame.data());
+    if (frame != expected)
+        throw std::runtime_error("Snow differs from FillSnow's old loop");
+
+    // The comm screen's video window, and the whole frame.
+    constexpr unsigned iterations = 200;
+    auto window = measure(iterations, [&] { snow.fill(std::byte(0x4F), 16, 24, 120, 90, frame_width, frame.data()); });
+    auto full = measure(iterations, [&] { snow.fill(std::byte(0x4F), 0, 0, frame_width, frame_height, frame_width, frame.data()); });
+
+    auto megapixels = [](unsigned width, unsigned height) { return double(width) * height / 1e6; };
+    std::cout << "Snow (Mpixels/s)\n"
+        << "  120x90      " << std::setw(8) << std::fixed << std::setprecision(1) << megapixels(120, 90) / window.seconds << '\n'
+        << "  " << frame_width << "x" << frame_height << "     " << std::setw(8) << megapixels(frame_width, frame_height) / full.seconds << '\n';
+
+    report("fill_snow/120x90", window, megapixels(120, 90), "Mpixels");
+    report("fill_snow/320x200", full, megapixels(frame_width, frame_height), "Mpixels");
+}
+
+namespace
+{
+    // Wcdx::FillSnow as it was written before it moved into the frame library.
+    void fill_reference(std::independent_bits_engine<std::mt19937, 1, unsigned int>& random_bit, std::byte color_index, int x, int y, unsigned width, unsigned height, std::byte* pixels)
+    {
+        for (unsigned h = 0; h != height; ++h)
+        {
+            auto p = pixels + (y * frame_width) + x;
+            for (unsigned w = 0; w != width; ++w)
+                *p++ = std::byte(random_bit() * unsigned(color_index));
+            ++y;
+        }
+    }
+}
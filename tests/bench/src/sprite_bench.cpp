@@ -0,0 +1,319 @@
+#include "bench.h"
+
+#include <image/png.h>
+#include <image/sprite.h>
+#include <parallel/parallel.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include <cstring>
+
+
+namespace
+{
+    struct sprite
+    {
+        unsigned width;
+        unsigned height;
+        std::vector<std::byte> pixels;
+        std::vector<std::byte> data;
+    };
+
+    std::vector<sprite> make_sprite_corpus(size_t count, uint32_t seed);
+    std::vector<std::byte> encode_sprite_reference(unsigned width, unsigned height, const std::vector<std::byte>& pixels);
+    void decode_sprite_reference(stdext::array_view<const std::byte> data, std::vector<std::byte>& pixels);
+}
+
+void run_sprite_benchmarks()
+{
+    auto corpus = make_sprite_corpus(2000, 6);
+    size_t pixel_count = 0;
+    for (auto& s : corpus)
+    {
+        std::vector<std::byte> pixels;
+        decode_sprite_reference({ s.data.data(), s.data.size() }, pixels);
+        if (pixels != s.pixels)
+            throw std::runtime_error("Reference sprite decode mismatch");
+
+        pixels.assign(s.pixels.size(), std::byte());
+        wcdx::image::decode_sprite({ s.data.data(), s.data.size() }, { pixels.data(), pixels.size() });
+        if (pixels != s.pixels)
+            throw std::runtime_error("Sprite decode mismatch");
+
+        pixel_count += s.pixels.size();
+    }
+
+    std::cout << "Sprite decode (" << corpus.size() << " sprites, " << pixel_count / corpus.size() << " pixels on average)\n";
+    std::vector<std::byte> pixels;
+    auto reference = measure(5, [&]
+    {
+        for (auto& s : corpus)
+            decode_sprite_reference({ s.data.data(), s.data.size() }, pixels);
+    });
+    auto direct = measure(5, [&]
+    {
+        for (auto& s : corpus)
+        {
+            pixels.resize(s.pixels.size());
+            wcdx::image::decode_sprite({ s.data.data(), s.data.size() }, { pixels.data(), pixels.size() });
+        }
+    });
+
+    std::cout << "  stream " << std::setw(10) << std::fixed << std::setprecision(0) << corpus.size() / reference.seconds << " images/s"
+        << "  direct " << std::setw(10) << corpus.size() / direct.seconds << " images/s"
+        << "  (" << std::setprecision(2) << reference.seconds / direct.seconds << "x)\n";
+    report("sprite_decode/stream", reference, double(corpus.size()), "images");
+    report("sprite_decode/direct", direct, double(corpus.size()), "images");
+
+    std::cout << "Sprite encode\n";
+    size_t reference_bytes = 0;
+    size_t optimal_bytes = 0;
+    wcdx::image::sprite_encoder encoder;
+    for (auto& s : corpus)
+    {
+        auto reference = encode_sprite_reference(s.width, s.height, s.pixels);
+        decode_sprite_reference({ reference.data(), reference.size() }, pixels);
+        if (pixels != s.pixels)
+            throw std::runtime_error("Reference sprite encode mismatch");
+
+        reference_bytes += reference.size();
+        optimal_bytes += encoder.encode({ s.width, s.height }, { s.pixels.data(), s.pixels.size() }, 0, 0).size();
+    }
+
+    reference = measure(5, [&]
+    {
+        for (auto& s : corpus)
+            encode_sprite_reference(s.width, s.height, s.pixels);
+    });
+    auto optimal = measure(5, [&]
+    {
+        for (auto& s : corpus)
+            encoder.encode({ s.width, s.height }, { s.pixels.data(), s.pixels.size() }, 0, 0);
+    });
+
+    std::cout << "  greedy  " << std::setw(10) << std::setprecision(0) << corpus.size() / reference.seconds << " images/s  " << std::setw(9) << reference_bytes << " bytes\n"
+        << "  optimal " << std::setw(10) << corpus.size() / optimal.seconds << " images/s  " << std::setw(9) << optimal_bytes << " bytes"
+        << "  (" << std::setprecision(2) << optimal.seconds / reference.seconds << "x the time, "
+        << std::setprecision(1) << 100.0 * (double(reference_bytes) - double(optimal_bytes)) / double(reference_bytes) << "% smaller)\n";
+    report("sprite_encode/greedy", reference, double(corpus.size()), "images");
+    report("sprite_encode/optimal", optimal, double(corpus.size()), "images");
+
+    // Decoding and PNG encoding together, as wcimg -extract-all does, minus the file writes.
+    std::vector<std::byte> palette(3 * 256);
+    for (size_t n = 0; n < palette.size(); ++n)
+        palette[n] = std::byte(n / 3);
+
+    std::cout << "Sprite decode + PNG encode\n";
+    double single_time = 0;
+    for (unsigned jobs : { 1u, 2u, 4u, wcdx::parallel::default_job_count() })
+    {
+        auto thread_count = wcdx::parallel::job_count(corpus.size(), jobs);
+        std::vector<std::unique_ptr<wcdx::image::png_encoder>> encoders;
+        for (unsigned n = 0; n < thread_count; ++n)
+            encoders.push_back(std::make_unique<wcdx::image::png_encoder>(stdext::array_view<const std::byte>(palette.data(), palette.size())));
+        std::vector<std::vector<std::byte>> pixel_buffers(thread_count);
+
+        auto result = measure(3, [&]
+        {
+            wcdx::parallel::for_each_index(corpus.size(), jobs, [&](size_t n, unsigned thread)
+            {
+                auto& s = corpus[n];
+                auto& buffer = pixel_buffers[thread];
+                buffer.resize(s.pixels.size());
+                wcdx::image::decode_sprite({ s.data.data(), s.data.size() }, { buffer.data(), buffer.size() });
+                encoders[thread]->encode({ s.width, s.height }, { buffer.data(), buffer.size() });
+            });
+        });
+        if (jobs == 1)
+            single_time = result.seconds;
+
+        std::cout << "  " << std::setw(2) << jobs << " jobs: " << std::setw(10) << std::setprecision(0) << corpus.size() / result.seconds << " images/s"
+            << "  (" << std::setprecision(2) << single_time / result.seconds << "x)\n";
+        report("sprite_extract/" + std::to_string(jobs) + "_jobs", result, double(corpus.size()), "images");
+    }
+}
+
+namespace
+{
+    // Sprites with transparent margins around a rough blob, filled with a mix of solid runs
+    // and noise, at sizes typical of ships and cockpit pieces.
+    std::vector<sprite> make_sprite_corpus(size_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<sprite> corpus(count);
+        wcdx::image::sprite_encoder encoder;
+        for (auto& s : corpus)
+        {
+            s.width = 8 + random() % 120;
+            s.height = 8 + random() % 90;
+            s.pixels.assign(size_t(s.width) * s.height, wcdx::image::transparent_index);
+
+            for (unsigned y = 0; y < s.height; ++y)
+            {
+                auto dy = 2.0 * y / (s.height - 1) - 1;
+                auto half = std::min(unsigned(s.width / 2 * (1 - dy * dy) + random() % 3), s.width / 2);
+                auto first = s.width / 2 - half;
+                auto last = s.width / 2 + half;
+
+                auto row = s.pixels.data() + size_t(s.width) * y;
+                for (auto x = first; x < last; )
+                {
+                    auto length = std::min(unsigned(1 + random() % 16), last - x);
+                    switch (random() % 4)
+                    {
+                    case 0:
+                        x += random() % 2 == 0 ? length : 0;
+                        break;
+
+                    case 1:
+                    case 2:
+                        std::fill_n(row + x, length, std::byte(random() % 255));
+                        x += length;
+                        break;
+
+                    default:
+                        for (; length > 0; --length)
+                            row[x++] = std::byte(random() % 255);
+                        break;
+                    }
+                }
+            }
+
+            auto data = encoder.encode({ s.width, s.height }, { s.pixels.data(), s.pixels.size() }, 0, 0);
+            s.data.assign(data.begin(), data.end());
+        }
+
+        return corpus;
+    }
+
+    // The encoder wcimg -pack used before sprite_encoder, with the reference point at the
+    // top left: runs are taken greedily when longer than three pixels, or longer than two at
+    // the end of a segment.
+    std::vector<std::byte> encode_sprite_reference(unsigned width, unsigned height, const std::vector<std::byte>& pixels)
+    {
+        std::vector<std::byte> data;
+        auto write16 = [&](unsigned value)
+        {
+            data.push_back(std::byte(value));
+            data.push_back(std::byte(value >> 8));
+        };
+
+        write16(width - 1);
+        write16(0);
+        write16(0);
+        write16(height - 1);
+
+        auto p = pixels.data();
+        auto p_first = p;
+        auto p_last = p + pixels.size();
+        while ((p = std::find_if(p, p_last, [](std::byte pixel) { return pixel != std::byte(0xFF); })) != p_last)
+        {
+            auto offset = p - p_first;
+            auto x = unsigned(offset % width);
+            auto y = unsigned(offset / width);
+
+            auto row_last = p_first + width * (y + 1);
+            auto seg_first = p;
+            auto seg_last = std::find(seg_first, row_last, std::byte(0xFF));
+            while (p != seg_last)
+            {
+                auto run_first = p;
+                auto run_last = p;
+                ptrdiff_t run_length = 0;
+                while ((run_first = std::adjacent_find(run_first, seg_last)) != seg_last)
+                {
+                    run_last = std::find_if(run_first, seg_last, [&](std::byte pixel) { return pixel != *run_first; });
+                    run_length = run_last - run_first;
+                    if (run_length > 3 || (run_length > 2 && run_last == seg_last))
+                        break;
+
+                    run_first = run_last;
+                }
+
+                if (p == seg_first && run_first == seg_last)
+                {
+                    auto length = seg_last - seg_first;
+                    write16(unsigned(length << 1));
+                    write16(x);
+                    write16(y);
+                    data.insert(data.end(), p, seg_last);
+                    p = seg_last;
+                }
+                else
+                {
+                    if (p == seg_first)
+                    {
+                        write16(unsigned((seg_last - seg_first) << 1 | 1));
+                        write16(x);
+                        write16(y);
+                    }
+
+                    if (p != run_first)
+                    {
+                        data.push_back(std::byte((run_first - p) << 1));
+                        data.insert(data.end(), p, run_first);
+                        p = run_first;
+                    }
+
+                    if (run_first < run_last)
+                    {
+                        data.push_back(std::byte(run_length << 1 | 1));
+                        data.push_back(*p);
+                        p = run_last;
+                    }
+                }
+            }
+        }
+
+        write16(0);
+        return data;
+    }
+
+    // The decoder wcimg used before decode_sprite: every field and pixel read through a
+    // stream, with no checks against the image bounds.
+    void decode_sprite_reference(stdext::array_view<const std::byte> data, std::vector<std::byte>& pixels)
+    {
+        stdext::memory_input_stream input(data.data(), data.size());
+        auto right_extent = input.read<int16_t>();
+        auto left_extent = input.read<int16_t>();
+        auto top_extent = input.read<int16_t>();
+        auto bottom_extent = input.read<int16_t>();
+
+        auto width = unsigned(left_extent + right_extent + 1);
+        auto height = unsigned(top_extent + bottom_extent + 1);
+        pixels.assign(size_t(width) * height, std::byte(0xFF));
+
+        uint16_t seg_flags;
+        while ((seg_flags = input.read<uint16_t>()) != 0)
+        {
+            auto seg_width = seg_flags >> 1;
+            auto x = input.read<int16_t>() + left_extent;
+            auto y = input.read<int16_t>() + top_extent;
+
+            auto segment_data = pixels.data() + (y * width) + x;
+            if ((seg_flags & 1) != 0)
+            {
+                while (seg_width > 0)
+                {
+                    auto run_flags = input.read<uint8_t>();
+                    auto run_width = run_flags >> 1;
+                    if ((run_flags & 1) != 0)
+                        std::fill_n(segment_data, run_width, input.read<std::byte>());
+                    else
+                        input.read_all(segment_data, run_width);
+
+                    seg_width -= run_width;
+                    segment_data += run_width;
+                }
+            }
+            else
+                input.read_all(segment_data, seg_width);
+        }
+    }
+}
@@ -0,0 +1,419 @@
+#include <fileio/read_cache.h>
+
+#include <test/support.h>
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+    // Plain C runtime descriptor calls, counted.
+    class posix_io : public wcdx::fileio::descriptor_io
+    {
+    public:
+        long seek(int filedesc, long offset, int method) override;
+        long read(int filedesc, void* data, unsigned int size) override;
+        long length(int filedesc) override;
+
+        uint64_t calls() const noexcept { return _calls; }
+
+    private:
+        uint64_t _calls = 0;
+    };
+
+    // One call made by the game, in the order it was made.
+    struct trace_op
+    {
+        enum kind_t { open, close, read, seek, length } kind;
+        unsigned file;
+        long offset;
+        unsigned size;
+        int method;
+    };
+
+    // A scratch directory holding the files the trace reads, removed on destruction.
+    class test_files
+    {
+    public:
+        test_files();
+
+    public:
+        const std::filesystem::path& path(unsigned file) const { return _paths[file]; }
+        size_t count() const noexcept { return _paths.size(); }
+        size_t size(unsigned file) const { return size_t(std::filesystem::file_size(_paths[file])); }
+
+    private:
+        wcdx::test::scratch_directory _directory;
+        std::vector<std::filesystem::path> _paths;
+    };
+
+    using wcdx::test::check;
+
+    std::vector<trace_op> make_trace(const test_files& files, uint32_t seed);
+    std::vector<std::byte> replay(const std::vector<trace_op>& trace, const test_files& files, wcdx::fileio::read_cache& cache);
+    int open_file(const std::filesystem::path& path, int flags);
+    void close_file(int fd);
+    bool read_at(int fd, void* data, unsigned int size, long offset);
+
+    void test_replay();
+    void test_fallback();
+    void test_release();
+    void test_edges();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("fileio", []
+    {
+        test_replay();
+        test_fallback();
+        test_release();
+        test_edges();
+    });
+}
+
+namespace
+{
+    void test_replay()
+    {
+        test_files files;
+        auto trace = make_trace(files, 1);
+
+        posix_io direct_io;
+        wcdx::fileio::read_cache direct(direct_io, false);
+        auto expected = replay(trace, files, direct);
+
+        posix_io mapped_io;
+        wcdx::fileio::read_cache mapped(mapped_io, true);
+        auto actual = replay(trace, files, mapped);
+
+        check(actual == expected, "Mapped replay differs from direct replay");
+
+        // Every read at an offset costs the direct replay a seek and a read; the mapped
+        // replay makes no descriptor calls at all.
+        uint64_t expected_calls = 0;
+        uint64_t served = 0;
+        for (auto& op : trace)
+        {
+            switch (op.kind)
+            {
+            case trace_op::read:
+                expected_calls += op.offset != -1 ? 2 : 1;
+                ++served;
+                break;
+
+            case trace_op::seek:
+            case trace_op::length:
+                ++expected_calls;
+                ++served;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        check(direct_io.calls() == expected_calls, "Unexpected descriptor calls in direct replay: " + std::to_string(direct_io.calls()));
+        check(mapped_io.calls() == 0, "Mapped replay made " + std::to_string(mapped_io.calls()) + " descriptor calls");
+
+        auto stats = mapped.stats();
+        check(stats.hits == served && stats.misses == 0, "Bad hit counts");
+        check(stats.mapped_files == 0, "Descriptors still mapped after replay");
+        check(stats.bytes_served != 0, "No bytes served");
+        check(direct.stats().hits == 0 && direct.stats().misses == served, "Disabled cache counted hits");
+
+        std::cout << trace.size() << " traced calls: " << direct_io.calls() << " descriptor calls direct, "
+            << mapped_io.calls() << " mapped\n";
+    }
+
+    void test_fallback()
+    {
+        test_files files;
+        posix_io io;
+        wcdx::fileio::read_cache cache(io);
+
+        // A descriptor that isn't attached goes to io every time.
+        auto fd = open_file(files.path(0), O_RDWR);
+        std::byte expected[16], actual[16];
+        check(read_at(fd, expected, sizeof(expected), 100), "Direct read failed");
+        check(cache.read(fd, 100, sizeof(actual), actual), "Read failed");
+        check(std::memcmp(expected, actual, sizeof(expected)) == 0, "Wrong data read");
+        check(io.calls() == 2 && cache.stats().misses == 1 && cache.stats().hits == 0, "Unattached read not passed through");
+
+        long position;
+        check(cache.seek(fd, 0, SEEK_CUR, position) && position == 116, "Unattached seek not passed through");
+        long length;
+        check(cache.length(fd, length) && size_t(length) == files.size(0), "Unattached length not passed through");
+        close_file(fd);
+
+        // Neither a missing file nor a disabled cache attaches anything.
+        check(!cache.attach(3, files.path(0).string() + ".missing"), "Attached a missing file");
+        wcdx::fileio::read_cache disabled(io, false);
+        fd = open_file(files.path(0), O_RDONLY);
+        check(!disabled.attach(fd, files.path(0)), "Disabled cache attached a file");
+        check(cache.attach(fd, files.path(0)) && cache.stats().mapped_files == 1, "File not attached");
+        cache.detach(fd);
+        check(cache.stats().mapped_files == 0, "File not detached");
+        close_file(fd);
+    }
+
+    void test_release()
+    {
+        test_files files;
+        posix_io io;
+        wcdx::fileio::read_cache cache(io);
+
+        auto fd = open_file(files.path(1), O_RDONLY);
+        check(cache.attach(fd, files.path(1)), "File not attached");
+
+        std::byte first[64], second[64], expected[128];
+        check(cache.read(fd, 1000, sizeof(first), first), "Read failed");
+        check(io.calls() == 0, "Attached read made descriptor calls");
+
+        // Opening the file for writing hands the descriptor back at the same position.
+        cache.release(files.path(1));
+        check(cache.stats().mapped_files == 0, "File still mapped after release");
+        check(cache.read(fd, -1, sizeof(second), second), "Read after release failed");
+        check(cache.stats().misses == 1, "Read after release not passed through");
+
+        check(read_at(fd, expected, sizeof(expected), 1000), "Direct read failed");
+        check(std::memcmp(first, expected, sizeof(first)) == 0 && std::memcmp(second, expected + 64, sizeof(second)) == 0, "Position lost on release");
+        close_file(fd);
+    }
+
+    void test_edges()
+    {
+        test_files files;
+        posix_io io;
+        wcdx::fileio::read_cache cache(io);
+
+        auto fd = open_file(files.path(2), O_RDONLY);
+        check(cache.attach(fd, files.path(2)), "Empty file not attached");
+
+        long length, position;
+        check(cache.length(fd, length) && length == 0, "Bad length of empty file");
+        std::byte buffer[4] = { std::byte(1), std::byte(2), std::byte(3), std::byte(4) };
+        check(cache.read(fd, 0, sizeof(buffer), buffer) && buffer[0] == std::byte(1), "Read of empty file changed the buffer");
+        check(cache.seek(fd, 10, SEEK_END, position) && position == 10, "Seek past the end failed");
+        check(!cache.seek(fd, -11, SEEK_CUR, position) && position == -1, "Seek before the start succeeded");
+        check(cache.seek(fd, 0, SEEK_CUR, position) && position == 10, "Failed seek moved the position");
+        check(!cache.seek(fd, 0, 7, position), "Seek with a bad method succeeded");
+        check(!cache.read(fd, -2, sizeof(buffer), buffer), "Read at a negative offset succeeded");
+        cache.detach(fd);
+        close_file(fd);
+        check(io.calls() == 0, "Mapped calls made descriptor calls");
+    }
+
+    long posix_io::seek(int filedesc, long offset, int method)
+    {
+        ++_calls;
+#ifdef _WIN32
+        return ::_lseek(filedesc, offset, method);
+#else
+        return long(::lseek(filedesc, off_t(offset), method));
+#endif
+    }
+
+    long posix_io::read(int filedesc, void* data, unsigned int size)
+    {
+        ++_calls;
+#ifdef _WIN32
+        return long(::_read(filedesc, data, size));
+#else
+        return long(::read(filedesc, data, size));
+#endif
+    }
+
+    long posix_io::length(int filedesc)
+    {
+        ++_calls;
+#ifdef _WIN32
+        struct _stat status;
+        return ::_fstat(filedesc, &status) == 0 ? long(status.st_size) : -1;
+#else
+        struct stat status;
+        return ::fstat(filedesc, &status) == 0 ? long(status.st_size) : -1;
+#endif
+    }
+
+    test_files::test_files()
+        : _directory("wcdx_fileio_test_")
+    {
+        // Two data files of different sizes and an empty one.
+        std::mt19937 random(7);
+        for (size_t size : { size_t(300000), size_t(4099), size_t(0) })
+        {
+            auto path = _directory.path() / ("file" + std::to_string(_paths.size()) + ".dat");
+            std::vector<char> data(size);
+            std::generate(data.begin(), data.end(), [&] { return char(random()); });
+            std::ofstream out(path, std::ios::binary);
+            out.write(data.data(), std::streamsize(data.size()));
+            out.close();
+            if (!out)
+                throw std::runtime_error("Failed to write " + path.string());
+            _paths.push_back(std::move(path));
+        }
+    }
+
+    // The pattern the game's resource loader follows: open a file, read a small header and
+    // an offset table at explicit offsets, then pull each resource in with a run of tiny
+    // reads, with the occasional seek, length query and read off the end along the way.
+    std::vector<trace_op> make_trace(const test_files& files, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<trace_op> trace;
+        for (unsigned pass = 0; pass != 20; ++pass)
+        {
+            auto file = unsigned(random() % files.count());
+            auto size = long(files.size(file));
+            trace.push_back({ trace_op::open, file, 0, 0, 0 });
+            trace.push_back({ trace_op::length, file, 0, 0, 0 });
+            trace.push_back({ trace_op::read, file, 0, 4, 0 });
+            trace.push_back({ trace_op::read, file, 4, 64, 0 });
+
+            for (unsigned resource = 0; resource != 30; ++resource)
+            {
+                auto offset = size != 0 ? long(random() % uint32_t(size)) : 0;
+                trace.push_back({ trace_op::read, file, offset, 2, 0 });
+                for (auto count = random() % 40; count != 0; --count)
+                    trace.push_back({ trace_op::read, file, -1, unsigned(1 + random() % 16), 0 });
+
+                switch (random() % 4)
+                {
+                case 0:
+                    trace.push_back({ trace_op::seek, file, long(random() % 256), 0, SEEK_CUR });
+                    break;
+
+                case 1:
+                    trace.push_back({ trace_op::seek, file, -long(random() % 64), 0, SEEK_END });
+                    trace.push_back({ trace_op::read, file, -1, 128, 0 });
+                    break;
+
+                case 2:
+                    trace.push_back({ trace_op::seek, file, -1, 0, SEEK_SET });
+                    break;
+
+                default:
+                    trace.push_back({ trace_op::read, file, size + 10, 8, 0 });
+                    break;
+                }
+            }
+
+            trace.push_back({ trace_op::close, file, 0, 0, 0 });
+        }
+
+        return trace;
+    }
+
+    // Returns everything the calls returned, in order.
+    std::vector<std::byte> replay(const std::vector<trace_op>& trace, const test_files& files, wcdx::fileio::read_cache& cache)
+    {
+        std::vector<std::byte> results;
+        auto record = [&](const void* data, size_t size)
+        {
+            auto bytes = static_cast<const std::byte*>(data);
+            results.insert(results.end(), bytes, bytes + size);
+        };
+
+        std::vector<int> descriptors(files.count(), -1);
+        std::vector<std::byte> buffer;
+        for (auto& op : trace)
+        {
+            auto& fd = descriptors[op.file];
+            switch (op.kind)
+            {
+            case trace_op::open:
+                fd = open_file(files.path(op.file), O_RDONLY);
+                cache.attach(fd, files.path(op.file));
+                break;
+
+            case trace_op::close:
+                cache.detach(fd);
+                close_file(fd);
+                fd = -1;
+                break;
+
+            case trace_op::read:
+            {
+                // Short reads leave the rest of the buffer as it was.
+                buffer.assign(op.size, std::byte(0xCD));
+                bool result = cache.read(fd, op.offset, op.size, buffer.data());
+                record(&result, sizeof(result));
+                record(buffer.data(), buffer.size());
+                break;
+            }
+
+            case trace_op::seek:
+            {
+                long position;
+                bool result = cache.seek(fd, op.offset, op.method, position);
+                record(&result, sizeof(result));
+                record(&position, sizeof(position));
+                break;
+            }
+
+            case trace_op::length:
+            {
+                long length;
+                bool result = cache.length(fd, length);
+                record(&result, sizeof(result));
+                record(&length, sizeof(length));
+                break;
+            }
+            }
+        }
+
+        return results;
+    }
+
+    int open_file(const std::filesystem::path& path, int flags)
+    {
+#ifdef _WIN32
+        auto fd = ::_wopen(path.c_str(), flags | _O_BINARY | _O_NOINHERIT);
+#else
+        auto fd = ::open(path.c_str(), flags | O_CLOEXEC);
+#endif
+        if (fd == -1)
+            throw std::runtime_error("Failed to open " + path.string());
+        return fd;
+    }
+
+    void close_file(int fd)
+    {
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    // Reads size bytes at offset without going through a cache, leaving the file position
+    // after them.
+    bool read_at(int fd, void* data, unsigned int size, long offset)
+    {
+        posix_io io;
+        return io.seek(fd, offset, SEEK_SET) == offset && io.read(fd, data, size) == long(size);
+    }
+}
@@ -0,0 +1,511 @@
+#include <frame/convert.h>
+#include <frame/dirty_rows.h>
+#include <frame/recorder.h>
+#include <frame/recording.h>
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+#include <test/support.h>
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace
+{
+    // Collects everything written to it.
+    class vector_output_stream : public stdext::output_stream
+    {
+    public:
+        const std::vector<std::byte>& data() const noexcept { return _data; }
+
+    protected:
+        size_t do_write(const std::byte* buffer, size_t size) override;
+
+    private:
+        std::vector<std::byte> _data;
+    };
+
+    // A sequence of frames in which a few rectangles and palette entries change each time.
+    struct test_frame
+    {
+        std::vector<std::byte> pixels;
+        std::vector<uint32_t> palette;
+    };
+
+    using wcdx::test::check;
+    bool same_rect(const wcdx::frame::frame_rect& rect, unsigned left, unsigned top, unsigned right, unsigned bottom);
+
+    std::vector<uint32_t> make_palette(uint32_t seed);
+    std::vector<std::byte> make_frame(unsigned width, unsigned height, uint32_t seed);
+    std::vector<test_frame> make_frames(unsigned width, unsigned height, size_t count, uint32_t seed);
+    void check_frame(const wcdx::frame::recording_reader& reader, const test_frame& frame, const std::string& label);
+    bool reader_throws(const std::vector<std::byte>& recording);
+
+    void test_mark();
+    void test_clipping();
+    void test_mark_all();
+    void test_convert();
+    void test_convert_dirty_rows();
+    void test_recording_round_trip();
+    void test_recording_size();
+    void test_invalid_recordings();
+    void test_recorder();
+    void test_recorder_segments();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("frame", []
+    {
+        test_mark();
+        test_clipping();
+        test_mark_all();
+        test_convert();
+        test_convert_dirty_rows();
+        test_recording_round_trip();
+        test_recording_size();
+        test_invalid_recordings();
+        test_recorder();
+        test_recorder_segments();
+        std::cout << "Frame conversion tested " << (wcdx::frame::has_vector_conversion() ? "with AVX2\n" : "portable only\n");
+    });
+}
+
+namespace
+{
+    void test_mark()
+    {
+        wcdx::frame::dirty_rows dirty(320, 200);
+        check(!dirty.any() && !dirty.all() && dirty.bounds().empty(), "New frame is dirty");
+
+        dirty.mark(10, 20, 30, 2);
+        check(same_rect(dirty.bounds(), 10, 20, 40, 22), "Bad bounds after one mark");
+        check(dirty.row(19).empty() && dirty.row(22).empty(), "Rows outside the mark are dirty");
+        check(dirty.row(20).left == 10 && dirty.row(21).right == 40, "Bad span after one mark");
+
+        // A second mark on the same row widens its span to cover both.
+        dirty.mark(100, 21, 5, 1);
+        check(dirty.row(20).left == 10 && dirty.row(20).right == 40, "Unrelated row changed");
+        check(dirty.row(21).left == 10 && dirty.row(21).right == 105, "Span not widened");
+        check(same_rect(dirty.bounds(), 10, 20, 105, 22), "Bounds not widened");
+
+        dirty.mark(0, 150, 1, 1);
+        check(same_rect(dirty.bounds(), 0, 20, 105, 151), "Bounds not extended down");
+        check(dirty.any() && !dirty.all(), "Partial marks reported as the whole frame");
+
+        dirty.mark(50, 60, 0, 10);
+        dirty.mark(50, 60, 10, 0);
+        check(dirty.row(60).empty(), "Empty mark changed a row");
+
+        dirty.clear();
+        check(!dirty.any() && dirty.bounds().empty(), "Frame dirty after clear");
+        for (unsigned y = 0; y < dirty.height(); ++y)
+            check(dirty.row(y).empty(), "Row " + std::to_string(y) + " dirty after clear");
+    }
+
+    void test_clipping()
+    {
+        wcdx::frame::dirty_rows dirty(320, 200);
+        dirty.mark(-10, -5, 20, 10);
+        check(same_rect(dirty.bounds(), 0, 0, 10, 5), "Mark not clipped at top left");
+
+        dirty.clear();
+        dirty.mark(310, 195, 100, 100);
+        check(same_rect(dirty.bounds(), 310, 195, 320, 200), "Mark not clipped at bottom right");
+
+        dirty.clear();
+        dirty.mark(-100, 10, 50, 1);
+        dirty.mark(320, 10, 50, 1);
+        dirty.mark(10, 200, 1, 1);
+        dirty.mark(INT32_MAX, INT32_MAX, UINT32_MAX, UINT32_MAX);
+        dirty.mark(INT32_MIN, INT32_MIN, 10, 10);
+        check(!dirty.any(), "Mark outside the frame made it dirty");
+
+        dirty.mark(INT32_MIN, INT32_MIN, UINT32_MAX, UINT32_MAX);
+        check(dirty.all(), "Oversized mark didn't cover the frame");
+
+        bool threw = false;
+        try
+        {
+            wcdx::frame::dirty_rows empty(0, 10);
+        }
+        catch (const std::exception&)
+        {
+            threw = true;
+        }
+        check(threw, "Empty frame accepted");
+    }
+
+    void test_mark_all()
+    {
+        wcdx::frame::dirty_rows dirty(320, 200);
+        dirty.mark_all();
+        check(dirty.all() && same_rect(dirty.bounds(), 0, 0, 320, 200), "mark_all didn't cover the frame");
+
+        // Marks that together cover every pixel count as the whole frame too.
+        dirty.clear();
+        dirty.mark(0, 0, 200, 200);
+        check(!dirty.all(), "Left half reported as the whole frame");
+        dirty.mark(150, 0, 170, 200);
+        check(dirty.all(), "Two halves not reported as the whole frame");
+    }
+
+    void test_convert()
+    {
+        auto palette = make_palette(1);
+        auto indices = make_frame(1000, 1, 2);
+        for (size_t offset = 0; offset < 20; ++offset)
+        {
+            for (size_t count : { size_t(0), size_t(1), size_t(7), size_t(8), size_t(15), size_t(16), size_t(17), size_t(33), size_t(900) })
+            {
+                auto label = std::to_string(count) + " at " + std::to_string(offset) + ": ";
+                std::vector<uint32_t> expected(count + 2, 0xDEADBEEF);
+                for (size_t n = 0; n < count; ++n)
+                    expected[n + 1] = palette[uint8_t(indices[offset + n])];
+
+                std::vector<uint32_t> colors(count + 2, 0xDEADBEEF);
+                wcdx::frame::convert_indices(indices.data() + offset, palette.data(), colors.data() + 1, count);
+                check(colors == expected, label + "conversion mismatch");
+
+                std::fill(colors.begin(), colors.end(), 0xDEADBEEF);
+                wcdx::frame::convert_indices_portable(indices.data() + offset, palette.data(), colors.data() + 1, count);
+                check(colors == expected, label + "portable conversion mismatch");
+            }
+        }
+
+        // Every index, including the ones with the sign bit set, must reach its own entry.
+        std::vector<std::byte> all_indices(256);
+        for (unsigned n = 0; n < 256; ++n)
+            all_indices[n] = std::byte(n);
+        std::vector<uint32_t> colors(256);
+        wcdx::frame::convert_indices(all_indices.data(), palette.data(), colors.data(), colors.size());
+        check(colors == palette, "Not every index converted to its own color");
+    }
+
+    void test_convert_dirty_rows()
+    {
+        constexpr unsigned width = 320;
+        constexpr unsigned height = 200;
+        auto palette = make_palette(3);
+        auto frame = make_frame(width, height, 4);
+
+        // The destination stands in for a locked surface with padding at the end of each row.
+        constexpr unsigned pitch = width + 13;
+        constexpr uint32_t untouched = 0xDEADBEEF;
+        std::vector<uint32_t> surface(size_t(pitch) * height, untouched);
+
+        wcdx::frame::dirty_rows dirty(width, height);
+        dirty.mark(5, 10, 20, 3);
+        dirty.mark(100, 11, 50, 1);
+        dirty.mark(300, 40, 30, 2);
+        auto& bounds = dirty.bounds();
+        wcdx::frame::convert_dirty_rows(dirty, frame.data(), palette.data(),
+            surface.data() + bounds.top * pitch + bounds.left, pitch * sizeof(uint32_t));
+
+        for (unsigned y = 0; y < height; ++y)
+        {
+            auto span = dirty.row(y);
+            for (unsigned x = 0; x < width; ++x)
+            {
+                auto dirty_pixel = !span.empty() && x >= span.left && x < span.right;
+                auto expected = dirty_pixel ? palette[uint8_t(frame[y * width + x])] : untouched;
+                check(surface[y * pitch + x] == expected,
+                    "Bad pixel at " + std::to_string(x) + "," + std::to_string(y));
+            }
+            for (unsigned x = width; x < pitch; ++x)
+                check(surface[y * pitch + x] == untouched, "Padding overwritten on row " + std::to_string(y));
+        }
+    }
+
+    void test_recording_round_trip()
+    {
+        constexpr unsigned width = 320;
+        constexpr unsigned height = 200;
+        auto frames = make_frames(width, height, 40, 5);
+
+        wcdx::frame::recording_encoder encoder(width, height);
+        auto header = encoder.header();
+        std::vector<std::byte> recording(header.begin(), header.end());
+        for (auto& frame : frames)
+        {
+            auto encoded = encoder.encode(frame.pixels.data(), frame.palette.data());
+            recording.insert(recording.end(), encoded.begin(), encoded.end());
+        }
+
+        stdext::memory_input_stream in(recording.data(), recording.size());
+        wcdx::frame::recording_reader reader(in);
+        check(reader.width() == width && reader.height() == height, "Bad recording dimensions");
+        for (size_t n = 0; n < frames.size(); ++n)
+        {
+            check(reader.next(), "Recording ended early");
+            check(reader.frame_number() == n + 1, "Bad frame number");
+            check_frame(reader, frames[n], "Frame " + std::to_string(n) + ": ");
+        }
+        check(!reader.next(), "Recording didn't end");
+        check(!reader.next(), "Recording restarted after its end");
+    }
+
+    void test_recording_size()
+    {
+        constexpr unsigned width = 64;
+        constexpr unsigned height = 8;
+        auto frame = make_frame(width, height, 6);
+        auto palette = make_palette(7);
+
+        // Everything changes in the first frame: one palette record and one span per row.
+        wcdx::frame::recording_encoder encoder(width, height);
+        check(encoder.header().size() == 10, "Bad header size");
+        auto size = encoder.encode(frame.data(), palette.data()).size();
+        check(size == (3 + 3 * 256) + height * (7 + width) + 1, "Bad first frame size: " + std::to_string(size));
+
+        // Nothing changed, including the unused alpha byte.
+        palette[3] ^= 0xFF000000;
+        check(encoder.encode(frame.data(), palette.data()).size() == 1, "Unchanged frame not empty");
+
+        // A gap shorter than a span record is sent again rather than splitting the span.
+        frame[10] = ~frame[10];
+        frame[14] = ~frame[14];
+        check(encoder.encode(frame.data(), palette.data()).size() == 7 + 5 + 1, "Nearby changes not merged");
+        frame[10] = ~frame[10];
+        frame[30] = ~frame[30];
+        check(encoder.encode(frame.data(), palette.data()).size() == 2 * (7 + 1) + 1, "Distant changes merged");
+
+        // Likewise for palette entries one apart, but not two.
+        palette[5] ^= 1;
+        palette[7] ^= 1;
+        palette[20] ^= 1;
+        palette[23] ^= 1;
+        check(encoder.encode(frame.data(), palette.data()).size() == (3 + 3 * 3) + 2 * (3 + 3) + 1, "Bad palette update size");
+    }
+
+    void test_invalid_recordings()
+    {
+        wcdx::frame::recording_encoder encoder(4, 2);
+        auto header = encoder.header();
+        std::vector<std::byte> valid(header.begin(), header.end());
+        auto pixels = make_frame(4, 2, 8);
+        auto palette = make_palette(9);
+        auto frame = encoder.encode(pixels.data(), palette.data());
+        valid.insert(valid.end(), frame.begin(), frame.end());
+
+        check(!reader_throws(valid), "Valid recording rejected");
+        for (size_t size = 0; size < valid.size(); ++size)
+        {
+            // Stopping exactly after the header is an empty recording, not a truncated one.
+            if (size != header.size())
+                check(reader_throws({ valid.begin(), valid.begin() + size }), "Truncated recording accepted at " + std::to_string(size));
+        }
+
+        auto modified = [&](size_t offset, int value)
+        {
+            auto copy = valid;
+            copy[offset] = std::byte(value);
+            return copy;
+        };
+        check(reader_throws(modified(0, 'X')), "Bad signature accepted");
+        check(reader_throws(modified(4, 2)), "Unknown version accepted");
+        check(reader_throws(modified(6, 0)), "Zero width accepted");
+
+        // The palette record comes first, then one span per row.
+        auto palette_record = header.size();
+        auto span_record = palette_record + 3 + 3 * 256;
+        check(reader_throws(modified(palette_record, 3)), "Unknown record accepted");
+        check(reader_throws(modified(palette_record + 1, 1)), "Palette record past the last entry accepted");
+        check(reader_throws(modified(span_record + 1, 1)), "Span past the right edge accepted");
+        check(reader_throws(modified(span_record + 3, 2)), "Span below the bottom accepted");
+        check(reader_throws(modified(span_record + 5, 0)), "Empty span accepted");
+    }
+
+    void test_recorder()
+    {
+        constexpr unsigned width = 320;
+        constexpr unsigned height = 200;
+        auto frames = make_frames(width, height, 60, 10);
+
+        // A small ring may drop some frames, but every frame it accepts must come out, in order.
+        // Palettes are only passed along when they change, so a dropped frame may take a
+        // palette change with it that the next frame accepted has to carry.
+        for (unsigned capacity : { 1u, 4u, 64u })
+        {
+            auto label = "Capacity " + std::to_string(capacity) + ": ";
+            vector_output_stream out;
+            std::vector<size_t> accepted;
+            {
+                wcdx::frame::frame_recorder recorder(width, height, out, capacity);
+                for (size_t n = 0; n < frames.size(); ++n)
+                {
+                    bool palette_changed = n == 0 || frames[n].palette != frames[n - 1].palette;
+                    if (recorder.record(frames[n].pixels.data(), frames[n].palette.data(), palette_changed))
+                        accepted.push_back(n);
+                }
+                recorder.finish();
+                check(recorder.recorded_frames() == accepted.size(), label + "bad recorded frame count");
+                check(recorder.recorded_frames() + recorder.dropped_frames() == frames.size(), label + "frames unaccounted for");
+                check(!recorder.record(frames[0].pixels.data(), frames[0].palette.data()), label + "frame recorded after finish");
+            }
+            if (capacity == 64)
+                check(accepted.size() == frames.size(), label + "frames dropped with room in the ring");
+
+            stdext::memory_input_stream in(out.data().data(), out.data().size());
+            wcdx::frame::recording_reader reader(in);
+            for (auto n : accepted)
+            {
+                check(reader.next(), label + "recording ended early");
+                check_frame(reader, frames[n], label + "frame " + std::to_string(n) + ": ");
+            }
+            check(!reader.next(), label + "recording didn't end");
+        }
+    }
+
+    void test_recorder_segments()
+    {
+        constexpr unsigned width = 320;
+        constexpr unsigned height = 200;
+        constexpr uint64_t segment_size = 100000;
+        auto frames = make_frames(width, height, 60, 11);
+
+        std::deque<vector_output_stream> segments;
+        size_t segment_count;
+        {
+            wcdx::frame::frame_recorder recorder(width, height, [&]() -> stdext::output_stream& { return segments.emplace_back(); }, segment_size, 64);
+            for (size_t n = 0; n < frames.size(); ++n)
+                check(recorder.record(frames[n].pixels.data(), frames[n].palette.data(), n == 0 || frames[n].palette != frames[n - 1].palette), "Frame dropped with room in the ring");
+            recorder.finish();
+            segment_count = recorder.segments();
+        }
+        check(segment_count == segments.size(), "Bad segment count");
+        check(segments.size() > 1, "Recording not split into segments");
+
+        // Each segment is a recording of its own, and together they hold every frame in order.
+        size_t n = 0;
+        for (auto& segment : segments)
+        {
+            auto label = "Segment " + std::to_string(&segment - &segments.front()) + ": ";
+            stdext::memory_input_stream in(segment.data().data(), segment.data().size());
+            wcdx::frame::recording_reader reader(in);
+            size_t frames_read = 0;
+            while (reader.next())
+            {
+                check(n < frames.size(), label + "too many frames");
+                check_frame(reader, frames[n], label + "frame " + std::to_string(n) + ": ");
+                ++n;
+                ++frames_read;
+            }
+            check(frames_read != 0, label + "no frames");
+            // A segment is closed by the first frame that takes it past its size.
+            if (&segment != &segments.back())
+                check(segment.data().size() >= segment_size, label + "closed early");
+        }
+        check(n == frames.size(), "Frames missing from segments");
+    }
+
+    size_t vector_output_stream::do_write(const std::byte* buffer, size_t size)
+    {
+        _data.insert(_data.end(), buffer, buffer + size);
+        return size;
+    }
+
+    bool same_rect(const wcdx::frame::frame_rect& rect, unsigned left, unsigned top, unsigned right, unsigned bottom)
+    {
+        return rect.left == left && rect.top == top && rect.right == right && rect.bottom == bottom;
+    }
+
+    std::vector<uint32_t> make_palette(uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<uint32_t> palette(256);
+        for (auto& color : palette)
+            color = uint32_t(random());
+        return palette;
+    }
+
+    std::vector<std::byte> make_frame(unsigned width, unsigned height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::byte> frame(size_t(width) * height);
+        for (auto& index : frame)
+            index = std::byte(random());
+        return frame;
+    }
+
+    std::vector<test_frame> make_frames(unsigned width, unsigned height, size_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<test_frame> frames;
+        test_frame frame = { make_frame(width, height, seed), make_palette(seed) };
+        for (size_t n = 0; n < count; ++n)
+        {
+            for (auto changes = random() % 4; changes-- > 0; )
+            {
+                auto left = random() % width;
+                auto top = random() % height;
+                auto right = std::min<unsigned>(width, left + 1 + random() % 64);
+                auto bottom = std::min<unsigned>(height, top + 1 + random() % 32);
+                auto color = std::byte(random());
+                for (auto y = top; y < bottom; ++y)
+                {
+                    for (auto x = left; x < right; ++x)
+                        frame.pixels[y * width + x] = (x + y) % 3 == 0 ? std::byte(random()) : color;
+                }
+            }
+
+            // Every so often, fade the whole palette; otherwise touch a couple of entries.
+            if (n % 10 == 9)
+            {
+                for (auto& color : frame.palette)
+                    color = (color >> 1) & 0x7F7F7F7F;
+            }
+            else if (random() % 2 == 0)
+            {
+                frame.palette[random() % 256] = uint32_t(random());
+            }
+
+            frames.push_back(frame);
+        }
+
+        return frames;
+    }
+
+    void check_frame(const wcdx::frame::recording_reader& reader, const test_frame& frame, const std::string& label)
+    {
+        auto pixels = reader.pixels();
+        check(std::equal(pixels.begin(), pixels.end(), frame.pixels.begin(), frame.pixels.end()), label + "pixel mismatch");
+
+        auto rgb = reader.palette_rgb();
+        for (unsigned n = 0; n < 256; ++n)
+        {
+            auto expected = frame.palette[n] & 0x00FFFFFF;
+            check(reader.palette()[n] == expected, label + "palette mismatch at " + std::to_string(n));
+            check(rgb[3 * n] == std::byte(expected >> 16) && rgb[3 * n + 1] == std::byte(expected >> 8) && rgb[3 * n + 2] == std::byte(expected),
+                label + "RGB palette mismatch at " + std::to_string(n));
+        }
+    }
+
+    bool reader_throws(const std::vector<std::byte>& recording)
+    {
+        try
+        {
+            stdext::memory_input_stream in(recording.data(), recording.size());
+            wcdx::frame::recording_reader reader(in);
+            while (reader.next())
+                ;
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+}
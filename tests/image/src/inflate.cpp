@@ -0,0 +1,240 @@
+#include "inflate.h"
+
+#include <stdexcept>
+
+#include <cstdint>
+
+
+namespace
+{
+    class bit_reader
+    {
+    public:
+        bit_reader(const std::byte* data, size_t size) noexcept : _data(data), _size(size) { }
+
+    public:
+        unsigned bits(unsigned count)
+        {
+            unsigned value = 0;
+            for (unsigned n = 0; n < count; ++n)
+            {
+                if (_position == _size)
+                    throw std::runtime_error("Unexpected end of deflate stream");
+                auto bit = (unsigned(_data[_position]) >> _bit) & 1;
+                value |= bit << n;
+                if (++_bit == 8)
+                {
+                    _bit = 0;
+                    ++_position;
+                }
+            }
+            return value;
+        }
+
+        void align() noexcept
+        {
+            if (_bit != 0)
+            {
+                _bit = 0;
+                ++_position;
+            }
+        }
+
+        std::byte byte()
+        {
+            if (_position == _size)
+                throw std::runtime_error("Unexpected end of deflate stream");
+            return _data[_position++];
+        }
+
+        size_t position() const noexcept { return _position; }
+
+    private:
+        const std::byte* _data;
+        size_t _size;
+        size_t _position = 0;
+        unsigned _bit = 0;
+    };
+
+    // Canonical Huffman decoding by code length counts, one bit at a time.
+    struct huffman
+    {
+        uint16_t counts[16];
+        uint16_t symbols[288];
+
+        huffman(const uint8_t* lengths, unsigned count)
+        {
+            for (auto& c : counts)
+                c = 0;
+            for (unsigned n = 0; n < count; ++n)
+                ++counts[lengths[n]];
+
+            uint16_t offsets[16];
+            offsets[1] = 0;
+            for (unsigned len = 1; len < 15; ++len)
+                offsets[len + 1] = uint16_t(offsets[len] + counts[len]);
+            for (unsigned n = 0; n < count; ++n)
+            {
+                if (lengths[n] != 0)
+                    symbols[offsets[lengths[n]]++] = uint16_t(n);
+            }
+        }
+
+        unsigned decode(bit_reader& in) const
+        {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (unsigned len = 1; len <= 15; ++len)
+            {
+                code |= int(in.bits(1));
+                int count = counts[len];
+                if (code - count < first)
+                    return symbols[index + (code - first)];
+                index += count;
+                first += count;
+                first <<= 1;
+                code <<= 1;
+            }
+            throw std::runtime_error("Invalid Huffman code");
+        }
+    };
+
+    constexpr uint16_t length_base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t length_extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    constexpr uint16_t distance_base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    constexpr uint8_t distance_extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    void inflate_codes(bit_reader& in, const huffman& litlen, const huffman& distance, std::vector<std::byte>& out)
+    {
+        while (true)
+        {
+            auto symbol = litlen.decode(in);
+            if (symbol < 256)
+            {
+                out.push_back(std::byte(symbol));
+                continue;
+            }
+            if (symbol == 256)
+                return;
+
+            symbol -= 257;
+            if (symbol >= 29)
+                throw std::runtime_error("Invalid length code");
+            size_t length = length_base[symbol] + in.bits(length_extra[symbol]);
+
+            auto dsymbol = distance.decode(in);
+            if (dsymbol >= 30)
+                throw std::runtime_error("Invalid distance code");
+            size_t dist = distance_base[dsymbol] + in.bits(distance_extra[dsymbol]);
+            if (dist > out.size())
+                throw std::runtime_error("Distance too far back");
+
+            for (size_t n = 0; n < length; ++n)
+                out.push_back(out[out.size() - dist]);
+        }
+    }
+
+    void inflate(bit_reader& in, std::vector<std::byte>& out)
+    {
+        unsigned final;
+        do
+        {
+            final = in.bits(1);
+            auto type = in.bits(2);
+            if (type == 0)
+            {
+                in.align();
+                unsigned length = unsigned(in.byte()) | unsigned(in.byte()) << 8;
+                unsigned inverse = unsigned(in.byte()) | unsigned(in.byte()) << 8;
+                if (length != (~inverse & 0xFFFF))
+                    throw std::runtime_error("Stored block length mismatch");
+                for (unsigned n = 0; n < length; ++n)
+                    out.push_back(in.byte());
+            }
+            else if (type == 1)
+            {
+                uint8_t lengths[288 + 30];
+                for (unsigned n = 0; n < 288; ++n)
+                    lengths[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+                for (unsigned n = 0; n < 30; ++n)
+                    lengths[288 + n] = 5;
+                inflate_codes(in, huffman(lengths, 288), huffman(lengths + 288, 30), out);
+            }
+            else if (type == 2)
+            {
+                auto hlit = in.bits(5) + 257;
+                auto hdist = in.bits(5) + 1;
+                auto hclen = in.bits(4) + 4;
+                static constexpr uint8_t order[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+                uint8_t code_lengths[19] = { };
+                for (unsigned n = 0; n < hclen; ++n)
+                    code_lengths[order[n]] = uint8_t(in.bits(3));
+                huffman code_length_code(code_lengths, 19);
+
+                uint8_t lengths[286 + 30] = { };
+                for (unsigned n = 0; n < hlit + hdist; )
+                {
+                    auto symbol = code_length_code.decode(in);
+                    if (symbol < 16)
+                    {
+                        lengths[n++] = uint8_t(symbol);
+                        continue;
+                    }
+
+                    uint8_t value = 0;
+                    unsigned repeat;
+                    if (symbol == 16)
+                    {
+                        if (n == 0)
+                            throw std::runtime_error("Repeat with no previous length");
+                        value = lengths[n - 1];
+                        repeat = 3 + in.bits(2);
+                    }
+                    else if (symbol == 17)
+                        repeat = 3 + in.bits(3);
+                    else
+                        repeat = 11 + in.bits(7);
+
+                    if (n + repeat > hlit + hdist)
+                        throw std::runtime_error("Too many code lengths");
+                    while (repeat-- > 0)
+                        lengths[n++] = value;
+                }
+
+                inflate_codes(in, huffman(lengths, hlit), huffman(lengths + hlit, hdist), out);
+            }
+            else
+                throw std::runtime_error("Invalid block type");
+        } while (final == 0);
+    }
+}
+
+std::vector<std::byte> zlib_decompress(const std::byte* data, size_t size)
+{
+    if (size < 6)
+        throw std::runtime_error("zlib stream too short");
+
+    auto cmf = unsigned(data[0]);
+    auto flg = unsigned(data[1]);
+    if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || (cmf << 8 | flg) % 31 != 0 || (flg & 0x20) != 0)
+        throw std::runtime_error("Invalid zlib header");
+
+    bit_reader in(data + 2, size - 6);
+    std::vector<std::byte> out;
+    inflate(in, out);
+
+    uint32_t s1 = 1, s2 = 0;
+    for (auto b : out)
+    {
+        s1 = (s1 + uint32_t(b)) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+
+    auto trailer = data + size - 4;
+    auto expected = uint32_t(trailer[0]) << 24 | uint32_t(trailer[1]) << 16 | uint32_t(trailer[2]) << 8 | uint32_t(trailer[3]);
+    if ((s2 << 16 | s1) != expected)
+        throw std::runtime_error("Adler-32 mismatch");
+
+    return out;
+}
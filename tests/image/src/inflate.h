@@ -0,0 +1,14 @@
+#ifndef INFLATE_INCLUDED
+#define INFLATE_INCLUDED
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+
+
+// A minimal, unoptimized zlib decoder (RFC 1950 and 1951), written independently of the
+// encoder so the two can check each other.  Throws std::runtime_error on malformed input.
+std::vector<std::byte> zlib_decompress(const std::byte* data, size_t size);
+
+#endif
@@ -0,0 +1,688 @@
+#include "inflate.h"
+
+#include <image/font.h>
+#include <image/palette.h>
+#include <image/png.h>
+#include <image/sprite.h>
+
+#include <stdext/array_view.h>
+
+#include <test/font.h>
+#include <test/support.h>
+
+#include <algorithm>
+#include <exception>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+    struct png_chunk
+    {
+        std::string type;
+        const std::byte* data;
+        uint32_t length;
+    };
+
+    using wcdx::test::check;
+    using wcdx::test::make_bytes;
+    using wcdx::test::make_font;
+    using wcdx::test::throws;
+
+    uint32_t read_uint32(const std::byte* p);
+    uint32_t crc32(const std::byte* data, size_t size);
+    std::vector<png_chunk> parse_png(stdext::array_view<const std::byte> png);
+    void check_round_trip(wcdx::image::png_encoder& encoder, const std::vector<std::byte>& palette, unsigned width, unsigned height, const std::vector<std::byte>& pixels);
+
+    std::vector<std::byte> make_palette();
+    std::vector<std::byte> make_sprite(unsigned width, unsigned height, uint32_t seed);
+    std::vector<std::byte> make_noise(unsigned width, unsigned height, uint32_t seed);
+
+    void test_all_levels();
+    void test_encoder_reuse();
+    void test_incompressible();
+    void test_invalid_arguments();
+    void test_sprite_decode();
+    void test_invalid_sprites();
+    void test_sprite_round_trip();
+    void test_sprite_size();
+    void test_quantizer();
+    void test_quantize_image();
+    void test_dither();
+    void test_font_load();
+    void test_invalid_fonts();
+    void test_font_atlas();
+    void test_atlas_metrics();
+
+    std::byte nearest_reference(const std::vector<std::byte>& palette, int red, int green, int blue);
+
+    size_t minimal_sprite_size(unsigned width, unsigned height, const std::vector<std::byte>& pixels);
+}
+
+int main()
+{
+    return wcdx::test::run_tests("image", []
+    {
+        test_all_levels();
+        test_encoder_reuse();
+        test_incompressible();
+        test_invalid_arguments();
+        test_sprite_decode();
+        test_invalid_sprites();
+        test_sprite_round_trip();
+        test_sprite_size();
+        test_quantizer();
+        test_quantize_image();
+        test_dither();
+        test_font_load();
+        test_invalid_fonts();
+        test_font_atlas();
+        test_atlas_metrics();
+    });
+}
+
+namespace
+{
+    void test_all_levels()
+    {
+        auto palette = make_palette();
+        auto pixels = make_sprite(320, 200, 1);
+        for (unsigned level = 0; level <= wcdx::image::png_encoder::max_compression_level; ++level)
+        {
+            wcdx::image::png_encoder encoder({ palette.data(), palette.size() }, level);
+            check_round_trip(encoder, palette, 320, 200, pixels);
+        }
+    }
+
+    void test_encoder_reuse()
+    {
+        auto palette = make_palette();
+        wcdx::image::png_encoder encoder({ palette.data(), palette.size() });
+
+        static constexpr unsigned sizes[][2] = { { 640, 480 }, { 1, 1 }, { 17, 3 }, { 3, 300 }, { 64, 64 } };
+        uint32_t seed = 2;
+        for (auto& size : sizes)
+            check_round_trip(encoder, palette, size[0], size[1], make_sprite(size[0], size[1], seed++));
+
+        // Changing the level between images must not disturb the reused buffers.
+        encoder.set_compression_level(1);
+        check_round_trip(encoder, palette, 100, 100, make_sprite(100, 100, seed++));
+        encoder.set_compression_level(9);
+        check_round_trip(encoder, palette, 100, 100, make_sprite(100, 100, seed++));
+    }
+
+    void test_incompressible()
+    {
+        auto palette = make_palette();
+        wcdx::image::png_encoder encoder({ palette.data(), palette.size() });
+
+        // Large enough to need several stored blocks.
+        auto pixels = make_noise(400, 400, 3);
+        check_round_trip(encoder, palette, 400, 400, pixels);
+        check(encoder.encode({ 400, 400 }, { pixels.data(), pixels.size() }).size() < pixels.size() + pixels.size() / 100 + 1024,
+            "Incompressible data expanded too much");
+    }
+
+    void test_invalid_arguments()
+    {
+        auto palette = make_palette();
+        wcdx::image::png_encoder encoder({ palette.data(), palette.size() });
+        std::vector<std::byte> pixels(100);
+
+        check(throws([&] { encoder.encode({ 10, 11 }, { pixels.data(), pixels.size() }); }), "Mismatched pixel count accepted");
+        check(throws([&] { encoder.encode({ 0, 10 }, { pixels.data(), 0 }); }), "Empty image accepted");
+        check(throws([&] { encoder.set_compression_level(10); }), "Invalid compression level accepted");
+        check(throws([&] { wcdx::image::png_encoder bad({ palette.data(), 765 }); }), "Short palette accepted");
+    }
+
+    // A 5x3 sprite with its reference point at (1, 1): one literal segment, and one segment
+    // made of a fill run and a literal run.
+    const std::vector<std::byte> test_sprite = make_bytes(
+    {
+        3, 0,   1, 0,   1, 0,   1, 0,
+        2 << 1, 0,   0xFF, 0xFF,   0xFF, 0xFF,   7, 8,
+        4 << 1 | 1, 0,   0, 0,   1, 0,   3 << 1 | 1, 9,   1 << 1, 10,
+        0, 0,
+    });
+
+    void test_sprite_decode()
+    {
+        auto header = wcdx::image::read_sprite_header({ test_sprite.data(), test_sprite.size() });
+        check(header.width() == 5 && header.height() == 3, "Bad sprite dimensions");
+
+        std::vector<std::byte> pixels(15);
+        wcdx::image::decode_sprite({ test_sprite.data(), test_sprite.size() }, { pixels.data(), pixels.size() });
+        check(pixels == make_bytes(
+        {
+            7, 8, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 9, 9, 9, 10,
+        }), "Sprite pixel mismatch");
+
+        // Runs long enough to be copied a word at a time must not disturb their neighbors.
+        auto wide = make_bytes(
+        {
+            21, 0,   1, 0,   0, 0,   0, 0,
+            20 << 1 | 1, 0,   0, 0,   0, 0,
+            5 << 1, 1, 2, 3, 4, 5,   7 << 1 | 1, 6,   8 << 1, 7, 8, 9, 10, 11, 12, 13, 14,
+            0, 0,
+        });
+        pixels.resize(23);
+        wcdx::image::decode_sprite({ wide.data(), wide.size() }, { pixels.data(), pixels.size() });
+        check(pixels == make_bytes(
+        {
+            0xFF, 1, 2, 3, 4, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0xFF, 0xFF,
+        }), "Wide sprite pixel mismatch");
+    }
+
+    void test_invalid_sprites()
+    {
+        auto decode = [](const std::vector<std::byte>& sprite)
+        {
+            auto header = wcdx::image::read_sprite_header({ sprite.data(), sprite.size() });
+            std::vector<std::byte> pixels(size_t(header.width()) * header.height());
+            wcdx::image::decode_sprite({ sprite.data(), sprite.size() }, { pixels.data(), pixels.size() });
+        };
+
+        // Every prefix of a valid sprite is truncated.
+        for (size_t size = 0; size < test_sprite.size(); ++size)
+            check(throws([&] { decode({ test_sprite.begin(), test_sprite.begin() + size }); }), "Truncated sprite accepted at " + std::to_string(size));
+
+        auto modified = [](size_t offset, int value)
+        {
+            auto sprite = test_sprite;
+            sprite[offset] = std::byte(value);
+            return sprite;
+        };
+
+        check(throws([&] { decode(modified(3, 0xFF)); }), "Negative width accepted");
+        check(throws([&] { decode(modified(8, 6 << 1)); }), "Segment past right edge accepted");
+        check(throws([&] { decode(modified(10, 0xFE)); }), "Segment past left edge accepted");
+        check(throws([&] { decode(modified(20, 3)); }), "Segment past bottom edge accepted");
+        check(throws([&] { decode(modified(24, 4 << 1 | 1)); }), "Run past segment end accepted");
+        check(throws([&] { decode(modified(24, 1)); }), "Empty run accepted");
+
+        std::vector<std::byte> pixels(14);
+        check(throws([&] { wcdx::image::decode_sprite({ test_sprite.data(), test_sprite.size() }, { pixels.data(), pixels.size() }); }),
+            "Mismatched pixel buffer accepted");
+    }
+
+    void test_sprite_round_trip()
+    {
+        wcdx::image::sprite_encoder encoder;
+        auto round_trip = [&](unsigned width, unsigned height, const std::vector<std::byte>& pixels, int reference_x, int reference_y)
+        {
+            auto label = std::to_string(width) + "x" + std::to_string(height) + " sprite: ";
+            auto sprite = encoder.encode({ width, height }, { pixels.data(), pixels.size() }, reference_x, reference_y);
+            auto header = wcdx::image::read_sprite_header(sprite);
+            check(header.left_extent == reference_x && header.top_extent == reference_y, label + "bad reference point");
+            check(header.width() == int(width) && header.height() == int(height), label + "bad dimensions");
+
+            std::vector<std::byte> decoded(pixels.size());
+            wcdx::image::decode_sprite(sprite, { decoded.data(), decoded.size() });
+            check(decoded == pixels, label + "pixel mismatch");
+        };
+
+        uint32_t seed = 20;
+        static constexpr unsigned sizes[][2] = { { 1, 1 }, { 17, 3 }, { 64, 64 }, { 320, 200 }, { 300, 2 } };
+        for (auto& size : sizes)
+        {
+            round_trip(size[0], size[1], make_sprite(size[0], size[1], seed++), 0, 0);
+            round_trip(size[0], size[1], make_sprite(size[0], size[1], seed++), int(size[0] / 2), int(size[1] - 1));
+        }
+
+        // Runs, literals, and segments longer than the format allows must be split.
+        std::vector<std::byte> solid(1000, std::byte(3));
+        round_trip(1000, 1, solid, 500, 0);
+        round_trip(500, 1, make_noise(500, 1, seed++), 0, 0);
+
+        auto max_width = unsigned(wcdx::image::sprite_encoder::max_segment_width) + 1;
+        auto wide = make_noise(max_width, 1, seed++);
+        std::replace(wide.begin(), wide.end(), wcdx::image::transparent_index, std::byte(0));
+        round_trip(max_width, 1, wide, 0, 0);
+
+        auto empty = std::vector<std::byte>(100, wcdx::image::transparent_index);
+        round_trip(10, 10, empty, 5, 5);
+        check(encoder.encode({ 10, 10 }, { empty.data(), empty.size() }, 0, 0).size() == 10, "Empty sprite has segments");
+
+        std::vector<std::byte> pixels(4);
+        check(throws([&] { encoder.encode({ 2, 3 }, { pixels.data(), pixels.size() }, 0, 0); }), "Mismatched pixel count accepted");
+        check(throws([&] { encoder.encode({ 2, 2 }, { pixels.data(), pixels.size() }, 40000, 0); }), "Out of range reference point accepted");
+    }
+
+    void test_sprite_size()
+    {
+        wcdx::image::sprite_encoder encoder;
+        uint32_t seed = 40;
+        for (unsigned n = 0; n < 20; ++n)
+        {
+            auto width = 1 + n * 37 % 300;
+            auto height = 1 + n * 11 % 40;
+            auto pixels = make_sprite(width, height, seed++);
+            auto size = encoder.encode({ width, height }, { pixels.data(), pixels.size() }, 0, 0).size();
+            check(size == minimal_sprite_size(width, height, pixels), std::to_string(width) + "x" + std::to_string(height) + " sprite not minimal");
+        }
+    }
+
+    // The smallest possible encoding, found by trying every run length at every position.
+    size_t minimal_sprite_size(unsigned width, unsigned height, const std::vector<std::byte>& pixels)
+    {
+        constexpr size_t max_run = wcdx::image::sprite_encoder::max_run_width;
+        constexpr size_t max_segment = wcdx::image::sprite_encoder::max_segment_width;
+
+        size_t total = 8 + 2;
+        for (unsigned y = 0; y < height; ++y)
+        {
+            auto row = pixels.data() + size_t(width) * y;
+            for (size_t x = 0; x < width; )
+            {
+                if (row[x] == wcdx::image::transparent_index)
+                {
+                    ++x;
+                    continue;
+                }
+
+                auto end = x;
+                while (end < width && end - x < max_segment && row[end] != wcdx::image::transparent_index)
+                    ++end;
+
+                auto segment = row + x;
+                auto length = end - x;
+                std::vector<size_t> cost(length + 1, SIZE_MAX);
+                cost[0] = 0;
+                for (size_t i = 1; i <= length; ++i)
+                {
+                    for (size_t run = 1; run <= std::min(i, max_run); ++run)
+                    {
+                        cost[i] = std::min(cost[i], cost[i - run] + 1 + run);
+                        if (std::all_of(segment + i - run, segment + i, [&](std::byte pixel) { return pixel == segment[i - 1]; }))
+                            cost[i] = std::min(cost[i], cost[i - run] + 2);
+                    }
+                }
+
+                total += 6 + std::min(length, cost[length]);
+                x = end;
+            }
+        }
+
+        return total;
+    }
+
+    void test_quantizer()
+    {
+        // Duplicate colors check that ties go to the lower index.
+        auto palette = make_palette();
+        std::copy_n(palette.begin(), 30, palette.begin() + 300);
+        wcdx::image::color_quantizer quantizer({ palette.data(), palette.size() });
+
+        for (size_t n = 0; n < 255; ++n)
+        {
+            auto red = int(palette[3 * n]);
+            auto green = int(palette[3 * n + 1]);
+            auto blue = int(palette[3 * n + 2]);
+            check(quantizer.nearest(uint8_t(red), uint8_t(green), uint8_t(blue)) == nearest_reference(palette, red, green, blue),
+                "Palette color " + std::to_string(n) + " not mapped to itself");
+        }
+
+        std::mt19937 random(50);
+        for (unsigned n = 0; n < 100000; ++n)
+        {
+            auto red = int(random() % 256);
+            auto green = int(random() % 256);
+            auto blue = int(random() % 256);
+            check(quantizer.nearest(uint8_t(red), uint8_t(green), uint8_t(blue)) == nearest_reference(palette, red, green, blue),
+                "Nearest color mismatch for " + std::to_string(red) + "," + std::to_string(green) + "," + std::to_string(blue));
+        }
+
+        // The transparent color is never chosen, even for an exact match.
+        check(quantizer.nearest(uint8_t(palette[765]), uint8_t(palette[766]), uint8_t(palette[767])) != wcdx::image::transparent_index,
+            "Transparent color chosen");
+    }
+
+    void test_quantize_image()
+    {
+        auto palette = make_palette();
+        wcdx::image::color_quantizer quantizer({ palette.data(), palette.size() });
+
+        unsigned width = 97;
+        unsigned height = 31;
+        auto bgra = make_noise(4 * width, height, 51);
+        std::vector<std::byte> indices(size_t(width) * height);
+        quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() });
+        for (size_t n = 0; n < indices.size(); ++n)
+        {
+            auto pixel = bgra.data() + 4 * n;
+            auto expected = uint8_t(pixel[3]) < 2 ? wcdx::image::transparent_index
+                : nearest_reference(palette, int(pixel[2]), int(pixel[1]), int(pixel[0]));
+            check(indices[n] == expected, "Quantized pixel " + std::to_string(n) + " mismatch");
+        }
+
+        // Only pixels that are all but invisible become transparent; soft edges keep a color.
+        std::vector<std::byte> edge;
+        for (unsigned alpha : { 0, 1, 2, 64, 0x7F })
+            edge.insert(edge.end(), { std::byte(0x20), std::byte(0x40), std::byte(0x60), std::byte(alpha) });
+        std::vector<std::byte> edge_indices(edge.size() / 4);
+        quantizer.quantize({ unsigned(edge_indices.size()), 1 }, { edge.data(), edge.size() }, { edge_indices.data(), edge_indices.size() });
+        check(edge_indices[0] == wcdx::image::transparent_index && edge_indices[1] == wcdx::image::transparent_index,
+            "Invisible pixel not transparent");
+        for (size_t n = 2; n < edge_indices.size(); ++n)
+            check(edge_indices[n] == nearest_reference(palette, 0x60, 0x40, 0x20), "Translucent pixel " + std::to_string(n) + " not opaque");
+
+        check(throws([&] { quantizer.quantize({ width, height + 1 }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() }); }),
+            "Mismatched pixel count accepted");
+    }
+
+    void test_dither()
+    {
+        // Black and white only, so a flat gray can only be made by mixing the two.
+        std::vector<std::byte> palette(3 * 256, std::byte(0));
+        std::fill_n(palette.begin() + 3, 3, std::byte(0xFF));
+        wcdx::image::color_quantizer quantizer({ palette.data(), palette.size() });
+
+        unsigned width = 64;
+        unsigned height = 64;
+        std::vector<std::byte> bgra(4 * size_t(width) * height, std::byte(0x40));
+        for (size_t n = 3; n < bgra.size(); n += 4)
+            bgra[n] = std::byte(0xFF);
+        bgra[3] = std::byte(0);
+
+        std::vector<std::byte> indices(size_t(width) * height);
+        quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() });
+        check(std::count(indices.begin(), indices.end(), std::byte(0)) == ptrdiff_t(indices.size()) - 1, "Undithered gray not mapped to black");
+
+        quantizer.quantize({ width, height }, { bgra.data(), bgra.size() }, { indices.data(), indices.size() }, true);
+        check(indices[0] == wcdx::image::transparent_index, "Transparent pixel dithered");
+        auto white = std::count(indices.begin(), indices.end(), std::byte(1));
+        auto black = std::count(indices.begin(), indices.end(), std::byte(0));
+        check(white + black == ptrdiff_t(indices.size()) - 1, "Dither chose an unexpected color");
+
+        // 0x40 is a quarter of the way from black to white.
+        auto expected = double(indices.size() - 1) * 0x40 / 0xFF;
+        check(std::abs(double(white) - expected) < indices.size() / 100.0, "Dithered gray has the wrong brightness");
+    }
+
+    void test_font_load()
+    {
+        std::vector<unsigned> widths(wcdx::image::font::glyph_count);
+        for (size_t n = 0; n < widths.size(); ++n)
+            widths[n] = n % 9;
+        auto data = make_font(7, widths);
+        wcdx::image::font font({ data.data(), data.size() });
+
+        check(font.height() == 7, "Font height mismatch");
+        size_t position = wcdx::image::font::header_size;
+        for (unsigned n = 0; n < wcdx::image::font::glyph_count; ++n)
+        {
+            check(font.width(n) == widths[n], "Glyph width mismatch");
+            auto size = size_t(widths[n]) * 7;
+            check(size == 0 || std::memcmp(font.pixels(n), data.data() + position, size) == 0, "Glyph pixel mismatch");
+            position += size;
+        }
+
+        // Glyphs may share pixels, and needn't be stored in order.
+        auto shared = make_font(2, { 0, 3, 3 });
+        shared[4 + 256 + 1] = shared[4 + 256 + 2];
+        shared[4 + 512 + 1] = shared[4 + 512 + 2];
+        wcdx::image::font shared_font({ shared.data(), shared.size() });
+        check(shared_font.pixels(1) == shared_font.pixels(2), "Shared glyph pixels not shared");
+    }
+
+    void test_invalid_fonts()
+    {
+        auto load = [](const std::vector<std::byte>& data)
+        {
+            wcdx::image::font font({ data.data(), data.size() });
+        };
+
+        auto data = make_font(4, { 0, 2, 5, 1 });
+        for (size_t size = 0; size < data.size(); ++size)
+            check(throws([&] { load({ data.begin(), data.begin() + size }); }), "Truncated font accepted at " + std::to_string(size));
+        check(!throws([&] { load(data); }), "Valid font rejected");
+
+        auto in_header = data;
+        in_header[4 + 256 + 2] = std::byte(0x10);
+        in_header[4 + 512 + 2] = std::byte(0);
+        check(throws([&] { load(in_header); }), "Glyph inside header accepted");
+
+        auto past_end = data;
+        past_end[4 + 512 + 2] = std::byte(0xFF);
+        check(throws([&] { load(past_end); }), "Glyph past end accepted");
+
+        // An empty glyph's position is never looked at.
+        auto empty = data;
+        empty[4 + 256] = std::byte(0xFF);
+        empty[4 + 512] = std::byte(0xFF);
+        check(!throws([&] { load(empty); }), "Empty glyph position checked");
+    }
+
+    void test_font_atlas()
+    {
+        auto check_atlas = [](const std::vector<unsigned>& widths, unsigned height)
+        {
+            auto label = std::to_string(widths.size()) + " glyphs of height " + std::to_string(height) + ": ";
+            auto data = make_font(height, widths);
+            wcdx::image::font font({ data.data(), data.size() });
+            auto atlas = wcdx::image::pack_atlas(font);
+
+            check(atlas.width != 0 && (atlas.width & (atlas.width - 1)) == 0, label + "width not a power of two");
+            check(atlas.height != 0 && (atlas.height & (atlas.height - 1)) == 0, label + "height not a power of two");
+            check(atlas.font_height == height, label + "font height mismatch");
+            check(atlas.pixels.size() == size_t(atlas.width) * atlas.height, label + "pixel count mismatch");
+
+            std::vector<unsigned> coverage(atlas.pixels.size());
+            size_t area = 0;
+            for (unsigned n = 0; n < wcdx::image::font::glyph_count; ++n)
+            {
+                auto& entry = atlas.entries[n];
+                check(entry.width == font.width(n) && entry.height == height, label + "entry size mismatch");
+                check(size_t(entry.x) + entry.width <= atlas.width, label + "glyph past right edge");
+                check(entry.width == 0 || size_t(entry.y) + entry.height <= atlas.height, label + "glyph past bottom edge");
+                area += size_t(entry.width) * entry.height;
+
+                for (unsigned y = 0; y < entry.height && entry.width != 0; ++y)
+                {
+                    auto row = size_t(entry.y + y) * atlas.width + entry.x;
+                    check(std::memcmp(atlas.pixels.data() + row, font.pixels(n) + size_t(y) * entry.width, entry.width) == 0, label + "glyph pixel mismatch");
+                    for (unsigned x = 0; x < entry.width; ++x)
+                        ++coverage[row + x];
+                }
+            }
+
+            for (size_t n = 0; n < coverage.size(); ++n)
+            {
+                check(coverage[n] <= 1, label + "glyphs overlap");
+                check(coverage[n] != 0 || atlas.pixels[n] == wcdx::image::transparent_index, label + "uncovered pixel not transparent");
+            }
+            check(size_t(atlas.width) * atlas.height >= area, label + "atlas smaller than its glyphs");
+            return atlas;
+        };
+
+        std::vector<unsigned> widths(wcdx::image::font::glyph_count);
+        for (size_t n = 0; n < widths.size(); ++n)
+            widths[n] = n < 32 ? 0 : 4 + n % 5;
+        check_atlas(widths, 8);
+        check_atlas(widths, 1);
+
+        auto wide = check_atlas({ 255 }, 3);
+        check(wide.width == 256 && wide.height == 4, "Single wide glyph not packed tightly");
+
+        auto same = check_atlas(std::vector<unsigned>(wcdx::image::font::glyph_count, 8), 8);
+        check(same.width == 128 && same.height == 128, "Uniform glyphs not packed tightly");
+
+        auto empty = check_atlas({ }, 10);
+        check(empty.width == 1 && empty.height == 1, "Empty font not packed into one pixel");
+
+        auto tall = make_font(256, { 1 });
+        check(throws([&] { wcdx::image::pack_atlas(wcdx::image::font({ tall.data(), tall.size() })); }), "Font taller than metrics allow accepted");
+    }
+
+    void test_atlas_metrics()
+    {
+        auto data = make_font(6, { 0, 3, 0, 5 });
+        auto atlas = wcdx::image::pack_atlas(wcdx::image::font({ data.data(), data.size() }));
+        auto metrics = wcdx::image::atlas_metrics(atlas);
+
+        check(metrics.size() == 14 + 6 * wcdx::image::font::glyph_count, "Metrics size mismatch");
+        check(std::memcmp(metrics.data(), "WCFA", 4) == 0, "Metrics signature mismatch");
+        auto read_uint16 = [&](size_t offset) { return unsigned(metrics[offset]) | unsigned(metrics[offset + 1]) << 8; };
+        check(read_uint16(4) == wcdx::image::atlas_metrics_version, "Metrics version mismatch");
+        check(read_uint16(6) == atlas.width && read_uint16(8) == atlas.height, "Metrics atlas size mismatch");
+        check(read_uint16(10) == 6 && read_uint16(12) == wcdx::image::font::glyph_count, "Metrics font mismatch");
+
+        for (unsigned n = 0; n < wcdx::image::font::glyph_count; ++n)
+        {
+            auto offset = 14 + 6 * size_t(n);
+            auto& entry = atlas.entries[n];
+            check(read_uint16(offset) == entry.x && read_uint16(offset + 2) == entry.y, "Metrics glyph position mismatch");
+            check(unsigned(metrics[offset + 4]) == entry.width && unsigned(metrics[offset + 5]) == entry.height, "Metrics glyph size mismatch");
+        }
+        check(unsigned(metrics[14 + 6 * 3 + 4]) == 5, "Metrics glyph width mismatch");
+    }
+
+    std::byte nearest_reference(const std::vector<std::byte>& palette, int red, int green, int blue)
+    {
+        auto best_distance = INT_MAX;
+        size_t best_index = 0;
+        for (size_t n = 0; n < 255; ++n)
+        {
+            auto dr = red - int(palette[3 * n]);
+            auto dg = green - int(palette[3 * n + 1]);
+            auto db = blue - int(palette[3 * n + 2]);
+            auto distance = dr * dr + dg * dg + db * db;
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best_index = n;
+            }
+        }
+
+        return std::byte(best_index);
+    }
+
+    void check_round_trip(wcdx::image::png_encoder& encoder, const std::vector<std::byte>& palette, unsigned width, unsigned height, const std::vector<std::byte>& pixels)
+    {
+        auto label = std::to_string(width) + "x" + std::to_string(height) + " at level " + std::to_string(encoder.compression_level()) + ": ";
+        auto png = encoder.encode({ width, height }, { pixels.data(), pixels.size() });
+        auto chunks = parse_png(png);
+
+        check(chunks.size() == 5, label + "unexpected chunk count");
+        check(chunks[0].type == "IHDR" && chunks[0].length == 13, label + "bad IHDR");
+        check(read_uint32(chunks[0].data) == width && read_uint32(chunks[0].data + 4) == height, label + "bad dimensions");
+        check(chunks[0].data[8] == std::byte(8) && chunks[0].data[9] == std::byte(3), label + "not 8-bit indexed");
+
+        check(chunks[1].type == "PLTE" && chunks[1].length == palette.size(), label + "bad PLTE");
+        check(std::memcmp(chunks[1].data, palette.data(), palette.size()) == 0, label + "palette mismatch");
+
+        check(chunks[2].type == "tRNS" && chunks[2].length == 256, label + "bad tRNS");
+        for (unsigned n = 0; n < 256; ++n)
+            check(chunks[2].data[n] == std::byte(n == 255 ? 0 : 0xFF), label + "bad transparency");
+
+        check(chunks[3].type == "IDAT", label + "missing IDAT");
+        check(chunks[4].type == "IEND" && chunks[4].length == 0, label + "bad IEND");
+
+        auto scanlines = zlib_decompress(chunks[3].data, chunks[3].length);
+        check(scanlines.size() == size_t(width + 1) * height, label + "bad scanline size");
+        for (unsigned y = 0; y < height; ++y)
+        {
+            auto row = scanlines.data() + size_t(width + 1) * y;
+            check(row[0] == std::byte(0), label + "unexpected filter type");
+            check(std::memcmp(row + 1, pixels.data() + size_t(width) * y, width) == 0, label + "pixel mismatch in row " + std::to_string(y));
+        }
+    }
+
+    std::vector<png_chunk> parse_png(stdext::array_view<const std::byte> png)
+    {
+        static constexpr uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        check(png.size() >= sizeof(signature) && std::memcmp(png.data(), signature, sizeof(signature)) == 0, "Bad PNG signature");
+
+        std::vector<png_chunk> chunks;
+        auto p = png.data() + sizeof(signature);
+        auto last = png.data() + png.size();
+        while (p != last)
+        {
+            check(last - p >= 12, "Truncated chunk header");
+            auto length = read_uint32(p);
+            check(size_t(last - p) >= size_t(12) + length, "Truncated chunk");
+
+            png_chunk chunk = { std::string(reinterpret_cast<const char*>(p + 4), 4), p + 8, length };
+            check(read_uint32(p + 8 + length) == crc32(p + 4, size_t(length) + 4), "CRC mismatch in " + chunk.type);
+            chunks.push_back(chunk);
+            p += 12 + size_t(length);
+        }
+
+        return chunks;
+    }
+
+    std::vector<std::byte> make_palette()
+    {
+        std::vector<std::byte> palette(3 * 256);
+        for (size_t n = 0; n < palette.size(); ++n)
+            palette[n] = std::byte(n * 7 + n / 3);
+        return palette;
+    }
+
+    // Transparent background with horizontal runs and noisy patches, roughly like sprites.
+    std::vector<std::byte> make_sprite(unsigned width, unsigned height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::byte> pixels(size_t(width) * height, std::byte(0xFF));
+        for (auto p = pixels.begin(); p != pixels.end(); )
+        {
+            auto length = std::min(size_t(1 + random() % 24), size_t(pixels.end() - p));
+            switch (random() % 3)
+            {
+            case 0:
+                p += length;
+                break;
+
+            case 1:
+                p = std::fill_n(p, length, std::byte(random() % 255));
+                break;
+
+            default:
+                for (; length > 0; --length)
+                    *p++ = std::byte(random() % 32);
+                break;
+            }
+        }
+
+        return pixels;
+    }
+
+    std::vector<std::byte> make_noise(unsigned width, unsigned height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::byte> pixels(size_t(width) * height);
+        for (auto& pixel : pixels)
+            pixel = std::byte(random());
+        return pixels;
+    }
+
+    uint32_t read_uint32(const std::byte* p)
+    {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+    }
+
+    uint32_t crc32(const std::byte* data, size_t size)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t n = 0; n < size; ++n)
+        {
+            crc ^= uint32_t(data[n]);
+            for (unsigned k = 0; k < 8; ++k)
+                crc = (crc & 1) != 0 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        }
+        return crc ^ 0xFFFFFFFF;
+    }
+}
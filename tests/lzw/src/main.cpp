@@ -0,0 +1,269 @@
+#include <lzw/lzw.h>
+
+#include <stdext/array_view.h>
+
+#include <test/support.h>
+
+#include <algorithm>
+#include <exception>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace
+{
+    // What walk_codes found in a compressed stream.
+    struct code_stats
+    {
+        size_t codes = 0;
+        size_t resets = 0;
+        unsigned max_width = 0;
+    };
+
+    using wcdx::test::check;
+    using wcdx::test::throws;
+
+    std::vector<std::byte> random_bytes(size_t size, uint32_t seed);
+    std::vector<std::byte> round_trip(const std::vector<std::byte>& input, const std::string& label);
+    std::vector<std::byte> pack_codes(std::initializer_list<std::pair<unsigned, unsigned>> codes);
+    code_stats walk_codes(const std::vector<std::byte>& compressed);
+    bool decompress_throws(const std::vector<std::byte>& compressed, size_t output_size);
+
+    void test_empty();
+    void test_single_bytes();
+    void test_dictionary_fill();
+    void test_truncated();
+    void test_invalid_streams();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("lzw", []
+    {
+        test_empty();
+        test_single_bytes();
+        test_dictionary_fill();
+        test_truncated();
+        test_invalid_streams();
+    });
+}
+
+namespace
+{
+    void test_empty()
+    {
+        // Empty input is a lone stop code, with no reset code before it.
+        auto compressed = wcdx::lzw::compress({ nullptr, 0 });
+        check(compressed == pack_codes({ { wcdx::lzw::stop_code, wcdx::lzw::min_code_width } }), "Bad compressed empty input");
+        check(wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { nullptr, 0 }) == 0, "Bad size for empty input");
+
+        std::vector<std::byte> output(16);
+        check(wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), output.size() }) == 0, "Empty input decompressed to data");
+    }
+
+    void test_single_bytes()
+    {
+        for (unsigned value = 0; value < 256; ++value)
+        {
+            std::vector<std::byte> input = { std::byte(value) };
+            auto compressed = round_trip(input, "Byte " + std::to_string(value) + ": ");
+            check(compressed == pack_codes({ { wcdx::lzw::reset_code, 9 }, { value, 9 }, { wcdx::lzw::stop_code, 9 } }), "Bad code stream for byte " + std::to_string(value));
+        }
+
+        // A run of one byte value builds ever longer strings of it.
+        for (size_t length : { 2, 3, 10, 100, 5000 })
+            round_trip(std::vector<std::byte>(length, std::byte(0x41)), "Run of " + std::to_string(length) + ": ");
+    }
+
+    void test_dictionary_fill()
+    {
+        // Random bytes add close to one dictionary entry per byte, so every length around
+        // the points where codes widen to 10, 11, and 12 bits and where the dictionary fills
+        // and starts over is covered by some prefix of the input.
+        auto input = random_bytes(20000, 1);
+        std::vector<size_t> lengths;
+        for (size_t boundary : { 512, 1024, 2048, 4096, 8192 })
+        {
+            for (size_t length = boundary - 300; length <= boundary + 50; ++length)
+                lengths.push_back(length);
+        }
+        lengths.push_back(input.size());
+
+        for (auto length : lengths)
+            round_trip({ input.begin(), input.begin() + length }, "Random prefix of " + std::to_string(length) + ": ");
+
+        auto compressed = wcdx::lzw::compress({ input.data(), input.size() });
+        auto stats = walk_codes(compressed);
+        check(stats.max_width == wcdx::lzw::max_code_width, "Codes never reached full width");
+        check(stats.resets >= 4, "Dictionary not reset when full");
+
+        // Once full, the dictionary starts over at 9-bit codes, so a file much larger than
+        // it still round-trips.
+        round_trip(random_bytes(200000, 2), "Large input: ");
+
+        // Compressible data fills the dictionary with long strings.
+        std::vector<std::byte> text;
+        std::mt19937 random(3);
+        while (text.size() < 100000)
+        {
+            static const char* const words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ", "\n" };
+            for (auto p = words[random() % std::size(words)]; *p != '\0'; ++p)
+                text.push_back(std::byte(*p));
+        }
+        compressed = round_trip(text, "Text: ");
+        check(compressed.size() < text.size() / 2, "Text barely compressed");
+    }
+
+    void test_truncated()
+    {
+        auto input = random_bytes(3000, 4);
+        auto compressed = wcdx::lzw::compress({ input.data(), input.size() });
+
+        // Every prefix of the stream ends before its stop code.
+        std::vector<std::byte> output(input.size());
+        for (size_t size = 0; size < compressed.size(); ++size)
+        {
+            check(decompress_throws({ compressed.begin(), compressed.begin() + size }, output.size()),
+                "Stream truncated to " + std::to_string(size) + " bytes accepted");
+        }
+
+        // A stream that simply stops without a stop code.
+        auto no_stop = pack_codes({ { wcdx::lzw::reset_code, 9 }, { 'A', 9 }, { 'B', 9 } });
+        check(decompress_throws(no_stop, 16), "Stream without a stop code accepted");
+
+        // The same stream with its stop code decodes.
+        auto with_stop = pack_codes({ { wcdx::lzw::reset_code, 9 }, { 'A', 9 }, { 'B', 9 }, { wcdx::lzw::stop_code, 9 } });
+        std::vector<std::byte> decoded(16);
+        check(wcdx::lzw::decompress({ with_stop.data(), with_stop.size() }, { decoded.data(), decoded.size() }) == 2
+            && decoded[0] == std::byte('A') && decoded[1] == std::byte('B'), "Bad hand-built stream");
+    }
+
+    void test_invalid_streams()
+    {
+        using wcdx::lzw::reset_code;
+        using wcdx::lzw::stop_code;
+
+        check(decompress_throws(pack_codes({ { 'A', 9 }, { stop_code, 9 } }), 16), "Stream without a reset code accepted");
+
+        // The first code after a reset has no previous string to extend, and no code can
+        // reach past the next one to be defined.
+        check(decompress_throws(pack_codes({ { reset_code, 9 }, { 0x102, 9 }, { stop_code, 9 } }), 16), "Undefined first code accepted");
+        check(decompress_throws(pack_codes({ { reset_code, 9 }, { 'A', 9 }, { 0x103, 9 }, { stop_code, 9 } }), 16), "Code past the dictionary accepted");
+
+        // A code defined by itself: the previous string followed by its own first byte.
+        auto self = pack_codes({ { reset_code, 9 }, { 'A', 9 }, { 0x102, 9 }, { stop_code, 9 } });
+        std::vector<std::byte> output(3);
+        check(wcdx::lzw::decompress({ self.data(), self.size() }, { output.data(), output.size() }) == 3
+            && std::all_of(output.begin(), output.end(), [](std::byte b) { return b == std::byte('A'); }), "Bad self-referencing code");
+
+        // Output that doesn't fit.
+        auto input = random_bytes(1000, 5);
+        auto compressed = wcdx::lzw::compress({ input.data(), input.size() });
+        check(decompress_throws(compressed, input.size() - 1), "Output buffer overrun");
+        check(decompress_throws(self, 2), "Output buffer overrun by a self-referencing code");
+    }
+
+    std::vector<std::byte> random_bytes(size_t size, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::byte> bytes(size);
+        for (auto& b : bytes)
+            b = std::byte(random());
+        return bytes;
+    }
+
+    // Compresses input, checks that it decompresses to the same bytes, both into a buffer of
+    // exactly the right size and into one with room to spare, and returns the compressed data.
+    std::vector<std::byte> round_trip(const std::vector<std::byte>& input, const std::string& label)
+    {
+        auto compressed = wcdx::lzw::compress({ input.data(), input.size() });
+
+        std::vector<std::byte> output(input.size() + 8);
+        auto size = wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), input.size() });
+        check(size == input.size() && std::equal(input.begin(), input.end(), output.begin()), label + "bad round trip");
+
+        size = wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), output.size() });
+        check(size == input.size(), label + "bad size with room to spare");
+        return compressed;
+    }
+
+    // Packs codes of the given widths least significant bit first, as compress does.
+    std::vector<std::byte> pack_codes(std::initializer_list<std::pair<unsigned, unsigned>> codes)
+    {
+        std::vector<std::byte> packed;
+        uint32_t bits = 0;
+        unsigned bit_count = 0;
+        for (auto [code, width] : codes)
+        {
+            bits |= code << bit_count;
+            for (bit_count += width; bit_count >= CHAR_BIT; bit_count -= CHAR_BIT)
+            {
+                packed.push_back(std::byte(bits));
+                bits >>= CHAR_BIT;
+            }
+        }
+
+        if (bit_count != 0)
+            packed.push_back(std::byte(bits));
+        return packed;
+    }
+
+    // Reads the codes of a well-formed stream, widening them the way the decoder does: the
+    // dictionary grows by one entry for every code but the first after each reset.
+    code_stats walk_codes(const std::vector<std::byte>& compressed)
+    {
+        code_stats stats;
+        size_t bit = 0;
+        auto read = [&](unsigned width)
+        {
+            unsigned code = 0;
+            for (unsigned n = 0; n < width; ++n, ++bit)
+            {
+                if (bit / CHAR_BIT >= compressed.size())
+                    throw std::runtime_error("Code stream ended early");
+                code |= unsigned(std::to_integer<unsigned>(compressed[bit / CHAR_BIT]) >> (bit % CHAR_BIT) & 1) << n;
+            }
+            stats.max_width = std::max(stats.max_width, width);
+            ++stats.codes;
+            return code;
+        };
+
+        auto code = read(wcdx::lzw::min_code_width);
+        while (code == wcdx::lzw::reset_code)
+        {
+            ++stats.resets;
+            unsigned width = wcdx::lzw::min_code_width;
+            unsigned table_size = wcdx::lzw::first_dictionary_code;
+            bool first = true;
+            while ((code = read(width)) != wcdx::lzw::reset_code && code != wcdx::lzw::stop_code)
+            {
+                if (!first && table_size != wcdx::lzw::dictionary_size
+                    && ++table_size == 1u << width && width != wcdx::lzw::max_code_width)
+                {
+                    ++width;
+                }
+                first = false;
+            }
+        }
+
+        check(code == wcdx::lzw::stop_code, "Code stream doesn't end with a stop code");
+        return stats;
+    }
+
+    bool decompress_throws(const std::vector<std::byte>& compressed, size_t output_size)
+    {
+        std::vector<std::byte> output(output_size);
+        return throws([&] { wcdx::lzw::decompress({ compressed.data(), compressed.size() }, { output.data(), output.size() }); });
+    }
+}
@@ -0,0 +1,216 @@
+#include <parallel/parallel.h>
+#include <parallel/work_pool.h>
+
+#include <test/support.h>
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdlib>
+
+
+namespace
+{
+    using wcdx::test::check;
+
+    void test_for_each_index();
+    void test_for_each_index_errors();
+    void test_pool();
+    void test_pool_nested();
+    void test_pool_errors();
+    void test_pool_discard();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("parallel", []
+    {
+        test_for_each_index();
+        test_for_each_index_errors();
+        test_pool();
+        test_pool_nested();
+        test_pool_errors();
+        test_pool_discard();
+    });
+}
+
+namespace
+{
+    void test_for_each_index()
+    {
+        std::vector<std::atomic<unsigned>> calls(1000);
+        std::vector<std::thread::id> thread_ids(4);
+        std::atomic<bool> consistent(true);
+        wcdx::parallel::for_each_index(calls.size(), 4, [&](size_t n, unsigned thread)
+        {
+            ++calls[n];
+            // Each thread number belongs to one thread.
+            auto& id = thread_ids[thread];
+            if (id == std::thread::id())
+                id = std::this_thread::get_id();
+            else if (id != std::this_thread::get_id())
+                consistent = false;
+        });
+
+        for (auto& count : calls)
+            check(count == 1, "Index not called exactly once");
+        check(consistent, "Thread number shared between threads");
+
+        check(wcdx::parallel::job_count(2, 8) == 2, "More jobs than indices");
+        check(wcdx::parallel::job_count(0, 8) == 1, "No jobs for no indices");
+
+        size_t sum = 0;
+        wcdx::parallel::for_each_index(10, 1, [&](size_t n) { sum += n; });
+        check(sum == 45, "Single job missed indices");
+    }
+
+    void test_for_each_index_errors()
+    {
+        std::atomic<size_t> calls(0);
+        try
+        {
+            wcdx::parallel::for_each_index(100000, 4, [&](size_t n)
+            {
+                ++calls;
+                if (n == 10)
+                    throw std::runtime_error("index 10");
+            });
+            check(false, "Exception not propagated");
+        }
+        catch (const std::runtime_error& e)
+        {
+            check(std::string(e.what()) == "index 10", "Wrong exception propagated");
+        }
+        check(calls < 100000, "Indices started after a failure");
+    }
+
+    void test_pool()
+    {
+        wcdx::parallel::work_pool pool(4);
+        check(pool.size() == 4, "Wrong pool size");
+
+        std::atomic<size_t> sum(0);
+        std::atomic<bool> in_range(true);
+        for (size_t n = 0; n < 10000; ++n)
+        {
+            pool.submit([&, n](unsigned thread)
+            {
+                if (thread >= 4)
+                    in_range = false;
+                sum += n;
+            });
+        }
+        pool.wait();
+        check(sum == 10000 * 9999 / 2, "Tasks not all run");
+        check(in_range, "Thread number out of range");
+
+        // The pool can be reused after waiting.
+        pool.submit([&](unsigned) { sum = 0; });
+        pool.wait();
+        check(sum == 0, "Pool not reusable");
+    }
+
+    void test_pool_nested()
+    {
+        // A binary tree of tasks, each submitting its children.
+        wcdx::parallel::work_pool pool(3);
+        std::atomic<size_t> leaves(0);
+        std::mutex ids_mutex;
+        std::set<std::thread::id> ids;
+
+        std::function<void (unsigned, unsigned)> node = [&](unsigned depth, unsigned)
+        {
+            {
+                std::lock_guard<std::mutex> lock(ids_mutex);
+                ids.insert(std::this_thread::get_id());
+            }
+
+            if (depth == 0)
+            {
+                ++leaves;
+                return;
+            }
+
+            for (unsigned n = 0; n < 2; ++n)
+                pool.submit([&, depth](unsigned thread) { node(depth - 1, thread); });
+        };
+
+        pool.submit([&](unsigned thread) { node(12, thread); });
+        pool.wait();
+        check(leaves == 1 << 12, "Nested tasks not all run");
+        check(ids.count(std::this_thread::get_id()) == 0, "Task run on the waiting thread");
+    }
+
+    void test_pool_errors()
+    {
+        wcdx::parallel::work_pool pool(2);
+        std::atomic<size_t> calls(0);
+        for (size_t n = 0; n < 1000; ++n)
+        {
+            pool.submit([&, n](unsigned)
+            {
+                ++calls;
+                if (n == 0)
+                    throw std::runtime_error("task 0");
+            });
+        }
+
+        try
+        {
+            pool.wait();
+            check(false, "Exception not propagated");
+        }
+        catch (const std::runtime_error& e)
+        {
+            check(std::string(e.what()) == "task 0", "Wrong exception propagated");
+        }
+
+        // The error is reported once; later work runs normally.
+        calls = 0;
+        pool.submit([&](unsigned) { ++calls; });
+        pool.wait();
+        check(calls == 1, "Pool unusable after a failure");
+    }
+
+    void test_pool_discard()
+    {
+        std::atomic<bool> started(false);
+        std::atomic<bool> destroying(false);
+        std::atomic<size_t> calls(0);
+        std::thread release;
+        {
+            // One thread, held by the first task until the pool is being destroyed, so the
+            // rest are still queued when it stops.
+            wcdx::parallel::work_pool pool(1);
+            pool.submit([&](unsigned)
+            {
+                started = true;
+                while (!destroying)
+                    std::this_thread::yield();
+                pool.submit([&](unsigned) { ++calls; });
+            });
+            while (!started)
+                std::this_thread::yield();
+            for (size_t n = 0; n < 100; ++n)
+                pool.submit([&](unsigned) { ++calls; });
+
+            release = std::thread([&]
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                destroying = true;
+            });
+        }
+        release.join();
+        check(calls == 0, "Queued tasks run while destroying the pool");
+    }
+}
@@ -0,0 +1,358 @@
+#include <patch/md5.h>
+#include <patch/patch.h>
+
+#include <dif_tables.h>
+
+#include <stdext/stream.h>
+
+#include <test/support.h>
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+    // Offsets into the image built by make_image.
+    constexpr size_t pe_offset = 0x80;
+    constexpr size_t characteristics_offset = pe_offset + 0x16;
+    constexpr size_t optional_header_offset = pe_offset + 0x18;
+    constexpr size_t section_offset = optional_header_offset + 224;
+    constexpr size_t idata_offset = 0x200;
+    constexpr uint32_t idata_rva = 0x2000;
+    constexpr size_t ddraw_name_offset = idata_offset + 0x110;
+    constexpr size_t ddraw_thunks_offset = idata_offset + 0x90;
+    constexpr size_t create_name_offset = idata_offset + 0x170;
+    constexpr size_t image_size = 0x400;
+
+    using wcdx::test::check;
+    bool patch_throws(std::vector<std::byte> image);
+
+    template <class T>
+    void put(std::vector<std::byte>& image, size_t offset, T value);
+    template <class T>
+    T get(const std::vector<std::byte>& image, size_t offset);
+    void put_string(std::vector<std::byte>& image, size_t offset, const char* str);
+    bool has_string(const std::vector<std::byte>& image, size_t offset, const char* str);
+
+    std::vector<std::byte> make_image();
+
+    void test_md5();
+    void test_headers();
+    void test_invalid_headers();
+    void test_apply_patch();
+    void test_dif_tables();
+    void test_patch_executable();
+}
+
+int main()
+{
+    return wcdx::test::run_tests("patch", []
+    {
+        test_md5();
+        test_headers();
+        test_invalid_headers();
+        test_apply_patch();
+        test_dif_tables();
+        test_patch_executable();
+    });
+}
+
+namespace
+{
+    void test_md5()
+    {
+        using wcdx::patch::md5_hash;
+
+        // RFC 1321's test suite, along with messages whose padding just fits in one block,
+        // just doesn't, and fills a block of its own.
+        check(md5_hash("", 0) == md5_hash{ 0xd98c1dd4, 0x04b2008f, 0x980980e9, 0x7e42f8ec }, "Bad hash of empty message");
+        check(md5_hash("abc", 3) == md5_hash{ 0x98500190, 0xb04fd23c, 0x7d3f96d6, 0x727fe128 }, "Bad hash of \"abc\"");
+
+        std::string digits;
+        for (unsigned n = 0; n != 8; ++n)
+            digits += "1234567890";
+        check(md5_hash(digits.data(), digits.size()) == md5_hash{ 0xa2f4ed57, 0x55c9e32b, 0x2eda49ac, 0x7ab60721 }, "Bad hash of two blocks");
+
+        std::string a55(55, 'a'), a56(56, 'a'), a64(64, 'a');
+        check(md5_hash(a55.data(), a55.size()) == md5_hash{ 0xb67217ef, 0x22a1f9df, 0x95528535, 0x65dfd04a }, "Bad hash of 55 bytes");
+        check(md5_hash(a56.data(), a56.size()) == md5_hash{ 0xc78a0c3b, 0xb028f803, 0x70196c4c, 0x1872d106 }, "Bad hash of 56 bytes");
+        check(md5_hash(a64.data(), a64.size()) == md5_hash{ 0xd4424801, 0x4971b580, 0x63034a5a, 0x67733f79 }, "Bad hash of 64 bytes");
+
+        auto bytes = reinterpret_cast<const std::byte*>("abc");
+        check(wcdx::patch::image_hash(bytes, 3) == (0x98500190 ^ 0xb04fd23c ^ 0x7d3f96d6 ^ 0x727fe128), "Bad image hash");
+    }
+
+    void test_headers()
+    {
+        auto original = make_image();
+        auto image = original;
+        stdext::memory_stream image_data(image.data(), image.size());
+        wcdx::patch::patch_headers(image_data);
+
+        check(get<uint16_t>(image, characteristics_offset) == 0x0103, "Relocations not marked as stripped");
+        check(get<uint16_t>(image, optional_header_offset + 40) == 5 && get<uint16_t>(image, optional_header_offset + 42) == 1, "Bad OS version");
+        check(get<uint16_t>(image, optional_header_offset + 48) == 5 && get<uint16_t>(image, optional_header_offset + 50) == 1, "Bad subsystem version");
+        check(get<uint16_t>(image, optional_header_offset + 70) == 0x8140, "NX-compatible bit not set");
+        check(get<uint32_t>(image, optional_header_offset + 136) == 0 && get<uint32_t>(image, optional_header_offset + 140) == 0, "Relocation directory not cleared");
+        check(get<uint32_t>(image, optional_header_offset + 128) == 0x2000, "Wrong directory cleared");
+
+        check(has_string(image, idata_offset + 0x100, "USER32.dll"), "Wrong DLL renamed");
+        check(has_string(image, ddraw_name_offset, "wcdx.dll"), "ddraw.dll not renamed");
+        check(get<uint16_t>(image, create_name_offset) == 0 && has_string(image, create_name_offset + 2, "WcdxCreate"), "DirectDrawCreate not renamed");
+        check(has_string(image, idata_offset + 0x150 + 2, "DirectDrawEnumerateA"), "Wrong function renamed");
+
+        // The lookup entry following DirectDrawCreate ends the list.
+        check(get<uint32_t>(image, ddraw_thunks_offset + 8) == idata_rva + 0x170, "DirectDrawCreate's lookup entry changed");
+        check(get<uint32_t>(image, ddraw_thunks_offset + 12) == 0, "Lookup list not ended after DirectDrawCreate");
+
+        // Nothing else changes.
+        size_t changed = 0;
+        for (size_t n = 0; n != image.size(); ++n)
+            changed += image[n] != original[n];
+        check(changed <= 48, "Too many bytes changed: " + std::to_string(changed));
+    }
+
+    void test_invalid_headers()
+    {
+        auto image = make_image();
+        put_string(image, pe_offset, "NE");
+        check(patch_throws(image), "Accepted an image with no PE signature");
+
+        image = make_image();
+        put<uint16_t>(image, optional_header_offset, 0x107);
+        check(patch_throws(image), "Accepted an image with a bad optional header");
+
+        image = make_image();
+        put_string(image, section_offset, ".text");
+        check(patch_throws(image), "Accepted an image with no .idata section");
+
+        image = make_image();
+        put_string(image, ddraw_name_offset, "GDI32.dll");
+        check(patch_throws(image), "Accepted an image that doesn't import ddraw.dll");
+
+        image = make_image();
+        put_string(image, create_name_offset + 2, "DirectDrawCreateClipper");
+        check(patch_throws(image), "Accepted an image that doesn't import DirectDrawCreate");
+
+        image = make_image();
+        image.resize(idata_offset);
+        check(patch_throws(image), "Accepted a truncated image");
+    }
+
+    void test_apply_patch()
+    {
+        const unsigned char data[] = { 1, 2, 3, 0xA, 0xB, 0xC, 4, 0xD };
+        const wcdx::patch::patch_range ranges[] = { { 4, 3, 0 }, { 9, 1, 6 } };
+        const wcdx::patch::patch_table table = { 0, ranges, std::size(ranges), data };
+
+        std::vector<std::byte> image(10);
+        for (size_t n = 0; n != image.size(); ++n)
+            image[n] = std::byte(n);
+
+        check(wcdx::patch::apply_patch(table, image.data(), image.size()) == false, "Applied a patch that doesn't match");
+        for (size_t n = 0; n != image.size(); ++n)
+            check(image[n] == std::byte(n), "Image changed by a patch that doesn't match");
+
+        image[4] = std::byte(1);
+        image[5] = std::byte(2);
+        image[6] = std::byte(3);
+        auto unpatched = image;
+        check(wcdx::patch::apply_patch(table, image.data(), image.size()) == false, "Applied a patch whose last range doesn't match");
+        check(image == unpatched, "Image changed by a patch that only partly matches");
+        check(wcdx::patch::apply_patch(table, image.data(), image.size() - 1) == false, "Applied a patch past the end of the image");
+        check(image == unpatched, "Image changed by a patch that doesn't fit");
+
+        image[9] = std::byte(4);
+        check(wcdx::patch::apply_patch(table, image.data(), image.size()), "Patch not applied");
+        check(image[4] == std::byte(0xA) && image[5] == std::byte(0xB) && image[6] == std::byte(0xC) && image[9] == std::byte(0xD), "Wrong bytes patched");
+        check(image[3] == std::byte(3) && image[7] == std::byte(7) && image[8] == std::byte(8), "Bytes outside the patch changed");
+
+        // Once applied, the patch no longer matches.
+        check(!wcdx::patch::apply_patch(table, image.data(), image.size()), "Applied a patch twice");
+    }
+
+    void test_dif_tables()
+    {
+        check(std::size(dif_tables::patches) == 1, "Wrong number of tables");
+        auto& table = dif_tables::patches[0];
+        check(wcdx::patch::find_patch(dif_tables::patches, 0x12345678) == &table, "Table not found by hash");
+        check(wcdx::patch::find_patch(dif_tables::patches, 0x87654321) == nullptr, "Found a table for the wrong hash");
+
+        // Consecutive offsets coalesce; the byte past the end of the file splits the last two.
+        check(table.range_count == 3, "Wrong number of ranges: " + std::to_string(table.range_count));
+        check(table.ranges[0].offset == 0x10 && table.ranges[0].size == 3 && table.ranges[0].data_offset == 0, "Bad first range");
+        check(table.ranges[1].offset == 0x20 && table.ranges[1].size == 1 && table.ranges[1].data_offset == 6, "Bad second range");
+        check(table.ranges[2].offset == 0x22 && table.ranges[2].size == 1 && table.ranges[2].data_offset == 8, "Bad third range");
+
+        const unsigned char data[] = { 0x00, 0x01, 0x02, 0xAA, 0xBB, 0xCC, 0x03, 0xDD, 0x05, 0xFF };
+        check(std::equal(std::begin(data), std::end(data), table.data), "Bad table data");
+
+        std::vector<std::byte> image(0x30);
+        image[0x11] = std::byte(0x01);
+        image[0x12] = std::byte(0x02);
+        image[0x20] = std::byte(0x03);
+        image[0x21] = std::byte(0x42);
+        image[0x22] = std::byte(0x05);
+        check(wcdx::patch::apply_patch(table, image.data(), image.size()), "Generated table not applied");
+        check(image[0x10] == std::byte(0xAA) && image[0x12] == std::byte(0xCC) && image[0x20] == std::byte(0xDD) && image[0x22] == std::byte(0xFF), "Generated table patched the wrong bytes");
+        check(image[0x21] == std::byte(0x42), "Byte past the end of the original file patched");
+    }
+
+    void test_patch_executable()
+    {
+        auto original = make_image();
+        auto hash = wcdx::patch::image_hash(original.data(), original.size());
+
+        // A table for the unpatched image, changing a byte outside the headers.
+        const unsigned char data[] = { 0x00, 0x00, 0x5A, 0xA5 };
+        const wcdx::patch::patch_range ranges[] = { { 0x3F0, 2, 0 } };
+        const wcdx::patch::patch_table tables[] =
+        {
+            { hash ^ 1, ranges, 0, data },
+            { hash, ranges, std::size(ranges), data }
+        };
+
+        auto headers_only = original;
+        wcdx::patch::patch_executable(headers_only, tables, true);
+        check(has_string(headers_only, ddraw_name_offset, "wcdx.dll"), "Headers not patched");
+        check(headers_only[0x3F0] == std::byte(0), "Table applied with headers_only");
+
+        auto image = original;
+        wcdx::patch::patch_executable(image, tables, false);
+        check(has_string(image, ddraw_name_offset, "wcdx.dll"), "Headers not patched");
+        check(image[0x3F0] == std::byte(0x5A) && image[0x3F1] == std::byte(0xA5), "Table not applied");
+
+        // A patched executable isn't recognized a second time.
+        bool threw = false;
+        try
+        {
+            wcdx::patch::patch_executable(image, tables, false);
+        }
+        catch (const std::runtime_error&)
+        {
+            threw = true;
+        }
+        check(threw, "Patched an unrecognized executable");
+
+        // A recognized executable that's been altered where the table applies.
+        image = original;
+        image[0x3F1] = std::byte(1);
+        const wcdx::patch::patch_table altered[] = { { wcdx::patch::image_hash(image.data(), image.size()), ranges, std::size(ranges), data } };
+        threw = false;
+        try
+        {
+            wcdx::patch::patch_executable(image, altered, false);
+        }
+        catch (const std::runtime_error&)
+        {
+            threw = true;
+        }
+        check(threw && image[0x3F0] == std::byte(0), "Patched an executable that doesn't match its table");
+    }
+
+    bool patch_throws(std::vector<std::byte> image)
+    {
+        try
+        {
+            stdext::memory_stream image_data(image.data(), image.size());
+            wcdx::patch::patch_headers(image_data);
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    template <class T>
+    void put(std::vector<std::byte>& image, size_t offset, T value)
+    {
+        std::memcpy(image.data() + offset, &value, sizeof(value));
+    }
+
+    template <class T>
+    T get(const std::vector<std::byte>& image, size_t offset)
+    {
+        T value;
+        std::memcpy(&value, image.data() + offset, sizeof(value));
+        return value;
+    }
+
+    void put_string(std::vector<std::byte>& image, size_t offset, const char* str)
+    {
+        std::memcpy(image.data() + offset, str, std::strlen(str) + 1);
+    }
+
+    bool has_string(const std::vector<std::byte>& image, size_t offset, const char* str)
+    {
+        return std::memcmp(image.data() + offset, str, std::strlen(str) + 1) == 0;
+    }
+
+    // A minimal PE32 executable: headers, a single .idata section importing MessageBoxA from
+    // USER32.dll and, from DDRAW.dll, an ordinal followed by DirectDrawEnumerateA,
+    // DirectDrawCreate and DirectDrawCreateEx.
+    std::vector<std::byte> make_image()
+    {
+        std::vector<std::byte> image(image_size);
+        put_string(image, 0, "MZ");
+        put<uint32_t>(image, 0x3C, pe_offset);
+
+        put_string(image, pe_offset, "PE");
+        put<uint16_t>(image, pe_offset + 4, 0x14C);                     // Machine
+        put<uint16_t>(image, pe_offset + 6, 1);                         // NumberOfSections
+        put<uint16_t>(image, pe_offset + 20, 224);                      // SizeOfOptionalHeader
+        put<uint16_t>(image, characteristics_offset, 0x0102);
+
+        put<uint16_t>(image, optional_header_offset, 0x10B);
+        put<uint16_t>(image, optional_header_offset + 40, 4);           // MajorOperatingSystemVersion
+        put<uint16_t>(image, optional_header_offset + 48, 4);           // MajorSubsystemVersion
+        put<uint16_t>(image, optional_header_offset + 70, 0x8040);      // DllCharacteristics
+        put<uint32_t>(image, optional_header_offset + 92, 16);          // NumberOfRvaAndSizes
+        put<uint32_t>(image, optional_header_offset + 104, idata_rva);  // Import directory
+        put<uint32_t>(image, optional_header_offset + 108, 3 * 20);
+        put<uint32_t>(image, optional_header_offset + 128, 0x2000);     // Resource directory
+        put<uint32_t>(image, optional_header_offset + 136, 0x3000);     // Relocation directory
+        put<uint32_t>(image, optional_header_offset + 140, 0x100);
+
+        put_string(image, section_offset, ".idata");
+        put<uint32_t>(image, section_offset + 8, 0x200);                // VirtualSize
+        put<uint32_t>(image, section_offset + 12, idata_rva);           // VirtualAddress
+        put<uint32_t>(image, section_offset + 16, 0x200);               // SizeOfRawData
+        put<uint32_t>(image, section_offset + 20, idata_offset);        // PointerToRawData
+
+        // Import directory entries, then lookup lists, then names.
+        put<uint32_t>(image, idata_offset, idata_rva + 0x80);
+        put<uint32_t>(image, idata_offset + 12, idata_rva + 0x100);
+        put<uint32_t>(image, idata_offset + 16, idata_rva + 0x80);
+        put<uint32_t>(image, idata_offset + 20, idata_rva + 0x90);
+        put<uint32_t>(image, idata_offset + 32, idata_rva + 0x110);
+        put<uint32_t>(image, idata_offset + 36, idata_rva + 0x90);
+
+        put<uint32_t>(image, idata_offset + 0x80, idata_rva + 0x140);
+        put<uint32_t>(image, ddraw_thunks_offset, 0x80000001);
+        put<uint32_t>(image, ddraw_thunks_offset + 4, idata_rva + 0x150);
+        put<uint32_t>(image, ddraw_thunks_offset + 8, idata_rva + 0x170);
+        put<uint32_t>(image, ddraw_thunks_offset + 12, idata_rva + 0x190);
+
+        put_string(image, idata_offset + 0x100, "USER32.dll");
+        put_string(image, ddraw_name_offset, "DDRAW.dll");
+        put_string(image, idata_offset + 0x140 + 2, "MessageBoxA");
+        put_string(image, idata_offset + 0x150 + 2, "DirectDrawEnumerateA");
+        put<uint16_t>(image, create_name_offset, 0x12);
+        put_string(image, create_name_offset + 2, "DirectDrawCreate");
+        put_string(image, idata_offset + 0x190 + 2, "DirectDrawCreateEx");
+        return image;
+    }
+}
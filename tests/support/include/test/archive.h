@@ -0,0 +1,61 @@
+#ifndef TEST_ARCHIVE_INCLUDED
+#define TEST_ARCHIVE_INCLUDED
+#pragma once
+
+#include "support.h"
+
+#include <archive/archive.h>
+#include <lzw/lzw.h>
+
+#include <stdext/array_view.h>
+
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace wcdx::test
+{
+    // A resource to lay out in an archive built by make_archive.
+    struct archive_resource
+    {
+        archive_resource(std::vector<std::byte> data, bool compressed = false)
+            : data(std::move(data)), compressed(compressed)
+        {
+        }
+
+        std::vector<std::byte> data;
+        bool compressed;
+    };
+
+    // Lays out the file size, the descriptor table, and then each resource in order.
+    // Compressed resources are stored as their decompressed size followed by LZW data.
+    inline std::vector<std::byte> make_archive(const std::vector<archive_resource>& resources)
+    {
+        std::vector<std::byte> data(4 + 4 * resources.size());
+        for (size_t n = 0; n < resources.size(); ++n)
+        {
+            auto& resource = resources[n];
+            auto type = resource.compressed ? archive::resource_type_compressed : archive::resource_type_uncompressed;
+            put_uint32(data, 4 + 4 * n, (type << 24) | uint32_t(data.size()));
+
+            if (resource.compressed)
+            {
+                auto compressed = lzw::compress({ resource.data.data(), resource.data.size() });
+                auto offset = data.size();
+                data.resize(offset + sizeof(uint32_t));
+                put_uint32(data, offset, uint32_t(resource.data.size()));
+                data.insert(data.end(), compressed.begin(), compressed.end());
+            }
+            else
+                data.insert(data.end(), resource.data.begin(), resource.data.end());
+        }
+
+        put_uint32(data, 0, uint32_t(data.size()));
+        return data;
+    }
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TEST_FONT_INCLUDED
+#define TEST_FONT_INCLUDED
+#pragma once
+
+#include <image/font.h>
+
+#include <vector>
+
+#include <cstddef>
+
+
+namespace wcdx::test
+{
+    // Glyphs past the end of widths are empty, and empty glyphs have no position.  Pixels
+    // are stored in glyph order.  The color index is 0x2A, which leaves its high byte clear.
+    inline std::vector<std::byte> make_font(unsigned height, const std::vector<unsigned>& widths)
+    {
+        std::vector<std::byte> data(image::font::header_size);
+        data[0] = std::byte(height);
+        data[1] = std::byte(height >> 8);
+        data[2] = std::byte(0x2A);
+        for (size_t n = 0; n < widths.size(); ++n)
+        {
+            data[4 + n] = std::byte(widths[n]);
+            auto size = size_t(widths[n]) * height;
+            if (size == 0)
+                continue;
+
+            data[4 + 256 + n] = std::byte(data.size());
+            data[4 + 512 + n] = std::byte(data.size() >> 8);
+            for (size_t i = 0; i < size; ++i)
+                data.push_back(std::byte((n * 31 + i) % 0xFF));
+        }
+        return data;
+    }
+}
+
+#endif
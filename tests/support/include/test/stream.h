@@ -0,0 +1,112 @@
+#ifndef TEST_STREAM_INCLUDED
+#define TEST_STREAM_INCLUDED
+#pragma once
+
+#include <audio/wcaudio_stream.h>
+
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace wcdx::test
+{
+    // Each link is an intensity or trigger and the chunk it leads to.
+    using link_list = std::vector<std::pair<uint8_t, uint32_t>>;
+
+    // A chunk to lay out in a stream built by make_stream.
+    struct stream_chunk
+    {
+        uint32_t size;
+        link_list trigger_links;
+        link_list chunk_links;
+    };
+
+    // Lays out the header, the chunk table, the links, and then the chunks' samples, either
+    // in chunk order or backward.  samples(chunk_index, size) returns a chunk's size bytes of
+    // samples.  Samples are sixteen-bit stereo at 22050 Hz, so a frame is four bytes.
+    template <class Samples>
+    std::vector<std::byte> make_stream(const std::vector<stream_chunk>& chunks, Samples&& samples, bool reverse_layout = false)
+    {
+        std::vector<std::byte> data(sizeof(audio::stream_file_header));
+        auto append = [&](auto value)
+        {
+            auto p = reinterpret_cast<const std::byte*>(&value);
+            data.insert(data.end(), p, p + sizeof(value));
+        };
+
+        audio::stream_file_header header = { };
+        std::memcpy(&header.magic, "STRM", sizeof(header.magic));
+        header.channels = 2;
+        header.bits_per_sample = 16;
+        header.sample_rate = 22050;
+        header.buffer_size = 0x4000;
+        header.chunk_count = uint32_t(chunks.size());
+        for (auto& chunk : chunks)
+        {
+            header.chunk_link_count += uint32_t(chunk.chunk_links.size());
+            header.trigger_link_count += uint32_t(chunk.trigger_links.size());
+        }
+
+        header.chunk_headers_offset = uint32_t(data.size());
+        auto samples_offset = header.chunk_headers_offset + 6 * sizeof(uint32_t) * chunks.size()
+            + 5 * (header.chunk_link_count + header.trigger_link_count);
+        std::vector<uint32_t> start_offsets(chunks.size());
+        auto offset = uint32_t(samples_offset);
+        for (size_t n = 0; n < chunks.size(); ++n)
+        {
+            auto index = reverse_layout ? chunks.size() - 1 - n : n;
+            start_offsets[index] = offset;
+            offset += chunks[index].size;
+        }
+
+        uint32_t chunk_link_index = 0;
+        uint32_t trigger_link_index = 0;
+        for (size_t n = 0; n < chunks.size(); ++n)
+        {
+            append(start_offsets[n]);
+            append(start_offsets[n] + chunks[n].size);
+            append(uint32_t(chunks[n].trigger_links.size()));
+            append(trigger_link_index);
+            append(uint32_t(chunks[n].chunk_links.size()));
+            append(chunk_link_index);
+            trigger_link_index += uint32_t(chunks[n].trigger_links.size());
+            chunk_link_index += uint32_t(chunks[n].chunk_links.size());
+        }
+
+        header.chunk_link_offset = uint32_t(data.size());
+        for (auto& chunk : chunks)
+        {
+            for (auto [intensity, chunk_index] : chunk.chunk_links)
+            {
+                append(intensity);
+                append(chunk_index);
+            }
+        }
+
+        header.trigger_link_offset = uint32_t(data.size());
+        for (auto& chunk : chunks)
+        {
+            for (auto [trigger, chunk_index] : chunk.trigger_links)
+            {
+                append(trigger);
+                append(chunk_index);
+            }
+        }
+
+        for (size_t n = 0; n < chunks.size(); ++n)
+        {
+            auto index = uint32_t(reverse_layout ? chunks.size() - 1 - n : n);
+            auto chunk_samples = samples(index, chunks[index].size);
+            data.insert(data.end(), chunk_samples.begin(), chunk_samples.end());
+        }
+
+        std::memcpy(data.data(), &header, sizeof(header));
+        return data;
+    }
+}
+
+#endif
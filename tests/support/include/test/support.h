@@ -0,0 +1,115 @@
+#ifndef TEST_SUPPORT_INCLUDED
+#define TEST_SUPPORT_INCLUDED
+#pragma once
+
+#include <exception>
+#include <filesystem>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace wcdx::test
+{
+    // Fails the running test with message unless condition holds.
+    inline void check(bool condition, const std::string& message)
+    {
+        if (!condition)
+            throw std::runtime_error(message);
+    }
+
+    // Whether calling function throws a std::exception.
+    template <class Function>
+    bool throws(Function&& function)
+    {
+        try
+        {
+            function();
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    // Spells out binary test data as a list of byte values.
+    inline std::vector<std::byte> make_bytes(std::initializer_list<int> values)
+    {
+        std::vector<std::byte> bytes;
+        for (auto value : values)
+            bytes.push_back(std::byte(value));
+        return bytes;
+    }
+
+    // Stores value little-endian at offset, which must already be inside data.
+    inline void put_uint32(std::vector<std::byte>& data, size_t offset, uint32_t value)
+    {
+        for (unsigned n = 0; n != 4; ++n)
+            data[offset + n] = std::byte(value >> (8 * n));
+    }
+
+    // A new, uniquely named directory under the system's temporary directory, removed along
+    // with everything in it on destruction.
+    class scratch_directory
+    {
+    public:
+        explicit scratch_directory(const std::string& prefix)
+        {
+            std::random_device random;
+            do
+            {
+                _path = std::filesystem::temp_directory_path() / (prefix + std::to_string(random()));
+            } while (!std::filesystem::create_directories(_path));
+        }
+
+        scratch_directory(const scratch_directory&) = delete;
+        scratch_directory& operator = (const scratch_directory&) = delete;
+
+        ~scratch_directory()
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(_path, ec);
+        }
+
+    public:
+        const std::filesystem::path& path() const noexcept { return _path; }
+
+    private:
+        std::filesystem::path _path;
+    };
+
+    // The body of a test program's main: calls tests, then reports either that every test
+    // of the suite passed or the first failure.  Returns main's exit status.
+    template <class Function>
+    int run_tests(const char* suite, Function&& tests)
+    {
+        try
+        {
+            tests();
+            std::cout << "All " << suite << " tests passed\n";
+            return EXIT_SUCCESS;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+        }
+        catch (...)
+        {
+            std::cerr << "Unknown error\n";
+        }
+
+        return EXIT_FAILURE;
+    }
+}
+
+#endif